@@ -18,6 +18,16 @@
 #define VEDI_ESTRAZIONE	0x05
 #define VEDI_VINCITE	0x06
 #define ESCI			0x07
+#define VEDI_RIEPILOGO	0x08
+#define VEDI_METRICHE	0x09
+#define RIPRENDI_SESSIONE	0x0A
+#define QUOTA			0x0B
+#define ANNULLA_ABBONAMENTO	0x0C
+#define VEDI_ESPOSIZIONE	0x0D
+#define STATISTICHE		0x0E
+#define CERCA_ESTRAZIONI	0x0F
+#define REPLAY			0x10
+#define IMPOSTA_PERIODO	0x11
 // }
 
 // Codici errori {
@@ -29,6 +39,9 @@
 #define IP_BLOCCATO				0x05
 #define USERNAME_OCCUPATO		0x06
 #define FILE_VUOTO				0x07
+#define RICHIESTE_ECCESSIVE		0x08
+#define PERMESSO_NEGATO			0x09
+#define CAPACITA_ESAURITA		0x0A	// il server non accetta nuovi utenti
 
 #define ERRORE_INTERNO_SERVER		0xFE
 #define MESSAGGIO_NON_COMPRENSIBILE	0xFF
@@ -39,6 +52,24 @@
 #define QUANTI_NUMERI_ESTRATTI 5
 #define NUMERI_ESTRAIBILI 90
 #define QUANTITA_MASSIMA_NUMERI_SCHEDINA 10
+#define QUANTITA_MASSIMA_NUMERI_SISTEMA 30	// le giocate a sistema non espandono le combinazioni (vedi lotto_premi.h)
+#define MARCATORE_SISTEMA 'S'	// precede le schedine a sistema serializzate
+#define MARCATORE_ESTRAZIONI 'E'	// precede il numero di estrazioni delle schedine valide per piu' estrazioni
+#define MARCATORE_ABBONAMENTO 'A'	// precede il timestamp di annullamento degli abbonamenti
+#define MASSIMO_ESTRAZIONI_SCHEDINA 100
+#define ABBONAMENTO 0	// quanteEstrazioni di una schedina valida fino all'annullamento
+#define CIFRE_ANNULLAMENTO 10	// il timestamp di annullamento ha larghezza fissa, per poterlo riscrivere sul registro
+
+// Esiti delle schedine per i filtri di !vedi_giocate
+#define ESITO_QUALSIASI 0
+#define ESITO_VINCENTE 1	// ha vinto su almeno un'estrazione
+#define ESITO_PERDENTE 2	// ha concluso le sue estrazioni senza vincite
+#define ESITO_IN_GIOCO 3	// non ha ancora vinto e partecipa ad estrazioni future
+#define LUNGHEZZA_FILTRO_GIOCATE 12	// ruote (2 byte), numero (1), da (4), a (4), esito (1)
+
+// Unico utente abilitato ai comandi riservati (es. !vedi_esposizione e !vedi_metriche). Lo username non puo' essere registrato
+// con !signup: l'account va creato dal gestore del server, scrivendolo nel file degli utenti a server fermo
+#define UTENTE_AMMINISTRATORE "admin"
 
 #define LUNGHEZZA_SESSION_ID 10
 #define QUANTE_CIFRE 10
@@ -20,6 +20,9 @@ struct schedina {
 	int quantiNumeri;
 	double* importi;
 	int quantiImporti;
+	int sistema;	// se 1, ogni importo e' puntato su ciascuna combinazione dei numeri giocati (vedi lotto_premi.h)
+	int quanteEstrazioni;	// estrazioni consecutive su cui e' giocata la schedina (ABBONAMENTO: fino all'annullamento)
+	time_t annullamento;	// per gli abbonamenti, timestamp dell'annullamento (0 se l'abbonamento e' attivo)
 };
 
 /* Struttura utilizzata per creare e gestire una lista di schedine
@@ -27,6 +30,9 @@ struct schedina {
 struct schedina_list {
 	struct schedina s;
 	time_t timestamp;	// timestamp di registrazione della schedina
+	uint32_t offset;	// offset del record della schedina nel registro
+	int estrazioni_coperte;	// estrazioni su cui la schedina e' gia' stata giocata
+	int conclusa;			// 1 se la schedina non partecipa a nessun'altra estrazione
 	struct schedina_list* next;
 };
 
@@ -49,6 +55,29 @@ struct vincita {
 	int quante_ruote;
 };
 
+/* Struttura che mantiene il riepilogo delle vincite di un utente.
+ * Viene memorizzata come record a dimensione fissa e aggiornata ad ogni vincita registrata
+ */
+struct riepilogo_vincite {
+	double totale_vincite[QUANTI_TIPI_PREMIO];	// totale vinto per ogni tipo di puntata
+	uint32_t quante_schedine_vincenti;			// numero di schedine con almeno una vincita
+	double vincita_migliore;					// importo della schedina che ha vinto di piu'
+	time_t timestamp_vincita_migliore;			// timestamp dell'estrazione della vincita migliore
+	uint32_t estrazioni_controllate;			// estrazioni di FILE_ESTRAZIONI su cui sono state controllate le schedine
+	uint32_t fine_controllata;					// fine del registro delle schedine all'ultima verifica
+};
+
+/* Filtri del comando !vedi_giocate, valutati dal server su ogni schedina del registro.
+ * Sul socket i campi vengono inviati uno dopo l'altro, in formato network (LUNGHEZZA_FILTRO_GIOCATE byte)
+ */
+struct filtro_giocate {
+	uint16_t ruote;		// maschera delle ruote (bit i: ruota di codice i), la schedina deve giocarne almeno una. 0: tutte
+	uint8_t numero;		// numero che la schedina deve contenere, 0: qualsiasi
+	uint32_t da;		// timestamp minimo di registrazione della schedina
+	uint32_t a;			// timestamp massimo di registrazione della schedina
+	uint8_t esito;		// ESITO_QUALSIASI, ESITO_VINCENTE, ESITO_PERDENTE o ESITO_IN_GIOCO
+};
+
 
 //////////////////////////////////////////////////
 //				FUNZIONI DI UTILITY				//
@@ -71,7 +100,11 @@ void distruggi_vincita (struct vincita* vin);
 //
 // FUNZIONI DI SERIALIZZAZIONE E DESERIALIZZAZIONE
 //
-/* Serializza la struttura schedina
+/* Serializza la struttura schedina.
+ * Le schedine a sistema sono precedute da MARCATORE_SISTEMA, quelle valide per piu' estrazioni
+ * da MARCATORE_ESTRAZIONI e dal numero delle estrazioni, gli abbonamenti da MARCATORE_ABBONAMENTO
+ * e dal timestamp di annullamento (CIFRE_ANNULLAMENTO cifre). Le schedine ordinarie per una sola
+ * estrazione restano nel formato originale, percio' i registri scritti in precedenza si leggono senza conversioni
  * 
  * @sched schedina da serializzare
  * @len puntatore alla variabile che conterra' la lunghezza della schedina serializzata
@@ -89,6 +122,17 @@ char* serializza_schedina_txt (struct schedina sched, uint16_t* len);
  */
 struct schedina deserializza_schedina_txt (char* str, int* quanti_byte_letti);
 
+/* Legge i marcatori che precedono una schedina serializzata e imposta i campi corrispondenti
+ * (sistema, quanteEstrazioni e annullamento). Senza marcatori la schedina e' ordinaria
+ * e valida per una sola estrazione
+ * 
+ * @str schedina serializzata
+ * @sched schedina in cui scrivere i campi
+ * 
+ * @return numero di caratteri letti, -1 se un marcatore non e' valido
+ */
+int leggiMarcatoriSchedina (const char* str, struct schedina* sched);
+
 //
 // FUNZIONI DI CONVERSIONE
 //
@@ -107,4 +151,42 @@ int convertiRuotaStringToInt (char* str);
  */
 void inserisci_lista_schedina (struct schedina_list** lista, struct schedina_list* elem);
 
+//
+// FILE PER UTENTE
+//
+/* I vecchi file di registro per utente (%utente%_schedine.bin, %utente%_vincite.txt e %utente%_riepilogo.bin)
+ * non stanno nella cartella dei file, che con milioni di utenti renderebbe lente ricerche e scansioni della directory,
+ * ma in due livelli di sottocartelle: <cartella>/ab/cd/%utente%<suffisso>, dove ab e cd sono i primi due byte
+ * (in esadecimale) dell'hash FNV-1a dello username. Le cartelle di secondo livello sono 65536,
+ * percio' anche con milioni di utenti ognuna contiene poche decine di file
+ */
+#define SUFFISSO_SCHEDINE_UTENTE "_schedine.bin"
+#define SUFFISSO_VINCITE_UTENTE "_vincite.txt"
+#define SUFFISSO_RIEPILOGO_UTENTE "_riepilogo.bin"
+#define CARTELLE_PER_LIVELLO 256
+
+/* Scrive il percorso di un file per utente. E' l'unico punto in cui viene costruito un percorso di questo tipo
+ * 
+ * @percorso buffer in cui scrivere il percorso
+ * @dimensione dimensione del buffer
+ * @cartella cartella dei file (senza '/' finale)
+ * @utente username dell'utente
+ * @suffisso suffisso del file (SUFFISSO_SCHEDINE_UTENTE, SUFFISSO_VINCITE_UTENTE o SUFFISSO_RIEPILOGO_UTENTE)
+ * 
+ * @return lunghezza del percorso, -1 se il buffer non e' sufficiente
+ */
+int percorsoFileUtente (char* percorso, size_t dimensione, const char* cartella, const char* utente, const char* suffisso);
+
+/* Sposta nelle rispettive sottocartelle (vedi percorsoFileUtente(...)) i file per utente che si trovano
+ * direttamente nella cartella dei file, come nella disposizione precedente. I file non vengono modificati
+ * e vengono spostati con link(...) e unlink(...), che non sostituiscono mai un file esistente: se nella sottocartella
+ * c'e' gia' un file diverso con lo stesso nome la migrazione si ferma. Una migrazione interrotta
+ * puo' essere ripresa richiamando la funzione
+ * 
+ * @cartella cartella dei file (senza '/' finale)
+ * 
+ * @return numero dei file spostati, -1 in caso di errore (errno vale EEXIST se una destinazione e' un altro file)
+ */
+int migraFileUtenti (const char* cartella);
+
 #endif	// LOTTO_H
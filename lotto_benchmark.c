@@ -0,0 +1,655 @@
+#include "lotto.h"
+#include "lotto_casuale.h"
+#include "lotto_condivisa.h"
+#include "lotto_registri.h"
+#include "lotto_utenti.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FILE_UTENTI_BENCHMARK "/tmp/lotto_benchmark_utenti.txt"
+
+#define QUANTE_RICERCHE 1000000
+
+#define QUANTI_VALORI_CASUALI 100000000
+#define QUANTI_SESSION_ID 1000000
+#define QUANTE_ESTRAZIONI 1000000
+
+// I segmenti del benchmark dei registri vanno su un file system su disco (fdatasync(...) su tmpfs non costa nulla):
+// per default nella cartella dei file del server, oppure nella cartella indicata con -c
+#define CARTELLA_BENCHMARK_REGISTRI "./files"
+#define NOME_BENCHMARK_REGISTRI "lotto_benchmark_registro_"
+#define GIOCATE_BENCHMARK_REGISTRI 10000
+#define RECORD_BENCHMARK_REGISTRI "1700000000 1 0 0 0 0 0 0 0 0 0 17 23 45 61 88 0 0 0 0 0 0 1.00 2.00 0.00 0.00 0.00|"
+
+// Ogni utente del benchmark dell'archivio ha un registro di circa 200 KB (un blocco di archivio)
+#define UTENTI_BENCHMARK_ARCHIVIO 32
+#define SCHEDINE_BENCHMARK_ARCHIVIO 2500
+#define LETTURE_BENCHMARK_ARCHIVIO 1000
+
+// Prefisso dei segmenti dei benchmark dei registri (vedi CARTELLA_BENCHMARK_REGISTRI)
+char prefisso_registri[512] = CARTELLA_BENCHMARK_REGISTRI"/"NOME_BENCHMARK_REGISTRI;
+
+//////////////////////////////////////////////
+//			FUNZIONI DI UTILITA'			//
+//////////////////////////////////////////////
+/* Restituisce l'istante attuale in nanosecondi (orologio monotono)
+ */
+uint64_t adessoNanosecondi ()
+{
+	struct timespec t;
+	
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000ULL + (uint64_t)t.tv_nsec;
+}
+
+//////////////////////////////////////////////////////
+//				DIRECTORY DEGLI UTENTI				//
+//////////////////////////////////////////////////////
+/* Cerca uno username scandendo il file degli utenti record per record
+ * (implementazione precedente alla directory degli utenti, usata come termine di paragone)
+ * 
+ * @return 1 se lo username esiste, 0 altrimenti
+ */
+int cercaUsernameScansione (const char* username)
+{
+	FILE* fileUtenti;
+	char temp_password[512], temp_username[512];
+	
+	fileUtenti = fopen(FILE_UTENTI_BENCHMARK, "r");
+	if (!fileUtenti) {
+		return 0;
+	}
+	
+	while (fscanf(fileUtenti, "%s %s ", temp_username, temp_password) == 2) {
+		if (strcmp(username, temp_username) == 0) {
+			fclose(fileUtenti);
+			return 1;
+		}
+	}
+	
+	fclose(fileUtenti);
+	return 0;
+}
+
+/* Misura il tempo medio di ricerca di uno username (esistente e non esistente)
+ * al crescere del numero degli utenti registrati, fino a 1M di utenti
+ */
+void benchmarkDirectoryUtenti ()
+{
+	const int quanti_utenti[] = {1000, 10000, 100000, 1000000};
+	int i, j;
+	
+	printf("DIRECTORY DEGLI UTENTI (%i ricerche per misura)\n", QUANTE_RICERCHE);
+	printf("%10s %14s %16s %16s %18s\n", "utenti", "caricamento ms", "ns/ric. esist.", "ns/ric. assente", "ns/ric. scansione");
+	
+	for (i = 0; i < sizeof(quanti_utenti) / sizeof(quanti_utenti[0]); ++i) {
+		FILE* fileUtenti;
+		char username[64];
+		uint64_t inizio, caricamento, esistenti, assenti, scansione = 0;
+		int trovati = 0;
+		
+		// Genera il file degli utenti
+		fileUtenti = fopen(FILE_UTENTI_BENCHMARK, "w");
+		if (!fileUtenti) {
+			perror("Impossibile creare file utenti del benchmark");
+			return;
+		}
+		for (j = 0; j < quanti_utenti[i]; ++j) {
+			fprintf(fileUtenti, "utente%i password%i ", j, j);
+		}
+		fclose(fileUtenti);
+		
+		// Caricamento
+		inizio = adessoNanosecondi();
+		if (inizializzaDirectoryUtenti(FILE_UTENTI_BENCHMARK, NULL) != quanti_utenti[i]) {
+			fprintf(stderr, "Caricamento della directory fallito\n");
+			return;
+		}
+		caricamento = adessoNanosecondi() - inizio;
+		
+		// Ricerca di utenti esistenti (login, signup con username occupato)
+		inizio = adessoNanosecondi();
+		for (j = 0; j < QUANTE_RICERCHE; ++j) {
+			sprintf(username, "utente%i", rand() % quanti_utenti[i]);
+			trovati += cercaUtente(username, NULL);
+		}
+		esistenti = adessoNanosecondi() - inizio;
+		
+		// Ricerca di utenti non esistenti (signup con username libero)
+		inizio = adessoNanosecondi();
+		for (j = 0; j < QUANTE_RICERCHE; ++j) {
+			sprintf(username, "nuovo%i", rand());
+			trovati += cercaUtente(username, NULL);
+		}
+		assenti = adessoNanosecondi() - inizio;
+		
+		// Scansione lineare del file (solo per le dimensioni piu' piccole: e' O(utenti))
+		if (quanti_utenti[i] <= 10000) {
+			inizio = adessoNanosecondi();
+			for (j = 0; j < 100; ++j) {
+				sprintf(username, "utente%i", rand() % quanti_utenti[i]);
+				cercaUsernameScansione(username);
+			}
+			scansione = (adessoNanosecondi() - inizio) / 100;
+		}
+		
+		if (trovati != QUANTE_RICERCHE) {
+			fprintf(stderr, "Risultati delle ricerche inattesi (%i)\n", trovati);
+		}
+		
+		printf("%10i %14.1f %16.1f %16.1f ", quanti_utenti[i], caricamento / 1e6,
+				(double)esistenti / QUANTE_RICERCHE, (double)assenti / QUANTE_RICERCHE);
+		if (scansione) {
+			printf("%18.1f\n", (double)scansione);
+		}
+		else {
+			printf("%18s\n", "-");
+		}
+		fflush(stdout);
+		
+		chiudiDirectoryUtenti();
+	}
+	
+	remove(FILE_UTENTI_BENCHMARK);
+	printf("\n");
+}
+
+//////////////////////////////////////////////////
+//				GENERATORI CASUALI				//
+//////////////////////////////////////////////////
+/* Converte un intero in [0, QUANTI_CARATTERI_ALFANUMERICI) nel carattere alfanumerico corrispondente
+ */
+char carattereAlfanumerico (int random)
+{
+	if (random < QUANTE_CIFRE) {
+		return (char)(random + ASCII_PRIMA_CIFRA);
+	}
+	random -= QUANTE_CIFRE;
+	if (random < QUANTE_LETTERE) {
+		return (char)(random + ASCII_PRIMA_LETTERA_MINUSCOLA);
+	}
+	return (char)(random - QUANTE_LETTERE + ASCII_PRIMA_LETTERA_MAIUSCOLA);
+}
+
+/* Genera un session id con rand() (implementazione precedente, usata come termine di paragone)
+ */
+void generaSessionIdRand (char* buffer)
+{
+	int i;
+	
+	for (i = 0; i < LUNGHEZZA_SESSION_ID; ++i) {
+		buffer[i] = carattereAlfanumerico(rand() % QUANTI_CARATTERI_ALFANUMERICI);
+	}
+	buffer[LUNGHEZZA_SESSION_ID] = '\0';
+}
+
+/* Genera un session id con una chiamata a getrandom(...) per ogni id (senza riserva)
+ */
+void generaSessionIdGetrandom (char* buffer)
+{
+	uint8_t byte_casuali[LUNGHEZZA_SESSION_ID];
+	int i;
+	
+	getrandom(byte_casuali, sizeof(byte_casuali), 0);
+	for (i = 0; i < LUNGHEZZA_SESSION_ID; ++i) {
+		buffer[i] = carattereAlfanumerico(byte_casuali[i] % QUANTI_CARATTERI_ALFANUMERICI);	// distorto, solo per misura
+	}
+	buffer[LUNGHEZZA_SESSION_ID] = '\0';
+}
+
+/* Genera un session id con la riserva crittografica (implementazione attuale del server)
+ */
+void generaSessionIdRiserva (char* buffer)
+{
+	int i;
+	
+	for (i = 0; i < LUNGHEZZA_SESSION_ID; ++i) {
+		buffer[i] = carattereAlfanumerico((int)casualeSicuroLimitato(QUANTI_CARATTERI_ALFANUMERICI));
+	}
+	buffer[LUNGHEZZA_SESSION_ID] = '\0';
+}
+
+/* Estrae i numeri di una ruota con rand() e ripetizione in caso di duplicati (implementazione precedente)
+ */
+void estraiNumeriRand (uint32_t* estrazione)
+{
+	int i, scorri, unico;
+	
+	for (i = 0; i < QUANTI_NUMERI_ESTRATTI; ++i) {
+		do {
+			unico = 1;
+			estrazione[i] = (uint32_t)(rand() % NUMERI_ESTRAIBILI + 1);
+			for (scorri = 0; scorri < i; ++scorri) {
+				if (estrazione[i] == estrazione[scorri]) {
+					unico = 0;
+					break;
+				}
+			}
+		} while (!unico);
+	}
+}
+
+/* Conta quanti dei primi QUANTI_CONFRONTI_FORK session id generati da un processo figlio
+ * coincidono con quelli generati dal padre dopo la fork(...)
+ */
+#define QUANTI_CONFRONTI_FORK 1000
+
+int sessionIdUgualiDopoFork (void (*genera)(char*))
+{
+	char id_padre[LUNGHEZZA_SESSION_ID + 1], id_figlio[LUNGHEZZA_SESSION_ID + 1];
+	int canale[2], i, uguali = 0;
+	pid_t pid;
+	
+	// Il generatore viene usato prima della fork(...), come nel server
+	genera(id_padre);
+	
+	if (pipe(canale) < 0) {
+		return -1;
+	}
+	fflush(stdout);
+	pid = fork();
+	if (pid == 0) {
+		close(canale[0]);
+		for (i = 0; i < QUANTI_CONFRONTI_FORK; ++i) {
+			genera(id_figlio);
+			write(canale[1], id_figlio, LUNGHEZZA_SESSION_ID);
+		}
+		_exit(0);
+	}
+	close(canale[1]);
+	
+	for (i = 0; i < QUANTI_CONFRONTI_FORK; ++i) {
+		genera(id_padre);
+		if (read(canale[0], id_figlio, LUNGHEZZA_SESSION_ID) != LUNGHEZZA_SESSION_ID) {
+			break;
+		}
+		uguali += !memcmp(id_padre, id_figlio, LUNGHEZZA_SESSION_ID);
+	}
+	
+	close(canale[0]);
+	waitpid(pid, NULL, 0);
+	return uguali;
+}
+
+/* Misura il throughput dei generatori casuali, della generazione dei session id e delle estrazioni,
+ * confrontando le implementazioni basate su rand() con quelle di lotto_casuale
+ */
+void benchmarkGeneratoriCasuali ()
+{
+	struct generatore_casuale* generatore = generatoreDelProcesso();
+	uint64_t inizio, tempo_rand, tempo_xoshiro, somma = 0;
+	uint32_t estrazione[QUANTI_NUMERI_ESTRATTI];
+	char id[LUNGHEZZA_SESSION_ID + 1];
+	int i;
+	
+	printf("GENERATORI CASUALI\n");
+	
+	// Valori casuali
+	inizio = adessoNanosecondi();
+	for (i = 0; i < QUANTI_VALORI_CASUALI; ++i) {
+		somma += (uint64_t)rand();
+	}
+	tempo_rand = adessoNanosecondi() - inizio;
+	
+	inizio = adessoNanosecondi();
+	for (i = 0; i < QUANTI_VALORI_CASUALI; ++i) {
+		somma += prossimoCasuale(generatore);
+	}
+	tempo_xoshiro = adessoNanosecondi() - inizio;
+	
+	printf("%-36s %10.2f ns/valore  %8.1f M/s\n", "rand() (31 bit)", (double)tempo_rand / QUANTI_VALORI_CASUALI,
+			QUANTI_VALORI_CASUALI * 1e3 / tempo_rand);
+	printf("%-36s %10.2f ns/valore  %8.1f M/s\n", "xoshiro256** (64 bit)", (double)tempo_xoshiro / QUANTI_VALORI_CASUALI,
+			QUANTI_VALORI_CASUALI * 1e3 / tempo_xoshiro);
+	
+	// Session id
+	inizio = adessoNanosecondi();
+	for (i = 0; i < QUANTI_SESSION_ID; ++i) {
+		generaSessionIdRand(id);
+	}
+	printf("%-36s %10.2f ns/id\n", "session id con rand()", (double)(adessoNanosecondi() - inizio) / QUANTI_SESSION_ID);
+	
+	inizio = adessoNanosecondi();
+	for (i = 0; i < QUANTI_SESSION_ID; ++i) {
+		generaSessionIdGetrandom(id);
+	}
+	printf("%-36s %10.2f ns/id\n", "session id con getrandom() per id", (double)(adessoNanosecondi() - inizio) / QUANTI_SESSION_ID);
+	
+	inizio = adessoNanosecondi();
+	for (i = 0; i < QUANTI_SESSION_ID; ++i) {
+		generaSessionIdRiserva(id);
+	}
+	printf("%-36s %10.2f ns/id\n", "session id con riserva crittografica", (double)(adessoNanosecondi() - inizio) / QUANTI_SESSION_ID);
+	
+	printf("%-36s %6i/%i (rand()), %i/%i (riserva)\n", "session id uguali padre/figlio", 
+			sessionIdUgualiDopoFork(generaSessionIdRand), QUANTI_CONFRONTI_FORK,
+			sessionIdUgualiDopoFork(generaSessionIdRiserva), QUANTI_CONFRONTI_FORK);
+	
+	// Estrazioni (una ruota)
+	inizio = adessoNanosecondi();
+	for (i = 0; i < QUANTE_ESTRAZIONI; ++i) {
+		estraiNumeriRand(estrazione);
+		somma += estrazione[0];
+	}
+	printf("%-36s %10.2f ns/ruota\n", "estrazione con rand() e ripetizioni", (double)(adessoNanosecondi() - inizio) / QUANTE_ESTRAZIONI);
+	
+	inizio = adessoNanosecondi();
+	for (i = 0; i < QUANTE_ESTRAZIONI; ++i) {
+		estraiNumeri(generatore, estrazione, QUANTI_NUMERI_ESTRATTI, NUMERI_ESTRAIBILI);
+		somma += estrazione[0];
+	}
+	printf("%-36s %10.2f ns/ruota\n", "estrazione con Fisher-Yates", (double)(adessoNanosecondi() - inizio) / QUANTE_ESTRAZIONI);
+	
+	// Impedisce al compilatore di eliminare i cicli
+	if (somma == 0) {
+		printf("\n");
+	}
+	printf("\n");
+	fflush(stdout);
+}
+
+//////////////////////////////////////////////////////
+//				DURABILITA' DELLE GIOCATE			//
+//////////////////////////////////////////////////////
+static int ordine_crescente_latenza (const void* a, const void* b)
+{
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+	
+	return (x > y) - (x < y);
+}
+
+/* Misura throughput e latenza delle conferme con una durabilita' e un numero di processi che giocano in parallelo
+ * (ogni processo rappresenta un client connesso al server, che attende la conferma prima della giocata successiva)
+ */
+void misuraDurabilita (const char* durabilita, int processi)
+{
+	uint64_t* latenze, inizio, tempo, somma = 0;
+	int giocate = GIOCATE_BENCHMARK_REGISTRI / processi * processi;
+	char percorso[600];
+	int i, j, errori = 0, stato;
+	
+	latenze = (uint64_t*)allocaMemoriaCondivisa(giocate * sizeof(uint64_t));
+	if (!latenze || impostaDurabilitaRegistri(durabilita) < 0 || inizializzaRegistri(prefisso_registri, 0) < 0) {
+		fprintf(stderr, "Impossibile preparare il benchmark dei registri\n");
+		return;
+	}
+	
+	inizio = adessoNanosecondi();
+	for (i = 0; i < processi; ++i) {
+		if (fork() == 0) {
+			char utente[32];
+			
+			sprintf(utente, "utente%i", i);
+			for (j = i; j < giocate; j += processi) {
+				uint64_t t = adessoNanosecondi();
+				
+				if (aggiungiSchedinaRegistro(utente, RECORD_BENCHMARK_REGISTRI, strlen(RECORD_BENCHMARK_REGISTRI)) < 0) {
+					_exit(EXIT_FAILURE);
+				}
+				latenze[j] = adessoNanosecondi() - t;
+			}
+			_exit(EXIT_SUCCESS);
+		}
+	}
+	for (i = 0; i < processi; ++i) {
+		wait(&stato);
+		errori += !WIFEXITED(stato) || WEXITSTATUS(stato) != EXIT_SUCCESS;
+	}
+	tempo = adessoNanosecondi() - inizio;
+	
+	qsort(latenze, giocate, sizeof(uint64_t), ordine_crescente_latenza);
+	for (i = 0; i < giocate; ++i) {
+		somma += latenze[i];
+	}
+	printf("%-20s %8i %12.0f %12.1f %12.1f %12.1f%s\n", durabilita, processi, giocate * 1e9 / tempo,
+			somma / 1e3 / giocate, latenze[giocate / 2] / 1e3, latenze[giocate * 99 / 100] / 1e3,
+			errori ? "  (errori)" : "");
+	fflush(stdout);
+	
+	chiudiRegistri();
+	liberaMemoriaCondivisa(latenze, giocate * sizeof(uint64_t));
+	for (i = 1; ; ++i) {
+		snprintf(percorso, sizeof(percorso), FORMATO_PERCORSO_SEGMENTO, prefisso_registri, i);
+		if (unlink(percorso) < 0) {
+			break;
+		}
+	}
+}
+
+/* Misura il throughput delle giocate e la latenza delle conferme con ogni livello di durabilita'
+ * (nessuna sincronizzazione, commit di gruppo con e senza attesa, una sincronizzazione per schedina)
+ */
+void benchmarkDurabilita ()
+{
+	const char* durabilita[] = {"nessuna", "gruppo=0/32", "gruppo", "schedina"};
+	const int processi[] = {1, 8, 32};
+	FILE* fileUtenti;
+	int i, j;
+	
+	fileUtenti = fopen(FILE_UTENTI_BENCHMARK, "w");
+	if (!fileUtenti) {
+		perror("Impossibile creare file utenti del benchmark");
+		return;
+	}
+	for (i = 0; i < 32; ++i) {
+		fprintf(fileUtenti, "utente%i password%i ", i, i);
+	}
+	fclose(fileUtenti);
+	if (inizializzaDirectoryUtenti(FILE_UTENTI_BENCHMARK, NULL) < 0) {
+		fprintf(stderr, "Caricamento della directory fallito\n");
+		return;
+	}
+	
+	printf("DURABILITA' DELLE GIOCATE (%i giocate per misura)\n", GIOCATE_BENCHMARK_REGISTRI);
+	printf("%-20s %8s %12s %12s %12s %12s\n", "durabilita'", "processi", "giocate/s", "media us", "mediana us", "99% us");
+	for (i = 0; i < sizeof(durabilita) / sizeof(durabilita[0]); ++i) {
+		for (j = 0; j < sizeof(processi) / sizeof(processi[0]); ++j) {
+			misuraDurabilita(durabilita[i], processi[j]);
+		}
+	}
+	
+	chiudiDirectoryUtenti();
+	remove(FILE_UTENTI_BENCHMARK);
+	printf("\n");
+}
+
+//////////////////////////////////////////////////////
+//				ARCHIVIO DELLE SCHEDINE				//
+//////////////////////////////////////////////////////
+/* Misura la latenza della lettura delle schedine estratte di un utente (come vedi_giocate di tipo 0)
+ */
+void misuraLettureRegistro (const char* descrizione)
+{
+	uint64_t latenze[LETTURE_BENCHMARK_ARCHIVIO], somma = 0, t;
+	struct stato_registro stato;
+	char utente[32];
+	char* dati;
+	uint32_t lunghezza;
+	int i, errori = 0;
+	
+	for (i = 0; i < LETTURE_BENCHMARK_ARCHIVIO; ++i) {
+		sprintf(utente, "utente%i", i % UTENTI_BENCHMARK_ARCHIVIO);
+		statoRegistro(utente, &stato);
+		
+		t = adessoNanosecondi();
+		if (leggiRegistroSchedine(utente, INIZIO_REGISTRO_SCHEDINE, stato.inizio_non_estratte, &dati, &lunghezza) < 0) {
+			errori++;
+		}
+		else {
+			free(dati);
+		}
+		latenze[i] = adessoNanosecondi() - t;
+		somma += latenze[i];
+	}
+	
+	qsort(latenze, LETTURE_BENCHMARK_ARCHIVIO, sizeof(uint64_t), ordine_crescente_latenza);
+	printf("%-24s %12.1f %12.1f %12.1f %12.1f%s\n", descrizione, somma / 1e3 / LETTURE_BENCHMARK_ARCHIVIO,
+			latenze[LETTURE_BENCHMARK_ARCHIVIO / 2] / 1e3, latenze[LETTURE_BENCHMARK_ARCHIVIO * 99 / 100] / 1e3,
+			latenze[LETTURE_BENCHMARK_ARCHIVIO - 1] / 1e3, errori ? "  (errori)" : "");
+	fflush(stdout);
+}
+
+/* Misura la latenza della lettura delle schedine estratte prima e dopo la loro archiviazione
+ * (le schedine degli utenti sono intercalate nei segmenti, come quando giocano contemporaneamente)
+ * e il rapporto di compressione dell'archivio
+ */
+void benchmarkArchivio ()
+{
+	struct stato_registro stato;
+	char utente[32], percorso[600], metriche[4096], record[256];
+	const char* campo;
+	unsigned long byte_archiviati = 0, byte_archivio = 0;
+	uint64_t inizio;
+	long archiviate;
+	FILE* fileUtenti;
+	int i, j;
+	
+	fileUtenti = fopen(FILE_UTENTI_BENCHMARK, "w");
+	if (!fileUtenti) {
+		perror("Impossibile creare file utenti del benchmark");
+		return;
+	}
+	for (i = 0; i < UTENTI_BENCHMARK_ARCHIVIO; ++i) {
+		fprintf(fileUtenti, "utente%i password%i ", i, i);
+	}
+	fclose(fileUtenti);
+	
+	// L'archiviazione non viene rallentata: si misura la latenza delle letture, non quella dell'archiviazione
+	if (inizializzaDirectoryUtenti(FILE_UTENTI_BENCHMARK, NULL) < 0 || impostaDurabilitaRegistri("nessuna") < 0
+			|| impostaArchiviazioneRegistri("1/1048576") < 0 || inizializzaRegistri(prefisso_registri, 0) < 0) {
+		fprintf(stderr, "Impossibile preparare il benchmark dell'archivio\n");
+		return;
+	}
+	
+	// Schedine con timestamp e numeri diversi (la compressione dipende dal contenuto), poi estratte e controllate
+	for (j = 0; j < SCHEDINE_BENCHMARK_ARCHIVIO; ++j) {
+		for (i = 0; i < UTENTI_BENCHMARK_ARCHIVIO; ++i) {
+			sprintf(utente, "utente%i", i);
+			sprintf(record, "%i %i 0 0 0 0 0 0 0 0 0 %i %i %i %i %i 0 0 0 0 0 0 1.00 2.00 0.00 0.00 0.00|",
+					1700000000 + j * 300 + rand() % 300, 1 << (rand() % QUANTE_RUOTE), rand() % 90 + 1, rand() % 90 + 1,
+					rand() % 90 + 1, rand() % 90 + 1, rand() % 90 + 1);
+			aggiungiSchedinaRegistro(utente, record, strlen(record));
+		}
+	}
+	registraEstrazioneRegistri();
+	for (i = 0; i < UTENTI_BENCHMARK_ARCHIVIO; ++i) {
+		sprintf(utente, "utente%i", i);
+		statoRegistro(utente, &stato);
+		impostaInizioDaControllare(utente, stato.fine);
+	}
+	
+	printf("ARCHIVIO DELLE SCHEDINE (%i utenti, %i schedine per utente, %i letture per misura)\n",
+			UTENTI_BENCHMARK_ARCHIVIO, SCHEDINE_BENCHMARK_ARCHIVIO, LETTURE_BENCHMARK_ARCHIVIO);
+	printf("%-24s %12s %12s %12s %12s\n", "registro", "media us", "mediana us", "99% us", "massima us");
+	misuraLettureRegistro("schedine nei segmenti");
+	
+	inizio = adessoNanosecondi();
+	archiviate = archiviaRegistri();
+	printf("(archiviazione di %li schedine: %.1f ms)\n", archiviate, (adessoNanosecondi() - inizio) / 1e6);
+	misuraLettureRegistro("schedine archiviate");
+	
+	scriviMetricheRegistri(metriche, sizeof(metriche));
+	campo = strstr(metriche, "registri_byte_archiviati ");
+	if (campo) {
+		sscanf(campo, "registri_byte_archiviati %lu", &byte_archiviati);
+	}
+	campo = strstr(metriche, "registri_byte_archivio ");
+	if (campo) {
+		sscanf(campo, "registri_byte_archivio %lu", &byte_archivio);
+	}
+	printf("Compressione: %lu byte di schedine in %lu byte di archivio (%.1f:1)\n", byte_archiviati, byte_archivio,
+			byte_archivio ? (double)byte_archiviati / byte_archivio : 0.0);
+	
+	chiudiRegistri();
+	chiudiDirectoryUtenti();
+	remove(FILE_UTENTI_BENCHMARK);
+	for (i = 1; ; ++i) {
+		snprintf(percorso, sizeof(percorso), FORMATO_PERCORSO_SEGMENTO, prefisso_registri, i);
+		if (unlink(percorso) < 0) {
+			break;
+		}
+	}
+	snprintf(percorso, sizeof(percorso), FORMATO_PERCORSO_ARCHIVIO, prefisso_registri, 1);
+	remove(percorso);
+	printf("\n");
+}
+
+//////////////////////////////////////////////
+//					MAIN					//
+//////////////////////////////////////////////
+/* Controlla se un benchmark e' stato richiesto da linea di comando
+ * (se non e' stato indicato alcun benchmark, vengono eseguiti tutti)
+ * 
+ * @return 1 se il benchmark va eseguito, 0 altrimenti
+ */
+int richiesto (int argc, char** argv, const char* nome)
+{
+	int i;
+	
+	if (argc < 2) {
+		return 1;
+	}
+	
+	for (i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], nome)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Esegue i benchmark indicati come parametri (tutti, se non ne viene indicato nessuno)
+ * 
+ *    ./lotto_benchmark [-c cartella] [utenti] [casuale] [durabilita] [archivio]
+ * 
+ * (-c sceglie la cartella dei segmenti dei benchmark dei registri, che deve trovarsi su disco)
+ */
+int main (int argc, char** argv)
+{
+	const char* benchmark[] = {"utenti", "casuale", "durabilita", "archivio"};
+	int i, j;
+	
+	if (argc >= 3 && !strcmp(argv[1], "-c")) {
+		snprintf(prefisso_registri, sizeof(prefisso_registri), "%s/%s", argv[2], NOME_BENCHMARK_REGISTRI);
+		argv[2] = argv[0];
+		argv += 2;
+		argc -= 2;
+	}
+	
+	// Controlla che i benchmark richiesti esistano
+	for (i = 1; i < argc; ++i) {
+		for (j = 0; j < sizeof(benchmark) / sizeof(benchmark[0]); ++j) {
+			if (!strcmp(argv[i], benchmark[j])) {
+				break;
+			}
+		}
+		if (j == sizeof(benchmark) / sizeof(benchmark[0])) {
+			fprintf(stderr, "Benchmark <%s> non riconosciuto\n", argv[i]);
+			fflush(stderr);
+			exit(EXIT_FAILURE);
+		}
+	}
+	
+	srand(time(NULL));
+	
+	if (richiesto(argc, argv, "utenti")) {
+		benchmarkDirectoryUtenti();
+	}
+	if (richiesto(argc, argv, "casuale")) {
+		benchmarkGeneratoriCasuali();
+	}
+	if (richiesto(argc, argv, "durabilita")) {
+		benchmarkDurabilita();
+	}
+	if (richiesto(argc, argv, "archivio")) {
+		benchmarkArchivio();
+	}
+	
+	return 0;
+}
@@ -0,0 +1,451 @@
+#include "lotto_bloccati.h"
+#include "lotto_condivisa.h"
+#include "costanti.h"
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MASCHERA_INDIRIZZI_BLOCCATI (CAPACITA_INDIRIZZI_BLOCCATI - 1)
+
+// Oltre questo numero di indirizzi le catene di scansione diventano troppo lunghe
+#define MASSIMO_INDIRIZZI_BLOCCATI (CAPACITA_INDIRIZZI_BLOCCATI / 4 * 3)
+
+#define DURATA_BLOCCO_IP (MINUTI_DI_BLOCCO_IP * 60)
+
+// Un settore per ogni minuto di blocco, piu' il minuto in corso e quello di inserimento:
+// un blocco attivo non si trova mai in un settore che verra' purgato prima della sua scadenza
+#define SETTORI_RUOTA (MINUTI_DI_BLOCCO_IP + 2)
+
+// Il log viene compattato quando contiene piu' del doppio dei record necessari (e almeno questo numero di record)
+#define MINIMO_RECORD_COMPATTAZIONE 1024
+
+#define NESSUN_NODO 0xFFFFFFFF
+
+/* Elemento della tabella hash.
+ * Un elemento con indirizzo pari a 0 e' libero (0.0.0.0 non puo' essere l'indirizzo di un client)
+ */
+struct elemento_bloccato {
+	uint32_t indirizzo;
+	int64_t scadenza;				// istante in cui termina il blocco
+};
+
+/* Nodo della ruota temporizzata: ogni indirizzo presente nella tabella ha esattamente un nodo,
+ * collegato nel settore del minuto in cui scade il suo blocco
+ */
+struct nodo_ruota {
+	uint32_t indirizzo;
+	uint32_t prossimo;				// indice del nodo successivo nel settore (o nella lista dei liberi)
+};
+
+/* Struttura allocata in memoria condivisa
+ */
+struct tabella_bloccati {
+	pthread_mutex_t mutex;			// serializza le modifiche
+	uint32_t sequenza;				// contatore del seqlock: dispari durante una modifica della tabella
+	uint32_t quanti_bloccati;		// elementi presenti nella tabella (anche se scaduti ma non ancora purgati)
+	uint64_t record_nel_log;
+	int64_t minuto_ruota;			// primo minuto il cui settore non e' ancora stato purgato
+	uint32_t settori[SETTORI_RUOTA];	// testa della lista dei nodi di ogni settore
+	uint32_t nodi_liberi;
+	
+	// Metriche
+	uint64_t controlli;
+	uint64_t blocchi;
+	uint64_t purgati;
+	uint64_t compattazioni;
+	
+	struct elemento_bloccato elementi[CAPACITA_INDIRIZZI_BLOCCATI];
+	struct nodo_ruota nodi[MASSIMO_INDIRIZZI_BLOCCATI];
+};
+
+static struct tabella_bloccati* tabella = NULL;
+static char percorso_log[512];
+
+/* Calcola la posizione iniziale di un indirizzo nella tabella
+ */
+static uint32_t posizioneIndirizzo (uint32_t indirizzo)
+{
+	uint64_t hash = (uint64_t)indirizzo * 0x9E3779B97F4A7C15ULL;
+	
+	return (uint32_t)(hash >> 32) & MASCHERA_INDIRIZZI_BLOCCATI;
+}
+
+/* Inizia una modifica della tabella: da questo momento i lettori ripeteranno la ricerca.
+ * Se il processo precedente e' terminato durante una modifica il contatore e' rimasto dispari, e viene riallineato
+ */
+static void iniziaModifica ()
+{
+	uint32_t sequenza = tabella->sequenza | 1;
+	
+	__atomic_store_n(&tabella->sequenza, sequenza, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/* Termina una modifica della tabella, rendendola visibile ai lettori
+ */
+static void terminaModifica ()
+{
+	__atomic_store_n(&tabella->sequenza, tabella->sequenza + 1, __ATOMIC_RELEASE);
+}
+
+/* Cerca l'elemento di un indirizzo (DEVE essere chiamata possedendo il mutex)
+ * 
+ * @return indice dell'elemento, oppure indice dell'elemento libero in cui inserirlo se l'indirizzo non e' presente
+ */
+static uint32_t trovaElemento (uint32_t indirizzo)
+{
+	uint32_t i = posizioneIndirizzo(indirizzo);
+	
+	while (tabella->elementi[i].indirizzo != 0 && tabella->elementi[i].indirizzo != indirizzo) {
+		i = (i + 1) & MASCHERA_INDIRIZZI_BLOCCATI;
+	}
+	return i;
+}
+
+/* Rimuove un elemento dalla tabella spostando all'indietro gli elementi successivi della catena
+ * (non servono marcatori di cancellazione). DEVE essere chiamata durante una modifica
+ */
+static void rimuoviElemento (uint32_t i)
+{
+	uint32_t j = i, k;
+	
+	while (1) {
+		j = (j + 1) & MASCHERA_INDIRIZZI_BLOCCATI;
+		if (tabella->elementi[j].indirizzo == 0) {
+			break;
+		}
+		
+		// L'elemento in j puo' essere spostato in i solo se la sua posizione iniziale k non cade in (i, j]
+		k = posizioneIndirizzo(tabella->elementi[j].indirizzo);
+		if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j)) {
+			continue;
+		}
+		
+		__atomic_store_n(&tabella->elementi[i].scadenza, tabella->elementi[j].scadenza, __ATOMIC_RELAXED);
+		__atomic_store_n(&tabella->elementi[i].indirizzo, tabella->elementi[j].indirizzo, __ATOMIC_RELAXED);
+		i = j;
+	}
+	
+	__atomic_store_n(&tabella->elementi[i].indirizzo, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&tabella->elementi[i].scadenza, 0, __ATOMIC_RELAXED);
+}
+
+/* Collega un nodo al settore della ruota corrispondente al minuto di scadenza
+ */
+static void collegaNodo (uint32_t nodo, int64_t scadenza)
+{
+	uint32_t settore = (uint32_t)((scadenza / 60) % SETTORI_RUOTA);
+	
+	tabella->nodi[nodo].prossimo = tabella->settori[settore];
+	tabella->settori[settore] = nodo;
+}
+
+/* Inserisce un blocco nella tabella, o ne aggiorna la scadenza se l'indirizzo e' gia' presente.
+ * DEVE essere chiamata possedendo il mutex
+ * 
+ * @return 1 in caso di successo, -1 se la tabella e' piena
+ */
+static int inserisciBlocco (uint32_t indirizzo, int64_t scadenza)
+{
+	uint32_t i, nodo;
+	
+	i = trovaElemento(indirizzo);
+	
+	if (tabella->elementi[i].indirizzo == indirizzo) {
+		// Il nodo resta nel settore della scadenza precedente: verra' ricollegato quando quel settore sara' purgato
+		if (scadenza > tabella->elementi[i].scadenza) {
+			iniziaModifica();
+			__atomic_store_n(&tabella->elementi[i].scadenza, scadenza, __ATOMIC_RELAXED);
+			terminaModifica();
+		}
+		return 1;
+	}
+	
+	if (tabella->quanti_bloccati >= MASSIMO_INDIRIZZI_BLOCCATI || tabella->nodi_liberi == NESSUN_NODO) {
+		return -1;
+	}
+	
+	iniziaModifica();
+	__atomic_store_n(&tabella->elementi[i].scadenza, scadenza, __ATOMIC_RELAXED);
+	__atomic_store_n(&tabella->elementi[i].indirizzo, indirizzo, __ATOMIC_RELAXED);
+	terminaModifica();
+	
+	nodo = tabella->nodi_liberi;
+	tabella->nodi_liberi = tabella->nodi[nodo].prossimo;
+	tabella->nodi[nodo].indirizzo = indirizzo;
+	collegaNodo(nodo, scadenza);
+	
+	tabella->quanti_bloccati++;
+	return 1;
+}
+
+/* Riscrive il log con i soli blocchi presenti nella tabella (su un file temporaneo, poi rinominato).
+ * DEVE essere chiamata possedendo il mutex
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int compattaLog ()
+{
+	char percorso_temporaneo[520];
+	FILE* log;
+	uint32_t i;
+	uint64_t scritti = 0;
+	
+	sprintf(percorso_temporaneo, "%s.tmp", percorso_log);
+	
+	log = fopen(percorso_temporaneo, "wb");
+	if (!log) {
+		perror("Impossibile creare log compattato degli indirizzi bloccati");
+		return -1;
+	}
+	
+	for (i = 0; i < CAPACITA_INDIRIZZI_BLOCCATI; ++i) {
+		struct in_addr indirizzo;
+		time_t timestamp;
+		
+		if (tabella->elementi[i].indirizzo == 0) {
+			continue;
+		}
+		
+		// Nel log si registra l'istante del blocco, non quello della scadenza
+		indirizzo.s_addr = tabella->elementi[i].indirizzo;
+		timestamp = (time_t)(tabella->elementi[i].scadenza - DURATA_BLOCCO_IP);
+		fwrite(&indirizzo, sizeof(indirizzo), 1, log);
+		fwrite(&timestamp, sizeof(timestamp), 1, log);
+		scritti++;
+	}
+	
+	if (fclose(log) != 0 || rename(percorso_temporaneo, percorso_log) < 0) {
+		perror("Impossibile sostituire il log degli indirizzi bloccati");
+		remove(percorso_temporaneo);
+		return -1;
+	}
+	
+	tabella->record_nel_log = scritti;
+	tabella->compattazioni++;
+	return 0;
+}
+
+/* Avanza la ruota temporizzata fino al minuto attuale e compatta il log se necessario.
+ * DEVE essere chiamata possedendo il mutex
+ */
+static void purga (time_t adesso)
+{
+	int64_t minuto_attuale = (int64_t)adesso / 60;
+	
+	// Se la ruota e' rimasta ferma per piu' di un giro, basta purgare ogni settore una volta
+	if (minuto_attuale - tabella->minuto_ruota > SETTORI_RUOTA) {
+		tabella->minuto_ruota = minuto_attuale - SETTORI_RUOTA;
+	}
+	
+	// Un settore puo' essere purgato solo quando il suo minuto e' completamente trascorso
+	for (; tabella->minuto_ruota < minuto_attuale; tabella->minuto_ruota++) {
+		uint32_t settore = (uint32_t)(tabella->minuto_ruota % SETTORI_RUOTA);
+		uint32_t nodo = tabella->settori[settore];
+		
+		tabella->settori[settore] = NESSUN_NODO;
+		
+		while (nodo != NESSUN_NODO) {
+			uint32_t prossimo = tabella->nodi[nodo].prossimo;
+			uint32_t i = trovaElemento(tabella->nodi[nodo].indirizzo);
+			
+			if (tabella->elementi[i].scadenza > adesso) {
+				// L'indirizzo e' stato bloccato di nuovo dopo la scadenza: il nodo passa al settore della nuova scadenza
+				collegaNodo(nodo, tabella->elementi[i].scadenza);
+			}
+			else {
+				iniziaModifica();
+				rimuoviElemento(i);
+				terminaModifica();
+				
+				tabella->nodi[nodo].prossimo = tabella->nodi_liberi;
+				tabella->nodi_liberi = nodo;
+				tabella->quanti_bloccati--;
+				tabella->purgati++;
+			}
+			
+			nodo = prossimo;
+		}
+	}
+	
+	if (tabella->record_nel_log > MINIMO_RECORD_COMPATTAZIONE &&
+			tabella->record_nel_log > 2 * (uint64_t)tabella->quanti_bloccati) {
+		compattaLog();
+	}
+}
+
+/* Crea la tabella degli indirizzi bloccati in memoria condivisa e la popola dal log, che viene poi compattato
+ * 
+ * @file_log percorso del log dei blocchi
+ * 
+ * @return numero degli indirizzi attualmente bloccati, -1 in caso di errore
+ */
+int inizializzaIndirizziBloccati (const char* file_log)
+{
+	FILE* log;
+	time_t adesso;
+	uint32_t i;
+	
+	tabella = (struct tabella_bloccati*)allocaMemoriaCondivisa(sizeof(struct tabella_bloccati));
+	if (!tabella) {
+		return -1;
+	}
+	if (inizializzaMutexCondiviso(&tabella->mutex) < 0) {
+		return -1;
+	}
+	
+	strncpy(percorso_log, file_log, sizeof(percorso_log) - 1);
+	time(&adesso);
+	
+	// Ruota vuota, tutti i nodi nella lista dei liberi
+	for (i = 0; i < SETTORI_RUOTA; ++i) {
+		tabella->settori[i] = NESSUN_NODO;
+	}
+	for (i = 0; i < MASSIMO_INDIRIZZI_BLOCCATI; ++i) {
+		tabella->nodi[i].prossimo = (i + 1 < MASSIMO_INDIRIZZI_BLOCCATI) ? i + 1 : NESSUN_NODO;
+	}
+	tabella->nodi_liberi = 0;
+	tabella->minuto_ruota = (int64_t)adesso / 60;
+	
+	// Caricamento dei blocchi ancora attivi
+	log = fopen(file_log, "rb");
+	if (log) {
+		struct in_addr indirizzo;
+		time_t timestamp;
+		
+		while (fread(&indirizzo, sizeof(indirizzo), 1, log) == 1 && fread(&timestamp, sizeof(timestamp), 1, log) == 1) {
+			if (timestamp + DURATA_BLOCCO_IP > adesso && indirizzo.s_addr != 0) {
+				inserisciBlocco(indirizzo.s_addr, (int64_t)timestamp + DURATA_BLOCCO_IP);
+			}
+		}
+		fclose(log);
+	}
+	
+	if (compattaLog() < 0) {
+		return -1;
+	}
+	tabella->compattazioni = 0;
+	
+	return (int)tabella->quanti_bloccati;
+}
+
+/* Controlla se un indirizzo e' bloccato, senza acquisire il mutex.
+ * La ricerca viene ripetuta se una modifica della tabella e' iniziata o terminata nel frattempo
+ * 
+ * @indirizzo indirizzo IPv4 in formato network
+ * @adesso istante attuale
+ * 
+ * @return 1 se l'indirizzo e' bloccato, 0 altrimenti
+ */
+int indirizzoBloccato (uint32_t indirizzo, time_t adesso)
+{
+	uint32_t sequenza, i, corrente;
+	int64_t scadenza;
+	
+	__atomic_fetch_add(&tabella->controlli, 1, __ATOMIC_RELAXED);
+	
+	do {
+		sequenza = __atomic_load_n(&tabella->sequenza, __ATOMIC_ACQUIRE);
+		scadenza = 0;
+		
+		for (i = posizioneIndirizzo(indirizzo); ; i = (i + 1) & MASCHERA_INDIRIZZI_BLOCCATI) {
+			corrente = __atomic_load_n(&tabella->elementi[i].indirizzo, __ATOMIC_RELAXED);
+			if (corrente == 0) {
+				break;
+			}
+			if (corrente == indirizzo) {
+				scadenza = __atomic_load_n(&tabella->elementi[i].scadenza, __ATOMIC_RELAXED);
+				break;
+			}
+		}
+		
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((sequenza & 1) || sequenza != __atomic_load_n(&tabella->sequenza, __ATOMIC_RELAXED));
+	
+	// Un blocco scaduto ma non ancora purgato non blocca l'indirizzo
+	return scadenza > adesso;
+}
+
+/* Blocca un indirizzo per MINUTI_DI_BLOCCO_IP minuti: scrive il blocco nel log e lo inserisce nella tabella
+ * 
+ * @indirizzo indirizzo IPv4 in formato network
+ * @adesso istante del blocco
+ * 
+ * @return 1 in caso di successo, -1 in caso di errore
+ */
+int bloccaIndirizzo (uint32_t indirizzo, time_t adesso)
+{
+	FILE* log;
+	struct in_addr addr;
+	int ret;
+	
+	bloccaMutexCondiviso(&tabella->mutex);
+	
+	log = fopen(percorso_log, "ab");
+	if (!log) {
+		perror("Impossibile aprire log degli indirizzi bloccati");
+		sbloccaMutexCondiviso(&tabella->mutex);
+		return -1;
+	}
+	addr.s_addr = indirizzo;
+	fwrite(&addr, sizeof(addr), 1, log);
+	fwrite(&adesso, sizeof(adesso), 1, log);
+	fclose(log);
+	tabella->record_nel_log++;
+	
+	// La purga precede l'inserimento, cosi' i blocchi scaduti liberano posto nella tabella
+	purga(adesso);
+	
+	ret = inserisciBlocco(indirizzo, (int64_t)adesso + DURATA_BLOCCO_IP);
+	if (ret < 0) {
+		fprintf(stderr, "Tabella degli indirizzi bloccati piena\n");
+		fflush(stderr);
+	}
+	else {
+		tabella->blocchi++;
+	}
+	
+	sbloccaMutexCondiviso(&tabella->mutex);
+	return ret;
+}
+
+/* Rimuove dalla tabella i blocchi scaduti e compatta il log se necessario
+ * 
+ * @adesso istante attuale
+ */
+void purgaIndirizziScaduti (time_t adesso)
+{
+	bloccaMutexCondiviso(&tabella->mutex);
+	purga(adesso);
+	sbloccaMutexCondiviso(&tabella->mutex);
+}
+
+/* Scrive le metriche degli indirizzi bloccati (una per riga, nel formato "nome valore")
+ * 
+ * @buffer buffer in cui scrivere le metriche
+ * @dimensione dimensione del buffer
+ * 
+ * @return numero di caratteri scritti
+ */
+int scriviMetricheBloccati (char* buffer, size_t dimensione)
+{
+	int ret;
+	
+	bloccaMutexCondiviso(&tabella->mutex);
+	ret = snprintf(buffer, dimensione,
+			"indirizzi_bloccati %u\n"
+			"indirizzi_controlli %lu\n"
+			"indirizzi_blocchi %lu\n"
+			"indirizzi_purgati %lu\n"
+			"indirizzi_record_log %lu\n"
+			"indirizzi_compattazioni_log %lu\n",
+			tabella->quanti_bloccati,
+			(unsigned long)__atomic_load_n(&tabella->controlli, __ATOMIC_RELAXED),
+			(unsigned long)tabella->blocchi,
+			(unsigned long)tabella->purgati,
+			(unsigned long)tabella->record_nel_log,
+			(unsigned long)tabella->compattazioni);
+	sbloccaMutexCondiviso(&tabella->mutex);
+	
+	return caratteriScritti(ret, dimensione);
+}
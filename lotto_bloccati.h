@@ -0,0 +1,71 @@
+#ifndef LOTTO_BLOCCATI_H
+#define LOTTO_BLOCCATI_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+//////////////////////////////////////////////////////
+//				INDIRIZZI IP BLOCCATI				//
+//////////////////////////////////////////////////////
+/* Gli indirizzi IPv4 bloccati (dopo il terzo login errato) sono mantenuti in una tabella hash
+ * ad indirizzamento aperto in memoria condivisa, ciascuno con il proprio istante di scadenza del blocco.
+ * 
+ * Il controllo di un indirizzo non acquisisce mutex e non effettua chiamate di sistema: le scritture
+ * sono protette da un contatore di sequenza (seqlock) e il lettore ripete la ricerca se la tabella
+ * e' stata modificata durante la lettura.
+ * 
+ * Gli indirizzi scaduti vengono rimossi da una ruota temporizzata (timer wheel) con un settore per minuto.
+ * Ogni blocco viene anche scritto in coda ad un log su file, usato per ricostruire la tabella al riavvio;
+ * il log viene compattato (riscritto con i soli blocchi attivi) all'avvio e quando cresce troppo.
+ */
+
+// Numero di elementi della tabella (potenza di 2)
+#define CAPACITA_INDIRIZZI_BLOCCATI (1 << 16)
+
+/* Crea la tabella degli indirizzi bloccati in memoria condivisa e la popola con i blocchi ancora attivi
+ * presenti nel log, che viene poi compattato.
+ * Deve essere chiamata dal processo principale prima di creare i processi figli.
+ * 
+ * @file_log percorso del log dei blocchi (formato: indirizzo (in_addr) | timestamp del blocco (time_t))
+ * 
+ * @return numero degli indirizzi attualmente bloccati, -1 in caso di errore
+ */
+int inizializzaIndirizziBloccati (const char* file_log);
+
+/* Controlla se un indirizzo e' bloccato
+ * 
+ * @indirizzo indirizzo IPv4 in formato network
+ * @adesso istante attuale
+ * 
+ * @return 1 se l'indirizzo e' bloccato, 0 altrimenti
+ */
+int indirizzoBloccato (uint32_t indirizzo, time_t adesso);
+
+/* Blocca un indirizzo per MINUTI_DI_BLOCCO_IP minuti a partire da adesso.
+ * Il blocco viene scritto nel log e inserito nella tabella; vengono inoltre rimossi i blocchi scaduti
+ * 
+ * @indirizzo indirizzo IPv4 in formato network
+ * @adesso istante del blocco
+ * 
+ * @return 1 in caso di successo, -1 in caso di errore
+ */
+int bloccaIndirizzo (uint32_t indirizzo, time_t adesso);
+
+/* Rimuove dalla tabella i blocchi scaduti, avanzando la ruota temporizzata fino al minuto attuale,
+ * e compatta il log se contiene troppi blocchi scaduti
+ * 
+ * @adesso istante attuale
+ */
+void purgaIndirizziScaduti (time_t adesso);
+
+/* Scrive le metriche degli indirizzi bloccati (una per riga, nel formato "nome valore")
+ * 
+ * @buffer buffer in cui scrivere le metriche
+ * @dimensione dimensione del buffer
+ * 
+ * @return numero di caratteri scritti
+ */
+int scriviMetricheBloccati (char* buffer, size_t dimensione);
+
+#endif	// LOTTO_BLOCCATI_H
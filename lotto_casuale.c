@@ -0,0 +1,233 @@
+#include "lotto_casuale.h"
+#include "costanti.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/random.h>
+#include <time.h>
+#include <unistd.h>
+
+// Byte letti dal kernel ad ogni ricarica della riserva crittografica (circa 100 session id)
+#define DIMENSIONE_RISERVA 4096
+
+static __thread struct generatore_casuale generatore_thread;
+static __thread int generatore_inizializzato = 0;
+
+static __thread uint8_t riserva[DIMENSIONE_RISERVA];
+static __thread size_t posizione_riserva = DIMENSIONE_RISERVA;	// riserva vuota
+
+static pthread_once_t registrazione_fork = PTHREAD_ONCE_INIT;
+
+/* Eseguita nel processo figlio dopo una fork(...): il figlio non deve riusare
+ * ne' lo stato del generatore ne' i byte della riserva del padre
+ */
+static void dopoFork ()
+{
+	generatore_inizializzato = 0;
+	posizione_riserva = DIMENSIONE_RISERVA;
+	memset(riserva, 0, sizeof(riserva));
+}
+
+static void registraGestoreFork ()
+{
+	pthread_atfork(NULL, NULL, dopoFork);
+}
+
+/* Un passo di splitmix64, usato per espandere un seme nello stato del generatore
+ */
+static uint64_t splitmix64 (uint64_t* x)
+{
+	uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+	
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+static uint64_t ruota (const uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+/* Riempie un buffer con byte casuali del kernel.
+ * Se getrandom(...) non e' disponibile, ripiega su un seme ricavato da orologio e pid (NON crittografico)
+ */
+static void leggiByteKernel (void* buffer, size_t quanti)
+{
+	size_t letti = 0;
+	ssize_t ret;
+	
+	while (letti < quanti) {
+		ret = getrandom((uint8_t*)buffer + letti, quanti - letti, 0);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		letti += ret;
+	}
+	
+	if (letti < quanti) {
+		struct timespec t;
+		uint64_t seme;
+		
+		perror("getrandom fallita");
+		clock_gettime(CLOCK_REALTIME, &t);
+		seme = ((uint64_t)t.tv_sec << 32) ^ (uint64_t)t.tv_nsec ^ ((uint64_t)getpid() << 16);
+		
+		for (; letti < quanti; ++letti) {
+			((uint8_t*)buffer)[letti] = (uint8_t)splitmix64(&seme);
+		}
+	}
+}
+
+/* Inizializza un generatore a partire da un seme
+ * 
+ * @generatore generatore da inizializzare
+ * @seme seme del generatore
+ */
+void inizializzaGeneratore (struct generatore_casuale* generatore, uint64_t seme)
+{
+	int i;
+	
+	for (i = 0; i < 4; ++i) {
+		generatore->stato[i] = splitmix64(&seme);
+	}
+}
+
+/* Inizializza un generatore con byte casuali del kernel
+ * 
+ * @generatore generatore da inizializzare
+ */
+void inizializzaGeneratoreCasuale (struct generatore_casuale* generatore)
+{
+	do {
+		leggiByteKernel(generatore->stato, sizeof(generatore->stato));
+	} while (!(generatore->stato[0] | generatore->stato[1] | generatore->stato[2] | generatore->stato[3]));	// lo stato nullo e' degenere
+}
+
+/* Restituisce il generatore del thread chiamante, inizializzandolo con getrandom(...) se necessario
+ */
+struct generatore_casuale* generatoreDelProcesso ()
+{
+	if (!generatore_inizializzato) {
+		pthread_once(&registrazione_fork, registraGestoreFork);
+		inizializzaGeneratoreCasuale(&generatore_thread);
+		generatore_inizializzato = 1;
+	}
+	return &generatore_thread;
+}
+
+/* Restituisce il prossimo valore a 64 bit di un generatore (xoshiro256**)
+ */
+uint64_t prossimoCasuale (struct generatore_casuale* generatore)
+{
+	uint64_t* s = generatore->stato;
+	const uint64_t risultato = ruota(s[1] * 5, 7) * 9;
+	const uint64_t t = s[1] << 17;
+	
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = ruota(s[3], 45);
+	
+	return risultato;
+}
+
+/* Riduce un valore casuale a 32 bit in [0, limite) con il metodo di Lemire (moltiplicazione e rifiuto):
+ * i valori che produrrebbero distorsione vengono scartati e sostituiti da quelli forniti da prossimo(...)
+ */
+#define RIDUCI_SENZA_DISTORSIONE(x, limite, prossimo) do {		\
+		uint64_t m = (uint64_t)(x) * (limite);						\
+		if ((uint32_t)m < (limite)) {								\
+			uint32_t soglia = -(limite) % (limite);					\
+			while ((uint32_t)m < soglia) {							\
+				(x) = (prossimo);									\
+				m = (uint64_t)(x) * (limite);						\
+			}														\
+		}															\
+		(x) = (uint32_t)(m >> 32);									\
+	} while (0)
+
+/* Restituisce un intero uniformemente distribuito in [0, limite)
+ * 
+ * @generatore generatore da usare
+ * @limite estremo superiore escluso, maggiore di 0
+ */
+uint32_t casualeLimitato (struct generatore_casuale* generatore, uint32_t limite)
+{
+	uint32_t x = (uint32_t)(prossimoCasuale(generatore) >> 32);
+	
+	RIDUCI_SENZA_DISTORSIONE(x, limite, (uint32_t)(prossimoCasuale(generatore) >> 32));
+	return x;
+}
+
+/* Restituisce un reale uniformemente distribuito in [0, 1)
+ */
+double casualeReale (struct generatore_casuale* generatore)
+{
+	return (double)(prossimoCasuale(generatore) >> 11) * 0x1.0p-53;
+}
+
+/* Estrae numeri distinti in [1, massimo] con un mescolamento di Fisher-Yates parziale
+ * 
+ * @generatore generatore da usare
+ * @numeri array in cui scrivere i numeri estratti
+ * @quanti numero di numeri da estrarre
+ * @massimo numero piu' alto estraibile
+ */
+void estraiNumeri (struct generatore_casuale* generatore, uint32_t* numeri, int quanti, uint32_t massimo)
+{
+	uint8_t urna[NUMERI_ESTRAIBILI];
+	uint32_t i, j;
+	uint8_t temp;
+	
+	for (i = 0; i < massimo; ++i) {
+		urna[i] = (uint8_t)(i + 1);
+	}
+	
+	// Al passo i, il numero estratto e' scelto tra quelli rimasti in urna[i..massimo-1]
+	for (i = 0; i < (uint32_t)quanti; ++i) {
+		j = i + casualeLimitato(generatore, massimo - i);
+		temp = urna[i];
+		urna[i] = urna[j];
+		urna[j] = temp;
+		numeri[i] = urna[i];
+	}
+}
+
+/* Restituisce 32 bit casuali dalla riserva crittografica del thread, ricaricandola se vuota
+ */
+static uint32_t prossimoSicuro ()
+{
+	uint32_t x;
+	
+	if (posizione_riserva + sizeof(x) > DIMENSIONE_RISERVA) {
+		pthread_once(&registrazione_fork, registraGestoreFork);
+		leggiByteKernel(riserva, DIMENSIONE_RISERVA);
+		posizione_riserva = 0;
+	}
+	
+	memcpy(&x, riserva + posizione_riserva, sizeof(x));
+	
+	// I byte usati vengono cancellati, cosi' che non restino in memoria
+	memset(riserva + posizione_riserva, 0, sizeof(x));
+	posizione_riserva += sizeof(x);
+	return x;
+}
+
+/* Restituisce un intero uniformemente distribuito in [0, limite) estratto dal generatore crittografico del kernel
+ * 
+ * @limite estremo superiore escluso, maggiore di 0
+ */
+uint32_t casualeSicuroLimitato (uint32_t limite)
+{
+	uint32_t x = prossimoSicuro();
+	
+	RIDUCI_SENZA_DISTORSIONE(x, limite, prossimoSicuro());
+	return x;
+}
@@ -0,0 +1,76 @@
+#ifndef LOTTO_CASUALE_H
+#define LOTTO_CASUALE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//////////////////////////////////////////////////
+//				GENERATORI CASUALI				//
+//////////////////////////////////////////////////
+/* Generatori di numeri casuali per processo (e per thread), al posto di rand():
+ * il processo principale del server inizializzava rand() una sola volta prima delle fork(...),
+ * percio' tutti i processi figli generavano la stessa sequenza (e gli stessi session id).
+ * 
+ * - generatoreDelProcesso() restituisce un generatore xoshiro256** proprio del thread chiamante,
+ *   inizializzato con getrandom(...) al primo utilizzo e di nuovo dopo ogni fork(...).
+ *   E' adatto alle estrazioni e alle simulazioni, non a valori che devono restare segreti.
+ * - casualeSicuroLimitato(...) estrae valori dal generatore crittografico del kernel (getrandom(...)),
+ *   letti a blocchi in una riserva per thread cosi' da non effettuare una chiamata di sistema per valore.
+ *   Va usato per i session id. Anche la riserva viene svuotata dopo ogni fork(...).
+ */
+
+/* Stato di un generatore xoshiro256**
+ */
+struct generatore_casuale {
+	uint64_t stato[4];
+};
+
+/* Inizializza un generatore a partire da un seme: la sequenza generata e' riproducibile
+ * 
+ * @generatore generatore da inizializzare
+ * @seme seme del generatore
+ */
+void inizializzaGeneratore (struct generatore_casuale* generatore, uint64_t seme);
+
+/* Inizializza un generatore con byte casuali del kernel
+ * 
+ * @generatore generatore da inizializzare
+ */
+void inizializzaGeneratoreCasuale (struct generatore_casuale* generatore);
+
+/* Restituisce il generatore del thread chiamante, inizializzandolo con getrandom(...) se necessario
+ */
+struct generatore_casuale* generatoreDelProcesso ();
+
+/* Restituisce il prossimo valore a 64 bit di un generatore
+ */
+uint64_t prossimoCasuale (struct generatore_casuale* generatore);
+
+/* Restituisce un intero uniformemente distribuito in [0, limite) (senza la distorsione del modulo)
+ * 
+ * @generatore generatore da usare
+ * @limite estremo superiore escluso, maggiore di 0
+ */
+uint32_t casualeLimitato (struct generatore_casuale* generatore, uint32_t limite);
+
+/* Restituisce un reale uniformemente distribuito in [0, 1)
+ */
+double casualeReale (struct generatore_casuale* generatore);
+
+/* Estrae numeri distinti in [1, massimo], con un mescolamento di Fisher-Yates parziale:
+ * ogni sottoinsieme ordinato e' equiprobabile e non servono estrazioni ripetute in caso di duplicati
+ * 
+ * @generatore generatore da usare
+ * @numeri array in cui scrivere i numeri estratti (nell'ordine di estrazione)
+ * @quanti numero di numeri da estrarre, al piu' massimo
+ * @massimo numero piu' alto estraibile (al piu' NUMERI_ESTRAIBILI)
+ */
+void estraiNumeri (struct generatore_casuale* generatore, uint32_t* numeri, int quanti, uint32_t massimo);
+
+/* Restituisce un intero uniformemente distribuito in [0, limite) estratto dal generatore crittografico del kernel
+ * 
+ * @limite estremo superiore escluso, maggiore di 0
+ */
+uint32_t casualeSicuroLimitato (uint32_t limite);
+
+#endif	// LOTTO_CASUALE_H
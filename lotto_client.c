@@ -20,9 +20,25 @@
 #define C_VEDI_ESTRAZIONE 5
 #define C_VEDI_VINCITE 6
 #define C_ESCI 7
+#define C_VEDI_RIEPILOGO 8
+#define C_VEDI_METRICHE 9
+#define C_RIPRENDI 10
+#define C_QUOTA 11
+#define C_ANNULLA_ABBONAMENTO 12
+#define C_VEDI_ESPOSIZIONE 13
+#define C_STATISTICHE 14
+#define C_CERCA_ESTRAZIONI 15
+#define C_REPLAY 16
+#define C_IMPOSTA_PERIODO 17
 
 #define BUFFER_SIZE 1024
 
+// Numero dei ritardatari mostrati da !statistiche
+#define QUANTI_NUMERI_RITARDATARI 5
+
+// Impostata da attendiRisposta(...) quando il server rifiuta il session id (sessione scaduta o non valida)
+static int sessione_non_valida = 0;
+
 //
 // COMUNICAZIONE CLIENT-SERVER
 //
@@ -42,29 +58,22 @@ int inviaComando (const int socket, const uint8_t tipo, const void* msg, const s
 	uint16_t len_buffer = len + sizeof(tipo), // lunghezza del buffer = lunghezza del messaggio + header (1 byte)
 			network_len_buffer;	// contiene la lunghezza del buffer in formato network
 	
-	buffer = malloc(len_buffer);
+	buffer = malloc(sizeof(network_len_buffer) + len_buffer);
 	if (!buffer) {
 		fprintf(stderr, "Impossibile allocare dinamicamente buffer\n");
 		fflush(stderr);
 		return -1;
 	}
 	
-	// Genera il messaggio
-	memcpy(buffer, &tipo, sizeof(tipo));
-	memcpy(buffer + sizeof(tipo), msg, len);
-	
+	// Genera il messaggio, preceduto dalla sua dimensione: inviati separatamente, il secondo segmento
+	// attenderebbe l'ACK del primo (algoritmo di Nagle), che il server ritarda fino a 40ms
 	network_len_buffer = htons(len_buffer);
+	memcpy(buffer, &network_len_buffer, sizeof(network_len_buffer));
+	memcpy(buffer + sizeof(network_len_buffer), &tipo, sizeof(tipo));
+	memcpy(buffer + sizeof(network_len_buffer) + sizeof(tipo), msg, len);
 	
-	// Invia dimensione messaggio
-	ret = send(socket, &network_len_buffer, sizeof(network_len_buffer), 0);
-	if (ret < 0) {
-		perror("Impossibile inviare dimensione messaggio");
-		free(buffer);
-		return -1;
-	}
-	
-	// Invia messaggio
-	ret = send(socket, buffer, len_buffer, 0);
+	// Invia dimensione e messaggio
+	ret = send(socket, buffer, sizeof(network_len_buffer) + len_buffer, 0);
 	if (ret < 0) {
 		perror("Impossibile inviare messaggio");
 		free(buffer);
@@ -119,6 +128,11 @@ int attendiRisposta (const int socket, void** msg)
 		return 0;
 	}
 	
+	// Il server ha rifiutato il session id: la connessione non e' piu' autenticata
+	if (len >= 2 && ((uint8_t*)*msg)[0] == ERR && ((uint8_t*)*msg)[1] == SESSION_ID_ERRATO) {
+		sessione_non_valida = 1;
+	}
+	
 	return len;
 }
 
@@ -141,12 +155,21 @@ void stampaAiuto(int comando)
 		printf("3) !login <username> <password> --> autentica un utente\n");
 	}
 	if (comando == C_INVIA_GIOCATA || comando == -1) {
-		printf("4) !invia_giocata g --> invia una giocata g al server\n");
+		printf(	"4) !invia_giocata g --> invia una giocata g al server, dove g = [-s] [-e <k> | -a] -r <ruote> -n <numeri> -i <importi>\n"
+				"                        con l'opzione -s la giocata e' un sistema (fino a %i numeri):\n"
+				"                        ogni importo e' puntato su ciascuna combinazione dei numeri giocati;\n"
+				"                        con l'opzione -e la giocata vale per le prossime k estrazioni (fino a %i),\n"
+				"                        con l'opzione -a e' un abbonamento, valido fino a !annulla_abbonamento\n",
+				QUANTITA_MASSIMA_NUMERI_SISTEMA, MASSIMO_ESTRAZIONI_SCHEDINA);
 	}
 	if (comando == C_VEDI_GIOCATE || comando == -1) {
 		printf(	"5) !vedi_giocate tipo --> visualizza le giocate precedenti dove tipo = {0,1}\n"
 				"                          e permette di visualizzare le giocate passate '0'\n"
-				"                          oppure le giocate attive '1' (ancora non estratte)\n");
+				"                          oppure le giocate attive '1' (ancora non estratte).\n"
+				"                          Filtri opzionali: -r <ruote> (giocate su almeno una delle ruote),\n"
+				"                          -n <numero> (giocate che contengono il numero), -d <da> <a> (giocate\n"
+				"                          registrate tra le date, nel formato gg-mm-aaaa) e -e <esito>,\n"
+				"                          con esito = {vincenti, perdenti, in_gioco}\n");
 	}
 	if (comando == C_VEDI_ESTRAZIONE || comando == -1) {
 		printf(	"6) !vedi_estrazione <n> <ruota> --> mostra i numeri delle ultime n estrazioni\n"
@@ -155,8 +178,48 @@ void stampaAiuto(int comando)
 	if (comando == C_VEDI_VINCITE || comando == -1) {
 		printf(	"7) !vedi_vincite --> mostra tutte le schedine vinte dall'utente\n");
 	}
+	if (comando == C_VEDI_RIEPILOGO || comando == -1) {
+		printf(	"8) !vedi_riepilogo --> mostra i totali delle vincite dell'utente\n");
+	}
+	if (comando == C_VEDI_METRICHE || comando == -1) {
+		printf(	"9) !vedi_metriche --> mostra le metriche del server. Riservato all'utente " UTENTE_AMMINISTRATORE "\n");
+	}
+	if (comando == C_RIPRENDI || comando == -1) {
+		printf(	"10) !riprendi <session_id> --> riprende una sessione ottenuta con un login precedente,\n"
+				"                               senza ripetere il login\n");
+	}
+	if (comando == C_QUOTA || comando == -1) {
+		printf(	"11) !quota g --> mostra le probabilita' di vincita e la vincita attesa della giocata g,\n"
+				"                 senza inviarla (la sintassi di g e' la stessa di !invia_giocata)\n");
+	}
+	if (comando == C_ANNULLA_ABBONAMENTO || comando == -1) {
+		printf(	"12) !annulla_abbonamento <n> --> annulla l'abbonamento n; senza n mostra gli abbonamenti attivi\n");
+	}
+	if (comando == C_VEDI_ESPOSIZIONE || comando == -1) {
+		printf(	"13) !vedi_esposizione <ruota> <numero> [<numero>] --> mostra quanto il banco pagherebbe alla prossima\n"
+				"                                    estrazione se sulla ruota uscisse il numero (o l'ambo).\n"
+				"                                    Riservato all'utente " UTENTE_AMMINISTRATORE "\n");
+	}
+	if (comando == C_STATISTICHE || comando == -1) {
+		printf(	"14) !statistiche <ruota> --> mostra frequenza e ritardo dei numeri estratti sulla ruota\n"
+				"                             e gli ambi usciti piu' spesso\n");
+	}
+	if (comando == C_CERCA_ESTRAZIONI || comando == -1) {
+		printf(	"15) !cerca_estrazioni <da> <a> <ruote> --> mostra le estrazioni effettuate tra le date <da> e <a>\n"
+				"                                           (nel formato gg-mm-aaaa, incluse) sulle ruote specificate;\n"
+				"                                           senza ruote mostra tutte le ruote\n");
+	}
+	if (comando == C_REPLAY || comando == -1) {
+		printf(	"16) !replay <da> <a> g --> mostra quanto avrebbe vinto la giocata g se fosse stata giocata su ogni\n"
+				"                           estrazione tra le date <da> e <a> (nel formato gg-mm-aaaa, incluse).\n"
+				"                           La sintassi di g e' la stessa di !invia_giocata (-e e -a vengono ignorate)\n");
+	}
+	if (comando == C_IMPOSTA_PERIODO || comando == -1) {
+		printf(	"17) !imposta_periodo <periodo> --> cambia il periodo delle estrazioni, in minuti oppure in secondi\n"
+				"                                   con il suffisso 's' (per esempio 30s). Riservato all'utente " UTENTE_AMMINISTRATORE "\n");
+	}
 	if (comando == C_ESCI || comando == -1) {
-		printf("8) !esci --> termina il client\n");
+		printf("17) !esci --> termina il client\n");
 	}
 	
 	printf("\n");
@@ -263,6 +326,36 @@ int convertiComandoStringToInt (char* str)
 	if (!strcmp(str, "vedi_vincite")) {
 		return C_VEDI_VINCITE;
 	}
+	if (!strcmp(str, "vedi_riepilogo")) {
+		return C_VEDI_RIEPILOGO;
+	}
+	if (!strcmp(str, "vedi_metriche")) {
+		return C_VEDI_METRICHE;
+	}
+	if (!strcmp(str, "riprendi")) {
+		return C_RIPRENDI;
+	}
+	if (!strcmp(str, "quota")) {
+		return C_QUOTA;
+	}
+	if (!strcmp(str, "annulla_abbonamento")) {
+		return C_ANNULLA_ABBONAMENTO;
+	}
+	if (!strcmp(str, "vedi_esposizione")) {
+		return C_VEDI_ESPOSIZIONE;
+	}
+	if (!strcmp(str, "statistiche")) {
+		return C_STATISTICHE;
+	}
+	if (!strcmp(str, "cerca_estrazioni")) {
+		return C_CERCA_ESTRAZIONI;
+	}
+	if (!strcmp(str, "replay")) {
+		return C_REPLAY;
+	}
+	if (!strcmp(str, "imposta_periodo")) {
+		return C_IMPOSTA_PERIODO;
+	}
 	if (!strcmp(str, "esci")) {
 		return C_ESCI;
 	}
@@ -282,7 +375,7 @@ int convertiComandoStringToInt (char* str)
 char** parseComando (char* comando, size_t len, size_t* len_parsed)
 {
 	int quanteParole = 1;
-	char delimiter = ' ';
+	const char delimiter[] = " ";	// strsep(...) vuole una stringa terminata, non un singolo carattere
 	char* temp = NULL;
 	char** parsed_comando = NULL;
 	int i = 0;
@@ -291,7 +384,7 @@ char** parseComando (char* comando, size_t len, size_t* len_parsed)
 	
 	// Conta le parole
 	for (i = 0; i < len; ++i) {
-		if (comando[i] == delimiter) quanteParole++;
+		if (comando[i] == delimiter[0]) quanteParole++;
 	}
 	
 	parsed_comando = (char**)malloc(quanteParole * sizeof(char*));
@@ -302,7 +395,7 @@ char** parseComando (char* comando, size_t len, size_t* len_parsed)
 	
 	// Parse del comando
 	for (i = 0; i < quanteParole; ++i) {
-		temp = strsep(&comando, &delimiter);
+		temp = strsep(&comando, delimiter);
 		parsed_comando[i] = malloc(strlen(temp) + 1);
 		if (!parsed_comando[i]) {
 			perror("Impossibile allocare parola per parsed_comando");
@@ -374,6 +467,166 @@ int controllaAsciiDouble (char* numero)
 	return 1;
 }
 
+/* Converte una data nel formato gg-mm-aaaa nel timestamp del suo inizio (o della sua fine) nell'ora locale
+ * 
+ * @data stringa contenente la data
+ * @fine_giornata 1 per ottenere l'ultimo secondo della giornata, 0 per il primo
+ * @timestamp puntatore in cui scrivere il timestamp (puo' essere NULL per controllare solo la data)
+ * 
+ * @return 1 se la data e' valida, 0 altrimenti
+ */
+int convertiData (const char* data, const int fine_giornata, time_t* timestamp)
+{
+	struct tm tm_data;
+	int giorno, mese, anno, letti = 0;
+	time_t risultato;
+	
+	if (sscanf(data, "%2d-%2d-%4d%n", &giorno, &mese, &anno, &letti) != 3 || data[letti] != '\0') {
+		return 0;
+	}
+	
+	memset(&tm_data, 0, sizeof(tm_data));
+	tm_data.tm_mday = giorno;
+	tm_data.tm_mon = mese - 1;
+	tm_data.tm_year = anno - 1900;
+	tm_data.tm_isdst = -1;
+	if (fine_giornata) {
+		tm_data.tm_hour = 23;
+		tm_data.tm_min = 59;
+		tm_data.tm_sec = 59;
+	}
+	
+	// mktime(...) normalizza le date inesistenti (ad esempio 31-02): la data e' valida solo se non cambia
+	risultato = mktime(&tm_data);
+	if (risultato == (time_t)-1 || tm_data.tm_mday != giorno || tm_data.tm_mon != mese - 1
+			|| tm_data.tm_year != anno - 1900 || risultato < 0 || (uint64_t)risultato > UINT32_MAX) {
+		return 0;
+	}
+	
+	if (timestamp) *timestamp = risultato;
+	return 1;
+}
+
+/* Converte il periodo delle estrazioni di !imposta_periodo, espresso in minuti oppure in secondi
+ * con il suffisso 's' (come il periodo passato al server all'avvio)
+ * 
+ * @periodo stringa contenente il periodo
+ * 
+ * @return periodo in secondi, 0 se il periodo non e' valido
+ */
+uint32_t convertiPeriodo (const char* periodo)
+{
+	unsigned long valore;
+	char* fine;
+	
+	if (periodo[0] < '0' || periodo[0] > '9') {
+		return 0;
+	}
+	valore = strtoul(periodo, &fine, 10);
+	if (fine[0] == 's' && fine[1] == '\0') {
+		return (valore > UINT32_MAX) ? 0 : (uint32_t)valore;
+	}
+	if (fine[0] != '\0' || valore > UINT32_MAX / 60) {
+		return 0;
+	}
+	return (uint32_t)(valore * 60);
+}
+
+/* Legge i filtri opzionali di !vedi_giocate <tipo>: -r <ruote>, -n <numero>, -d <da> <a> (date nel formato
+ * gg-mm-aaaa) e -e <esito>, con esito vincenti, perdenti o in_gioco. Ogni filtro puo' comparire una volta
+ * 
+ * @parsed_comando comando dopo il parse
+ * @len lunghezza di parsed_comando
+ * @filtro struttura in cui scrivere i filtri (i filtri assenti non escludono nessuna schedina)
+ * 
+ * @return numero dei filtri letti, -1 se i filtri non sono validi
+ */
+int leggiFiltroGiocate (char** parsed_comando, const size_t len, struct filtro_giocate* filtro)
+{
+	int i = 2, quanti = 0;
+	time_t da, a;
+	
+	filtro->ruote = 0;
+	filtro->numero = 0;
+	filtro->da = 0;
+	filtro->a = UINT32_MAX;
+	filtro->esito = ESITO_QUALSIASI;
+	
+	while (i < len) {
+		if (!strcmp(parsed_comando[i], "-r") && filtro->ruote == 0) {
+			for (++i; i < len && parsed_comando[i][0] != '-'; ++i) {
+				if (!controllaRuota(parsed_comando[i])) return -1;
+				filtro->ruote |= (uint16_t)(1 << convertiRuotaStringToInt(parsed_comando[i]));
+			}
+			if (filtro->ruote == 0) return -1;
+		}
+		else if (!strcmp(parsed_comando[i], "-n") && filtro->numero == 0) {
+			if (i + 1 >= len || !controllaAsciiInt(parsed_comando[i + 1])) return -1;
+			filtro->numero = (uint8_t)atoi(parsed_comando[i + 1]);
+			i += 2;
+		}
+		else if (!strcmp(parsed_comando[i], "-d") && filtro->da == 0 && filtro->a == UINT32_MAX) {
+			if (i + 2 >= len || !convertiData(parsed_comando[i + 1], 0, &da)
+					|| !convertiData(parsed_comando[i + 2], 1, &a) || da > a) return -1;
+			filtro->da = (uint32_t)da;
+			filtro->a = (uint32_t)a;
+			i += 3;
+		}
+		else if (!strcmp(parsed_comando[i], "-e") && filtro->esito == ESITO_QUALSIASI && i + 1 < len) {
+			if (!strcmp(parsed_comando[i + 1], "vincenti")) filtro->esito = ESITO_VINCENTE;
+			else if (!strcmp(parsed_comando[i + 1], "perdenti")) filtro->esito = ESITO_PERDENTE;
+			else if (!strcmp(parsed_comando[i + 1], "in_gioco")) filtro->esito = ESITO_IN_GIOCO;
+			else return -1;
+			i += 2;
+		}
+		else {
+			return -1;
+		}
+		quanti++;
+	}
+	return quanti;
+}
+
+/* Legge le opzioni di una giocata (!invia_giocata o !quota) che precedono le ruote:
+ * -s (sistema), -e <k> (giocata valida per k estrazioni) e -a (abbonamento), seguite da "-r"
+ * 
+ * @parsed_comando comando dopo il parse
+ * @len lunghezza di parsed_comando
+ * @sched schedina in cui scrivere i campi sistema, quanteEstrazioni e annullamento
+ * 
+ * @return indice della prima ruota in parsed_comando, -1 se le opzioni non sono valide
+ */
+int leggiOpzioniGiocata (char** parsed_comando, const size_t len, struct schedina* sched)
+{
+	int i = 1;
+	
+	sched->sistema = 0;
+	sched->quanteEstrazioni = 1;
+	sched->annullamento = 0;
+	
+	for (; i < len && strcmp(parsed_comando[i], "-r") != 0; ++i) {
+		if (!strcmp(parsed_comando[i], "-s") && !sched->sistema) {
+			sched->sistema = 1;
+		}
+		else if (!strcmp(parsed_comando[i], "-a") && sched->quanteEstrazioni == 1) {
+			sched->quanteEstrazioni = ABBONAMENTO;
+		}
+		else if (!strcmp(parsed_comando[i], "-e") && sched->quanteEstrazioni == 1 && i + 1 < len
+				&& strspn(parsed_comando[i + 1], "0123456789") == strlen(parsed_comando[i + 1])) {
+			sched->quanteEstrazioni = atoi(parsed_comando[++i]);
+			if (sched->quanteEstrazioni < 1 || sched->quanteEstrazioni > MASSIMO_ESTRAZIONI_SCHEDINA) {
+				printf("Una giocata puo' valere al massimo per %i estrazioni\n", MASSIMO_ESTRAZIONI_SCHEDINA);
+				return -1;
+			}
+		}
+		else {
+			return -1;
+		}
+	}
+	
+	return (i < len) ? i + 1 : -1;	// salta "-r"
+}
+
 /* Prende il risultato del parse di un comando e verifica se la sintassi risulta corretta
  * 
  * @parsed_comando comando dopo il parse
@@ -408,14 +661,16 @@ int validaComando (char** parsed_comando, size_t len)
 		}
 		return C_LOGIN;
 	}
-	// Comando invia_giocata
-	if (!strcmp(parsed_comando[0], "!invia_giocata")) {
-		// !invia_giocata -r <ruote> -n <numeri> -i <importi>
+	// Comandi invia_giocata e quota (stessa sintassi)
+	if (!strcmp(parsed_comando[0], "!invia_giocata") || !strcmp(parsed_comando[0], "!quota")) {
+		// !invia_giocata [-s] [-e <k> | -a] -r <ruote> -n <numeri> -i <importi>
 		int i, selezionateTutteLeRuote = 0;
-		int inizioRuota = 2, inizioNumeri, inizioImporti;
+		struct schedina opzioni;
+		int inizioRuota = leggiOpzioniGiocata(parsed_comando, len, &opzioni), inizioNumeri, inizioImporti;
+		int massimoNumeri = opzioni.sistema ? QUANTITA_MASSIMA_NUMERI_SISTEMA : QUANTITA_MASSIMA_NUMERI_SCHEDINA;
 
-		// RUOTE
-		if (strcmp(parsed_comando[1], "-r") != 0) {
+		// OPZIONI E RUOTE
+		if (inizioRuota < 0) {
 			return -1;
 		}
 		// Controlla che le stringhe siano ruote
@@ -449,8 +704,8 @@ int validaComando (char** parsed_comando, size_t len)
 		if (i == 0) {	// Non ci sono numeri
 			return -1;
 		}
-		if (i > QUANTITA_MASSIMA_NUMERI_SCHEDINA) {	// Troppi numeri
-			printf("Non ci possono essere piu' di %i numeri nella schedina\n", QUANTITA_MASSIMA_NUMERI_SCHEDINA);
+		if (i > massimoNumeri) {	// Troppi numeri
+			printf("Non ci possono essere piu' di %i numeri nella schedina\n", massimoNumeri);
 			return -1;
 		}
 		
@@ -468,13 +723,15 @@ int validaComando (char** parsed_comando, size_t len)
 			return -1;
 		}
 		
-		return C_INVIA_GIOCATA;
+		return strcmp(parsed_comando[0], "!quota") ? C_INVIA_GIOCATA : C_QUOTA;
 	}
 	
 	// Comando vedi_giocate
 	if (!strcmp(parsed_comando[0], "!vedi_giocate")) {
-		// !vedi_giocate <tipo>
-		if (len != 2) return -1;
+		// !vedi_giocate <tipo> <filtri (opzionali)>
+		struct filtro_giocate filtro;
+		
+		if (len < 2) return -1;
 		
 		// <tipo> puo' essere solo '0' o '1'
 		
@@ -482,6 +739,10 @@ int validaComando (char** parsed_comando, size_t len)
 			return -1;
 		}
 		
+		if (leggiFiltroGiocate(parsed_comando, len, &filtro) < 0) {
+			return -1;
+		}
+		
 		return C_VEDI_GIOCATE;
 	}
 	
@@ -510,6 +771,97 @@ int validaComando (char** parsed_comando, size_t len)
 		else return C_VEDI_VINCITE;
 	}
 	
+	// Comando !vedi_riepilogo
+	if (!strcmp(parsed_comando[0], "!vedi_riepilogo")) {
+		// E' presente solo il comando, senza opzioni
+		if (len != 1) return -1;
+		else return C_VEDI_RIEPILOGO;
+	}
+	
+	// Comando !vedi_metriche
+	if (!strcmp(parsed_comando[0], "!vedi_metriche")) {
+		// E' presente solo il comando, senza opzioni
+		if (len != 1) return -1;
+		else return C_VEDI_METRICHE;
+	}
+	
+	// Comando !riprendi
+	if (!strcmp(parsed_comando[0], "!riprendi")) {
+		// !riprendi <session_id>
+		if (len != 2 || strlen(parsed_comando[1]) != LUNGHEZZA_SESSION_ID) return -1;
+		else return C_RIPRENDI;
+	}
+	
+	// Comando !annulla_abbonamento
+	if (!strcmp(parsed_comando[0], "!annulla_abbonamento")) {
+		// !annulla_abbonamento <n (opzionale)>
+		if (len > 2 || (len == 2 && (strspn(parsed_comando[1], "0123456789") != strlen(parsed_comando[1])
+				|| atoi(parsed_comando[1]) < 1))) return -1;
+		else return C_ANNULLA_ABBONAMENTO;
+	}
+	
+	// Comando !vedi_esposizione
+	if (!strcmp(parsed_comando[0], "!vedi_esposizione")) {
+		// !vedi_esposizione <ruota> <numero> <secondo numero (opzionale)>
+		if (len < 3 || len > 4 || !controllaRuota(parsed_comando[1]) || !controllaAsciiInt(parsed_comando[2])) {
+			return -1;
+		}
+		if (len == 4 && (!controllaAsciiInt(parsed_comando[3]) || atoi(parsed_comando[3]) == atoi(parsed_comando[2]))) {
+			return -1;
+		}
+		return C_VEDI_ESPOSIZIONE;
+	}
+	
+	// Comando !statistiche
+	if (!strcmp(parsed_comando[0], "!statistiche")) {
+		// !statistiche <ruota>
+		if (len != 2 || !controllaRuota(parsed_comando[1])) return -1;
+		else return C_STATISTICHE;
+	}
+	
+	// Comando !cerca_estrazioni
+	if (!strcmp(parsed_comando[0], "!cerca_estrazioni")) {
+		// !cerca_estrazioni <da> <a> <ruote (opzionali)>
+		time_t da, a;
+		int i;
+		
+		if (len < 3 || !convertiData(parsed_comando[1], 0, &da) || !convertiData(parsed_comando[2], 1, &a) || da > a) {
+			return -1;
+		}
+		for (i = 3; i < len; ++i) {
+			if (!controllaRuota(parsed_comando[i])) return -1;
+		}
+		return C_CERCA_ESTRAZIONI;
+	}
+	
+	// Comando !replay
+	if (!strcmp(parsed_comando[0], "!replay")) {
+		// !replay <da> <a> [-s] [-e <k> | -a] -r <ruote> -n <numeri> -i <importi>
+		char comando_quota[] = "!quota";
+		char* data_fine;
+		time_t da, a;
+		int ret;
+		
+		if (len < 4 || !convertiData(parsed_comando[1], 0, &da) || !convertiData(parsed_comando[2], 1, &a) || da > a) {
+			return -1;
+		}
+		
+		// La giocata dopo le date si convalida come un comando !quota
+		data_fine = parsed_comando[2];
+		parsed_comando[2] = comando_quota;
+		ret = validaComando(parsed_comando + 2, len - 2);
+		parsed_comando[2] = data_fine;
+		
+		return (ret == C_QUOTA) ? C_REPLAY : -1;
+	}
+	
+	// Comando !imposta_periodo
+	if (!strcmp(parsed_comando[0], "!imposta_periodo")) {
+		// !imposta_periodo <periodo>
+		if (len != 2 || convertiPeriodo(parsed_comando[1]) == 0) return -1;
+		else return C_IMPOSTA_PERIODO;
+	}
+	
 	// Comando !esci
 	if (!strcmp(parsed_comando[0], "!esci")) {
 		// E' presente solo il comando, senza opzioni
@@ -622,10 +974,10 @@ int eseguiSignup(const int socket, char** parsed_comando)
 		if (ret < 0) {
 			return -1;
 		}
-	
+		
 		ret = attendiRisposta(socket, (void**)&msg);
 		if (ret <= 0) return ret;
-	
+		
 		dim_msg = ret;
 		exit = 1;
 		
@@ -645,6 +997,12 @@ int eseguiSignup(const int socket, char** parsed_comando)
 					dim_msg = richiediNuovoUsername(&msg);
 					exit = 0; // continua ad inviare lo username
 					continue;
+				case RICHIESTE_ECCESSIVE:
+					printf("Errore: troppe richieste dal tuo IP. Riprova tra qualche secondo\n");
+					break;
+				case CAPACITA_ESAURITA:
+					printf("Errore: il server non accetta nuove registrazioni\n");
+					break;
 				default:
 					printf("Errore sconosciuto\n");
 			}
@@ -732,15 +1090,19 @@ int eseguiLogin (const int socket, char** parsed_comando, char* session_id)
 				printf("Errore: il tuo IP e' temporanemente bloccato. Riprova piu' tardi\n");
 				return_value = 2;
 				break;
+			case RICHIESTE_ECCESSIVE:
+				printf("Errore: troppe richieste dal tuo IP. Riprova tra qualche secondo\n");
+				return_value = 2;
+				break;
 			default:
 				printf("Errore sconosciuto\n");
 				return_value = 2;
 		}
 	}
 	else if (msg[0] == DATI) {
-		printf("Login effettuato!\n");
 		// Copia il session_id inviato dal server
 		strcpy(session_id, msg + 1);
+		printf("Login effettuato! (session id %s, utilizzabile con !riprendi su una nuova connessione)\n", session_id);
 		return_value = 1;
 	}
 	else {
@@ -754,35 +1116,31 @@ int eseguiLogin (const int socket, char** parsed_comando, char* session_id)
 	return return_value;
 }
 
-/* Invia al server il comando invia_giocata. Il comando invia una schedina valida al server.
- * Il messaggio da inviare ha il seguente formato
- * ---------------------------------------------------------
- * | session_id (stringa + '\\0') | schedina (serializzata) |
- * ---------------------------------------------------------
+/* Costruisce la schedina descritta da un comando !invia_giocata o !quota gia' convalidato
+ * (i vettori della schedina vengono allocati dinamicamente e vanno deallocati dal chiamante)
  * 
- * @return -1 in caso di errore interno, 0 in caso di chiusura della connessione,
- *		1 in caso di successo, 2 in caso di fallimento
+ * @parsed_comando comando dopo il parse
+ * @len lunghezza di parsed_comando
+ * @sched schedina da costruire
  */
-int eseguiInviaGiocata (const int socket, char** parsed_comando, const size_t len, const char* session_id)
+void costruisciSchedina (char** parsed_comando, const size_t len, struct schedina* sched)
 {
-	int ret, i, 
-		base_index = 2; // contiene l'indice dell'elemento di parsed_comando attualmente in analisi
-	struct schedina sched;	// struttura che conterra' la schedina inserita dall'utente
-	char* schedina_serializzata;
-	char* messaggio;
-	uint8_t* risposta;	// conterra' la risposta del server
-	uint16_t len_schedina_serializzata;
+	int i, 
+		base_index; // contiene l'indice dell'elemento di parsed_comando attualmente in analisi
 	
 	//
 	// COSTRUISCI LA SCHEDINA
 	//
+	// Opzioni (sistema, estrazioni, abbonamento) prima delle ruote
+	base_index = leggiOpzioniGiocata(parsed_comando, len, sched);
+	
 	// Ruote
 	if (!strcmp(parsed_comando[base_index], "tutte")) { // Inserisci tutte le ruote
-		sched.quanteRuote = QUANTE_RUOTE;
-		sched.ruote = malloc(sched.quanteRuote * sizeof(int));
+		sched->quanteRuote = QUANTE_RUOTE;
+		sched->ruote = malloc(sched->quanteRuote * sizeof(int));
 		
 		for (i = 0; i < QUANTE_RUOTE; ++i) {
-			sched.ruote[i] = i;
+			sched->ruote[i] = i;
 		}
 		
 		base_index += 2;
@@ -793,37 +1151,38 @@ int eseguiInviaGiocata (const int socket, char** parsed_comando, const size_t le
 		while (strcmp(parsed_comando[base_index + i], "-n")) {
 			i++;
 		}
-
-		sched.quanteRuote = i;
-		sched.ruote = malloc(sched.quanteRuote * sizeof(int));
+		
+		sched->quanteRuote = i;
+		sched->ruote = malloc(sched->quanteRuote * sizeof(int));
 		
 		// Estrai le ruote dalla stringa
 		for (i = 0; strcmp(parsed_comando[base_index + i], "-n"); ++i) {
-			sched.ruote[i] = convertiRuotaStringToInt(parsed_comando[base_index + i]);
+			sched->ruote[i] = convertiRuotaStringToInt(parsed_comando[base_index + i]);
 		}
 		
-		base_index += (sched.quanteRuote + 1);
+		base_index += (sched->quanteRuote + 1);
 	}
 	
 	
 	
 	// NUMERI GIOCATI
 	// Conta i numeri
-	// (in fase di convalida del comando abbiamo gia' testato che i numeri sono meno di QUANTITA_MASSIMA_NUMERI_SCHEDINA)
+	// (in fase di convalida del comando abbiamo gia' testato che i numeri sono meno di QUANTITA_MASSIMA_NUMERI_SCHEDINA,
+	// o di QUANTITA_MASSIMA_NUMERI_SISTEMA per i sistemi)
 	i = 0;
 	while (strcmp(parsed_comando[base_index + i], "-i")) {
 		i++;
 	}
-
-	sched.quantiNumeri = i;
-	sched.numeriGiocati = malloc(sched.quantiNumeri * sizeof(int));
-
+	
+	sched->quantiNumeri = i;
+	sched->numeriGiocati = malloc(sched->quantiNumeri * sizeof(int));
+	
 	// Estrae i numeri giocati da parsed_comando
 	for (i = 0; strcmp(parsed_comando[base_index + i], "-i"); ++i) {
-		sched.numeriGiocati[i] = atoi(parsed_comando[base_index + i]);
+		sched->numeriGiocati[i] = atoi(parsed_comando[base_index + i]);
 	}
 	
-	base_index += (sched.quantiNumeri + 1);
+	base_index += (sched->quantiNumeri + 1);
 	
 	// IMPORTI
 	i = 0;
@@ -831,13 +1190,34 @@ int eseguiInviaGiocata (const int socket, char** parsed_comando, const size_t le
 		i++;
 	}
 	
-	sched.quantiImporti = i;
-	sched.importi = malloc(sched.quantiImporti * sizeof(double));
+	sched->quantiImporti = i;
+	sched->importi = malloc(sched->quantiImporti * sizeof(double));
 	
 	// Estrae gli importi da parsed_comando
 	for (i = 0; base_index + i < len; ++i) {
-		sched.importi[i] = atof(parsed_comando[base_index + i]);
+		sched->importi[i] = atof(parsed_comando[base_index + i]);
 	}
+}
+
+/* Invia al server il comando invia_giocata. Il comando invia una schedina valida al server.
+ * Il messaggio da inviare ha il seguente formato
+ * ---------------------------------------------------------
+ * | session_id (stringa + '\\0') | schedina (serializzata) |
+ * ---------------------------------------------------------
+ * 
+ * @return -1 in caso di errore interno, 0 in caso di chiusura della connessione,
+ *		1 in caso di successo, 2 in caso di fallimento
+ */
+int eseguiInviaGiocata (const int socket, char** parsed_comando, const size_t len, const char* session_id)
+{
+	int ret;
+	struct schedina sched;	// struttura che conterra' la schedina inserita dall'utente
+	char* schedina_serializzata;
+	char* messaggio;
+	uint8_t* risposta;	// conterra' la risposta del server
+	uint16_t len_schedina_serializzata;
+	
+	costruisciSchedina(parsed_comando, len, &sched);
 	
 	// Serializza schedina
 	schedina_serializzata = serializza_schedina_txt(sched, &len_schedina_serializzata);
@@ -863,6 +1243,13 @@ int eseguiInviaGiocata (const int socket, char** parsed_comando, const size_t le
 		return (ret == 0) ? 0 : -1;
 	}
 	
+	if (risposta[0] != DATI && risposta[1] == MESSAGGIO_NON_COMPRENSIBILE) {
+		printf("Invio schedina fallito: la giocata non e' valida (numeri o ruote ripetuti, numeri fuori da 1-%i,\n"
+				"       oppure importi su puntate che richiedono piu' numeri di quelli giocati)\n", NUMERI_ESTRAIBILI);
+		fflush(stdout);
+		free(risposta);
+		return 2;
+	}
 	if (risposta[0] != DATI) {
 		fprintf(stderr, "Invio schedina fallito: errore del server\n");
 		free(risposta);
@@ -874,19 +1261,77 @@ int eseguiInviaGiocata (const int socket, char** parsed_comando, const size_t le
 	return 1;
 }
 
-/* Invia al server il comando di vedi_giocate <tipo>.
+/* Stampa un elenco numerato di schedine serializzate (vedi serializza_schedina_txt(...))
+ * 
+ * @schedine schedine serializzate, una di seguito all'altra
+ * @lunghezza lunghezza di schedine (compreso il terminatore)
+ */
+void stampaElencoSchedine (char* schedine, const uint16_t lunghezza)
+{
+	int offset = 0, i = 1;
+	
+	while (offset < lunghezza - 1) { // non considerare il null terminator
+		struct schedina temp;
+		int quanti_byte_letti;
+		int j;
+		
+		// Deserializza le schedine
+		temp = deserializza_schedina_txt(schedine + offset, &quanti_byte_letti);
+		offset += quanti_byte_letti;
+		
+		// Stampa schedina a video
+		printf("%i) ", i);
+		
+		if (temp.sistema) {
+			printf("sistema ");
+		}
+		
+		for (j = 0; j < temp.quanteRuote; ++j) {
+			printf("%s ", convertiRuotaIntToString(temp.ruote[j]));
+		}
+		
+		for (j = 0; j < temp.quantiNumeri; ++j) {
+			printf("%i ", temp.numeriGiocati[j]);
+		}
+		
+		for (j = temp.quantiImporti - 1; j >= 0; --j) {
+			if (temp.importi[j] != 0) {
+				printf(temp.sistema ? "* %.2f per %s " : "* %.2f %s ", temp.importi[j], getTipoDiPuntata(j, MINUSCOLO));
+			}
+		}
+		
+		if (temp.quanteEstrazioni == ABBONAMENTO) {
+			printf(temp.annullamento ? "(abbonamento annullato)" : "(abbonamento)");
+		}
+		else if (temp.quanteEstrazioni > 1) {
+			printf("(per %i estrazioni)", temp.quanteEstrazioni);
+		}
+		
+		printf("\n");
+		
+		// Dealloca campi di temp
+		free(temp.ruote);
+		free(temp.numeriGiocati);
+		free(temp.importi);
+		
+		i++;
+	}
+}
+
+/* Invia al server il comando di vedi_giocate <tipo> <filtri>.
  * Il comando mostra le giocate effettuate dall'utente che sono gia' state estratte (se il tipo e' 0)
- * o che non sono state ancora estratte (se tipo e' 1)
+ * o che non sono state ancora estratte (se tipo e' 1). I filtri (vedi leggiFiltroGiocate(...))
+ * vengono inviati solo se presenti e valutati dal server, che invia solo le schedine richieste.
  * Il messaggio da inviare e' nel formato
- *		------------------------------------------------
- *		| session_id (stringa + '\\0') | tipo (uint8_t) |
- *		------------------------------------------------
+ *		---------------------------------------------------------------------
+ *		| session_id (stringa + '\\0') | tipo (uint8_t) | filtri (opzionali) |
+ *		---------------------------------------------------------------------
  * 
  * Il messaggio ricevuto dal server (se il comando ha avuto successo) e' nel formato
  *		--------------------------------------------------
  *		| DATI (uint8_t) | schedine serializzate | '\\0' |
  *		--------------------------------------------------
- *  
+ * 
  * @socket descrittore del socket su cui comunicare
  * @parsed_comando comando dopo il parse
  * @session_id id di sessione da inviare
@@ -894,11 +1339,13 @@ int eseguiInviaGiocata (const int socket, char** parsed_comando, const size_t le
  * @return -1 in caso di errore, 0 se il server chiude la connessione,
  *     1 se il comando viene eseguito con successo, 2 se il comando fallisce
  */
-int eseguiVediGiocate (const int socket, char** parsed_comando, const char* session_id)
+int eseguiVediGiocate (const int socket, char** parsed_comando, const size_t len, const char* session_id)
 {
-	int ret, i, offset;
+	int ret;
 	uint8_t tipo;
-	char msg[LUNGHEZZA_SESSION_ID + 1 + sizeof(tipo)];
+	char msg[LUNGHEZZA_SESSION_ID + 1 + sizeof(tipo) + LUNGHEZZA_FILTRO_GIOCATE];
+	size_t lunghezza_msg = LUNGHEZZA_SESSION_ID + 1 + sizeof(tipo);
+	struct filtro_giocate filtro;
 	char* risposta;
 	uint16_t lunghezza_risposta;
 	
@@ -907,7 +1354,22 @@ int eseguiVediGiocate (const int socket, char** parsed_comando, const char* sess
 	memcpy(msg, session_id, LUNGHEZZA_SESSION_ID + 1);
 	memcpy(msg + LUNGHEZZA_SESSION_ID + 1, &tipo, sizeof(tipo));
 	
-	ret = inviaComando(socket, VEDI_GIOCATE, msg, LUNGHEZZA_SESSION_ID + 1 + sizeof(tipo));
+	// Filtri in formato network, campo per campo
+	if (leggiFiltroGiocate(parsed_comando, len, &filtro) > 0) {
+		uint16_t ruote = htons(filtro.ruote);
+		uint32_t da = htonl(filtro.da), a = htonl(filtro.a);
+		
+		memcpy(msg + lunghezza_msg, &ruote, sizeof(ruote));
+		lunghezza_msg += sizeof(ruote);
+		msg[lunghezza_msg++] = (char)filtro.numero;
+		memcpy(msg + lunghezza_msg, &da, sizeof(da));
+		lunghezza_msg += sizeof(da);
+		memcpy(msg + lunghezza_msg, &a, sizeof(a));
+		lunghezza_msg += sizeof(a);
+		msg[lunghezza_msg++] = (char)filtro.esito;
+	}
+	
+	ret = inviaComando(socket, VEDI_GIOCATE, msg, lunghezza_msg);
 	if (ret < 0) return -1;
 	
 	ret = attendiRisposta(socket, (void**)&risposta);
@@ -925,11 +1387,15 @@ int eseguiVediGiocate (const int socket, char** parsed_comando, const char* sess
 				printf("\n");
 				return_value = 1;
 				break;
-				
+			
 			case MESSAGGIO_NON_COMPRENSIBILE:
 				printf("Il comando e' errato\n");
 				break;
-				
+			
+			case RICHIESTE_ECCESSIVE:
+				printf("Errore: troppe richieste dal tuo IP. Riprova tra qualche secondo\n");
+				break;
+			
 			default:
 				printf("Errore sconosciuto\n");
 		}
@@ -944,105 +1410,973 @@ int eseguiVediGiocate (const int socket, char** parsed_comando, const char* sess
 		return 2;
 	}
 	
-	// STAMPA SCHEDINA
-	offset = 1;
-	i = 1;
-	while (offset < lunghezza_risposta - 1) { // non considerare il null terminator
-		struct schedina temp;
-		int quanti_byte_letti;
-		int j;
-		
-		// Deserializza le schedine
-		temp = deserializza_schedina_txt(risposta + offset, &quanti_byte_letti);
-		offset += quanti_byte_letti;
-		
-		// Stampa schedina a video
-		printf("%i) ", i);
-		
-		for (j = 0; j < temp.quanteRuote; ++j) {
-			printf("%s ", convertiRuotaIntToString(temp.ruote[j]));
+	// STAMPA SCHEDINE
+	stampaElencoSchedine(risposta + 1, lunghezza_risposta - 1);
+	fflush(stdout);
+	free(risposta);
+	
+	return 1;
+}
+
+/* Invia al server il comando di annulla_abbonamento <n>.
+ * Senza <n> mostra gli abbonamenti attivi dell'utente (numerati), altrimenti annulla l'abbonamento <n>:
+ * l'abbonamento non partecipa piu' alle estrazioni successive.
+ * Il messaggio da inviare e' nel formato (n = 0 se non e' specificato)
+ *		--------------------------------------------------
+ *		| session_id (stringa + '\\0') | n (uint32_t) |
+ *		--------------------------------------------------
+ * 
+ * @socket descrittore del socket su cui comunicare
+ * @parsed_comando comando dopo il parse
+ * @len lunghezza di parsed_comando
+ * @session_id id di sessione da inviare
+ * 
+ * @return -1 in caso di errore, 0 se il server chiude la connessione,
+ *     1 se il comando viene eseguito con successo, 2 se il comando fallisce
+ */
+int eseguiAnnullaAbbonamento (const int socket, char** parsed_comando, const size_t len, const char* session_id)
+{
+	int ret;
+	uint32_t n, n_hton;	// parametro n del comando, rispettivamente in formato host e network
+	char msg[LUNGHEZZA_SESSION_ID + 1 + sizeof(n)];
+	char* risposta;
+	uint16_t lunghezza_risposta;
+	
+	n = (len < 2) ? 0 : (uint32_t)atoi(parsed_comando[1]);
+	n_hton = htonl(n);
+	
+	memcpy(msg, session_id, LUNGHEZZA_SESSION_ID + 1);
+	memcpy(msg + LUNGHEZZA_SESSION_ID + 1, &n_hton, sizeof(n_hton));
+	
+	ret = inviaComando(socket, ANNULLA_ABBONAMENTO, msg, sizeof(msg));
+	if (ret < 0) return -1;
+	
+	ret = attendiRisposta(socket, (void**)&risposta);
+	if (ret <= 0) {
+		return (ret == 0) ? 0 : -1;
+	}
+	
+	lunghezza_risposta = ret;
+	
+	// Decodifica tipo di risposta
+	if (risposta[0] == ERR) {
+		int return_value = 2;	// valore di ritorno
+		switch ((uint8_t)risposta[1]){
+			case FILE_VUOTO:
+				printf("Non ci sono abbonamenti attivi\n");
+				return_value = 1;
+				break;
+			
+			case MESSAGGIO_NON_COMPRENSIBILE:
+				printf("Errore: l'abbonamento %u non esiste (vedere !annulla_abbonamento senza argomenti)\n", n);
+				break;
+			
+			case RICHIESTE_ECCESSIVE:
+				printf("Errore: troppe richieste dal tuo IP. Riprova tra qualche secondo\n");
+				break;
+			
+			default:
+				printf("Errore sconosciuto\n");
+		}
+		fflush(stdout);
+		free(risposta);
+		return return_value;
+	}
+	else if (risposta[0] != DATI) {
+		printf("Errore: risposta del server non comprensibile\n");
+		fflush(stdout);
+		free(risposta);
+		return 2;
+	}
+	
+	if (n != 0) {
+		printf("Abbonamento %u annullato\n", n);
+	}
+	else {
+		printf("Abbonamenti attivi:\n");
+		stampaElencoSchedine(risposta + 1, lunghezza_risposta - 1);
+	}
+	fflush(stdout);
+	free(risposta);
+	
+	return 1;
+}
+
+/* Invia al server il comando di vedi_esposizione <ruota> <numero> <secondo numero>.
+ * Mostra quanto il banco pagherebbe alla prossima estrazione (vincite di ESTRATTO e di AMBO)
+ * se sulla ruota venisse estratto il numero, oppure l'ambo formato dai due numeri.
+ * Il messaggio da inviare e' nel formato (secondo numero = 0 se non e' specificato)
+ *		-------------------------------------------------------------------------------------------
+ *		| session_id (stringa + '\\0') | ruota (uint8_t) | numero (uint32_t) | secondo numero (uint32_t) |
+ *		-------------------------------------------------------------------------------------------
+ * 
+ * @socket descrittore del socket su cui comunicare
+ * @parsed_comando comando dopo il parse
+ * @len lunghezza di parsed_comando
+ * @session_id id di sessione da inviare
+ * 
+ * @return -1 in caso di errore, 0 se il server chiude la connessione,
+ *     1 se il comando viene eseguito con successo, 2 se il comando fallisce
+ */
+int eseguiVediEsposizione (const int socket, char** parsed_comando, const size_t len, const char* session_id)
+{
+	int ret;
+	uint8_t ruota;
+	uint32_t primo, secondo;
+	char msg[LUNGHEZZA_SESSION_ID + 1 + sizeof(ruota) + sizeof(primo) + sizeof(secondo)];
+	char* risposta;
+	
+	ruota = (uint8_t)convertiRuotaStringToInt(parsed_comando[1]);
+	primo = htonl((uint32_t)atoi(parsed_comando[2]));
+	secondo = htonl((len < 4) ? 0 : (uint32_t)atoi(parsed_comando[3]));
+	
+	memcpy(msg, session_id, LUNGHEZZA_SESSION_ID + 1);
+	memcpy(msg + LUNGHEZZA_SESSION_ID + 1, &ruota, sizeof(ruota));
+	memcpy(msg + LUNGHEZZA_SESSION_ID + 1 + sizeof(ruota), &primo, sizeof(primo));
+	memcpy(msg + LUNGHEZZA_SESSION_ID + 1 + sizeof(ruota) + sizeof(primo), &secondo, sizeof(secondo));
+	
+	ret = inviaComando(socket, VEDI_ESPOSIZIONE, msg, sizeof(msg));
+	if (ret < 0) return -1;
+	
+	ret = attendiRisposta(socket, (void**)&risposta);
+	if (ret <= 0) {
+		return (ret == 0) ? 0 : -1;
+	}
+	
+	// Decodifica tipo di risposta
+	if (risposta[0] == ERR) {
+		switch ((uint8_t)risposta[1]){
+			case PERMESSO_NEGATO:
+				printf("Errore: il comando e' riservato all'utente %s\n", UTENTE_AMMINISTRATORE);
+				break;
+			
+			case MESSAGGIO_NON_COMPRENSIBILE:
+				printf("Errore: ruota o numeri non validi\n");
+				break;
+			
+			case RICHIESTE_ECCESSIVE:
+				printf("Errore: troppe richieste dal tuo IP. Riprova tra qualche secondo\n");
+				break;
+			
+			default:
+				printf("Errore sconosciuto\n");
+		}
+		fflush(stdout);
+		free(risposta);
+		return 2;
+	}
+	else if (risposta[0] != DATI) {
+		printf("Errore: risposta del server non comprensibile\n");
+		fflush(stdout);
+		free(risposta);
+		return 2;
+	}
+	
+	if (len < 4) {
+		printf("Esposizione su %s %s: %s\n", parsed_comando[1], parsed_comando[2], risposta + 1);
+	}
+	else {
+		printf("Esposizione su %s %s-%s: %s\n", parsed_comando[1], parsed_comando[2], parsed_comando[3], risposta + 1);
+	}
+	fflush(stdout);
+	free(risposta);
+	
+	return 1;
+}
+
+/* Invia al server il comando di imposta_periodo <periodo>.
+ * Cambia il periodo delle estrazioni del server, senza riavviarlo.
+ * Il messaggio da inviare e' nel formato
+ *		---------------------------------------------------------
+ *		| session_id (stringa + '\\0') | periodo in secondi (uint32_t) |
+ *		---------------------------------------------------------
+ * 
+ * @socket descrittore del socket su cui comunicare
+ * @parsed_comando comando dopo il parse
+ * @session_id id di sessione da inviare
+ * 
+ * @return -1 in caso di errore, 0 se il server chiude la connessione,
+ *     1 se il comando viene eseguito con successo, 2 se il comando fallisce
+ */
+int eseguiImpostaPeriodo (const int socket, char** parsed_comando, const char* session_id)
+{
+	int ret;
+	uint32_t periodo;
+	char msg[LUNGHEZZA_SESSION_ID + 1 + sizeof(periodo)];
+	char* risposta;
+	
+	periodo = convertiPeriodo(parsed_comando[1]);
+	
+	memcpy(msg, session_id, LUNGHEZZA_SESSION_ID + 1);
+	periodo = htonl(periodo);
+	memcpy(msg + LUNGHEZZA_SESSION_ID + 1, &periodo, sizeof(periodo));
+	
+	ret = inviaComando(socket, IMPOSTA_PERIODO, msg, sizeof(msg));
+	if (ret < 0) return -1;
+	
+	ret = attendiRisposta(socket, (void**)&risposta);
+	if (ret <= 0) {
+		return (ret == 0) ? 0 : -1;
+	}
+	
+	// Decodifica tipo di risposta
+	if (risposta[0] == ERR) {
+		switch ((uint8_t)risposta[1]){
+			case PERMESSO_NEGATO:
+				printf("Errore: il comando e' riservato all'utente %s\n", UTENTE_AMMINISTRATORE);
+				break;
+			
+			case MESSAGGIO_NON_COMPRENSIBILE:
+				printf("Errore: periodo non valido\n");
+				break;
+			
+			case RICHIESTE_ECCESSIVE:
+				printf("Errore: troppe richieste dal tuo IP. Riprova tra qualche secondo\n");
+				break;
+			
+			default:
+				printf("Errore sconosciuto\n");
+		}
+		fflush(stdout);
+		free(risposta);
+		return 2;
+	}
+	else if (risposta[0] != DATI) {
+		printf("Errore: risposta del server non comprensibile\n");
+		fflush(stdout);
+		free(risposta);
+		return 2;
+	}
+	
+	printf("Periodo delle estrazioni impostato a %u secondi\n", convertiPeriodo(parsed_comando[1]));
+	fflush(stdout);
+	free(risposta);
+	
+	return 1;
+}
+
+/* Invia al server il comando di vedi_estrazione <n> <ruota>.
+ * Mostra all'utente i risultati delle ultime n estrazioni sulla ruota specificata.
+ * Se la ruota non e' specificata, mostra le ultime n estrazioni di tutte le ruote.
+ * Il messaggio da inviare e' nel formato
+ *		-----------------------------------------------------------------
+ *		| session_id (stringa + '\\0') | n (uint32_t) | ruota (uint8_t) |
+ *		-----------------------------------------------------------------
+ * 
+ * @socket descrittore del socket su cui comunicare
+ * @parsed_comando comando dopo il parse
+ * @len lunghezza di parsed_comando
+ * @session_id id di sessione da inviare
+ * 
+ * @return -1 in caso di errore, 0 se il server chiude la connessione,
+ *     1 se il comando viene eseguito con successo, 2 se il comando fallisce
+ */
+int eseguiVediEstrazione (const int socket, char** parsed_comando, const size_t len, const char* session_id)
+{
+	int ret, i, quante_ruote_stampate;
+	uint32_t n, n_hton;	// parametro n del comando, rispettivamente in formato host e network
+	uint8_t ruota;
+	char msg[LUNGHEZZA_SESSION_ID + 1 + sizeof(n) + sizeof(ruota)];
+	uint8_t* risposta;
+	uint16_t lunghezza_risposta;
+	
+	// Lettura degli argomenti del comando
+	n = (uint32_t)atoi(parsed_comando[1]);
+	ruota = (len < 3) ? RUOTA_NON_SPECIFICATA : (uint8_t)convertiRuotaStringToInt(parsed_comando[2]);
+	
+	// Conversione di n in fomato network
+	n_hton = htonl(n);
+	
+	// Costruzione del messaggio
+	memcpy(msg, session_id, LUNGHEZZA_SESSION_ID + 1);
+	memcpy(msg + LUNGHEZZA_SESSION_ID + 1, &n_hton, sizeof(n_hton));
+	memcpy(msg + LUNGHEZZA_SESSION_ID + 1 + sizeof(n_hton), &ruota, sizeof(ruota));
+	
+	ret = inviaComando(socket, VEDI_ESTRAZIONE, msg, LUNGHEZZA_SESSION_ID + 1 + sizeof(n_hton) + sizeof(ruota));
+	if (ret < 0) return -1;
+	
+	ret = attendiRisposta(socket, (void**)&risposta);
+	if (ret <= 0) {
+		return ret;
+	}
+	
+	lunghezza_risposta = (uint16_t)ret;
+	
+	// Decodifica tipo di risposta
+	if (risposta[0] == ERR) {
+		switch ((uint8_t)risposta[1]){
+			case FILE_VUOTO: // Non stampare nulla, ma non segnalare nemmeno errore al chiamante
+				printf("\n");
+				return 1;
+			case MESSAGGIO_NON_COMPRENSIBILE:
+				printf("Il comando e' errato\n");
+				break;
+			case RICHIESTE_ECCESSIVE:
+				printf("Errore: troppe richieste dal tuo IP. Riprova tra qualche secondo\n");
+				break;
+			default:
+				printf("Errore sconosciuto\n");
+		}
+		fflush(stdout);
+		free(risposta);
+		return 2;
+	}
+	else if (risposta[0] != DATI) {
+		printf("Errore: risposta del server non comprensibile\n");
+		fflush(stdout);
+		free(risposta);
+		return 2;
+	}
+	
+	// STAMPA ESTRAZIONE
+	i = 1;
+	quante_ruote_stampate = 0;
+	
+	while (i < lunghezza_risposta) {
+		int j;
+		uint8_t ruota_da_stampare = (uint8_t)risposta[i];	// indice della ruota attualmente in esame
+		const char* ruota_da_stampare_string = convertiRuotaIntToString((int)ruota_da_stampare); // nome della suddetta ruota
+		
+		printf("%s\t", ruota_da_stampare_string);
+		
+		// Siccome alcune stringhe sono piu' lunghe di un tab, questa printf e' necessaria per allineare
+		// quelle meno corte a quelle piu' lunghe
+		if (strlen(ruota_da_stampare_string) < 8) {
+			printf("\t");
+		}
+		
+		// Stampa tutti i numeri estratti
+		for (j = 0; j < QUANTI_NUMERI_ESTRATTI; ++j) {
+			// Estrae il numero da stampare e lo converte in formato host
+			uint32_t numero_da_stampare_network = *(uint32_t*)(risposta + i + sizeof(uint8_t) + j * sizeof(uint32_t));
+			uint32_t numero_da_stampare = ntohl(numero_da_stampare_network);
+			
+			printf("%2u\t", numero_da_stampare);
+		}
+		
+		printf("\n");
+		
+		// Teniamo conto del numero delle ruote stampate cosicche', se l'utente ha richiesto
+		// le estrazioni di tutte le ruote, inseriamo un newline aggiuntivo per separare i blocchi
+		// di estrazioni distinti (ovvero andiamo a capo ogni volta che viene stampato un intero blocco di ruote,
+		// ovvero QUANTE_RUOTE ruote)
+		quante_ruote_stampate++;
+		if (ruota == RUOTA_NON_SPECIFICATA && (quante_ruote_stampate % QUANTE_RUOTE) == 0) {
+			printf("\n");
+		}
+		
+		fflush(stdout);
+		
+		i += (QUANTI_NUMERI_ESTRATTI * sizeof(uint32_t) + sizeof(uint8_t));
+	}
+	
+	printf("\n");
+	fflush(stdout);
+	
+	free(risposta);
+	return 1;
+}
+
+/* Invia al server il comando !cerca_estrazioni <da> <a> <ruote>.
+ * Mostra all'utente le estrazioni effettuate tra le date <da> e <a> (incluse) sulle ruote specificate.
+ * Se le ruote non sono specificate, mostra le estrazioni di tutte le ruote.
+ * Il messaggio da inviare e' nel formato
+ *		-------------------------------------------------------------------------------------------
+ *		| session_id (stringa + '\\0') | da (uint32_t) | a (uint32_t) | maschera ruote (uint16_t) |
+ *		-------------------------------------------------------------------------------------------
+ * 
+ * @socket descrittore del socket su cui comunicare
+ * @parsed_comando comando dopo il parse
+ * @len lunghezza di parsed_comando
+ * @session_id id di sessione da inviare
+ * 
+ * @return -1 in caso di errore, 0 se il server chiude la connessione,
+ *     1 se il comando viene eseguito con successo, 2 se il comando fallisce
+ */
+int eseguiCercaEstrazioni (const int socket, char** parsed_comando, const size_t len, const char* session_id)
+{
+	int ret, i, j, quante_ruote;
+	time_t da, a;
+	uint32_t da_hton, a_hton, quante_nell_intervallo, quante_inviate, ultimo_timestamp = 0;
+	uint16_t maschera = 0, maschera_hton;
+	char msg[LUNGHEZZA_SESSION_ID + 1 + 2 * sizeof(uint32_t) + sizeof(uint16_t)];
+	uint8_t* risposta;
+	uint16_t lunghezza_risposta;
+	size_t quanti_byte_letti;
+	
+	// Lettura degli argomenti del comando
+	convertiData(parsed_comando[1], 0, &da);
+	convertiData(parsed_comando[2], 1, &a);
+	for (i = 3; i < len; ++i) {
+		maschera |= (uint16_t)(1 << convertiRuotaStringToInt(parsed_comando[i]));
+	}
+	if (maschera == 0) {
+		maschera = (uint16_t)((1 << QUANTE_RUOTE) - 1);	// tutte le ruote
+	}
+	for (i = 0, quante_ruote = 0; i < QUANTE_RUOTE; ++i) {
+		if (maschera & (1 << i)) quante_ruote++;
+	}
+	
+	// Costruzione del messaggio
+	da_hton = htonl((uint32_t)da);
+	a_hton = htonl((uint32_t)a);
+	maschera_hton = htons(maschera);
+	memcpy(msg, session_id, LUNGHEZZA_SESSION_ID + 1);
+	memcpy(msg + LUNGHEZZA_SESSION_ID + 1, &da_hton, sizeof(da_hton));
+	memcpy(msg + LUNGHEZZA_SESSION_ID + 1 + sizeof(da_hton), &a_hton, sizeof(a_hton));
+	memcpy(msg + LUNGHEZZA_SESSION_ID + 1 + sizeof(da_hton) + sizeof(a_hton), &maschera_hton, sizeof(maschera_hton));
+	
+	ret = inviaComando(socket, CERCA_ESTRAZIONI, msg, sizeof(msg));
+	if (ret < 0) return -1;
+	
+	ret = attendiRisposta(socket, (void**)&risposta);
+	if (ret <= 0) {
+		return ret;
+	}
+	
+	lunghezza_risposta = (uint16_t)ret;
+	
+	// Decodifica tipo di risposta
+	if (risposta[0] == ERR) {
+		switch ((uint8_t)risposta[1]){
+			case FILE_VUOTO:
+				printf("Nessuna estrazione nell'intervallo richiesto\n");
+				fflush(stdout);
+				free(risposta);
+				return 1;
+			case MESSAGGIO_NON_COMPRENSIBILE:
+				printf("Il comando e' errato\n");
+				break;
+			case RICHIESTE_ECCESSIVE:
+				printf("Errore: troppe richieste dal tuo IP. Riprova tra qualche secondo\n");
+				break;
+			default:
+				printf("Errore sconosciuto\n");
+		}
+		fflush(stdout);
+		free(risposta);
+		return 2;
+	}
+	else if (risposta[0] != DATI || lunghezza_risposta < 1 + 2 * sizeof(uint32_t)) {
+		printf("Errore: risposta del server non comprensibile\n");
+		fflush(stdout);
+		free(risposta);
+		return 2;
+	}
+	
+	memcpy(&quante_nell_intervallo, risposta + 1, sizeof(uint32_t));
+	memcpy(&quante_inviate, risposta + 1 + sizeof(uint32_t), sizeof(uint32_t));
+	quante_nell_intervallo = ntohl(quante_nell_intervallo);
+	quante_inviate = ntohl(quante_inviate);
+	quanti_byte_letti = 1 + 2 * sizeof(uint32_t);
+	
+	// STAMPA ESTRAZIONI
+	for (i = 0; i < quante_inviate; ++i) {
+		time_t timestamp;
+		struct tm* timeinfo;
+		
+		memcpy(&ultimo_timestamp, risposta + quanti_byte_letti, sizeof(uint32_t));
+		ultimo_timestamp = ntohl(ultimo_timestamp);
+		quanti_byte_letti += sizeof(uint32_t);
+		
+		timestamp = (time_t)ultimo_timestamp;
+		timeinfo = localtime(&timestamp);
+		printf("Estrazione del %02i-%02i-%4i ore %02i:%02i\n", timeinfo->tm_mday, timeinfo->tm_mon + 1,
+				timeinfo->tm_year + 1900, timeinfo->tm_hour, timeinfo->tm_min);
+		
+		for (j = 0; j < quante_ruote; ++j) {
+			const char* ruota_da_stampare_string = convertiRuotaIntToString((int)risposta[quanti_byte_letti]);
+			int k;
+			
+			printf("%s\t", ruota_da_stampare_string);
+			if (strlen(ruota_da_stampare_string) < 8) {
+				printf("\t");
+			}
+			
+			for (k = 0; k < QUANTI_NUMERI_ESTRATTI; ++k) {
+				uint32_t numero;
+				
+				memcpy(&numero, risposta + quanti_byte_letti + sizeof(uint8_t) + k * sizeof(uint32_t), sizeof(numero));
+				printf("%2u\t", ntohl(numero));
+			}
+			printf("\n");
+			
+			quanti_byte_letti += (QUANTI_NUMERI_ESTRATTI * sizeof(uint32_t) + sizeof(uint8_t));
+		}
+		printf("\n");
+	}
+	
+	// Il server invia solo le estrazioni che entrano in un messaggio
+	if (quante_inviate < quante_nell_intervallo) {
+		time_t ultima = (time_t)ultimo_timestamp;
+		struct tm* timeinfo = localtime(&ultima);
+		
+		printf("Mostrate %u estrazioni su %u, fino all'estrazione del %02i-%02i-%4i ore %02i:%02i\n",
+				quante_inviate, quante_nell_intervallo, timeinfo->tm_mday, timeinfo->tm_mon + 1,
+				timeinfo->tm_year + 1900, timeinfo->tm_hour, timeinfo->tm_min);
+	}
+	fflush(stdout);
+	
+	free(risposta);
+	return 1;
+}
+
+/* Stampa l'elenco delle vincite ricevuto dal server.
+ * 
+ * @risposta stringa contenente le vincite deserializzate
+ * @lunghezza_risposta lunghezza della risposta 
+ */
+void stampaVincite (const char* risposta, const int lunghezza_riposta)
+{
+	int i, j, ret;
+	int quanti_byte_letti = 0;	// "cursore" per l'analisi della stringa risposta
+	
+	// Variabili per la deserializzazione
+	time_t timestamp;
+	long int timestamp_int;
+	int quante_ruote;
+	unsigned int ruota;
+	int quanti_numeri_vincenti;
+	int numero_vincente;
+	int quanti_importi_vinti;
+	double importo_vinto;
+	
+	struct tm* timeinfo;	// struttura per stampare il timestamp in formato personalizzato
+	double totale_vincite[QUANTI_TIPI_PREMIO]; // contiene il totale delle vincite per ogni tipo di puntata
+	
+	memset(totale_vincite, 0, sizeof(double) * QUANTI_TIPI_PREMIO);
+	
+	while (quanti_byte_letti < lunghezza_riposta - 1) {	// risposta e' terminata dal carattere '\0', che non va letto
+		// Preleva il timestamp e il numero delle ruote
+		sscanf(risposta + quanti_byte_letti, "%ld %i %n", &timestamp_int, &quante_ruote, &ret);
+		timestamp = (time_t)timestamp_int;
+		quanti_byte_letti += ret;
+
+		// Stampa il timestamp
+		timeinfo = localtime(&timestamp);
+		printf("Estrazione del %02i-%02i-%4i ore %02i:%02i\n", timeinfo->tm_mday, timeinfo->tm_mon,
+				timeinfo->tm_year + 1900, timeinfo->tm_hour, timeinfo->tm_min);
+
+		// Stampa le ruote vincenti
+		for (i = 0; i < quante_ruote; ++i) {
+			sscanf(risposta + quanti_byte_letti, "%u %i %n", &ruota, &quanti_numeri_vincenti, &ret);
+			quanti_byte_letti += ret;
+
+			printf("%s\t", convertiRuotaIntToString(ruota));
+
+			// Stampa i numeri vincenti
+			for (j = 0; j < quanti_numeri_vincenti; ++j) {
+				sscanf(risposta + quanti_byte_letti, "%i %n", &numero_vincente, &ret);
+				quanti_byte_letti += ret;
+
+				printf("%i ", numero_vincente);
+			}
+
+			printf("\t>>\t");
+
+			sscanf(risposta + quanti_byte_letti, "%i %n", &quanti_importi_vinti, &ret);
+			quanti_byte_letti += ret;
+
+			// Stampale vincite in denaro
+			for (j = 0; j < quanti_importi_vinti; ++j) {
+				sscanf(risposta + quanti_byte_letti, "%lf %n", &importo_vinto, &ret);
+				quanti_byte_letti += ret;
+
+				printf("%s %.2lf  ", getTipoDiPuntata(j, INIZIALE_MAIUSCOLA), importo_vinto);
+
+				totale_vincite[j] += importo_vinto;
+			}
+
+			printf("\n***********************************************\n");
+			
+			quanti_byte_letti++; // Ogni vincita e' separata da un carattere '|'
 		}
-		
-		for (j = 0; j < temp.quantiNumeri; ++j) {
-			printf("%i ", temp.numeriGiocati[j]);
+	}
+	
+	printf("\n");
+	
+	// Stampa i totale delle vincite
+	for (i = 0; i < QUANTI_TIPI_PREMIO; ++i) {
+		printf("Vincite su %s: %.2lf\n", getTipoDiPuntata(i, CAPS_LOCK), totale_vincite[i]);
+	}
+	
+	printf("\n");
+}
+
+/* Invia il comando !vedi_vincite. Il corpo del messaggio contiene soltanto il session_id
+ * 
+ * @socket socket su cui e' attiva la connessione con il server
+ * @session_id stringa contenente il session_id dell'utente
+ * 
+ * @return -1 in caso di fallimento, 0 se il server chiude la connessione, 1 in caso di esito positivo del comando
+ */
+int eseguiVediVincite (const int socket, const char* session_id)
+{
+	int ret;
+	char msg[LUNGHEZZA_SESSION_ID + 1]; // session_id + null terminator
+	uint8_t* risposta;
+	uint16_t lunghezza_risposta;
+	
+	// Crea il messaggio
+	memcpy(msg, session_id, LUNGHEZZA_SESSION_ID + 1);
+	
+	ret = inviaComando(socket, VEDI_VINCITE, msg, LUNGHEZZA_SESSION_ID + 1);
+	if (ret < 0) return -1;
+	
+	ret = attendiRisposta(socket, (void**)&risposta);
+	if (ret <= 0) return ret;
+	
+	lunghezza_risposta = (uint16_t)ret;
+	
+	// Decodifica la risposta
+	if (risposta[0] == ERR) {
+		switch ((uint8_t)risposta[1]){
+			case FILE_VUOTO: // Non stampare nulla, ma non segnalare nemmeno errore al chiamante
+				printf("\n");
+				return 1;
+			case MESSAGGIO_NON_COMPRENSIBILE:
+				printf("Il comando e' errato\n");
+				break;
+			case RICHIESTE_ECCESSIVE:
+				printf("Errore: troppe richieste dal tuo IP. Riprova tra qualche secondo\n");
+				break;
+			default:
+				printf("Errore sconosciuto\n");
 		}
-		
-		for (j = temp.quantiImporti - 1; j >= 0; --j) {
-			if (temp.importi[j] != 0) {
-				printf("* %.2f %s ", temp.importi[j], getTipoDiPuntata(j, MINUSCOLO));
-			}
+		fflush(stdout);
+		free(risposta);
+		return 2;
+	}
+	else if (risposta[0] != DATI) {
+		printf("Errore: risposta del server non comprensibile\n");
+		fflush(stdout);
+		free(risposta);
+		return 2;
+	}
+	
+	stampaVincite((char*)(risposta + 1), (int)lunghezza_risposta - 1);
+	return 1;
+}
+
+/* Invia il comando !vedi_riepilogo. Il corpo del messaggio contiene soltanto il session_id.
+ * Il server risponde con il riepilogo delle vincite in formato testuale
+ *		--------------------------------------------------------------------------------------
+ *		| totali per tipo di puntata (QUANTI_TIPI_PREMIO double) | quante schedine vincenti |
+ *		| vincita migliore (double) | timestamp vincita migliore | '\\0' |
+ *		--------------------------------------------------------------------------------------
+ * 
+ * @socket socket su cui e' attiva la connessione con il server
+ * @session_id stringa contenente il session_id dell'utente
+ * 
+ * @return -1 in caso di fallimento, 0 se il server chiude la connessione,
+ *     1 in caso di esito positivo del comando, 2 se il comando fallisce
+ */
+int eseguiVediRiepilogo (const int socket, const char* session_id)
+{
+	int ret, i, quanti_byte_letti = 1, char_letti;	// salta il primo byte (tipo del messaggio)
+	char msg[LUNGHEZZA_SESSION_ID + 1]; // session_id + null terminator
+	char* risposta;
+	
+	// Variabili per la deserializzazione
+	double totale_vincite[QUANTI_TIPI_PREMIO];
+	unsigned int quante_schedine_vincenti;
+	double vincita_migliore;
+	long int timestamp_int;
+	time_t timestamp;
+	struct tm* timeinfo;
+	
+	// Crea il messaggio
+	memcpy(msg, session_id, LUNGHEZZA_SESSION_ID + 1);
+	
+	ret = inviaComando(socket, VEDI_RIEPILOGO, msg, LUNGHEZZA_SESSION_ID + 1);
+	if (ret < 0) return -1;
+	
+	ret = attendiRisposta(socket, (void**)&risposta);
+	if (ret <= 0) return ret;
+	
+	if (risposta[0] != DATI) {
+		printf("Errore: impossibile ottenere il riepilogo delle vincite\n");
+		fflush(stdout);
+		free(risposta);
+		return 2;
+	}
+	
+	// Deserializza il riepilogo
+	for (i = 0; i < QUANTI_TIPI_PREMIO; ++i) {
+		sscanf(risposta + quanti_byte_letti, "%lf %n", &totale_vincite[i], &char_letti);
+		quanti_byte_letti += char_letti;
+	}
+	sscanf(risposta + quanti_byte_letti, "%u %lf %ld", &quante_schedine_vincenti, &vincita_migliore, &timestamp_int);
+	timestamp = (time_t)timestamp_int;
+	
+	// Stampa il riepilogo
+	for (i = 0; i < QUANTI_TIPI_PREMIO; ++i) {
+		printf("Vincite su %s: %.2lf\n", getTipoDiPuntata(i, CAPS_LOCK), totale_vincite[i]);
+	}
+	printf("Schedine vincenti: %u\n", quante_schedine_vincenti);
+	
+	if (quante_schedine_vincenti > 0) {
+		timeinfo = localtime(&timestamp);
+		printf("Vincita migliore: %.2lf (estrazione del %02i-%02i-%4i ore %02i:%02i)\n", vincita_migliore,
+				timeinfo->tm_mday, timeinfo->tm_mon + 1, timeinfo->tm_year + 1900, timeinfo->tm_hour, timeinfo->tm_min);
+	}
+	
+	printf("\n");
+	fflush(stdout);
+	free(risposta);
+	return 1;
+}
+
+/* Invia il comando !vedi_metriche. Il corpo del messaggio contiene soltanto il session_id.
+ * Il server risponde con le metriche in formato testuale, una per riga nel formato "nome valore"
+ * 
+ * @socket socket su cui e' attiva la connessione con il server
+ * @session_id stringa contenente il session_id dell'utente
+ * 
+ * @return -1 in caso di fallimento, 0 se il server chiude la connessione,
+ *     1 in caso di esito positivo del comando, 2 se il comando fallisce
+ */
+int eseguiVediMetriche (const int socket, const char* session_id)
+{
+	int ret;
+	char msg[LUNGHEZZA_SESSION_ID + 1]; // session_id + null terminator
+	char* risposta;
+	
+	memcpy(msg, session_id, LUNGHEZZA_SESSION_ID + 1);
+	
+	ret = inviaComando(socket, VEDI_METRICHE, msg, LUNGHEZZA_SESSION_ID + 1);
+	if (ret < 0) return -1;
+	
+	ret = attendiRisposta(socket, (void**)&risposta);
+	if (ret <= 0) return ret;
+	
+	if (risposta[0] == ERR && (uint8_t)risposta[1] == PERMESSO_NEGATO) {
+		printf("Errore: il comando e' riservato all'utente %s\n", UTENTE_AMMINISTRATORE);
+		fflush(stdout);
+		free(risposta);
+		return 2;
+	}
+	if (risposta[0] != DATI) {
+		printf("Errore: impossibile ottenere le metriche del server\n");
+		fflush(stdout);
+		free(risposta);
+		return 2;
+	}
+	
+	printf("%s\n", risposta + 1);
+	fflush(stdout);
+	free(risposta);
+	return 1;
+}
+
+/* Invia il comando !riprendi <session_id>, che riprende su questa connessione una sessione
+ * ottenuta con un login precedente. Il corpo del messaggio contiene soltanto il session_id.
+ * Se la sessione e' valida, il server risponde con lo username dell'utente
+ * 
+ * @socket socket su cui e' attiva la connessione con il server
+ * @parsed_comando comando dopo il parse
+ * @session_id stringa in cui memorizzare il session_id, se la sessione viene ripresa
+ * 
+ * @return -1 in caso di fallimento, 0 se il server chiude la connessione,
+ *     1 se la sessione e' stata ripresa, 2 se il comando fallisce
+ */
+int eseguiRiprendi (const int socket, char** parsed_comando, char* session_id)
+{
+	int ret;
+	char msg[LUNGHEZZA_SESSION_ID + 1]; // session_id + null terminator
+	char* risposta;
+	
+	memcpy(msg, parsed_comando[1], LUNGHEZZA_SESSION_ID + 1);
+	
+	ret = inviaComando(socket, RIPRENDI_SESSIONE, msg, LUNGHEZZA_SESSION_ID + 1);
+	if (ret < 0) return -1;
+	
+	ret = attendiRisposta(socket, (void**)&risposta);
+	if (ret <= 0) return ret;
+	
+	if (risposta[0] != DATI) {
+		if (risposta[1] == RICHIESTE_ECCESSIVE) {
+			printf("Errore: troppe richieste dal tuo IP. Riprova tra qualche secondo\n");
 		}
-		
-		printf("\n");
-		
-		// Dealloca campi di temp
-		free(temp.ruote);
-		free(temp.numeriGiocati);
-		free(temp.importi);
-		
-		i++;
+		else {
+			printf("Errore: sessione inesistente o scaduta. Effettuare il login\n");
+		}
+		fflush(stdout);
+		free(risposta);
+		return 2;
 	}
+	
+	memcpy(session_id, msg, LUNGHEZZA_SESSION_ID + 1);
+	printf("Sessione ripresa: utente %s\n", risposta + 1);
 	fflush(stdout);
 	free(risposta);
+	return 1;
+}
+
+/* Invia il comando !quota g, che mostra le probabilita' di vincita e la vincita attesa di una giocata
+ * senza inviarla. Il comando non richiede il login, percio' il messaggio contiene soltanto la schedina serializzata.
+ * Il messaggio ricevuto dal server (se il comando ha avuto successo) e' in formato testuale:
+ *		------------------------------------------------------------------------------------------
+ *		| importo totale | per ogni k da 0 a QUANTI_NUMERI_ESTRATTI: probabilita' di k numeri     |
+ *		| comuni su una ruota e vincita su una ruota | quanti importi | per ogni tipo di puntata: |
+ *		| probabilita' di vincerla su una ruota | vincita attesa per ruota | vincita attesa | '\0' |
+ *		------------------------------------------------------------------------------------------
+ * 
+ * @socket socket su cui e' attiva la connessione con il server
+ * @parsed_comando comando dopo il parse
+ * @len lunghezza di parsed_comando
+ * 
+ * @return -1 in caso di fallimento, 0 se il server chiude la connessione,
+ *     1 in caso di esito positivo del comando, 2 se il comando fallisce
+ */
+int eseguiQuota (const int socket, char** parsed_comando, const size_t len)
+{
+	int ret, i, quanti_importi, quanti_byte_letti = 0, char_letti;
+	struct schedina sched;
+	char* schedina_serializzata;
+	char* risposta;
+	uint16_t len_schedina_serializzata;
+	double importo, probabilita, vincita, vincita_attesa_ruota, vincita_attesa;
+	
+	costruisciSchedina(parsed_comando, len, &sched);
+	schedina_serializzata = serializza_schedina_txt(sched, &len_schedina_serializzata);
+	
+	ret = inviaComando(socket, QUOTA, schedina_serializzata, len_schedina_serializzata);
+	
+	free(schedina_serializzata);
+	free(sched.ruote);
+	free(sched.numeriGiocati);
+	free(sched.importi);
+	
+	if (ret < 0) return -1;
+	
+	ret = attendiRisposta(socket, (void**)&risposta);
+	if (ret <= 0) return ret;
+	
+	if (risposta[0] != DATI) {
+		if (risposta[1] == RICHIESTE_ECCESSIVE) {
+			printf("Errore: troppe richieste dal tuo IP. Riprova tra qualche secondo\n");
+		}
+		else {
+			printf("Errore: la giocata non e' valida (numeri o ruote ripetuti, numeri fuori da 1-%i,\n"
+					"       oppure importi su puntate che richiedono piu' numeri di quelli giocati)\n", NUMERI_ESTRAIBILI);
+		}
+		fflush(stdout);
+		free(risposta);
+		return 2;
+	}
+	
+	sscanf(risposta + 1, "%lf %n", &importo, &char_letti);
+	quanti_byte_letti += char_letti;
+	
+	// La quota si riferisce ad una estrazione: una giocata su piu' estrazioni ripete la stessa quota su ognuna
+	if (sched.quanteEstrazioni == 1) {
+		printf("Importo totale della giocata: %.2lf\n\n", importo);
+	}
+	else if (sched.quanteEstrazioni == ABBONAMENTO) {
+		printf("Importo della giocata per ogni estrazione dell'abbonamento: %.2lf\n"
+				"(probabilita' e vincite si riferiscono ad una estrazione)\n\n", importo);
+	}
+	else {
+		printf("Importo totale della giocata: %.2lf (%.2lf per ognuna delle %i estrazioni)\n"
+				"(probabilita' e vincite si riferiscono ad una estrazione)\n\n", importo * sched.quanteEstrazioni, importo, sched.quanteEstrazioni);
+	}
+	printf("Numeri estratti tra quelli giocati, su una ruota:\n");
+	for (i = 0; i <= QUANTI_NUMERI_ESTRATTI; ++i) {
+		sscanf(risposta + 1 + quanti_byte_letti, "%lf %lf %n", &probabilita, &vincita, &char_letti);
+		quanti_byte_letti += char_letti;
+		printf("  %i: probabilita' %.6e, vincita %.2lf\n", i, probabilita, vincita);
+	}
+	
+	printf("\nProbabilita' di vincere su una ruota:\n");
+	sscanf(risposta + 1 + quanti_byte_letti, "%i %n", &quanti_importi, &char_letti);
+	quanti_byte_letti += char_letti;
+	for (i = 0; i < quanti_importi; ++i) {
+		sscanf(risposta + 1 + quanti_byte_letti, "%lf %n", &probabilita, &char_letti);
+		quanti_byte_letti += char_letti;
+		printf("  %s: 1 su %.1lf (%.6e)\n", getTipoDiPuntata(i, INIZIALE_MAIUSCOLA), 1 / probabilita, probabilita);
+	}
+	
+	sscanf(risposta + 1 + quanti_byte_letti, "%lf %lf", &vincita_attesa_ruota, &vincita_attesa);
+	printf("\nVincita attesa per ruota: %.4lf\n", vincita_attesa_ruota);
+	printf("Vincita attesa: %.4lf (ritorno per il giocatore %.2lf%%)\n\n", vincita_attesa,
+			(importo > 0) ? 100 * vincita_attesa / importo : 0);
+	fflush(stdout);
 	
+	free(risposta);
 	return 1;
 }
 
-/* Invia al server il comando di vedi_estrazione <n> <ruota>.
- * Mostra all'utente i risultati delle ultime n estrazioni sulla ruota specificata.
- * Se la ruota non e' specificata, mostra le ultime n estrazioni di tutte le ruote.
+/* Invia al server il comando !replay <da> <a> g, che gioca la giocata g su ogni estrazione effettuata
+ * tra le date <da> e <a> (incluse) e mostra quanto avrebbe vinto.
  * Il messaggio da inviare e' nel formato
- *		-----------------------------------------------------------------
- *		| session_id (stringa + '\\0') | n (uint32_t) | ruota (uint8_t) |
- *		-----------------------------------------------------------------
- *  
- * @socket descrittore del socket su cui comunicare
+ *		----------------------------------------------------------------------------------------
+ *		| session_id (stringa + '\\0') | da (uint32_t) | a (uint32_t) | schedina (serializzata) |
+ *		----------------------------------------------------------------------------------------
+ * 
+ * @socket socket su cui e' attiva la connessione con il server
  * @parsed_comando comando dopo il parse
  * @len lunghezza di parsed_comando
  * @session_id id di sessione da inviare
  * 
- * @return -1 in caso di errore, 0 se il server chiude la connessione,
- *     1 se il comando viene eseguito con successo, 2 se il comando fallisce
+ * @return -1 in caso di fallimento, 0 se il server chiude la connessione,
+ *     1 in caso di esito positivo del comando, 2 se il comando fallisce
  */
-int eseguiVediEstrazione (const int socket, char** parsed_comando, const size_t len, const char* session_id)
+int eseguiReplay (const int socket, char** parsed_comando, const size_t len, const char* session_id)
 {
-	int ret, i, quante_ruote_stampate;
-	uint32_t n, n_hton;	// parametro n del comando, rispettivamente in formato host e network
-	uint8_t ruota;
-	char msg[LUNGHEZZA_SESSION_ID + 1 + sizeof(n) + sizeof(ruota)];
-	uint8_t* risposta;
-	uint16_t lunghezza_risposta;
-	
-	// Lettura degli argomenti del comando
-	n = (uint32_t)atoi(parsed_comando[1]);
-	ruota = (len < 3) ? RUOTA_NON_SPECIFICATA : (uint8_t)convertiRuotaStringToInt(parsed_comando[2]);
-	
-	// Conversione di n in fomato network
-	n_hton = htonl(n);
+	int ret, i, quanti_importi, quante_migliori, quanti_byte_letti = 0, char_letti;
+	struct schedina sched;
+	char* schedina_serializzata;
+	char* messaggio;
+	char* risposta;
+	uint16_t len_schedina_serializzata;
+	time_t da, a;
+	uint32_t da_hton, a_hton;
+	unsigned long quante_estrazioni;
+	unsigned int estrazioni_vincenti;
+	double importo, vincita;
+	const size_t inizio_schedina = LUNGHEZZA_SESSION_ID + 1 + 2 * sizeof(uint32_t);
+	
+	convertiData(parsed_comando[1], 0, &da);
+	convertiData(parsed_comando[2], 1, &a);
+	
+	// La giocata inizia dopo le date: parsed_comando + 2 ha la stessa forma di un comando !quota
+	costruisciSchedina(parsed_comando + 2, len - 2, &sched);
+	schedina_serializzata = serializza_schedina_txt(sched, &len_schedina_serializzata);
+	free(sched.ruote);
+	free(sched.numeriGiocati);
+	free(sched.importi);
 	
-	// Costruzione del messaggio
-	memcpy(msg, session_id, LUNGHEZZA_SESSION_ID + 1);
-	memcpy(msg + LUNGHEZZA_SESSION_ID + 1, &n_hton, sizeof(n_hton));
-	memcpy(msg + LUNGHEZZA_SESSION_ID + 1 + sizeof(n_hton), &ruota, sizeof(ruota));
+	// Crea il messaggio
+	da_hton = htonl((uint32_t)da);
+	a_hton = htonl((uint32_t)a);
+	messaggio = malloc(inizio_schedina + len_schedina_serializzata);
+	strcpy(messaggio, session_id);
+	memcpy(messaggio + LUNGHEZZA_SESSION_ID + 1, &da_hton, sizeof(da_hton));
+	memcpy(messaggio + LUNGHEZZA_SESSION_ID + 1 + sizeof(da_hton), &a_hton, sizeof(a_hton));
+	memcpy(messaggio + inizio_schedina, schedina_serializzata, len_schedina_serializzata);
+	free(schedina_serializzata);
 	
-	ret = inviaComando(socket, VEDI_ESTRAZIONE, msg, LUNGHEZZA_SESSION_ID + 1 + sizeof(n_hton) + sizeof(ruota));
+	ret = inviaComando(socket, REPLAY, messaggio, inizio_schedina + len_schedina_serializzata);
+	free(messaggio);
 	if (ret < 0) return -1;
 	
 	ret = attendiRisposta(socket, (void**)&risposta);
-	if (ret <= 0) {
-		return ret;
-	}
-	
-	lunghezza_risposta = (uint16_t)ret;
+	if (ret <= 0) return ret;
 	
-	// Decodifica tipo di risposta
-	if (risposta[0] == ERR) {
-		switch ((uint8_t)risposta[1]){
-			case FILE_VUOTO: // Non stampare nulla, ma non segnalare nemmeno errore al chiamante
-				printf("\n");
+	if (risposta[0] != DATI) {
+		switch ((uint8_t)risposta[1]) {
+			case FILE_VUOTO:
+				printf("Nessuna estrazione nell'intervallo richiesto\n");
+				fflush(stdout);
+				free(risposta);
 				return 1;
 			case MESSAGGIO_NON_COMPRENSIBILE:
-				printf("Il comando e' errato\n");
+				printf("Errore: la giocata non e' valida (numeri o ruote ripetuti, numeri fuori da 1-%i,\n"
+						"       oppure importi su puntate che richiedono piu' numeri di quelli giocati)\n", NUMERI_ESTRAIBILI);
+				break;
+			case RICHIESTE_ECCESSIVE:
+				printf("Errore: troppe richieste dal tuo IP. Riprova tra qualche secondo\n");
 				break;
 			default:
 				printf("Errore sconosciuto\n");
@@ -1051,55 +2385,44 @@ int eseguiVediEstrazione (const int socket, char** parsed_comando, const size_t
 		free(risposta);
 		return 2;
 	}
-	else if (risposta[0] != DATI) {
-		printf("Errore: risposta del server non comprensibile\n");
-		fflush(stdout);
-		free(risposta);
-		return 2;
-	}
 	
-	// STAMPA ESTRAZIONE
-	i = 1;
-	quante_ruote_stampate = 0;
+	sscanf(risposta + 1, "%lu %lf %lf %u %i %n", &quante_estrazioni, &importo, &vincita, &estrazioni_vincenti,
+			&quanti_importi, &char_letti);
+	quanti_byte_letti += char_letti;
 	
-	while (i < lunghezza_risposta) {
-		int j;
-		uint8_t ruota_da_stampare = (uint8_t)risposta[i];	// indice della ruota attualmente in esame
-		const char* ruota_da_stampare_string = convertiRuotaIntToString((int)ruota_da_stampare); // nome della suddetta ruota
-		
-		printf("%s\t", ruota_da_stampare_string);
-		
-		// Siccome alcune stringhe sono piu' lunghe di un tab, questa printf e' necessaria per allineare
-		// quelle meno corte a quelle piu' lunghe
-		if (strlen(ruota_da_stampare_string) < 8) {
-			printf("\t");
-		}
-		
-		// Stampa tutti i numeri estratti
-		for (j = 0; j < QUANTI_NUMERI_ESTRATTI; ++j) {
-			// Estrae il numero da stampare e lo converte in formato host
-			uint32_t numero_da_stampare_network = *(uint32_t*)(risposta + i + sizeof(uint8_t) + j * sizeof(uint32_t));
-			uint32_t numero_da_stampare = ntohl(numero_da_stampare_network);
-			
-			printf("%2u\t", numero_da_stampare);
-		}
-		
-		printf("\n");
+	printf("Estrazioni giocate: %lu\n", quante_estrazioni);
+	printf("Importo giocato: %.2lf\n", importo);
+	printf("Vincita totale: %.2lf (ritorno per il giocatore %.2lf%%)\n", vincita, (importo > 0) ? 100 * vincita / importo : 0);
+	printf("Estrazioni vincenti: %u\n\n", estrazioni_vincenti);
+	
+	for (i = 0; i < quanti_importi; ++i) {
+		unsigned int vincenti;
+		double vincita_puntata;
 		
-		// Teniamo conto del numero delle ruote stampate cosicche', se l'utente ha richiesto
-		// le estrazioni di tutte le ruote, inseriamo un newline aggiuntivo per separare i blocchi
-		// di estrazioni distinti (ovvero andiamo a capo ogni volta che viene stampato un intero blocco di ruote,
-		// ovvero QUANTE_RUOTE ruote)
-		quante_ruote_stampate++;
-		if (ruota == RUOTA_NON_SPECIFICATA && (quante_ruote_stampate % QUANTE_RUOTE) == 0) {
-			printf("\n");
-		}
+		sscanf(risposta + 1 + quanti_byte_letti, "%u %lf %n", &vincenti, &vincita_puntata, &char_letti);
+		quanti_byte_letti += char_letti;
+		printf("  %s: vinto in %u estrazioni, per %.2lf\n", getTipoDiPuntata(i, INIZIALE_MAIUSCOLA), vincenti, vincita_puntata);
+	}
+	
+	sscanf(risposta + 1 + quanti_byte_letti, "%i %n", &quante_migliori, &char_letti);
+	quanti_byte_letti += char_letti;
+	if (quante_migliori > 0) {
+		printf("\nEstrazioni con la vincita piu' alta:\n");
+	}
+	for (i = 0; i < quante_migliori; ++i) {
+		long timestamp_letto;
+		double vincita_estrazione;
+		time_t timestamp;
+		struct tm* timeinfo;
 		
-		fflush(stdout);
+		sscanf(risposta + 1 + quanti_byte_letti, "%ld %lf %n", &timestamp_letto, &vincita_estrazione, &char_letti);
+		quanti_byte_letti += char_letti;
 		
-		i += (QUANTI_NUMERI_ESTRATTI * sizeof(uint32_t) + sizeof(uint8_t));
+		timestamp = (time_t)timestamp_letto;
+		timeinfo = localtime(&timestamp);
+		printf("  %02i-%02i-%4i ore %02i:%02i --> %.2lf\n", timeinfo->tm_mday, timeinfo->tm_mon + 1,
+				timeinfo->tm_year + 1900, timeinfo->tm_hour, timeinfo->tm_min, vincita_estrazione);
 	}
-	
 	printf("\n");
 	fflush(stdout);
 	
@@ -1107,137 +2430,105 @@ int eseguiVediEstrazione (const int socket, char** parsed_comando, const size_t
 	return 1;
 }
 
-/* Stampa l'elenco delle vincite ricevuto dal server.
- * 
- * @risposta stringa contenente le vincite deserializzate
- * @lunghezza_risposta lunghezza della risposta 
- */
-void stampaVincite (const char* risposta, const int lunghezza_riposta)
-{
-	int i, j, ret;
-	int quanti_byte_letti = 0;	// "cursore" per l'analisi della stringa risposta
-	
-	// Variabili per la deserializzazione
-	time_t timestamp;
-	long int timestamp_int;
-	int quante_ruote;
-	unsigned int ruota;
-	int quanti_numeri_vincenti;
-	int numero_vincente;
-	int quanti_importi_vinti;
-	double importo_vinto;
-	
-	struct tm* timeinfo;	// struttura per stampare il timestamp in formato personalizzato
-	double totale_vincite[QUANTI_TIPI_PREMIO]; // contiene il totale delle vincite per ogni tipo di puntata
-	
-	memset(totale_vincite, 0, sizeof(double) * QUANTI_TIPI_PREMIO);
-	
-	while (quanti_byte_letti < lunghezza_riposta - 1) {	// risposta e' terminata dal carattere '\0', che non va letto
-		// Preleva il timestamp e il numero delle ruote
-		sscanf(risposta + quanti_byte_letti, "%ld %i %n", &timestamp_int, &quante_ruote, &ret);
-		timestamp = (time_t)timestamp_int;
-		quanti_byte_letti += ret;
-
-		// Stampa il timestamp
-		timeinfo = localtime(&timestamp);
-		printf("Estrazione del %02i-%02i-%4i ore %02i:%02i\n", timeinfo->tm_mday, timeinfo->tm_mon,
-				timeinfo->tm_year + 1900, timeinfo->tm_hour, timeinfo->tm_min);
-
-		// Stampa le ruote vincenti
-		for (i = 0; i < quante_ruote; ++i) {
-			sscanf(risposta + quanti_byte_letti, "%u %i %n", &ruota, &quanti_numeri_vincenti, &ret);
-			quanti_byte_letti += ret;
-
-			printf("%s\t", convertiRuotaIntToString(ruota));
-
-			// Stampa i numeri vincenti
-			for (j = 0; j < quanti_numeri_vincenti; ++j) {
-				sscanf(risposta + quanti_byte_letti, "%i %n", &numero_vincente, &ret);
-				quanti_byte_letti += ret;
-
-				printf("%i ", numero_vincente);
-			}
-
-			printf("\t>>\t");
-
-			sscanf(risposta + quanti_byte_letti, "%i %n", &quanti_importi_vinti, &ret);
-			quanti_byte_letti += ret;
-
-			// Stampale vincite in denaro
-			for (j = 0; j < quanti_importi_vinti; ++j) {
-				sscanf(risposta + quanti_byte_letti, "%lf %n", &importo_vinto, &ret);
-				quanti_byte_letti += ret;
-
-				printf("%s %.2lf  ", getTipoDiPuntata(j, INIZIALE_MAIUSCOLA), importo_vinto);
-
-				totale_vincite[j] += importo_vinto;
-			}
-
-			printf("\n***********************************************\n");
-			
-			quanti_byte_letti++; // Ogni vincita e' separata da un carattere '|'
-		}
-	}
-	
-	printf("\n");
-	
-	// Stampa i totale delle vincite
-	for (i = 0; i < QUANTI_TIPI_PREMIO; ++i) {
-		printf("Vincite su %s: %.2lf\n", getTipoDiPuntata(i, CAPS_LOCK), totale_vincite[i]);
-	}
-	
-	printf("\n");
-}
-
-/* Invia il comando !vedi_vincite. Il corpo del messaggio contiene soltanto il session_id
+/* Invia il comando !statistiche <ruota>, che mostra frequenza e ritardo di ogni numero della ruota
+ * e gli ambi usciti piu' spesso. Il comando non richiede il login, percio' il messaggio contiene soltanto la ruota.
+ * Il messaggio ricevuto dal server (se il comando ha avuto successo) e' in formato testuale:
+ *		-----------------------------------------------------------------------------------------
+ *		| estrazioni | per ogni numero da 1 a NUMERI_ESTRAIBILI: frequenza e ritardo |          |
+ *		| quanti ambi | per ogni ambo: primo numero, secondo numero e frequenza | '\0'        |
+ *		-----------------------------------------------------------------------------------------
  * 
  * @socket socket su cui e' attiva la connessione con il server
- * @session_id stringa contenente il session_id dell'utente
+ * @parsed_comando comando dopo il parse
  * 
- * @return -1 in caso di fallimento, 0 se il server chiude la connessione, 1 in caso di esito positivo del comando
+ * @return -1 in caso di fallimento, 0 se il server chiude la connessione,
+ *     1 in caso di esito positivo del comando, 2 se il comando fallisce
  */
-int eseguiVediVincite (const int socket, const char* session_id)
+int eseguiStatistiche (const int socket, char** parsed_comando)
 {
-	int ret;
-	char msg[LUNGHEZZA_SESSION_ID + 1]; // session_id + null terminator
-	uint8_t* risposta;
-	uint16_t lunghezza_risposta;
+	int ret, i, quanti_byte_letti = 0, char_letti;
+	uint8_t ruota;
+	char* risposta;
+	unsigned int estrazioni, quanti_ambi, frequenze[NUMERI_ESTRAIBILI], ritardi[NUMERI_ESTRAIBILI];
+	int ritardatari[QUANTI_NUMERI_RITARDATARI];	// numeri con il ritardo maggiore, in ordine decrescente
 	
-	// Crea il messaggio
-	memcpy(msg, session_id, LUNGHEZZA_SESSION_ID + 1);
+	ruota = (uint8_t)convertiRuotaStringToInt(parsed_comando[1]);
 	
-	ret = inviaComando(socket, VEDI_VINCITE, msg, LUNGHEZZA_SESSION_ID + 1);
+	ret = inviaComando(socket, STATISTICHE, &ruota, sizeof(ruota));
 	if (ret < 0) return -1;
 	
 	ret = attendiRisposta(socket, (void**)&risposta);
 	if (ret <= 0) return ret;
 	
-	lunghezza_risposta = (uint16_t)ret;
-	
-	// Decodifica la risposta
-	if (risposta[0] == ERR) {
-		switch ((uint8_t)risposta[1]){
-			case FILE_VUOTO: // Non stampare nulla, ma non segnalare nemmeno errore al chiamante
-				printf("\n");
-				return 1;
-			case MESSAGGIO_NON_COMPRENSIBILE:
-				printf("Il comando e' errato\n");
-				break;
-			default:
-				printf("Errore sconosciuto\n");
+	if (risposta[0] != DATI) {
+		if (risposta[1] == RICHIESTE_ECCESSIVE) {
+			printf("Errore: troppe richieste dal tuo IP. Riprova tra qualche secondo\n");
+		}
+		else {
+			printf("Errore: ruota non valida\n");
 		}
 		fflush(stdout);
 		free(risposta);
 		return 2;
 	}
-	else if (risposta[0] != DATI) {
-		printf("Errore: risposta del server non comprensibile\n");
+	
+	sscanf(risposta + 1, "%u %n", &estrazioni, &char_letti);
+	quanti_byte_letti += char_letti;
+	for (i = 0; i < NUMERI_ESTRAIBILI; ++i) {
+		sscanf(risposta + 1 + quanti_byte_letti, "%u %u %n", &frequenze[i], &ritardi[i], &char_letti);
+		quanti_byte_letti += char_letti;
+	}
+	
+	printf("Ruota di %s: %u estrazioni\n\n", convertiRuotaIntToString(ruota), estrazioni);
+	if (estrazioni == 0) {
 		fflush(stdout);
 		free(risposta);
-		return 2;
+		return 1;
 	}
 	
-	stampaVincite((char*)(risposta + 1), (int)lunghezza_risposta - 1);
+	// Tabella dei numeri su tre colonne: numero, uscite, ritardo
+	for (i = 0; i < NUMERI_ESTRAIBILI / 3; ++i) {
+		int colonna;
+		
+		for (colonna = 0; colonna < 3; ++colonna) {
+			int n = i + colonna * (NUMERI_ESTRAIBILI / 3);
+			
+			printf("  %2i: %4u uscite, ritardo %-6u", n + 1, frequenze[n], ritardi[n]);
+		}
+		printf("\n");
+	}
+	
+	// Ritardatari: numeri con il ritardo maggiore (a parita' di ritardo, il numero minore)
+	for (i = 0; i < QUANTI_NUMERI_RITARDATARI; ++i) {
+		int n, j, migliore = -1;
+		
+		for (n = 0; n < NUMERI_ESTRAIBILI; ++n) {
+			for (j = 0; j < i && ritardatari[j] != n; ++j);
+			if (j == i && (migliore < 0 || ritardi[n] > ritardi[migliore])) {
+				migliore = n;
+			}
+		}
+		ritardatari[i] = migliore;
+	}
+	printf("\nRitardatari:");
+	for (i = 0; i < QUANTI_NUMERI_RITARDATARI; ++i) {
+		printf(" %i (%u)", ritardatari[i] + 1, ritardi[ritardatari[i]]);
+	}
+	
+	sscanf(risposta + 1 + quanti_byte_letti, "%u %n", &quanti_ambi, &char_letti);
+	quanti_byte_letti += char_letti;
+	printf("\nAmbi piu' frequenti:");
+	for (i = 0; i < (int)quanti_ambi; ++i) {
+		unsigned int primo, secondo, frequenza;
+		
+		sscanf(risposta + 1 + quanti_byte_letti, "%u %u %u %n", &primo, &secondo, &frequenza, &char_letti);
+		quanti_byte_letti += char_letti;
+		printf(" %u-%u (%u)", primo, secondo, frequenza);
+	}
+	printf("\n\n");
+	fflush(stdout);
+	
+	free(risposta);
 	return 1;
 }
 
@@ -1311,17 +2602,18 @@ int main (int argc, char** argv)
 		
 		tipo_comando = ret;
 		
-		// Se l'utente ha gia' effettuato il login, non sono ammessi i comandi !login e !signup
-		if (loggato && (tipo_comando == C_SIGNUP || tipo_comando == C_LOGIN)) {
+		// Se l'utente ha gia' effettuato il login, non sono ammessi i comandi !login, !signup e !riprendi
+		if (loggato && (tipo_comando == C_SIGNUP || tipo_comando == C_LOGIN || tipo_comando == C_RIPRENDI)) {
 			printf("Errore: L'utente ha gia' effettuato il login sul server. "
 						"Per favore disconnettersi prima di accedere con un nuovo account\n");
 			continue;
 		}
 		
 		// Se l'utente non ha ancora effettuato il login, sono ammessi solo i comandi
-		// !login, !signup, !help e !esci
+		// !login, !signup, !riprendi, !quota, !statistiche, !help e !esci
 		if (!loggato && tipo_comando != C_SIGNUP && tipo_comando != C_HELP 
-					&& tipo_comando != C_LOGIN && tipo_comando != C_ESCI) {
+					&& tipo_comando != C_LOGIN && tipo_comando != C_RIPRENDI && tipo_comando != C_QUOTA
+					&& tipo_comando != C_STATISTICHE && tipo_comando != C_ESCI) {
 			printf("Errore: L'utente deve prima effettuare il login\n");
 			continue;
 		}
@@ -1344,7 +2636,7 @@ int main (int argc, char** argv)
 				ret = eseguiInviaGiocata(client_socket, parsed_comando, len_parsed_comando, session_id);
 				break;
 			case C_VEDI_GIOCATE:
-				ret = eseguiVediGiocate(client_socket, parsed_comando, session_id);
+				ret = eseguiVediGiocate(client_socket, parsed_comando, len_parsed_comando, session_id);
 				break;
 			case C_VEDI_ESTRAZIONE:
 				ret = eseguiVediEstrazione(client_socket, parsed_comando, len_parsed_comando, session_id);
@@ -1352,11 +2644,52 @@ int main (int argc, char** argv)
 			case C_VEDI_VINCITE:
 				ret = eseguiVediVincite(client_socket, session_id);
 				break;
+			case C_VEDI_RIEPILOGO:
+				ret = eseguiVediRiepilogo(client_socket, session_id);
+				break;
+			case C_VEDI_METRICHE:
+				ret = eseguiVediMetriche(client_socket, session_id);
+				break;
+			case C_RIPRENDI:
+				ret = eseguiRiprendi(client_socket, parsed_comando, session_id);
+				loggato = (ret == 1) ? 1 : 0;
+				break;
+			case C_QUOTA:
+				ret = eseguiQuota(client_socket, parsed_comando, len_parsed_comando);
+				break;
+			case C_ANNULLA_ABBONAMENTO:
+				ret = eseguiAnnullaAbbonamento(client_socket, parsed_comando, len_parsed_comando, session_id);
+				break;
+			case C_VEDI_ESPOSIZIONE:
+				ret = eseguiVediEsposizione(client_socket, parsed_comando, len_parsed_comando, session_id);
+				break;
+			case C_STATISTICHE:
+				ret = eseguiStatistiche(client_socket, parsed_comando);
+				break;
+			case C_CERCA_ESTRAZIONI:
+				ret = eseguiCercaEstrazioni(client_socket, parsed_comando, len_parsed_comando, session_id);
+				break;
+			case C_REPLAY:
+				ret = eseguiReplay(client_socket, parsed_comando, len_parsed_comando, session_id);
+				break;
+			case C_IMPOSTA_PERIODO:
+				ret = eseguiImpostaPeriodo(client_socket, parsed_comando, session_id);
+				break;
 			case C_ESCI:
 				disconnetti = 1;
 				break;
 		}
 		
+		// Il server ha rifiutato il session id: e' necessario un nuovo login (o !riprendi)
+		if (sessione_non_valida) {
+			if (loggato) {
+				printf("La sessione e' scaduta. Effettuare di nuovo il login\n");
+				fflush(stdout);
+			}
+			sessione_non_valida = 0;
+			loggato = 0;
+		}
+		
 		// Libera memoria dinamica allocata
 		for (i = 0; i < len_parsed_comando; ++i) {
 			free(parsed_comando[i]);
@@ -0,0 +1,148 @@
+#include "lotto_colonne.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+// Byte occupati da un'estrazione nel file colonnare di una ruota
+#define LUNGHEZZA_RECORD_COLONNA QUANTI_NUMERI_ESTRATTI
+
+static char percorsi_colonne[QUANTE_RUOTE][512];
+
+// Stato dei file colonnari nel processo principale
+static long quante_colonne = 0;			// estrazioni presenti in tutti i file colonnari
+static int colonne_sospese = 0;			// 1 dopo un errore di scrittura: i file non vengono piu' estesi fino al riavvio
+
+/* Crea (o apre) i file colonnari delle ruote e li allinea tra loro
+ * 
+ * @prefisso prefisso del percorso dei file
+ * @quante_estrazioni numero delle estrazioni nel file delle estrazioni
+ * 
+ * @return numero delle estrazioni presenti nei file colonnari, -1 in caso di errore
+ */
+long inizializzaColonne (const char* prefisso, uint32_t quante_estrazioni)
+{
+	long quante = (long)quante_estrazioni;
+	int ruota, fd;
+	struct stat info;
+	
+	// Numero delle estrazioni presenti in tutti i file
+	for (ruota = 0; ruota < QUANTE_RUOTE; ++ruota) {
+		snprintf(percorsi_colonne[ruota], sizeof(percorsi_colonne[ruota]), "%s%i.bin", prefisso, ruota);
+		
+		fd = open(percorsi_colonne[ruota], O_RDONLY | O_CREAT, 0644);
+		if (fd < 0 || fstat(fd, &info) < 0) {
+			perror("Impossibile aprire file colonnare");
+			if (fd >= 0) close(fd);
+			return -1;
+		}
+		close(fd);
+		
+		if (info.st_size / LUNGHEZZA_RECORD_COLONNA < quante) {
+			quante = (long)(info.st_size / LUNGHEZZA_RECORD_COLONNA);
+		}
+	}
+	
+	// Le estrazioni oltre quelle comuni (o i record incompleti) vengono rimosse
+	for (ruota = 0; ruota < QUANTE_RUOTE; ++ruota) {
+		if (truncate(percorsi_colonne[ruota], (off_t)quante * LUNGHEZZA_RECORD_COLONNA) < 0) {
+			perror("Impossibile allineare file colonnare");
+			return -1;
+		}
+	}
+	quante_colonne = quante;
+	colonne_sospese = 0;
+	
+	return quante;
+}
+
+/* Aggiunge un'estrazione in coda ai file colonnari
+ * 
+ * @estratti numeri estratti su ogni ruota
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int aggiungiEstrazioneColonne (uint32_t estratti[QUANTE_RUOTE][QUANTI_NUMERI_ESTRATTI])
+{
+	int ruota, i, fd, ret = 0;
+	
+	// Dopo un errore l'estrazione i-esima non si troverebbe piu' all'indice i di tutti i file
+	if (colonne_sospese) {
+		return -1;
+	}
+	
+	for (ruota = 0; ruota < QUANTE_RUOTE; ++ruota) {
+		uint8_t record[LUNGHEZZA_RECORD_COLONNA];
+		
+		for (i = 0; i < QUANTI_NUMERI_ESTRATTI; ++i) {
+			record[i] = (uint8_t)estratti[ruota][i];
+		}
+		
+		fd = open(percorsi_colonne[ruota], O_WRONLY | O_APPEND);
+		if (fd < 0 || write(fd, record, sizeof(record)) != sizeof(record)) {
+			perror("Impossibile scrivere file colonnare");
+			ret = -1;
+		}
+		if (fd >= 0) close(fd);
+	}
+	
+	// Un'estrazione scritta solo su alcune ruote viene rimossa da tutte; i file restano indietro
+	// rispetto al file delle estrazioni e i lettori usano quello (vedi leggiUltimeEstrazioniRuota(...))
+	if (ret < 0) {
+		colonne_sospese = 1;
+		for (ruota = 0; ruota < QUANTE_RUOTE; ++ruota) {
+			if (truncate(percorsi_colonne[ruota], (off_t)quante_colonne * LUNGHEZZA_RECORD_COLONNA) < 0) {
+				perror("Impossibile allineare file colonnare");
+			}
+		}
+		return -1;
+	}
+	
+	quante_colonne++;
+	return 0;
+}
+
+/* Legge le ultime estrazioni di una ruota dal suo file colonnare
+ * 
+ * @ruota codice della ruota
+ * @n numero delle estrazioni da leggere
+ * @quante_estrazioni numero delle estrazioni nel file delle estrazioni
+ * @numeri vettore in cui scrivere i numeri, dall'estrazione meno recente alla piu' recente
+ * 
+ * @return numero delle estrazioni lette, -1 in caso di errore o se il file non e' allineato
+ */
+long leggiUltimeEstrazioniRuota (int ruota, uint32_t n, uint32_t quante_estrazioni, uint8_t* numeri)
+{
+	int fd;
+	long quante;
+	ssize_t letti;
+	struct stat info;
+	
+	if (ruota < 0 || ruota >= QUANTE_RUOTE) {
+		return -1;
+	}
+	
+	fd = open(percorsi_colonne[ruota], O_RDONLY);
+	if (fd < 0 || fstat(fd, &info) < 0) {
+		if (fd >= 0) close(fd);
+		return -1;
+	}
+	
+	// Un file colonnare rimasto indietro (o avanti) darebbe le estrazioni sbagliate
+	quante = (long)(info.st_size / LUNGHEZZA_RECORD_COLONNA);
+	if (quante != (long)quante_estrazioni) {
+		close(fd);
+		return -1;
+	}
+	if (quante > (long)n) {
+		quante = (long)n;
+	}
+	
+	// Le ultime <quante> estrazioni sono contigue in fondo al file
+	letti = pread(fd, numeri, (size_t)quante * LUNGHEZZA_RECORD_COLONNA,
+			(off_t)(info.st_size / LUNGHEZZA_RECORD_COLONNA - quante) * LUNGHEZZA_RECORD_COLONNA);
+	close(fd);
+	
+	return (letti == (ssize_t)quante * LUNGHEZZA_RECORD_COLONNA) ? quante : -1;
+}
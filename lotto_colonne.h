@@ -0,0 +1,59 @@
+#ifndef LOTTO_COLONNE_H
+#define LOTTO_COLONNE_H
+
+#include "costanti.h"
+#include <stdint.h>
+
+//////////////////////////////////////////////////////
+//			STORICO DELLE ESTRAZIONI PER RUOTA		//
+//////////////////////////////////////////////////////
+/* Nel file delle estrazioni i numeri di una ruota sono intervallati da quelli delle altre ruote:
+ * leggere lo storico di una sola ruota richiede una lettura a salti di un intero record per ogni estrazione.
+ * Per questo ogni ruota ha anche un file "colonnare" che contiene solo i suoi numeri, in ordine di estrazione:
+ * l'estrazione i-esima occupa i byte da i * QUANTI_NUMERI_ESTRATTI a (i + 1) * QUANTI_NUMERI_ESTRATTI - 1
+ * (i numeri estratti sono al massimo NUMERI_ESTRAIBILI, percio' ognuno occupa un solo byte).
+ * Lo storico di una ruota si legge quindi con una sola lettura sequenziale di un'area contigua.
+ * 
+ * I file colonnari vengono estesi dal processo principale dopo ogni estrazione, DOPO il file delle estrazioni,
+ * che resta il riferimento: all'avvio le estrazioni mancanti nei file colonnari vanno aggiunte leggendole
+ * dal file delle estrazioni. Se un'estrazione non puo' essere scritta su tutte le ruote, viene rimossa da tutte
+ * e i file colonnari non vengono piu' estesi fino al riavvio: nel frattempo non sono allineati al file
+ * delle estrazioni e le letture vanno fatte da quest'ultimo.
+ */
+
+/* Apre (o crea) i file colonnari delle ruote e li allinea tra loro: un'estrazione scritta solo su alcune ruote
+ * (ad esempio per un'interruzione del server) viene rimossa.
+ * Deve essere chiamata dal processo principale prima di creare i processi figli.
+ * 
+ * @prefisso prefisso del percorso dei file: il file della ruota r e' "<prefisso><r>.bin"
+ * @quante_estrazioni numero delle estrazioni nel file delle estrazioni
+ * 
+ * @return numero delle estrazioni presenti nei file colonnari (al massimo quante_estrazioni),
+ *	-1 in caso di errore. Le estrazioni successive vanno aggiunte con aggiungiEstrazioneColonne(...)
+ */
+long inizializzaColonne (const char* prefisso, uint32_t quante_estrazioni);
+
+/* Aggiunge un'estrazione in coda ai file colonnari (DEVE essere chiamata solo dal processo principale).
+ * In caso di errore i file vengono riportati all'ultima estrazione comune e sospesi fino al riavvio
+ * 
+ * @estratti numeri estratti su ogni ruota
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore o se i file sono sospesi
+ */
+int aggiungiEstrazioneColonne (uint32_t estratti[QUANTE_RUOTE][QUANTI_NUMERI_ESTRATTI]);
+
+/* Legge le ultime estrazioni di una ruota dal suo file colonnare, con una sola lettura
+ * 
+ * @ruota codice della ruota
+ * @n numero delle estrazioni da leggere
+ * @quante_estrazioni numero delle estrazioni nel file delle estrazioni
+ * @numeri vettore di almeno n * QUANTI_NUMERI_ESTRATTI byte in cui scrivere i numeri,
+ *	dall'estrazione meno recente alla piu' recente
+ * 
+ * @return numero delle estrazioni lette (minore di n se lo storico e' piu' corto), -1 in caso di errore
+ *	o se il file colonnare non contiene esattamente <quante_estrazioni> estrazioni
+ *	(in questo caso le estrazioni vanno lette dal file delle estrazioni)
+ */
+long leggiUltimeEstrazioniRuota (int ruota, uint32_t n, uint32_t quante_estrazioni, uint8_t* numeri);
+
+#endif	// LOTTO_COLONNE_H
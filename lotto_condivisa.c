@@ -0,0 +1,166 @@
+#include "lotto_condivisa.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+static int mutex_posseduti = 0;	// numero di mutex condivisi attualmente posseduti dal processo
+static sigset_t maschera_precedente;	// maschera dei segnali da ripristinare al rilascio dell'ultimo mutex
+
+/* Alloca un'area di memoria anonima condivisa tra il processo chiamante e i suoi processi figli.
+ * 
+ * @dimensione dimensione in byte dell'area
+ * 
+ * @return indirizzo dell'area allocata, NULL in caso di errore
+ */
+void* allocaMemoriaCondivisa (size_t dimensione)
+{
+	void* area;
+	
+	area = mmap(NULL, dimensione, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (area == MAP_FAILED) {
+		perror("Impossibile allocare memoria condivisa");
+		return NULL;
+	}
+	
+	return area;
+}
+
+/* Libera un'area allocata con allocaMemoriaCondivisa(...)
+ * 
+ * @area indirizzo dell'area
+ * @dimensione dimensione in byte dell'area
+ */
+void liberaMemoriaCondivisa (void* area, size_t dimensione)
+{
+	if (area) {
+		munmap(area, dimensione);
+	}
+}
+
+/* Inizializza un mutex utilizzabile da piu' processi (e robusto alla terminazione del possessore)
+ * 
+ * @mutex mutex da inizializzare, DEVE trovarsi in un'area di memoria condivisa
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int inizializzaMutexCondiviso (pthread_mutex_t* mutex)
+{
+	int ret;
+	pthread_mutexattr_t attributi;
+	
+	pthread_mutexattr_init(&attributi);
+	pthread_mutexattr_setpshared(&attributi, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&attributi, PTHREAD_MUTEX_ROBUST);
+	
+	ret = pthread_mutex_init(mutex, &attributi);
+	pthread_mutexattr_destroy(&attributi);
+	
+	if (ret != 0) {
+		fprintf(stderr, "Impossibile inizializzare mutex condiviso: %s\n", strerror(ret));
+		fflush(stderr);
+		return -1;
+	}
+	return 0;
+}
+
+/* Acquisisce un mutex condiviso, sospendendo la ricezione di SIGUSR1 finche' e' posseduto
+ * 
+ * @mutex mutex da acquisire
+ */
+void bloccaMutexCondiviso (pthread_mutex_t* mutex)
+{
+	int ret;
+	
+	if (mutex_posseduti == 0) {
+		sigset_t maschera;
+		
+		sigemptyset(&maschera);
+		sigaddset(&maschera, SIGUSR1);
+		sigprocmask(SIG_BLOCK, &maschera, &maschera_precedente);
+	}
+	mutex_posseduti++;
+	
+	ret = pthread_mutex_lock(mutex);
+	if (ret == EOWNERDEAD) {
+		// Il processo precedente e' terminato mentre possedeva il mutex:
+		// le strutture protette sono aggiornate con scritture atomiche, quindi il mutex viene recuperato
+		pthread_mutex_consistent(mutex);
+	}
+}
+
+/* Rilascia un mutex condiviso acquisito con bloccaMutexCondiviso(...)
+ * 
+ * @mutex mutex da rilasciare
+ */
+void sbloccaMutexCondiviso (pthread_mutex_t* mutex)
+{
+	pthread_mutex_unlock(mutex);
+	
+	mutex_posseduti--;
+	if (mutex_posseduti == 0) {
+		sigprocmask(SIG_SETMASK, &maschera_precedente, NULL);
+	}
+}
+
+/* Inizializza una variabile di condizione utilizzabile da piu' processi (scadenze su CLOCK_MONOTONIC)
+ * 
+ * @condizione variabile da inizializzare, DEVE trovarsi in un'area di memoria condivisa
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int inizializzaCondizioneCondivisa (pthread_cond_t* condizione)
+{
+	int ret;
+	pthread_condattr_t attributi;
+	
+	pthread_condattr_init(&attributi);
+	pthread_condattr_setpshared(&attributi, PTHREAD_PROCESS_SHARED);
+	pthread_condattr_setclock(&attributi, CLOCK_MONOTONIC);
+	
+	ret = pthread_cond_init(condizione, &attributi);
+	pthread_condattr_destroy(&attributi);
+	
+	if (ret != 0) {
+		fprintf(stderr, "Impossibile inizializzare condizione condivisa: %s\n", strerror(ret));
+		fflush(stderr);
+		return -1;
+	}
+	return 0;
+}
+
+/* Attende una variabile di condizione condivisa, rilasciando il mutex per la durata dell'attesa
+ * 
+ * @condizione variabile di condizione
+ * @mutex mutex posseduto dal chiamante (acquisito con bloccaMutexCondiviso(...))
+ * @scadenza istante (CLOCK_MONOTONIC) oltre il quale l'attesa termina, NULL per attendere senza limite
+ * 
+ * @return 0 se la condizione e' stata segnalata, 1 se l'attesa e' scaduta
+ */
+int attendiCondizioneCondivisa (pthread_cond_t* condizione, pthread_mutex_t* mutex, const struct timespec* scadenza)
+{
+	int ret;
+	
+	ret = scadenza ? pthread_cond_timedwait(condizione, mutex, scadenza) : pthread_cond_wait(condizione, mutex);
+	if (ret == EOWNERDEAD) {
+		// Come in bloccaMutexCondiviso(...): il mutex viene recuperato
+		pthread_mutex_consistent(mutex);
+	}
+	return (ret == ETIMEDOUT) ? 1 : 0;
+}
+
+/* Converte il risultato di una snprintf(...) nel numero dei caratteri scritti nel buffer
+ * 
+ * @ret risultato della snprintf(...)
+ * @dimensione dimensione del buffer
+ * 
+ * @return numero di caratteri scritti, escluso il terminatore
+ */
+int caratteriScritti (int ret, size_t dimensione)
+{
+	if (ret < 0 || dimensione == 0) {
+		return 0;
+	}
+	return ((size_t)ret >= dimensione) ? (int)dimensione - 1 : ret;
+}
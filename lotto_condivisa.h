@@ -0,0 +1,88 @@
+#ifndef LOTTO_CONDIVISA_H
+#define LOTTO_CONDIVISA_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <time.h>
+
+//////////////////////////////////////////////////////////
+//				MEMORIA CONDIVISA TRA PROCESSI			//
+//////////////////////////////////////////////////////////
+/* Le strutture condivise tra i processi del server vengono allocate dal processo principale
+ * PRIMA delle fork(...), cosi' che ogni processo figlio erediti la stessa area di memoria.
+ */
+
+/* Alloca un'area di memoria anonima condivisa tra il processo chiamante e i suoi processi figli.
+ * Le pagine vengono allocate dal kernel solo al primo accesso, percio' si puo' riservare
+ * un'area ampia senza occupare memoria fisica. L'area e' inizializzata a zero.
+ * 
+ * @dimensione dimensione in byte dell'area
+ * 
+ * @return indirizzo dell'area allocata, NULL in caso di errore
+ */
+void* allocaMemoriaCondivisa (size_t dimensione);
+
+/* Libera un'area allocata con allocaMemoriaCondivisa(...)
+ * 
+ * @area indirizzo dell'area
+ * @dimensione dimensione in byte dell'area
+ */
+void liberaMemoriaCondivisa (void* area, size_t dimensione);
+
+/* Inizializza un mutex utilizzabile da piu' processi.
+ * Il mutex e' "robusto": se un processo termina mentre lo possiede, il mutex viene recuperato
+ * dal processo successivo che tenta di acquisirlo.
+ * 
+ * @mutex mutex da inizializzare, DEVE trovarsi in un'area di memoria condivisa
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int inizializzaMutexCondiviso (pthread_mutex_t* mutex);
+
+/* Acquisisce un mutex condiviso.
+ * Finche' il mutex e' posseduto, il processo ignora temporaneamente il segnale di sospensione (SIGUSR1),
+ * in modo che un processo sospeso per l'estrazione non possa mai trattenere un mutex condiviso.
+ * 
+ * @mutex mutex da acquisire
+ */
+void bloccaMutexCondiviso (pthread_mutex_t* mutex);
+
+/* Rilascia un mutex condiviso acquisito con bloccaMutexCondiviso(...)
+ * 
+ * @mutex mutex da rilasciare
+ */
+void sbloccaMutexCondiviso (pthread_mutex_t* mutex);
+
+/* Inizializza una variabile di condizione utilizzabile da piu' processi (le scadenze delle attese
+ * sono espresse sull'orologio monotono, CLOCK_MONOTONIC)
+ * 
+ * @condizione variabile da inizializzare, DEVE trovarsi in un'area di memoria condivisa
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int inizializzaCondizioneCondivisa (pthread_cond_t* condizione);
+
+/* Attende una variabile di condizione condivisa, rilasciando il mutex per la durata dell'attesa.
+ * Il mutex DEVE essere stato acquisito con bloccaMutexCondiviso(...): durante l'attesa il segnale
+ * di sospensione resta bloccato, come se il mutex fosse posseduto.
+ * 
+ * @condizione variabile di condizione
+ * @mutex mutex posseduto dal chiamante
+ * @scadenza istante (CLOCK_MONOTONIC) oltre il quale l'attesa termina, NULL per attendere senza limite
+ * 
+ * @return 0 se la condizione e' stata segnalata, 1 se l'attesa e' scaduta
+ */
+int attendiCondizioneCondivisa (pthread_cond_t* condizione, pthread_mutex_t* mutex, const struct timespec* scadenza);
+
+/* Converte il risultato di una snprintf(...) nel numero dei caratteri effettivamente scritti nel buffer.
+ * Usata dalle funzioni che scrivono le metriche delle strutture condivise (scriviMetriche...(...)):
+ * un errore non scrive nulla, un testo troncato riempie il buffer fino al terminatore
+ * 
+ * @ret risultato della snprintf(...)
+ * @dimensione dimensione del buffer passato alla snprintf(...)
+ * 
+ * @return numero di caratteri scritti, escluso il terminatore
+ */
+int caratteriScritti (int ret, size_t dimensione);
+
+#endif	// LOTTO_CONDIVISA_H
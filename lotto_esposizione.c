@@ -0,0 +1,290 @@
+#include "lotto_esposizione.h"
+#include "lotto_condivisa.h"
+#include "lotto_premi.h"
+#include <stdio.h>
+#include <string.h>
+
+// Le correzioni si riferiscono alle prossime MASSIMO_ESTRAZIONI_SCHEDINA estrazioni (vettore circolare)
+#define QUANTE_CORREZIONI (MASSIMO_ESTRAZIONI_SCHEDINA + 1)
+
+/* Vincite di ESTRATTO e di AMBO per ogni numero e per ogni ambo di ogni ruota
+ */
+struct tabella_esposizione {
+	double estratti[QUANTE_RUOTE][NUMERI_ESTRAIBILI];
+	double ambi[QUANTE_RUOTE][QUANTI_AMBI];
+};
+
+/* Riconciliazione di un'estrazione.
+ * Le estrazioni sono identificate dall'indice in FILE_ESTRAZIONI e non dal timestamp,
+ * che in un file importato puo' ripetersi
+ */
+struct riconciliazione {
+	uint32_t numero;		// indice dell'estrazione + 1 (0 se l'elemento non e' mai stato usato)
+	double dovuto;			// somma dell'esposizione sui numeri e sugli ambi estratti
+	double liquidato;		// vincite di ESTRATTO e di AMBO gia' liquidate dalle verifiche delle schedine
+};
+
+/* Struttura allocata in memoria condivisa
+ */
+struct archivio_esposizione {
+	pthread_mutex_t mutex;
+	uint64_t estrazioni;			// estrazioni effettuate dall'avvio (indice delle correzioni)
+	int64_t avvio;					// timestamp di creazione delle tabelle
+	
+	// Metriche
+	uint64_t schedine;				// schedine sommate all'esposizione
+	uint64_t abbonamenti_annullati;
+	uint64_t abbonamenti_precedenti;	// annullati ma registrati prima dell'avvio, quindi mai sommati
+	uint64_t consultazioni;
+	
+	struct riconciliazione riconciliazioni[ESTRAZIONI_RICONCILIATE];	// vettore circolare
+	
+	struct tabella_esposizione attuale;		// esposizione della prossima estrazione
+	
+	// Correzioni da sommare all'esposizione dopo ognuna delle prossime estrazioni:
+	// correzioni[e % QUANTE_CORREZIONI] viene applicata quando l'estrazione numero e e' stata effettuata
+	struct tabella_esposizione correzioni[QUANTE_CORREZIONI];
+};
+
+static struct archivio_esposizione* archivio = NULL;
+
+/* Somma (o sottrae) ad una tabella le vincite di ESTRATTO e di AMBO di una schedina
+ * 
+ * @tabella tabella da aggiornare
+ * @sched schedina valida
+ * @segno 1 per sommare, -1 per sottrarre
+ */
+static void sommaSchedina (struct tabella_esposizione* tabella, const struct schedina* sched, double segno)
+{
+	double vincita_estratto = 0, vincita_ambo = 0;
+	int n = sched->quantiNumeri, r, i, j;
+	
+	// Stesse regole di calcolaVinciteRuota(...): importo di ogni combinazione, ripartito tra le ruote giocate
+	if (sched->quantiImporti > 0) {
+		vincita_estratto = (sched->sistema ? sched->importi[0] : sched->importi[0] / n)
+				* moltiplicatorePremio(0) / sched->quanteRuote;
+	}
+	if (sched->quantiImporti > 1 && n > 1) {
+		vincita_ambo = (sched->sistema ? sched->importi[1] : sched->importi[1] / coefficienteBinomiale(n, 2))
+				* moltiplicatorePremio(1) / sched->quanteRuote;
+	}
+	vincita_estratto *= segno;
+	vincita_ambo *= segno;
+	
+	for (r = 0; r < sched->quanteRuote; ++r) {
+		int ruota = sched->ruote[r];
+		
+		for (i = 0; i < n; ++i) {
+			tabella->estratti[ruota][sched->numeriGiocati[i] - 1] += vincita_estratto;
+		}
+		if (vincita_ambo == 0) {
+			continue;
+		}
+		for (i = 0; i < n; ++i) {
+			for (j = i + 1; j < n; ++j) {
+				int a = sched->numeriGiocati[i], b = sched->numeriGiocati[j];
+				
+				tabella->ambi[ruota][indiceAmbo(a, b)] += vincita_ambo;
+			}
+		}
+	}
+}
+
+/* Crea le tabelle dell'esposizione in memoria condivisa
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int inizializzaEsposizione ()
+{
+	archivio = (struct archivio_esposizione*)allocaMemoriaCondivisa(sizeof(struct archivio_esposizione));
+	if (!archivio) {
+		return -1;
+	}
+	archivio->avvio = (int64_t)time(NULL);
+	
+	return inizializzaMutexCondiviso(&archivio->mutex);
+}
+
+/* Somma all'esposizione una schedina appena registrata
+ * 
+ * @sched schedina valida
+ */
+void registraEsposizioneSchedina (const struct schedina* sched)
+{
+	bloccaMutexCondiviso(&archivio->mutex);
+	
+	sommaSchedina(&archivio->attuale, sched, 1);
+	
+	// Una schedina per K estrazioni esce dall'esposizione dopo la K-esima estrazione
+	if (sched->quanteEstrazioni != ABBONAMENTO) {
+		uint64_t ultima = archivio->estrazioni + sched->quanteEstrazioni;
+		
+		sommaSchedina(&archivio->correzioni[ultima % QUANTE_CORREZIONI], sched, -1);
+	}
+	archivio->schedine++;
+	
+	sbloccaMutexCondiviso(&archivio->mutex);
+}
+
+/* Sottrae dall'esposizione un abbonamento annullato, se era stato sommato
+ * 
+ * @sched abbonamento
+ * @registrazione timestamp di registrazione dell'abbonamento
+ */
+void annullaEsposizioneAbbonamento (const struct schedina* sched, time_t registrazione)
+{
+	bloccaMutexCondiviso(&archivio->mutex);
+	
+	// Le tabelle contengono solo le schedine registrate dall'avvio: sottrarre un abbonamento
+	// precedente renderebbe negativa l'esposizione dei suoi numeri
+	if ((int64_t)registrazione < archivio->avvio) {
+		archivio->abbonamenti_precedenti++;
+	}
+	else {
+		sommaSchedina(&archivio->attuale, sched, -1);
+		archivio->abbonamenti_annullati++;
+	}
+	
+	sbloccaMutexCondiviso(&archivio->mutex);
+}
+
+/* Restituisce l'esposizione della prossima estrazione su un numero o su un ambo
+ * 
+ * @ruota codice della ruota
+ * @primo numero
+ * @secondo secondo numero dell'ambo, 0 per il solo numero <primo>
+ * @esposizione puntatore in cui scrivere l'esposizione
+ * 
+ * @return 0 in caso di successo, -1 se ruota o numeri non sono validi
+ */
+int esposizioneEstrazione (int ruota, int primo, int secondo, double* esposizione)
+{
+	if (ruota < 0 || ruota >= QUANTE_RUOTE || primo < 1 || primo > NUMERI_ESTRAIBILI
+			|| secondo < 0 || secondo > NUMERI_ESTRAIBILI || secondo == primo) {
+		return -1;
+	}
+	
+	bloccaMutexCondiviso(&archivio->mutex);
+	if (secondo == 0) {
+		*esposizione = archivio->attuale.estratti[ruota][primo - 1];
+	}
+	else {
+		*esposizione = archivio->attuale.ambi[ruota][indiceAmbo(primo, secondo)];
+	}
+	archivio->consultazioni++;
+	sbloccaMutexCondiviso(&archivio->mutex);
+	
+	return 0;
+}
+
+/* Riconcilia l'esposizione dopo un'estrazione
+ * 
+ * @estrazione indice dell'estrazione in FILE_ESTRAZIONI
+ * @estratti numeri estratti su ogni ruota
+ */
+void riconciliaEsposizione (uint32_t estrazione, uint32_t estratti[QUANTE_RUOTE][QUANTI_NUMERI_ESTRATTI])
+{
+	struct riconciliazione* riconciliazione;
+	struct tabella_esposizione* correzione;
+	double dovuto = 0;
+	int r, i, j;
+	
+	bloccaMutexCondiviso(&archivio->mutex);
+	
+	// Importo dovuto sui numeri e sugli ambi estratti
+	for (r = 0; r < QUANTE_RUOTE; ++r) {
+		for (i = 0; i < QUANTI_NUMERI_ESTRATTI; ++i) {
+			int a = (int)estratti[r][i];
+			
+			dovuto += archivio->attuale.estratti[r][a - 1];
+			for (j = i + 1; j < QUANTI_NUMERI_ESTRATTI; ++j) {
+				int b = (int)estratti[r][j];
+				
+				dovuto += archivio->attuale.ambi[r][indiceAmbo(a, b)];
+			}
+		}
+	}
+	
+	riconciliazione = &archivio->riconciliazioni[archivio->estrazioni % ESTRAZIONI_RICONCILIATE];
+	riconciliazione->numero = estrazione + 1;
+	riconciliazione->dovuto = dovuto;
+	riconciliazione->liquidato = 0;
+	
+	// Le schedine che hanno concluso le loro estrazioni escono dall'esposizione
+	archivio->estrazioni++;
+	correzione = &archivio->correzioni[archivio->estrazioni % QUANTE_CORREZIONI];
+	for (r = 0; r < QUANTE_RUOTE; ++r) {
+		for (i = 0; i < NUMERI_ESTRAIBILI; ++i) {
+			archivio->attuale.estratti[r][i] += correzione->estratti[r][i];
+		}
+		for (i = 0; i < QUANTI_AMBI; ++i) {
+			archivio->attuale.ambi[r][i] += correzione->ambi[r][i];
+		}
+	}
+	memset(correzione, 0, sizeof(*correzione));
+	
+	sbloccaMutexCondiviso(&archivio->mutex);
+}
+
+/* Registra le vincite di ESTRATTO e di AMBO liquidate da una verifica delle schedine
+ * (le estrazioni non piu' riconciliate vengono ignorate)
+ * 
+ * @estrazione indice dell'estrazione in FILE_ESTRAZIONI
+ * @importo importo liquidato
+ */
+void registraLiquidazione (uint32_t estrazione, double importo)
+{
+	int i;
+	
+	bloccaMutexCondiviso(&archivio->mutex);
+	for (i = 0; i < ESTRAZIONI_RICONCILIATE; ++i) {
+		if (archivio->riconciliazioni[i].numero == estrazione + 1) {
+			archivio->riconciliazioni[i].liquidato += importo;
+			break;
+		}
+	}
+	sbloccaMutexCondiviso(&archivio->mutex);
+}
+
+/* Scrive le metriche dell'esposizione (una per riga, nel formato "nome valore")
+ * 
+ * @buffer buffer in cui scrivere le metriche
+ * @dimensione dimensione del buffer
+ * 
+ * @return numero di caratteri scritti
+ */
+int scriviMetricheEsposizione (char* buffer, size_t dimensione)
+{
+	int ret, contatore, i;
+	
+	bloccaMutexCondiviso(&archivio->mutex);
+	
+	ret = snprintf(buffer, dimensione,
+			"esposizione_schedine %lu\n"
+			"esposizione_abbonamenti_annullati %lu\n"
+			"esposizione_abbonamenti_precedenti_annullati %lu\n"
+			"esposizione_consultazioni %lu\n",
+			(unsigned long)archivio->schedine,
+			(unsigned long)archivio->abbonamenti_annullati,
+			(unsigned long)archivio->abbonamenti_precedenti,
+			(unsigned long)archivio->consultazioni);
+	contatore = caratteriScritti(ret, dimensione);
+	
+	for (i = 0; i < ESTRAZIONI_RICONCILIATE; ++i) {
+		struct riconciliazione* riconciliazione = &archivio->riconciliazioni[i];
+		
+		if (riconciliazione->numero == 0) {
+			continue;
+		}
+		
+		ret = snprintf(buffer + contatore, dimensione - contatore,
+				"esposizione_dovuto_%u %.2f\n"
+				"esposizione_liquidato_%u %.2f\n",
+				(unsigned int)(riconciliazione->numero - 1), riconciliazione->dovuto,
+				(unsigned int)(riconciliazione->numero - 1), riconciliazione->liquidato);
+		contatore += caratteriScritti(ret, dimensione - contatore);
+	}
+	
+	sbloccaMutexCondiviso(&archivio->mutex);
+	return contatore;
+}
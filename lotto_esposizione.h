@@ -0,0 +1,89 @@
+#ifndef LOTTO_ESPOSIZIONE_H
+#define LOTTO_ESPOSIZIONE_H
+
+#include "costanti.h"
+#include "lotto.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+//////////////////////////////////////////////////////
+//			ESPOSIZIONE DEL BANCO					//
+//////////////////////////////////////////////////////
+/* L'esposizione e' quanto il banco dovrebbe pagare alla prossima estrazione se un numero (o un ambo)
+ * venisse estratto su una ruota: per ogni coppia (ruota, numero) e (ruota, ambo) e' la somma delle vincite
+ * di ESTRATTO e di AMBO di tutte le schedine in gioco che contengono il numero (o l'ambo).
+ * Le puntate superiori all'ambo non vengono considerate.
+ * 
+ * Le tabelle sono in memoria condivisa e vengono aggiornate incrementalmente ad ogni schedina registrata,
+ * percio' una consultazione costa O(1). Le schedine valide per K estrazioni vengono sommate una volta
+ * e sottratte dopo la K-esima estrazione (tramite una tabella di correzioni per ognuna delle prossime
+ * MASSIMO_ESTRAZIONI_SCHEDINA estrazioni); gli abbonamenti restano fino all'annullamento.
+ * 
+ * Dopo ogni estrazione l'esposizione viene riconciliata con i numeri estratti: l'importo dovuto per l'estrazione
+ * viene registrato e confrontato con quanto liquidato dalle verifiche delle schedine (!vedi_vincite).
+ * Le tabelle contengono solo le schedine registrate dall'avvio del server.
+ */
+
+// Numero delle estrazioni di cui si mantiene la riconciliazione
+#define ESTRAZIONI_RICONCILIATE 4
+
+/* Crea le tabelle dell'esposizione in memoria condivisa.
+ * Deve essere chiamata dal processo principale prima di creare i processi figli.
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int inizializzaEsposizione ();
+
+/* Somma all'esposizione una schedina appena registrata, per tutte le estrazioni che copre
+ * 
+ * @sched schedina valida (vedi schedinaValida(...))
+ */
+void registraEsposizioneSchedina (const struct schedina* sched);
+
+/* Sottrae dall'esposizione un abbonamento annullato. Gli abbonamenti registrati prima della creazione
+ * delle tabelle non sono mai stati sommati, percio' vengono solo contati nelle metriche
+ * 
+ * @sched abbonamento
+ * @registrazione timestamp di registrazione dell'abbonamento
+ */
+void annullaEsposizioneAbbonamento (const struct schedina* sched, time_t registrazione);
+
+/* Restituisce l'esposizione della prossima estrazione su un numero o su un ambo
+ * 
+ * @ruota codice della ruota
+ * @primo numero (da 1 a NUMERI_ESTRAIBILI)
+ * @secondo secondo numero dell'ambo, 0 per l'esposizione sul solo numero <primo>
+ * @esposizione puntatore in cui scrivere l'esposizione
+ * 
+ * @return 0 in caso di successo, -1 se ruota o numeri non sono validi
+ */
+int esposizioneEstrazione (int ruota, int primo, int secondo, double* esposizione);
+
+/* Riconcilia l'esposizione dopo un'estrazione: registra l'importo dovuto sui numeri estratti
+ * e prepara le tabelle per l'estrazione successiva.
+ * Va chiamata dal processo principale dopo ogni estrazione
+ * 
+ * @estrazione indice dell'estrazione in FILE_ESTRAZIONI
+ * @estratti numeri estratti su ogni ruota
+ */
+void riconciliaEsposizione (uint32_t estrazione, uint32_t estratti[QUANTE_RUOTE][QUANTI_NUMERI_ESTRATTI]);
+
+/* Registra le vincite di ESTRATTO e di AMBO liquidate da una verifica delle schedine
+ * 
+ * @estrazione indice in FILE_ESTRAZIONI dell'estrazione su cui e' stata verificata la schedina
+ * @importo importo liquidato
+ */
+void registraLiquidazione (uint32_t estrazione, double importo);
+
+/* Scrive le metriche dell'esposizione (una per riga, nel formato "nome valore"),
+ * tra cui importo dovuto e importo liquidato delle ultime ESTRAZIONI_RICONCILIATE estrazioni
+ * 
+ * @buffer buffer in cui scrivere le metriche
+ * @dimensione dimensione del buffer
+ * 
+ * @return numero di caratteri scritti
+ */
+int scriviMetricheEsposizione (char* buffer, size_t dimensione);
+
+#endif	// LOTTO_ESPOSIZIONE_H
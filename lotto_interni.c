@@ -0,0 +1,284 @@
+#include "lotto_interni.h"
+#include "lotto_condivisa.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MASCHERA_GIOCATE_INTERNATE (CAPACITA_GIOCATE_INTERNATE - 1)
+
+// Oltre questo numero di giocate distinte la tabella di un'estrazione non accetta nuove giocate
+#define MASSIMO_GIOCATE_INTERNATE (CAPACITA_GIOCATE_INTERNATE / 4 * 3)
+
+/* Chiave canonica di una giocata.
+ * Viene azzerata prima di essere costruita, percio' due chiavi si confrontano byte per byte
+ */
+struct chiave_giocata {
+	struct insieme_numeri numeri;
+	uint16_t ruote;						// maschera delle ruote giocate
+	uint8_t sistema;
+	uint8_t quanti_importi;
+	double importi[QUANTI_TIPI_PREMIO];	// importi divisi per la puntata complessiva
+};
+
+/* Elemento di una tabella.
+ * Un elemento appartiene alla tabella solo se la sua generazione e' quella attuale della tabella:
+ * cosi' una tabella si svuota incrementando la generazione, senza riscrivere gli elementi
+ */
+struct elemento_giocata {
+	uint32_t generazione;
+	struct chiave_giocata chiave;
+	struct esito_giocata esito;
+};
+
+/* Tabella delle giocate di un'estrazione
+ */
+struct tabella_giocate {
+	uint32_t numero;				// indice dell'estrazione della tabella + 1 (0 se la tabella non e' mai stata usata)
+	uint32_t generazione;
+	
+	// Metriche dell'estrazione
+	uint32_t giocate;				// giocate verificate
+	uint32_t distinte;				// giocate distinte, ovvero verificate confrontandole con l'estrazione
+	uint32_t non_internate;			// giocate verificate senza internarle (tabella piena)
+	
+	struct elemento_giocata elementi[CAPACITA_GIOCATE_INTERNATE];
+};
+
+/* Struttura allocata in memoria condivisa
+ */
+struct giocate_internate {
+	pthread_mutex_t mutex;
+	
+	// Metriche
+	uint64_t giocate;
+	uint64_t distinte;
+	uint64_t estrazioni_non_in_tabella;	// giocate su estrazioni piu' vecchie di tutte quelle in tabella
+	
+	struct tabella_giocate tabelle[TABELLE_GIOCATE_INTERNATE];
+};
+
+static struct giocate_internate* interni = NULL;
+
+/* Costruisce la chiave canonica di una schedina
+ * 
+ * @return puntata complessiva della schedina (1 se tutti gli importi sono nulli)
+ */
+static double chiaveGiocata (const struct schedina* sched, struct chiave_giocata* chiave)
+{
+	double puntata = 0;
+	int i;
+	
+	memset(chiave, 0, sizeof(*chiave));
+	chiave->numeri = insiemeNumeri(sched->numeriGiocati, sched->quantiNumeri);
+	for (i = 0; i < sched->quanteRuote; ++i) {
+		chiave->ruote |= (uint16_t)(1 << sched->ruote[i]);
+	}
+	chiave->sistema = (uint8_t)sched->sistema;
+	chiave->quanti_importi = (uint8_t)sched->quantiImporti;
+	
+	for (i = 0; i < sched->quantiImporti; ++i) {
+		puntata += sched->importi[i];
+	}
+	if (puntata <= 0) {
+		puntata = 1;
+	}
+	for (i = 0; i < sched->quantiImporti; ++i) {
+		chiave->importi[i] = sched->importi[i] / puntata;
+	}
+	
+	return puntata;
+}
+
+/* Calcola la posizione iniziale di una chiave nella tabella
+ */
+static uint32_t posizioneGiocata (const struct chiave_giocata* chiave)
+{
+	uint64_t hash = chiave->numeri.parte[0] ^ (chiave->numeri.parte[1] * 0xFF51AFD7ED558CCDULL);
+	uint64_t importi[QUANTI_TIPI_PREMIO];
+	int i;
+	
+	memcpy(importi, chiave->importi, sizeof(importi));
+	hash ^= ((uint64_t)chiave->ruote << 16) | ((uint64_t)chiave->sistema << 8) | chiave->quanti_importi;
+	for (i = 0; i < QUANTI_TIPI_PREMIO; ++i) {
+		hash = (hash ^ importi[i]) * 0x9E3779B97F4A7C15ULL;
+	}
+	
+	return (uint32_t)(hash >> 32) & MASCHERA_GIOCATE_INTERNATE;
+}
+
+/* Confronta la giocata con l'estrazione
+ * 
+ * @chiave chiave della giocata, il cui vettore degli importi e' quello per ogni Euro puntato
+ */
+static void calcolaEsito (const struct schedina* sched, const struct chiave_giocata* chiave,
+							const struct insieme_numeri estratti[], struct esito_giocata* esito)
+{
+	struct schedina unitaria = *sched;
+	int i;
+	
+	unitaria.importi = (double*)chiave->importi;
+	
+	memset(esito, 0, sizeof(*esito));
+	for (i = 0; i < sched->quanteRuote; ++i) {
+		int ruota = sched->ruote[i], quanti_comuni;
+		
+		esito->comuni[ruota].parte[0] = chiave->numeri.parte[0] & estratti[ruota].parte[0];
+		esito->comuni[ruota].parte[1] = chiave->numeri.parte[1] & estratti[ruota].parte[1];
+		
+		quanti_comuni = quantiNumeriComuni(esito->comuni[ruota], esito->comuni[ruota]);
+		if (quanti_comuni > 0) {
+			calcolaVinciteRuota(&unitaria, quanti_comuni, esito->vincite[ruota]);
+		}
+	}
+}
+
+/* Restituisce la tabella di un'estrazione, riusando quella dell'estrazione piu' vecchia
+ * se l'estrazione non ha ancora una tabella (DEVE essere chiamata possedendo il mutex)
+ * 
+ * @return tabella dell'estrazione, NULL se l'estrazione e' piu' vecchia di tutte quelle in tabella
+ */
+static struct tabella_giocate* tabellaEstrazione (uint32_t estrazione)
+{
+	struct tabella_giocate* piu_vecchia = &interni->tabelle[0];
+	uint32_t numero = estrazione + 1;
+	int i;
+	
+	for (i = 0; i < TABELLE_GIOCATE_INTERNATE; ++i) {
+		if (interni->tabelle[i].numero == numero) {
+			return &interni->tabelle[i];
+		}
+		if (interni->tabelle[i].numero < piu_vecchia->numero) {
+			piu_vecchia = &interni->tabelle[i];
+		}
+	}
+	
+	if (numero < piu_vecchia->numero) {
+		return NULL;
+	}
+	
+	piu_vecchia->numero = numero;
+	piu_vecchia->generazione++;
+	piu_vecchia->giocate = piu_vecchia->distinte = piu_vecchia->non_internate = 0;
+	return piu_vecchia;
+}
+
+/* Crea le tabelle delle giocate in memoria condivisa
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int inizializzaGiocateInternate ()
+{
+	int i;
+	
+	interni = (struct giocate_internate*)allocaMemoriaCondivisa(sizeof(struct giocate_internate));
+	if (!interni) {
+		return -1;
+	}
+	
+	// La generazione 0 e' quella degli elementi mai scritti
+	for (i = 0; i < TABELLE_GIOCATE_INTERNATE; ++i) {
+		interni->tabelle[i].generazione = 1;
+	}
+	
+	return inizializzaMutexCondiviso(&interni->mutex);
+}
+
+/* Calcola l'esito di una schedina su un'estrazione
+ * 
+ * @sched schedina valida
+ * @estrazione indice dell'estrazione in FILE_ESTRAZIONI
+ * @estratti numeri estratti su ogni ruota
+ * @esito struttura in cui scrivere l'esito per ogni Euro puntato
+ * 
+ * @return puntata della schedina
+ */
+double esitoGiocata (const struct schedina* sched, uint32_t estrazione, const struct insieme_numeri estratti[], struct esito_giocata* esito)
+{
+	struct chiave_giocata chiave;
+	struct tabella_giocate* tabella;
+	double puntata;
+	uint32_t i;
+	
+	puntata = chiaveGiocata(sched, &chiave);
+	
+	bloccaMutexCondiviso(&interni->mutex);
+	interni->giocate++;
+	
+	tabella = tabellaEstrazione(estrazione);
+	if (!tabella) {
+		interni->estrazioni_non_in_tabella++;
+		interni->distinte++;
+		sbloccaMutexCondiviso(&interni->mutex);
+		
+		calcolaEsito(sched, &chiave, estratti, esito);
+		return puntata;
+	}
+	tabella->giocate++;
+	
+	for (i = posizioneGiocata(&chiave); tabella->elementi[i].generazione == tabella->generazione;
+			i = (i + 1) & MASCHERA_GIOCATE_INTERNATE) {
+		if (memcmp(&tabella->elementi[i].chiave, &chiave, sizeof(chiave)) == 0) {
+			// Giocata gia' verificata su questa estrazione
+			*esito = tabella->elementi[i].esito;
+			sbloccaMutexCondiviso(&interni->mutex);
+			return puntata;
+		}
+	}
+	
+	// Giocata distinta: viene confrontata con l'estrazione
+	calcolaEsito(sched, &chiave, estratti, esito);
+	interni->distinte++;
+	tabella->distinte++;
+	
+	if (tabella->distinte - tabella->non_internate > MASSIMO_GIOCATE_INTERNATE) {
+		tabella->non_internate++;
+	}
+	else {
+		tabella->elementi[i].chiave = chiave;
+		tabella->elementi[i].esito = *esito;
+		tabella->elementi[i].generazione = tabella->generazione;
+	}
+	
+	sbloccaMutexCondiviso(&interni->mutex);
+	return puntata;
+}
+
+/* Scrive le metriche delle giocate internate (una per riga, nel formato "nome valore")
+ * 
+ * @buffer buffer in cui scrivere le metriche
+ * @dimensione dimensione del buffer
+ * 
+ * @return numero di caratteri scritti
+ */
+int scriviMetricheGiocateInternate (char* buffer, size_t dimensione)
+{
+	int ret, contatore, i;
+	
+	bloccaMutexCondiviso(&interni->mutex);
+	
+	ret = snprintf(buffer, dimensione,
+			"giocate_internate_verificate %lu\n"
+			"giocate_internate_distinte %lu\n"
+			"giocate_internate_estrazioni_non_in_tabella %lu\n",
+			(unsigned long)interni->giocate,
+			(unsigned long)interni->distinte,
+			(unsigned long)interni->estrazioni_non_in_tabella);
+	contatore = caratteriScritti(ret, dimensione);
+	
+	// Rapporto di deduplicazione (giocate verificate / giocate distinte) di ogni estrazione in tabella
+	for (i = 0; i < TABELLE_GIOCATE_INTERNATE; ++i) {
+		struct tabella_giocate* tabella = &interni->tabelle[i];
+		
+		if (tabella->numero == 0 || tabella->distinte == 0) {
+			continue;
+		}
+		
+		ret = snprintf(buffer + contatore, dimensione - contatore,
+				"giocate_internate_rapporto_%u %.2f\n",
+				(unsigned int)(tabella->numero - 1), (double)tabella->giocate / tabella->distinte);
+		contatore += caratteriScritti(ret, dimensione - contatore);
+	}
+	
+	sbloccaMutexCondiviso(&interni->mutex);
+	return contatore;
+}
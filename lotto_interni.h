@@ -0,0 +1,70 @@
+#ifndef LOTTO_INTERNI_H
+#define LOTTO_INTERNI_H
+
+#include "costanti.h"
+#include "lotto.h"
+#include "lotto_premi.h"
+#include <stddef.h>
+#include <time.h>
+
+//////////////////////////////////////////////////////
+//				GIOCATE INTERNATE					//
+//////////////////////////////////////////////////////
+/* Molti giocatori registrano giocate identiche (gli stessi "numeri fortunati", le stesse ruote e la stessa
+ * ripartizione degli importi). Per non confrontarle con l'estrazione una volta per ogni utente,
+ * ogni giocata viene ridotta ad una chiave canonica: insieme dei numeri giocati, maschera delle ruote,
+ * tipo della schedina e vettore degli importi diviso per la puntata complessiva.
+ * L'esito di una chiave (numeri comuni e vincite per ogni Euro puntato su ogni ruota) viene calcolato
+ * una sola volta per estrazione, memorizzato nella tabella dell'estrazione e riusato per tutti i proprietari
+ * della stessa giocata, moltiplicandolo per la loro puntata.
+ * 
+ * Le tabelle sono in memoria condivisa, una per ognuna delle ultime TABELLE_GIOCATE_INTERNATE estrazioni
+ * verificate, identificate dall'indice dell'estrazione in FILE_ESTRAZIONI (due estrazioni possono avere
+ * lo stesso timestamp, per esempio in un file importato): quando arriva un'estrazione nuova viene riusata la tabella dell'estrazione piu' vecchia.
+ * Le estrazioni piu' vecchie di tutte quelle presenti vengono verificate senza internare le giocate.
+ * Gli accessi alle tabelle sono serializzati da un mutex condiviso.
+ */
+
+// Numero delle estrazioni con una tabella delle giocate
+#define TABELLE_GIOCATE_INTERNATE 4
+
+// Numero di elementi di ogni tabella (potenza di 2)
+#define CAPACITA_GIOCATE_INTERNATE (1 << 13)
+
+/* Esito di una giocata su un'estrazione, per le sole ruote giocate
+ */
+struct esito_giocata {
+	struct insieme_numeri comuni[QUANTE_RUOTE];				// numeri giocati estratti su ogni ruota
+	double vincite[QUANTE_RUOTE][QUANTI_TIPI_PREMIO];		// vincite di ogni puntata per ogni Euro puntato
+};
+
+/* Crea le tabelle delle giocate in memoria condivisa.
+ * Deve essere chiamata dal processo principale prima di creare i processi figli.
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int inizializzaGiocateInternate ();
+
+/* Calcola l'esito di una schedina su un'estrazione, riusando quello di una giocata identica
+ * gia' verificata sulla stessa estrazione
+ * 
+ * @sched schedina valida (vedi schedinaValida(...))
+ * @estrazione indice dell'estrazione in FILE_ESTRAZIONI
+ * @estratti numeri estratti su ogni ruota
+ * @esito struttura in cui scrivere l'esito per ogni Euro puntato
+ * 
+ * @return puntata della schedina, per cui vanno moltiplicate le vincite dell'esito
+ */
+double esitoGiocata (const struct schedina* sched, uint32_t estrazione, const struct insieme_numeri estratti[], struct esito_giocata* esito);
+
+/* Scrive le metriche delle giocate internate (una per riga, nel formato "nome valore"),
+ * tra cui il rapporto tra giocate verificate e giocate distinte per ognuna delle estrazioni in tabella
+ * 
+ * @buffer buffer in cui scrivere le metriche
+ * @dimensione dimensione del buffer
+ * 
+ * @return numero di caratteri scritti
+ */
+int scriviMetricheGiocateInternate (char* buffer, size_t dimensione);
+
+#endif	// LOTTO_INTERNI_H
@@ -0,0 +1,277 @@
+#include "lotto_limitatore.h"
+#include "lotto_condivisa.h"
+#include "costanti.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MASCHERA_INSIEMI_LIMITATORE (QUANTI_INSIEMI_LIMITATORE - 1)
+
+/* Limite di una categoria
+ */
+struct limite {
+	double frequenza;				// gettoni aggiunti al secondo (0 = nessun limite)
+	double raffica;					// capienza del secchiello
+};
+
+/* Secchiello di una categoria per un indirizzo
+ */
+struct secchiello {
+	double gettoni;
+	int64_t aggiornamento;			// istante dell'ultimo aggiornamento (ns, orologio monotono)
+};
+
+/* Elemento della cache: i secchielli di un indirizzo.
+ * Un elemento con indirizzo pari a 0 e' libero (0.0.0.0 non puo' essere l'indirizzo di un client)
+ */
+struct elemento_limitatore {
+	uint32_t indirizzo;
+	int64_t ultimo_accesso;			// usato per scegliere l'elemento da sostituire
+	uint32_t categorie_usate;		// maschera delle categorie il cui secchiello e' inizializzato
+	struct secchiello secchielli[QUANTE_CATEGORIE_LIMITE];
+};
+
+struct insieme_limitatore {
+	pthread_mutex_t mutex;
+	struct elemento_limitatore vie[VIE_LIMITATORE];
+};
+
+/* Struttura allocata in memoria condivisa
+ */
+struct limitatore {
+	uint64_t consentite[QUANTE_CATEGORIE_LIMITE];
+	uint64_t rifiutate[QUANTE_CATEGORIE_LIMITE];
+	uint64_t sostituzioni;			// indirizzi rimossi dalla cache per fare posto ad altri
+	struct insieme_limitatore insiemi[QUANTI_INSIEMI_LIMITATORE];
+};
+
+static struct limitatore* limitatore = NULL;
+
+// Nomi delle categorie (usati nelle specifiche dei limiti e nelle metriche)
+static const char* nomi_categorie[QUANTE_CATEGORIE_LIMITE] = {
+	[CATEGORIA_CONNESSIONE] = "connessioni",
+	[SIGNUP] = "signup",
+	[LOGIN] = "login",
+	[INVIA_GIOCATA] = "invia_giocata",
+	[VEDI_GIOCATE] = "vedi_giocate",
+	[VEDI_ESTRAZIONE] = "vedi_estrazione",
+	[VEDI_VINCITE] = "vedi_vincite",
+	[VEDI_RIEPILOGO] = "vedi_riepilogo",
+	[VEDI_METRICHE] = "vedi_metriche",
+	[RIPRENDI_SESSIONE] = "riprendi_sessione",
+	[QUOTA] = "quota",
+	[ANNULLA_ABBONAMENTO] = "annulla_abbonamento",
+	[VEDI_ESPOSIZIONE] = "vedi_esposizione",
+	[STATISTICHE] = "statistiche",
+	[CERCA_ESTRAZIONI] = "cerca_estrazioni",
+	[REPLAY] = "replay",
+	[IMPOSTA_PERIODO] = "imposta_periodo",
+};
+
+// Limiti predefiniti (le categorie non indicate hanno il limite di COMANDO_GENERICO)
+#define FREQUENZA_COMANDO_GENERICO 20.0
+#define RAFFICA_COMANDO_GENERICO 50.0
+
+static struct limite limiti[QUANTE_CATEGORIE_LIMITE] = {
+	[CATEGORIA_CONNESSIONE] = {5.0, 20.0},
+	[SIGNUP] = {1.0, 5.0},
+	[LOGIN] = {1.0, 5.0},
+	[RIPRENDI_SESSIONE] = {1.0, 5.0},
+	[VEDI_ESTRAZIONE] = {2.0, 10.0},
+};
+
+/* Restituisce l'istante attuale in nanosecondi (orologio monotono, comune a tutti i processi)
+ */
+static int64_t adessoNanosecondi ()
+{
+	struct timespec t;
+	
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+/* Imposta il limite di una o piu' categorie
+ * 
+ * @specifica stringa nel formato "nome=frequenza/raffica"
+ * 
+ * @return 0 in caso di successo, -1 se la specifica non e' valida
+ */
+int impostaLimite (const char* specifica)
+{
+	const char* uguale;
+	char* fine;
+	struct limite limite;
+	size_t lunghezza_nome;
+	int i, tutti_i_comandi, trovata = 0;
+	
+	uguale = strchr(specifica, '=');
+	if (!uguale) {
+		return -1;
+	}
+	lunghezza_nome = uguale - specifica;
+	
+	limite.frequenza = strtod(uguale + 1, &fine);
+	if (fine == uguale + 1 || *fine != '/' || limite.frequenza < 0) {
+		return -1;
+	}
+	limite.raffica = strtod(fine + 1, &fine);
+	if (*fine != '\0' || limite.raffica < 1) {
+		return -1;
+	}
+	
+	// "comandi" imposta il limite di tutte le categorie tranne le connessioni
+	tutti_i_comandi = (lunghezza_nome == strlen("comandi") && !strncmp(specifica, "comandi", lunghezza_nome));
+	
+	for (i = 0; i < QUANTE_CATEGORIE_LIMITE; ++i) {
+		if ((tutti_i_comandi && i != CATEGORIA_CONNESSIONE) || (nomi_categorie[i] &&
+				strlen(nomi_categorie[i]) == lunghezza_nome && !strncmp(specifica, nomi_categorie[i], lunghezza_nome))) {
+			limiti[i] = limite;
+			trovata = 1;
+		}
+	}
+	
+	return trovata ? 0 : -1;
+}
+
+/* Crea i secchielli in memoria condivisa
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int inizializzaLimitatore ()
+{
+	int i;
+	
+	// Le categorie senza un limite esplicito ricevono quello del comando generico
+	for (i = 0; i < QUANTE_CATEGORIE_LIMITE; ++i) {
+		if (i != CATEGORIA_CONNESSIONE && limiti[i].raffica == 0) {
+			limiti[i].frequenza = FREQUENZA_COMANDO_GENERICO;
+			limiti[i].raffica = RAFFICA_COMANDO_GENERICO;
+		}
+	}
+	
+	limitatore = (struct limitatore*)allocaMemoriaCondivisa(sizeof(struct limitatore));
+	if (!limitatore) {
+		return -1;
+	}
+	
+	for (i = 0; i < QUANTI_INSIEMI_LIMITATORE; ++i) {
+		if (inizializzaMutexCondiviso(&limitatore->insiemi[i].mutex) < 0) {
+			return -1;
+		}
+	}
+	
+	return 0;
+}
+
+/* Consuma i gettoni di una richiesta
+ * 
+ * @indirizzo indirizzo IPv4 del client in formato network
+ * @categoria CATEGORIA_CONNESSIONE oppure codice del comando
+ * @costo numero di gettoni richiesti
+ * 
+ * @return 1 se la richiesta e' consentita, 0 se deve essere rifiutata
+ */
+int richiestaConsentita (uint32_t indirizzo, uint8_t categoria, double costo)
+{
+	struct insieme_limitatore* insieme;
+	struct elemento_limitatore* elemento = NULL;
+	struct secchiello* secchiello;
+	const struct limite* limite;
+	int64_t adesso;
+	int i, consentita;
+	
+	if (categoria >= QUANTE_CATEGORIE_LIMITE) {
+		categoria = QUANTE_CATEGORIE_LIMITE - 1;
+	}
+	limite = &limiti[categoria];
+	
+	if (limite->frequenza == 0) {
+		__atomic_fetch_add(&limitatore->consentite[categoria], 1, __ATOMIC_RELAXED);
+		return 1;
+	}
+	
+	// Una richiesta piu' costosa dell'intera raffica non potrebbe mai essere pagata: viene rifiutata subito
+	if (costo > limite->raffica) {
+		__atomic_fetch_add(&limitatore->rifiutate[categoria], 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+	
+	adesso = adessoNanosecondi();
+	insieme = &limitatore->insiemi[(uint32_t)(((uint64_t)indirizzo * 0x9E3779B97F4A7C15ULL) >> 32) & MASCHERA_INSIEMI_LIMITATORE];
+	
+	bloccaMutexCondiviso(&insieme->mutex);
+	
+	// Cerca l'indirizzo nell'insieme; se non c'e', sostituisce l'elemento inattivo da piu' tempo
+	for (i = 0; i < VIE_LIMITATORE; ++i) {
+		if (insieme->vie[i].indirizzo == indirizzo) {
+			elemento = &insieme->vie[i];
+			break;
+		}
+		if (!elemento || insieme->vie[i].ultimo_accesso < elemento->ultimo_accesso) {
+			elemento = &insieme->vie[i];
+		}
+	}
+	if (elemento->indirizzo != indirizzo) {
+		if (elemento->indirizzo != 0) {
+			__atomic_fetch_add(&limitatore->sostituzioni, 1, __ATOMIC_RELAXED);
+		}
+		elemento->indirizzo = indirizzo;
+		elemento->categorie_usate = 0;
+	}
+	elemento->ultimo_accesso = adesso;
+	
+	// Un secchiello mai usato parte pieno
+	secchiello = &elemento->secchielli[categoria];
+	if (!(elemento->categorie_usate & (1U << categoria))) {
+		elemento->categorie_usate |= (1U << categoria);
+		secchiello->gettoni = limite->raffica;
+	}
+	else {
+		secchiello->gettoni += (double)(adesso - secchiello->aggiornamento) * 1e-9 * limite->frequenza;
+		if (secchiello->gettoni > limite->raffica) {
+			secchiello->gettoni = limite->raffica;
+		}
+	}
+	secchiello->aggiornamento = adesso;
+	
+	consentita = (secchiello->gettoni >= costo);
+	if (consentita) {
+		secchiello->gettoni -= costo;
+	}
+	
+	sbloccaMutexCondiviso(&insieme->mutex);
+	
+	__atomic_fetch_add(consentita ? &limitatore->consentite[categoria] : &limitatore->rifiutate[categoria], 1, __ATOMIC_RELAXED);
+	return consentita;
+}
+
+/* Scrive le metriche del limitatore (una per riga, nel formato "nome valore")
+ * 
+ * @buffer buffer in cui scrivere le metriche
+ * @dimensione dimensione del buffer
+ * 
+ * @return numero di caratteri scritti
+ */
+int scriviMetricheLimitatore (char* buffer, size_t dimensione)
+{
+	int i, ret, scritti = 0;
+	
+	for (i = 0; i < QUANTE_CATEGORIE_LIMITE; ++i) {
+		if (!nomi_categorie[i]) {
+			continue;
+		}
+		
+		ret = snprintf(buffer + scritti, dimensione - scritti,
+				"limitatore_consentite_%s %lu\n"
+				"limitatore_rifiutate_%s %lu\n",
+				nomi_categorie[i], (unsigned long)__atomic_load_n(&limitatore->consentite[i], __ATOMIC_RELAXED),
+				nomi_categorie[i], (unsigned long)__atomic_load_n(&limitatore->rifiutate[i], __ATOMIC_RELAXED));
+		scritti += caratteriScritti(ret, dimensione - scritti);
+	}
+	
+	ret = snprintf(buffer + scritti, dimensione - scritti, "limitatore_sostituzioni %lu\n",
+			(unsigned long)__atomic_load_n(&limitatore->sostituzioni, __ATOMIC_RELAXED));
+	
+	return scritti + caratteriScritti(ret, dimensione - scritti);
+}
@@ -0,0 +1,66 @@
+#ifndef LOTTO_LIMITATORE_H
+#define LOTTO_LIMITATORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//////////////////////////////////////////////////////
+//				LIMITATORE DELLE RICHIESTE			//
+//////////////////////////////////////////////////////
+/* Limita, per ogni indirizzo IP, la frequenza delle nuove connessioni e dei comandi con un "secchiello di gettoni"
+ * (token bucket): ogni categoria (connessioni e ciascun tipo di comando) ha un secchiello per indirizzo
+ * che si riempie con una certa frequenza fino ad una capienza massima (raffica); ogni richiesta consuma gettoni
+ * e viene rifiutata se il secchiello non ne contiene abbastanza.
+ * 
+ * I secchielli sono mantenuti in memoria condivisa, in una cache associativa a insiemi indicizzata per indirizzo:
+ * quando un insieme e' pieno viene sostituito l'indirizzo inattivo da piu' tempo (il cui secchiello e' comunque pieno).
+ * Ogni insieme e' protetto da un proprio mutex condiviso.
+ */
+
+// Categoria delle nuove connessioni. Le altre categorie coincidono con i codici dei comandi (vedi costanti.h)
+#define CATEGORIA_CONNESSIONE 0
+
+#define QUANTE_CATEGORIE_LIMITE 32
+
+// Dimensioni della cache: QUANTI_INSIEMI_LIMITATORE insiemi di VIE_LIMITATORE indirizzi
+#define QUANTI_INSIEMI_LIMITATORE (1 << 13)
+#define VIE_LIMITATORE 8
+
+/* Imposta il limite di una o piu' categorie.
+ * Deve essere chiamata dal processo principale prima di creare i processi figli.
+ * 
+ * @specifica stringa nel formato "nome=frequenza/raffica", dove nome e' "connessioni", il nome di un comando
+ *	(per esempio "vedi_estrazione") oppure "comandi" (tutti i comandi), frequenza e' il numero di gettoni
+ *	aggiunti al secondo e raffica la capienza del secchiello. Una frequenza pari a 0 disattiva il limite
+ * 
+ * @return 0 in caso di successo, -1 se la specifica non e' valida
+ */
+int impostaLimite (const char* specifica);
+
+/* Crea i secchielli in memoria condivisa.
+ * Deve essere chiamata dal processo principale prima di creare i processi figli.
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int inizializzaLimitatore ();
+
+/* Consuma i gettoni di una richiesta
+ * 
+ * @indirizzo indirizzo IPv4 del client in formato network
+ * @categoria CATEGORIA_CONNESSIONE oppure codice del comando
+ * @costo numero di gettoni richiesti (se supera la raffica, la richiesta viene sempre rifiutata)
+ * 
+ * @return 1 se la richiesta e' consentita, 0 se deve essere rifiutata
+ */
+int richiestaConsentita (uint32_t indirizzo, uint8_t categoria, double costo);
+
+/* Scrive le metriche del limitatore (una per riga, nel formato "nome valore")
+ * 
+ * @buffer buffer in cui scrivere le metriche
+ * @dimensione dimensione del buffer
+ * 
+ * @return numero di caratteri scritti
+ */
+int scriviMetricheLimitatore (char* buffer, size_t dimensione);
+
+#endif	// LOTTO_LIMITATORE_H
@@ -0,0 +1,52 @@
+#include "lotto.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Strumento di migrazione dei vecchi file di registro per utente (%utente%_schedine.bin, %utente%_vincite.txt
+ * e %utente%_riepilogo.bin) dalla cartella dei file alle sottocartelle indicate da percorsoFileUtente(...)
+ * (vedi lotto.h). Il server importa i vecchi file nei segmenti da entrambe le disposizioni senza spostarli:
+ * lo strumento serve solo a riordinare la cartella dei file, a server fermo, quando gli utenti sono molti.
+ * La migrazione sposta i file senza modificarli e senza mai sostituire un file gia' presente nelle sottocartelle;
+ * se viene interrotta, si riprende rieseguendo lo strumento.
+ * 
+ * Va eseguito dalla cartella del server:
+ *    ./lotto_migrazione [-c cartella]
+ */
+
+// Cartella predefinita dei file (come CARTELLA_FILES del server)
+#define CARTELLA_PREDEFINITA "./files"
+
+int main (int argc, char** argv)
+{
+	const char* cartella = CARTELLA_PREDEFINITA;
+	struct timespec inizio, fine;
+	int opzione, spostati;
+	
+	while ((opzione = getopt(argc, argv, "c:")) != -1) {
+		switch (opzione) {
+			case 'c': cartella = optarg; break;
+			default:
+				fprintf(stderr, "Uso: %s [-c cartella]\n", argv[0]);
+				exit(EXIT_FAILURE);
+		}
+	}
+	
+	clock_gettime(CLOCK_MONOTONIC, &inizio);
+	spostati = migraFileUtenti(cartella);
+	clock_gettime(CLOCK_MONOTONIC, &fine);
+	if (spostati < 0 && errno == EEXIST) {
+		fprintf(stderr, "Migrazione interrotta: una sottocartella di %s contiene gia' un file diverso con lo stesso nome\n", cartella);
+		exit(EXIT_FAILURE);
+	}
+	if (spostati < 0) {
+		perror("Impossibile completare la migrazione dei file per utente");
+		exit(EXIT_FAILURE);
+	}
+	
+	printf("Spostati %i file per utente nelle sottocartelle di %s in %.2f s\n", spostati, cartella,
+			(fine.tv_sec - inizio.tv_sec) + (fine.tv_nsec - inizio.tv_nsec) / 1e9);
+	return 0;
+}
@@ -0,0 +1,299 @@
+#include "lotto.h"
+#include "lotto_casuale.h"
+#include "lotto_premi.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Simulatore Monte Carlo delle vincite di una schedina.
+ * Estrae le ruote giocate con un generatore veloce (un generatore per thread) e calcola la vincita
+ * con le stesse regole del server (vedi lotto_premi.h), riportando vincita attesa, ritorno per il giocatore,
+ * varianza e probabilita' delle vincite piu' alte. I valori stimati vengono confrontati con quelli esatti,
+ * calcolati con la distribuzione ipergeometrica dei numeri comuni.
+ * 
+ *    ./lotto_montecarlo [-e estrazioni] [-t thread] [-s seme] [-s] -r tutte|<ruote>... -n <numeri>... -i <importi>...
+ * 
+ * La schedina si descrive come nel comando !invia_giocata del client, per esempio:
+ *    ./lotto_montecarlo -e 100000000 -r bari roma -n 15 19 33 -i 0 5 10
+ * oppure, per un sistema di 20 numeri su tutti gli ambi:
+ *    ./lotto_montecarlo -s -r napoli -n 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20 -i 0 1
+ */
+
+#define ESTRAZIONI_PREDEFINITE 10000000ULL
+#define SEME_PREDEFINITO 1
+
+// Le estrazioni vengono suddivise tra i thread in blocchi di questa dimensione
+#define ESTRAZIONI_PER_BLOCCO 65536
+
+#define MASSIMO_THREAD 256
+
+// Soglie (in multipli dell'importo giocato) per le probabilita' delle vincite piu' alte
+static const double soglie_coda[] = {1, 10, 100, 1000, 10000, 100000};
+#define QUANTE_SOGLIE (sizeof(soglie_coda) / sizeof(soglie_coda[0]))
+
+/* Risultati parziali di un thread.
+ * Allineati alla linea di cache, cosi' che i thread non si contendano la stessa linea
+ */
+struct risultati_thread {
+	uint64_t estrazioni;
+	uint64_t vincenti;					// estrazioni con vincita non nulla
+	uint64_t oltre_soglia[QUANTE_SOGLIE];
+	double somma;
+	double somma_quadrati;
+	double massimo;
+} __attribute__((aligned(64)));
+
+/* Parametri della simulazione, condivisi (in sola lettura) da tutti i thread
+ */
+struct simulazione {
+	struct schedina sched;
+	struct insieme_numeri numeri;			// numeri giocati
+	double vincita_per_comuni[QUANTI_NUMERI_ESTRATTI + 1];	// vincita su una ruota per numero di numeri comuni
+	double importo_totale;
+	uint64_t estrazioni;
+	uint64_t seme;
+	uint64_t prossimo_blocco;				// prossimo blocco di estrazioni da assegnare (atomico)
+	struct risultati_thread risultati[MASSIMO_THREAD];
+};
+
+static struct simulazione simulazione;
+
+/* Restituisce l'istante attuale in secondi (orologio monotono)
+ */
+static double adessoSecondi ()
+{
+	struct timespec t;
+	
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* Corpo di un thread: prende blocchi di estrazioni finche' ce ne sono.
+ * La vincita dipende solo dal numero di numeri comuni tra schedina ed estrazione, percio' ogni ruota
+ * costa l'estrazione di 5 numeri in una maschera di bit e un conteggio dei bit comuni
+ */
+static void* simulaThread (void* argomento)
+{
+	struct risultati_thread* risultati = (struct risultati_thread*)argomento;
+	struct risultati_thread parziali;
+	struct generatore_casuale generatore;
+	const double* vincita_per_comuni = simulazione.vincita_per_comuni;
+	const struct insieme_numeri numeri = simulazione.numeri;
+	const int quanteRuote = simulazione.sched.quanteRuote;
+	uint64_t blocco, k;
+	size_t s;
+	int r;
+	
+	memset(&parziali, 0, sizeof(parziali));
+	
+	while ((blocco = __atomic_fetch_add(&simulazione.prossimo_blocco, 1, __ATOMIC_RELAXED)) * ESTRAZIONI_PER_BLOCCO
+			< simulazione.estrazioni) {
+		uint64_t inizio = blocco * ESTRAZIONI_PER_BLOCCO;
+		uint64_t fine = inizio + ESTRAZIONI_PER_BLOCCO;
+		
+		if (fine > simulazione.estrazioni) {
+			fine = simulazione.estrazioni;
+		}
+		
+		// Ogni blocco ha il proprio seme: il risultato non dipende dal numero di thread
+		inizializzaGeneratore(&generatore, simulazione.seme ^ (blocco * 0x9E3779B97F4A7C15ULL));
+		
+		for (k = inizio; k < fine; ++k) {
+			double vincita = 0;
+			
+			for (r = 0; r < quanteRuote; ++r) {
+				struct insieme_numeri estrazione = {{0, 0}};
+				int quanti = 0;
+				
+				// Estrazione direttamente nella maschera: un numero gia' estratto viene scartato e ripetuto
+				// (succede con probabilita' < 5%), evitando di preparare un'urna di 90 numeri per ogni ruota
+				while (quanti < QUANTI_NUMERI_ESTRATTI) {
+					uint32_t numero = 1 + casualeLimitato(&generatore, NUMERI_ESTRAIBILI);
+					uint64_t bit = (uint64_t)1 << (numero & 63);
+					
+					if (!(estrazione.parte[numero >> 6] & bit)) {
+						estrazione.parte[numero >> 6] |= bit;
+						quanti++;
+					}
+				}
+				vincita += vincita_per_comuni[quantiNumeriComuni(numeri, estrazione)];
+			}
+			
+			if (vincita > 0) {
+				parziali.vincenti++;
+				parziali.somma += vincita;
+				parziali.somma_quadrati += vincita * vincita;
+				if (vincita > parziali.massimo) {
+					parziali.massimo = vincita;
+				}
+				for (s = 0; s < QUANTE_SOGLIE && vincita >= soglie_coda[s] * simulazione.importo_totale; ++s) {
+					parziali.oltre_soglia[s]++;
+				}
+			}
+		}
+		parziali.estrazioni += fine - inizio;
+	}
+	
+	*risultati = parziali;
+	return NULL;
+}
+
+/* Legge la schedina dalla riga di comando (stessa sintassi di !invia_giocata)
+ * 
+ * @return 0 in caso di successo, -1 se la schedina non e' valida
+ */
+static int leggiSchedina (int argc, char** argv, int indice, struct schedina* sched)
+{
+	static int ruote[QUANTE_RUOTE], numeri[QUANTITA_MASSIMA_NUMERI_SISTEMA];
+	static double importi[QUANTI_TIPI_PREMIO];
+	int i;
+	
+	sched->ruote = ruote;
+	sched->numeriGiocati = numeri;
+	sched->importi = importi;
+	sched->quanteRuote = sched->quantiNumeri = sched->quantiImporti = sched->sistema = 0;
+	sched->quanteEstrazioni = 1;	// il valore atteso di una giocata non dipende dalle estrazioni coperte
+	sched->annullamento = 0;
+	
+	while (indice < argc) {
+		char opzione;
+		
+		if (argv[indice][0] != '-' || strlen(argv[indice]) != 2) {
+			return -1;
+		}
+		opzione = argv[indice][1];
+		if (opzione == 's') {	// sistema (opzione senza argomenti)
+			sched->sistema = 1;
+		}
+		
+		for (++indice; indice < argc && argv[indice][0] != '-'; ++indice) {
+			if (opzione == 'r' && !strcmp(argv[indice], "tutte")) {
+				for (i = 0; i < QUANTE_RUOTE; ++i) {
+					ruote[i] = i;
+				}
+				sched->quanteRuote = QUANTE_RUOTE;
+			}
+			else if (opzione == 'r' && sched->quanteRuote < QUANTE_RUOTE) {
+				ruote[sched->quanteRuote] = convertiRuotaStringToInt(argv[indice]);
+				if (ruote[sched->quanteRuote++] < 0) {
+					return -1;
+				}
+			}
+			else if (opzione == 'n' && sched->quantiNumeri < QUANTITA_MASSIMA_NUMERI_SISTEMA) {
+				numeri[sched->quantiNumeri++] = atoi(argv[indice]);
+			}
+			else if (opzione == 'i' && sched->quantiImporti < QUANTI_TIPI_PREMIO) {
+				importi[sched->quantiImporti++] = atof(argv[indice]);
+			}
+			else {
+				return -1;
+			}
+		}
+	}
+	
+	return schedinaValida(sched) ? 0 : -1;
+}
+
+int main (int argc, char** argv)
+{
+	struct schedina* sched = &simulazione.sched;
+	struct risultati_thread totale;
+	pthread_t thread[MASSIMO_THREAD];
+	struct quota quota;
+	double media, varianza, varianza_ruota = 0, inizio, durata;
+	long quanti_thread = sysconf(_SC_NPROCESSORS_ONLN);
+	int i, indice = 1, k;
+	size_t s;
+	
+	simulazione.estrazioni = ESTRAZIONI_PREDEFINITE;
+	simulazione.seme = SEME_PREDEFINITO;
+	
+	// Opzioni della simulazione, seguite dalla schedina
+	// ("-s" seguito da un'altra opzione non e' il seme ma l'opzione sistema della schedina)
+	while (indice + 1 < argc && (!strcmp(argv[indice], "-e") || !strcmp(argv[indice], "-t")
+			|| (!strcmp(argv[indice], "-s") && argv[indice + 1][0] != '-'))) {
+		switch (argv[indice][1]) {
+			case 'e': simulazione.estrazioni = strtoull(argv[indice + 1], NULL, 10); break;
+			case 't': quanti_thread = atol(argv[indice + 1]); break;
+			case 's': simulazione.seme = strtoull(argv[indice + 1], NULL, 10); break;
+		}
+		indice += 2;
+	}
+	
+	if (quanti_thread < 1 || quanti_thread > MASSIMO_THREAD || leggiSchedina(argc, argv, indice, sched) < 0) {
+		fprintf(stderr, "Uso: %s [-e estrazioni] [-t thread (1-%i)] [-s seme] [-s] -r tutte|<ruote>... -n <numeri>... -i <importi>...\n",
+				argv[0], MASSIMO_THREAD);
+		exit(EXIT_FAILURE);
+	}
+	
+	// Quota esatta della schedina, calcolata con le regole del server: fornisce anche la vincita
+	// su una ruota per ogni numero di numeri comuni, usata dalla simulazione
+	inizializzaTabellePremi();
+	calcolaQuota(sched, &quota);
+	memcpy(simulazione.vincita_per_comuni, quota.vincita_comuni, sizeof(quota.vincita_comuni));
+	simulazione.numeri = insiemeNumeri(sched->numeriGiocati, sched->quantiNumeri);
+	simulazione.importo_totale = quota.importo;
+	
+	// Varianza esatta: le ruote sono indipendenti, percio' le varianze si sommano sulle ruote giocate
+	for (k = 0; k <= QUANTI_NUMERI_ESTRATTI; ++k) {
+		varianza_ruota += quota.probabilita_comuni[k] * quota.vincita_comuni[k] * quota.vincita_comuni[k];
+	}
+	varianza_ruota -= quota.vincita_attesa_ruota * quota.vincita_attesa_ruota;
+	
+	// Simulazione
+	inizio = adessoSecondi();
+	for (i = 0; i < quanti_thread; ++i) {
+		if (pthread_create(&thread[i], NULL, simulaThread, &simulazione.risultati[i]) != 0) {
+			perror("Impossibile creare thread");
+			exit(EXIT_FAILURE);
+		}
+	}
+	memset(&totale, 0, sizeof(totale));
+	for (i = 0; i < quanti_thread; ++i) {
+		struct risultati_thread* parziali = &simulazione.risultati[i];
+		
+		pthread_join(thread[i], NULL);
+		totale.estrazioni += parziali->estrazioni;
+		totale.vincenti += parziali->vincenti;
+		totale.somma += parziali->somma;
+		totale.somma_quadrati += parziali->somma_quadrati;
+		if (parziali->massimo > totale.massimo) {
+			totale.massimo = parziali->massimo;
+		}
+		for (s = 0; s < QUANTE_SOGLIE; ++s) {
+			totale.oltre_soglia[s] += parziali->oltre_soglia[s];
+		}
+	}
+	durata = adessoSecondi() - inizio;
+	
+	media = totale.somma / totale.estrazioni;
+	varianza = totale.somma_quadrati / totale.estrazioni - media * media;
+	
+	printf("Schedina: %i numeri su %i ruote, importo totale %.2lf\n", sched->quantiNumeri, sched->quanteRuote, simulazione.importo_totale);
+	printf("Estrazioni simulate: %lu con %li thread in %.2f s (%.1f milioni di ruote/s)\n", (unsigned long)totale.estrazioni,
+			quanti_thread, durata, totale.estrazioni * (double)sched->quanteRuote / durata / 1e6);
+	printf("\n%-28s %16s %16s\n", "", "stimato", "esatto");
+	printf("%-28s %16.6lf %16.6lf\n", "vincita attesa", media, quota.vincita_attesa);
+	printf("%-28s %15.4lf%% %15.4lf%%\n", "ritorno per il giocatore",
+			100 * media / simulazione.importo_totale, 100 * quota.vincita_attesa / simulazione.importo_totale);
+	printf("%-28s %15.4lf%% %15.4lf%%\n", "margine del banco",
+			100 - 100 * media / simulazione.importo_totale, 100 - 100 * quota.vincita_attesa / simulazione.importo_totale);
+	printf("%-28s %16.4lf %16.4lf\n", "varianza", varianza, varianza_ruota * sched->quanteRuote);
+	printf("%-28s %16.4lf %16.4lf\n", "deviazione standard", sqrt(varianza), sqrt(varianza_ruota * sched->quanteRuote));
+	printf("%-28s %16.6lf\n", "errore standard della media", sqrt(varianza / totale.estrazioni));
+	printf("%-28s %15.6lf%%\n", "estrazioni vincenti", 100.0 * totale.vincenti / totale.estrazioni);
+	printf("%-28s %16.2lf\n", "vincita massima osservata", totale.massimo);
+	
+	printf("\nProbabilita' di vincere almeno:\n");
+	for (s = 0; s < QUANTE_SOGLIE; ++s) {
+		printf("  %8.0lf volte l'importo    %.3e (%lu estrazioni)\n", soglie_coda[s],
+				(double)totale.oltre_soglia[s] / totale.estrazioni, (unsigned long)totale.oltre_soglia[s]);
+	}
+	
+	return 0;
+}
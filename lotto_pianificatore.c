@@ -0,0 +1,287 @@
+#include "lotto_pianificatore.h"
+#include "lotto_condivisa.h"
+#include <errno.h>
+#include <stdio.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NANOSECONDI_IN_UN_SECONDO 1000000000LL
+
+/* Metriche del pianificatore, allocate in memoria condivisa.
+ * Vengono scritte solo dal processo principale (con scritture atomiche) e lette da qualunque processo,
+ * tranne periodo_richiesto che viene scritto dal processo che chiede un nuovo periodo
+ */
+struct metriche_pianificatore {
+	uint32_t periodo;				// secondi
+	uint32_t periodo_richiesto;		// periodo chiesto con richiediPeriodoPianificatore(...), 0 se non ce n'e' nessuno
+	uint64_t cambi_periodo;
+	int64_t prossima_scadenza;		// secondi dall'epoch
+	uint64_t risvegli;				// letture del timer con almeno una scadenza
+	uint64_t estrazioni;
+	uint64_t saltate;				// scadenze perse senza estrazione (RECUPERO_UNICA o oltre il massimo)
+	uint64_t recuperate;			// estrazioni effettuate in ritardo di almeno un periodo (RECUPERO_COMPLETO)
+	uint64_t riallineamenti;		// modifiche dell'orologio di sistema
+	
+	// Ritardo del risveglio rispetto alla scadenza del calendario (ns)
+	uint64_t ritardo_ultimo;
+	uint64_t ritardo_massimo;
+	uint64_t ritardo_totale;
+	
+	// Durata delle estrazioni (ns)
+	uint64_t durata_ultima;
+	uint64_t durata_massima;
+};
+
+static struct metriche_pianificatore* metriche = NULL;
+
+static int descrittore_timer = -1;
+static int descrittore_richieste = -1;	// eventfd delle richieste di un nuovo periodo
+static int politica_recupero = RECUPERO_UNICA;
+static int64_t periodo_ns;
+static int64_t prossima_scadenza;	// prossima scadenza del calendario (ns dall'epoch)
+
+/* Arma il timer sulla prossima scadenza allineata al periodo
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int armaTimer ()
+{
+	struct itimerspec scadenze = {{0, 0}, {0, 0}};
+	struct timespec adesso;
+	uint32_t periodo = metriche->periodo;
+	
+	clock_gettime(CLOCK_REALTIME, &adesso);
+	scadenze.it_value.tv_sec = (adesso.tv_sec / periodo + 1) * periodo;
+	scadenze.it_interval.tv_sec = periodo;
+	
+	// Con TFD_TIMER_CANCEL_ON_SET la read(...) fallisce con ECANCELED se l'orologio di sistema viene modificato
+	if (timerfd_settime(descrittore_timer, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &scadenze, NULL) < 0) {
+		perror("Impossibile armare il timer delle estrazioni");
+		return -1;
+	}
+	
+	prossima_scadenza = (int64_t)scadenze.it_value.tv_sec * NANOSECONDI_IN_UN_SECONDO;
+	__atomic_store_n(&metriche->prossima_scadenza, (int64_t)scadenze.it_value.tv_sec, __ATOMIC_RELAXED);
+	return 0;
+}
+
+/* Crea il timer delle estrazioni e le metriche in memoria condivisa
+ * 
+ * @periodo periodo delle estrazioni in secondi (> 0)
+ * @politica politica di recupero delle scadenze perse
+ * 
+ * @return descrittore del timer, -1 in caso di errore
+ */
+int inizializzaPianificatore (uint32_t periodo, int politica)
+{
+	if (periodo == 0) {
+		return -1;
+	}
+	
+	metriche = (struct metriche_pianificatore*)allocaMemoriaCondivisa(sizeof(struct metriche_pianificatore));
+	if (!metriche) {
+		return -1;
+	}
+	metriche->periodo = periodo;
+	
+	politica_recupero = politica;
+	periodo_ns = (int64_t)periodo * NANOSECONDI_IN_UN_SECONDO;
+	
+	descrittore_timer = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK);
+	if (descrittore_timer < 0) {
+		perror("Impossibile creare il timer delle estrazioni");
+		return -1;
+	}
+	
+	// L'eventfd viene ereditato dai processi figli, che lo usano per segnalare un nuovo periodo
+	descrittore_richieste = eventfd(0, EFD_NONBLOCK);
+	if (descrittore_richieste < 0) {
+		perror("Impossibile creare il descrittore delle richieste del pianificatore");
+		close(descrittore_timer);
+		descrittore_timer = -1;
+		return -1;
+	}
+	
+	if (armaTimer() < 0) {
+		close(descrittore_timer);
+		close(descrittore_richieste);
+		descrittore_timer = descrittore_richieste = -1;
+		return -1;
+	}
+	
+	return descrittore_timer;
+}
+
+/* Restituisce il descrittore su cui vengono segnalate le richieste di un nuovo periodo
+ */
+int descrittoreRichiestePianificatore ()
+{
+	return descrittore_richieste;
+}
+
+/* Chiede di cambiare il periodo delle estrazioni (da qualunque processo del server)
+ * 
+ * @periodo nuovo periodo delle estrazioni in secondi (> 0)
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int richiediPeriodoPianificatore (uint32_t periodo)
+{
+	uint64_t segnale = 1;
+	
+	if (periodo == 0) {
+		return -1;
+	}
+	
+	// Tra piu' richieste ravvicinate vale l'ultima
+	__atomic_store_n(&metriche->periodo_richiesto, periodo, __ATOMIC_RELEASE);
+	return (write(descrittore_richieste, &segnale, sizeof(segnale)) == sizeof(segnale)) ? 0 : -1;
+}
+
+/* Applica l'ultimo periodo richiesto, riarmando il timer sul primo multiplo del nuovo periodo
+ * 
+ * @return nuovo periodo in secondi, 0 se non c'era nessuna richiesta, -1 in caso di errore
+ */
+long applicaPeriodoRichiesto ()
+{
+	uint64_t segnali;
+	uint32_t periodo;
+	
+	if (read(descrittore_richieste, &segnali, sizeof(segnali)) < 0 && errno != EAGAIN) {
+		perror("Impossibile leggere le richieste del pianificatore");
+		return -1;
+	}
+	
+	periodo = __atomic_exchange_n(&metriche->periodo_richiesto, 0, __ATOMIC_ACQUIRE);
+	if (periodo == 0) {
+		return 0;
+	}
+	
+	__atomic_store_n(&metriche->periodo, periodo, __ATOMIC_RELAXED);
+	__atomic_store_n(&metriche->cambi_periodo, metriche->cambi_periodo + 1, __ATOMIC_RELAXED);
+	periodo_ns = (int64_t)periodo * NANOSECONDI_IN_UN_SECONDO;
+	
+	return (armaTimer() < 0) ? -1 : (long)periodo;
+}
+
+/* Consuma le scadenze del timer e aggiorna le metriche
+ * 
+ * @timestamp vettore in cui scrivere la scadenza di ogni estrazione da effettuare
+ * 
+ * @return numero di estrazioni da effettuare, -1 in caso di errore
+ */
+int estrazioniDovute (time_t timestamp[])
+{
+	uint64_t scadenze, ritardo, dovute, i;
+	int64_t ultima_scadenza;
+	struct timespec adesso;
+	ssize_t ret;
+	
+	ret = read(descrittore_timer, &scadenze, sizeof(scadenze));
+	if (ret < 0) {
+		// L'orologio di sistema e' stato modificato: il calendario viene riallineato al nuovo orario
+		if (errno == ECANCELED) {
+			__atomic_store_n(&metriche->riallineamenti, metriche->riallineamenti + 1, __ATOMIC_RELAXED);
+			return (armaTimer() < 0) ? -1 : 0;
+		}
+		if (errno == EAGAIN || errno == EINTR) {
+			return 0;
+		}
+		perror("Impossibile leggere il timer delle estrazioni");
+		return -1;
+	}
+	if (ret != sizeof(scadenze) || scadenze == 0) {
+		return 0;
+	}
+	
+	// Ritardo rispetto all'ultima scadenza trascorsa: se il processo e' rimasto bloccato
+	// per piu' di un periodo, le scadenze precedenti sono state perse
+	clock_gettime(CLOCK_REALTIME, &adesso);
+	ultima_scadenza = prossima_scadenza + (int64_t)(scadenze - 1) * periodo_ns;
+	ritardo = (uint64_t)((int64_t)adesso.tv_sec * NANOSECONDI_IN_UN_SECONDO + adesso.tv_nsec - ultima_scadenza);
+	if ((int64_t)ritardo < 0) {
+		ritardo = 0;
+	}
+	prossima_scadenza = ultima_scadenza + periodo_ns;
+	
+	if (politica_recupero == RECUPERO_COMPLETO) {
+		dovute = (scadenze < MASSIMO_ESTRAZIONI_RECUPERATE) ? scadenze : MASSIMO_ESTRAZIONI_RECUPERATE;
+	}
+	else {
+		dovute = 1;
+	}
+	
+	// Le estrazioni dovute corrispondono alle ultime scadenze trascorse
+	for (i = 0; i < dovute; ++i) {
+		timestamp[i] = (time_t)((ultima_scadenza - (int64_t)(dovute - 1 - i) * periodo_ns) / NANOSECONDI_IN_UN_SECONDO);
+	}
+	
+	__atomic_store_n(&metriche->risvegli, metriche->risvegli + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&metriche->saltate, metriche->saltate + (scadenze - dovute), __ATOMIC_RELAXED);
+	__atomic_store_n(&metriche->recuperate, metriche->recuperate + (dovute - 1), __ATOMIC_RELAXED);
+	__atomic_store_n(&metriche->ritardo_ultimo, ritardo, __ATOMIC_RELAXED);
+	__atomic_store_n(&metriche->ritardo_totale, metriche->ritardo_totale + ritardo, __ATOMIC_RELAXED);
+	if (ritardo > metriche->ritardo_massimo) {
+		__atomic_store_n(&metriche->ritardo_massimo, ritardo, __ATOMIC_RELAXED);
+	}
+	__atomic_store_n(&metriche->prossima_scadenza, prossima_scadenza / NANOSECONDI_IN_UN_SECONDO, __ATOMIC_RELAXED);
+	
+	return (int)dovute;
+}
+
+/* Registra la durata di un'estrazione
+ * 
+ * @durata durata dell'estrazione in nanosecondi
+ */
+void registraDurataEstrazione (int64_t durata)
+{
+	__atomic_store_n(&metriche->estrazioni, metriche->estrazioni + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&metriche->durata_ultima, (uint64_t)durata, __ATOMIC_RELAXED);
+	if ((uint64_t)durata > metriche->durata_massima) {
+		__atomic_store_n(&metriche->durata_massima, (uint64_t)durata, __ATOMIC_RELAXED);
+	}
+}
+
+/* Scrive le metriche del pianificatore (una per riga, nel formato "nome valore")
+ * 
+ * @buffer buffer in cui scrivere le metriche
+ * @dimensione dimensione del buffer
+ * 
+ * @return numero di caratteri scritti
+ */
+int scriviMetrichePianificatore (char* buffer, size_t dimensione)
+{
+	uint64_t risvegli = __atomic_load_n(&metriche->risvegli, __ATOMIC_RELAXED);
+	uint64_t ritardo_totale = __atomic_load_n(&metriche->ritardo_totale, __ATOMIC_RELAXED);
+	int ret;
+	
+	ret = snprintf(buffer, dimensione,
+			"pianificatore_periodo_secondi %u\n"
+			"pianificatore_cambi_periodo %lu\n"
+			"pianificatore_prossima_estrazione %ld\n"
+			"pianificatore_estrazioni %lu\n"
+			"pianificatore_scadenze_saltate %lu\n"
+			"pianificatore_estrazioni_recuperate %lu\n"
+			"pianificatore_riallineamenti %lu\n"
+			"pianificatore_ritardo_ultimo_us %lu\n"
+			"pianificatore_ritardo_medio_us %lu\n"
+			"pianificatore_ritardo_massimo_us %lu\n"
+			"pianificatore_durata_ultima_estrazione_us %lu\n"
+			"pianificatore_durata_massima_estrazione_us %lu\n",
+			__atomic_load_n(&metriche->periodo, __ATOMIC_RELAXED),
+			(unsigned long)__atomic_load_n(&metriche->cambi_periodo, __ATOMIC_RELAXED),
+			(long int)__atomic_load_n(&metriche->prossima_scadenza, __ATOMIC_RELAXED),
+			(unsigned long)__atomic_load_n(&metriche->estrazioni, __ATOMIC_RELAXED),
+			(unsigned long)__atomic_load_n(&metriche->saltate, __ATOMIC_RELAXED),
+			(unsigned long)__atomic_load_n(&metriche->recuperate, __ATOMIC_RELAXED),
+			(unsigned long)__atomic_load_n(&metriche->riallineamenti, __ATOMIC_RELAXED),
+			(unsigned long)(__atomic_load_n(&metriche->ritardo_ultimo, __ATOMIC_RELAXED) / 1000),
+			(unsigned long)(risvegli ? ritardo_totale / risvegli / 1000 : 0),
+			(unsigned long)(__atomic_load_n(&metriche->ritardo_massimo, __ATOMIC_RELAXED) / 1000),
+			(unsigned long)(__atomic_load_n(&metriche->durata_ultima, __ATOMIC_RELAXED) / 1000),
+			(unsigned long)(__atomic_load_n(&metriche->durata_massima, __ATOMIC_RELAXED) / 1000));
+	
+	return caratteriScritti(ret, dimensione);
+}
@@ -0,0 +1,96 @@
+#ifndef LOTTO_PIANIFICATORE_H
+#define LOTTO_PIANIFICATORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+//////////////////////////////////////////////////////
+//			PIANIFICATORE DELLE ESTRAZIONI			//
+//////////////////////////////////////////////////////
+/* Il pianificatore scandisce le estrazioni con un timerfd sull'orologio di sistema (CLOCK_REALTIME),
+ * allineato ai multipli del periodo a partire dall'epoch: con un periodo di 5 minuti le estrazioni
+ * avvengono alle xx:00, xx:05, ... indipendentemente dall'istante di avvio e dalla durata delle estrazioni,
+ * percio' il calendario non accumula ritardo. Il periodo si esprime in secondi.
+ * 
+ * Il descrittore del timer viene controllato dal ciclo principale del server (con poll(...), insieme al socket
+ * in ascolto): quando diventa leggibile, estrazioniDovute(...) restituisce quante estrazioni effettuare.
+ * Se il server e' rimasto bloccato per piu' di un periodo, le scadenze perse vengono gestite secondo
+ * la politica di recupero:
+ * - RECUPERO_UNICA: si effettua una sola estrazione e le scadenze perse vengono saltate
+ * - RECUPERO_COMPLETO: si effettuano tutte le estrazioni perse (al massimo MASSIMO_ESTRAZIONI_RECUPERATE)
+ * Ogni estrazione dovuta riceve la propria scadenza del calendario, cosi' che le estrazioni recuperate
+ * una dopo l'altra abbiano timestamp distinti.
+ * 
+ * Se l'orologio di sistema viene modificato, il timer viene riallineato al nuovo orario.
+ * 
+ * Il periodo puo' essere cambiato mentre il server e' attivo: qualunque processo puo' chiedere un nuovo periodo
+ * con richiediPeriodoPianificatore(...), che lo scrive in memoria condivisa e lo segnala al processo principale
+ * attraverso un eventfd; il ciclo principale controlla anche questo descrittore e, quando diventa leggibile,
+ * applicaPeriodoRichiesto(...) riarma il timer sul primo multiplo del nuovo periodo.
+ * Le metriche (ritardo delle estrazioni rispetto al calendario, scadenze saltate, ...) sono in memoria condivisa,
+ * cosi' che qualunque processo del server possa riportarle.
+ */
+
+#define RECUPERO_UNICA 0
+#define RECUPERO_COMPLETO 1
+
+#define MASSIMO_ESTRAZIONI_RECUPERATE 10
+
+/* Crea il timer delle estrazioni e le metriche in memoria condivisa.
+ * Deve essere chiamata dal processo principale prima di creare i processi figli.
+ * 
+ * @periodo periodo delle estrazioni in secondi (> 0)
+ * @politica politica di recupero delle scadenze perse (RECUPERO_UNICA o RECUPERO_COMPLETO)
+ * 
+ * @return descrittore del timer (da controllare con poll(...)), -1 in caso di errore
+ */
+int inizializzaPianificatore (uint32_t periodo, int politica);
+
+/* Restituisce il descrittore (eventfd) su cui vengono segnalate le richieste di un nuovo periodo,
+ * da controllare con poll(...) nel ciclo principale insieme al timer
+ */
+int descrittoreRichiestePianificatore ();
+
+/* Chiede di cambiare il periodo delle estrazioni. Puo' essere chiamata da qualunque processo del server:
+ * il nuovo periodo viene applicato dal processo principale con applicaPeriodoRichiesto(...)
+ * 
+ * @periodo nuovo periodo delle estrazioni in secondi (> 0)
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int richiediPeriodoPianificatore (uint32_t periodo);
+
+/* Applica l'ultimo periodo richiesto con richiediPeriodoPianificatore(...), riarmando il timer.
+ * Va chiamata dal processo principale quando il descrittore delle richieste e' leggibile.
+ * 
+ * @return nuovo periodo in secondi, 0 se non c'era nessuna richiesta, -1 in caso di errore
+ */
+long applicaPeriodoRichiesto ();
+
+/* Consuma le scadenze del timer e aggiorna le metriche.
+ * Va chiamata quando il descrittore del timer e' leggibile.
+ * 
+ * @timestamp vettore di MASSIMO_ESTRAZIONI_RECUPERATE elementi in cui scrivere la scadenza (secondi dall'epoch)
+ *	di ogni estrazione da effettuare, in ordine crescente
+ * 
+ * @return numero di estrazioni da effettuare (0 se il timer e' stato riallineato), -1 in caso di errore
+ */
+int estrazioniDovute (time_t timestamp[]);
+
+/* Registra la durata di un'estrazione (usata solo per le metriche)
+ * 
+ * @durata durata dell'estrazione in nanosecondi
+ */
+void registraDurataEstrazione (int64_t durata);
+
+/* Scrive le metriche del pianificatore (una per riga, nel formato "nome valore")
+ * 
+ * @buffer buffer in cui scrivere le metriche
+ * @dimensione dimensione del buffer
+ * 
+ * @return numero di caratteri scritti
+ */
+int scriviMetrichePianificatore (char* buffer, size_t dimensione);
+
+#endif	// LOTTO_PIANIFICATORE_H
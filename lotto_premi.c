@@ -0,0 +1,215 @@
+#include "lotto_premi.h"
+
+/* probabilita_comuni[n][k]: probabilita' che k degli n numeri giocati siano estratti su una ruota
+ * (distribuzione ipergeometrica: C(n, k) * C(NUMERI_ESTRAIBILI - n, QUANTI_NUMERI_ESTRATTI - k) / C(NUMERI_ESTRAIBILI, QUANTI_NUMERI_ESTRATTI))
+ */
+static double probabilita_comuni[QUANTITA_MASSIMA_NUMERI_SISTEMA + 1][QUANTI_NUMERI_ESTRATTI + 1];
+
+/* binomiali[n][k]: coefficiente binomiale C(n, k), per n fino alla quantita' massima di numeri di un sistema
+ * e k fino alla puntata piu' alta (C(n, k) = 0 se k > n)
+ */
+static double binomiali[QUANTITA_MASSIMA_NUMERI_SISTEMA + 1][QUANTI_NUMERI_ESTRATTI + 1];
+
+/* Dato l'indice di una puntata (0: ESTRATTO, 1: AMBO...), restituisce il "moltiplicatore del premio",
+ * ovvero il valore della vincita per ogni Euro giocato (supponendo che l'importo della giocata 
+ * non venga suddiviso in sotto-importi). Rappresenta la funzione di conversione della Tabella 1
+ * a pagina 2 delle specifiche di progetto.
+ * 
+ * @p indice della vincita/puntata
+ * 
+ * @return valore della vincita per ogni euro giocato
+ */
+double moltiplicatorePremio (int p)
+{
+	switch (p) {
+		case 0: return PREMIO_SINGOLO;
+		case 1: return PREMIO_AMBO;
+		case 2: return PREMIO_TERNO;
+		case 3: return PREMIO_QUATERNA;
+		case 4: return PREMIO_CINQUINA;
+		default: return 1;
+	}
+}
+
+/* Calcola il coefficiente binomiale con parametri n e k
+ * Formula originale --> ( n! ) / ( k! * (n-k)! )
+ * che semplificanso diventa --> ( n * (n-1) * (n-2) * ... * (n-k+1) ) / ( k * (k-1) * ... * 2 * 1)
+ * 
+ * Il prodotto viene accumulato un fattore alla volta in un double (dopo ogni passo e' ancora un coefficiente
+ * binomiale, quindi un intero esatto): calcolare numeratore e denominatore separatamente con interi a 32 bit
+ * va in overflow gia' con C(90, 5)
+ */
+double coefficienteBinomiale (unsigned int n, unsigned int k)
+{
+	unsigned int i;
+	double risultato = 1;
+	
+	if (k > n) return -1;
+	
+	for (i = 0; i < k; ++i) {
+		risultato = risultato * (n-i) / (i+1);
+	}
+	
+	return risultato;
+}
+
+/* Calcola le vincite di una schedina su una delle ruote giocate
+ * 
+ * @sched schedina giocata
+ * @quantiComuni quanti numeri giocati sono stati estratti sulla ruota
+ * @vincite vettore in cui scrivere la vincita di ogni tipo di puntata
+ * 
+ * @return numero delle vincite scritte in <vincite>
+ */
+int calcolaVinciteRuota (const struct schedina* sched, int quantiComuni, double* vincite)
+{
+	int j;
+	
+	// Si usa il minimo perche' se l'utente scommette per un'evento che richiede alpha numeri (es: terno, 3) 
+	// e ci sono solo beta numeri comuni (con beta < alpha, es: ambo, 2),
+	// allora sicuramente gli eventi con indice SUPERIORE a beta non si sono verificati.
+	// Inoltre, se si verifica un evento di indice beta, tutti gli eventi di indice INFERIORE a beta
+	// si verificano con una frequenza pari al coefficiente binomiale (es: se vinco il terno, vinco anche 3 ambi e 3 estratti)
+	int quante_vincite = (sched->quantiImporti < quantiComuni) ? sched->quantiImporti : quantiComuni;
+	
+	for (j = 0; j < quante_vincite; ++j) {
+		/* Formula usata:
+		 * > importo_combinazione
+		 *		--> importo puntato su ogni combinazione di j+1 numeri: nelle schedine ordinarie l'importo
+		 *			della puntata j viene diviso tra le C(quantiNumeri, j+1) combinazioni dei numeri giocati,
+		 *			nelle schedine a sistema e' gia' l'importo di ciascuna combinazione
+		 * > binomiali[quantiComuni][j+1]
+		 *		--> frequenza dell'evento j nel set dei numeri comuni (combinazioni vincenti)
+		 * > moltiplicatorePremio(j)
+		 *		--> moltiplicatore statico dovuto al tipo di scommessa (estratto, ambo, terno...)
+		 * > quanteRuote
+		 *		--> il premio base per ogni euro viene equamente ripartito su ogni ruota
+		 */
+		double importo_combinazione = sched->sistema ? sched->importi[j]
+				: sched->importi[j] / binomiali[sched->quantiNumeri][j+1];
+		
+		vincite[j] = importo_combinazione
+			* binomiali[quantiComuni][j+1]
+			* (moltiplicatorePremio(j) / sched->quanteRuote);
+	}
+	
+	return quante_vincite;
+}
+
+/* Costruisce le tabelle dei coefficienti binomiali e della distribuzione ipergeometrica
+ */
+void inizializzaTabellePremi ()
+{
+	double casi_totali = coefficienteBinomiale(NUMERI_ESTRAIBILI, QUANTI_NUMERI_ESTRATTI);
+	int n, k;
+	
+	for (n = 0; n <= QUANTITA_MASSIMA_NUMERI_SISTEMA; ++n) {
+		for (k = 0; k <= QUANTI_NUMERI_ESTRATTI; ++k) {
+			double a = coefficienteBinomiale(n, k),
+				b = coefficienteBinomiale(NUMERI_ESTRAIBILI - n, QUANTI_NUMERI_ESTRATTI - k);
+			
+			binomiali[n][k] = (a < 0) ? 0 : a;
+			probabilita_comuni[n][k] = (a < 0 || b < 0) ? 0 : a * b / casi_totali;
+		}
+	}
+}
+
+/* Calcola l'importo totale di una schedina
+ * 
+ * @sched schedina valida
+ * 
+ * @return importo totale
+ */
+double importoSchedina (const struct schedina* sched)
+{
+	double importo = 0;
+	int j;
+	
+	for (j = 0; j < sched->quantiImporti; ++j) {
+		importo += sched->sistema ? sched->importi[j] * binomiali[sched->quantiNumeri][j+1] : sched->importi[j];
+	}
+	return importo;
+}
+
+/* Verifica che una schedina sia giocabile
+ * 
+ * @sched schedina da verificare
+ * 
+ * @return 1 se la schedina e' valida, 0 altrimenti
+ */
+int schedinaValida (const struct schedina* sched)
+{
+	uint32_t ruote_giocate = 0;
+	struct insieme_numeri numeri = {{0, 0}};
+	int i;
+	
+	if (sched->quanteRuote < 1 || sched->quanteRuote > QUANTE_RUOTE
+			|| sched->quantiNumeri < 1
+			|| sched->quantiNumeri > (sched->sistema ? QUANTITA_MASSIMA_NUMERI_SISTEMA : QUANTITA_MASSIMA_NUMERI_SCHEDINA)
+			|| sched->quantiImporti < 1 || sched->quantiImporti > sched->quantiNumeri
+			|| sched->quantiImporti > QUANTI_TIPI_PREMIO
+			|| sched->quanteEstrazioni < 0 || sched->quanteEstrazioni > MASSIMO_ESTRAZIONI_SCHEDINA
+			|| sched->annullamento < 0) {
+		return 0;
+	}
+	
+	for (i = 0; i < sched->quanteRuote; ++i) {
+		if (sched->ruote[i] < 0 || sched->ruote[i] >= QUANTE_RUOTE || (ruote_giocate & (1u << sched->ruote[i]))) {
+			return 0;
+		}
+		ruote_giocate |= 1u << sched->ruote[i];
+	}
+	
+	for (i = 0; i < sched->quantiNumeri; ++i) {
+		int numero = sched->numeriGiocati[i];
+		
+		if (numero < 1 || numero > NUMERI_ESTRAIBILI || (numeri.parte[numero >> 6] & ((uint64_t)1 << (numero & 63)))) {
+			return 0;
+		}
+		numeri.parte[numero >> 6] |= (uint64_t)1 << (numero & 63);
+	}
+	
+	for (i = 0; i < sched->quantiImporti; ++i) {
+		if (!(sched->importi[i] >= 0)) {	// esclude anche NaN
+			return 0;
+		}
+	}
+	
+	return 1;
+}
+
+/* Calcola la quota di una schedina
+ * 
+ * @sched schedina valida
+ * @quota struttura in cui scrivere la quota
+ */
+void calcolaQuota (const struct schedina* sched, struct quota* quota)
+{
+	const double* probabilita = probabilita_comuni[sched->quantiNumeri];
+	int j, k;
+	
+	quota->importo = importoSchedina(sched);
+	
+	quota->vincita_attesa_ruota = 0;
+	for (k = 0; k <= QUANTI_NUMERI_ESTRATTI; ++k) {
+		double vincite[QUANTI_TIPI_PREMIO];
+		int quante = calcolaVinciteRuota(sched, k, vincite);
+		
+		quota->probabilita_comuni[k] = probabilita[k];
+		quota->vincita_comuni[k] = 0;
+		for (j = 0; j < quante && k <= sched->quantiNumeri; ++j) {	// non si possono avere piu' numeri comuni che giocati
+			quota->vincita_comuni[k] += vincite[j];
+		}
+		quota->vincita_attesa_ruota += probabilita[k] * quota->vincita_comuni[k];
+	}
+	
+	// Si vince la puntata di indice j se almeno j+1 numeri giocati vengono estratti
+	for (j = 0; j < QUANTI_TIPI_PREMIO; ++j) {
+		quota->probabilita_premio[j] = 0;
+		for (k = j + 1; k <= QUANTI_NUMERI_ESTRATTI; ++k) {
+			quota->probabilita_premio[j] += probabilita[k];
+		}
+	}
+	
+	quota->vincita_attesa = quota->vincita_attesa_ruota * sched->quanteRuote;
+}
@@ -0,0 +1,150 @@
+#ifndef LOTTO_PREMI_H
+#define LOTTO_PREMI_H
+
+#include "lotto.h"
+#include <stdint.h>
+
+//////////////////////////////////////////////////
+//				CALCOLO DEI PREMI				//
+//////////////////////////////////////////////////
+/* Regole di calcolo delle vincite, condivise dal server (verifica delle schedine con !vedi_vincite)
+ * e dagli strumenti di simulazione (lotto_montecarlo).
+ * 
+ * La vincita di una schedina su una ruota dipende solo da quanti numeri giocati sono stati estratti
+ * sulla ruota: le simulazioni possono quindi precalcolare la vincita per ogni numero di numeri comuni
+ * e confrontare schedina ed estrazione come insiemi di bit.
+ * 
+ * Per lo stesso motivo la quota di una schedina (probabilita' di ogni esito e vincita attesa) si calcola
+ * esattamente dalla distribuzione ipergeometrica dei numeri comuni, tabulata all'avvio per ogni quantita'
+ * di numeri giocati: il calcolo di una quota richiede solo poche decine di operazioni.
+ * 
+ * Una schedina di n numeri equivale a tutte le C(n, j+1) combinazioni di j+1 numeri per ogni puntata j,
+ * e di queste ne vincono esattamente C(comuni, j+1): le vincite si calcolano dai coefficienti binomiali
+ * senza mai espandere le combinazioni. Nelle schedine ordinarie l'importo della puntata j e' ripartito
+ * tra le sue combinazioni; nelle schedine a sistema (fino a QUANTITA_MASSIMA_NUMERI_SISTEMA numeri)
+ * l'importo e' puntato su ciascuna combinazione, e il costo della schedina e' importo * C(n, j+1).
+ */
+
+/* Insieme di numeri estraibili (da 1 a NUMERI_ESTRAIBILI) rappresentato come maschera di bit
+ */
+struct insieme_numeri {
+	uint64_t parte[2];
+};
+
+_Static_assert(NUMERI_ESTRAIBILI < 128, "la maschera dei numeri e' di 128 bit");
+
+/* Costruisce l'insieme di un vettore di numeri
+ * 
+ * @numeri numeri da inserire (compresi tra 1 e NUMERI_ESTRAIBILI)
+ * @quanti quantita' dei numeri
+ * 
+ * @return insieme dei numeri
+ */
+static inline struct insieme_numeri insiemeNumeri (const int* numeri, int quanti)
+{
+	struct insieme_numeri insieme = {{0, 0}};
+	int i;
+	
+	for (i = 0; i < quanti; ++i) {
+		insieme.parte[numeri[i] >> 6] |= (uint64_t)1 << (numeri[i] & 63);
+	}
+	return insieme;
+}
+
+// Numero degli ambi di una ruota: C(NUMERI_ESTRAIBILI, 2)
+#define QUANTI_AMBI (NUMERI_ESTRAIBILI * (NUMERI_ESTRAIBILI - 1) / 2)
+
+/* Restituisce l'indice (da 0 a QUANTI_AMBI - 1) dell'ambo formato da due numeri distinti,
+ * usato dalle tabelle indicizzate per ambo
+ * 
+ * @a, @b numeri dell'ambo (compresi tra 1 e NUMERI_ESTRAIBILI, in qualunque ordine)
+ */
+static inline int indiceAmbo (int a, int b)
+{
+	if (a > b) {
+		int temp = a;
+		
+		a = b;
+		b = temp;
+	}
+	return (a - 1) * (2 * NUMERI_ESTRAIBILI - a) / 2 + (b - a - 1);
+}
+
+/* Restituisce quanti numeri hanno in comune due insiemi
+ */
+static inline int quantiNumeriComuni (struct insieme_numeri a, struct insieme_numeri b)
+{
+	return __builtin_popcountll(a.parte[0] & b.parte[0]) + __builtin_popcountll(a.parte[1] & b.parte[1]);
+}
+
+/* Dato l'indice di una puntata (0: ESTRATTO, 1: AMBO...), restituisce il "moltiplicatore del premio",
+ * ovvero il valore della vincita per ogni Euro giocato (supponendo che l'importo della giocata
+ * non venga suddiviso in sotto-importi)
+ * 
+ * @p indice della vincita/puntata
+ * 
+ * @return valore della vincita per ogni euro giocato
+ */
+double moltiplicatorePremio (int p);
+
+/* Calcola il coefficiente binomiale con parametri n e k
+ * 
+ * @return coefficiente binomiale, -1 se k > n
+ */
+double coefficienteBinomiale (unsigned int n, unsigned int k);
+
+/* Calcola le vincite di una schedina su una delle ruote giocate.
+ * Il costo non dipende dalla quantita' dei numeri giocati (vedi inizializzaTabellePremi())
+ * 
+ * @sched schedina giocata
+ * @quantiComuni quanti numeri giocati sono stati estratti sulla ruota
+ * @vincite vettore di almeno QUANTI_TIPI_PREMIO elementi in cui scrivere la vincita di ogni tipo di puntata
+ * 
+ * @return numero delle vincite scritte in <vincite>, ovvero min(quantiImporti, quantiComuni)
+ */
+int calcolaVinciteRuota (const struct schedina* sched, int quantiComuni, double* vincite);
+
+/* Quota di una schedina: probabilita' degli esiti su una ruota e vincite attese
+ */
+struct quota {
+	double probabilita_comuni[QUANTI_NUMERI_ESTRATTI + 1];	// probabilita' di k numeri giocati estratti su una ruota
+	double vincita_comuni[QUANTI_NUMERI_ESTRATTI + 1];		// vincita su una ruota con k numeri comuni
+	double probabilita_premio[QUANTI_TIPI_PREMIO];			// probabilita' di vincere ogni tipo di puntata su una ruota
+	double vincita_attesa_ruota;
+	double vincita_attesa;									// su tutte le ruote giocate
+	double importo;											// importo totale della schedina
+};
+
+/* Costruisce le tabelle dei coefficienti binomiali e della distribuzione ipergeometrica
+ * usate da calcolaVinciteRuota(...) e calcolaQuota(...).
+ * Va chiamata una volta all'avvio, prima di calcolare qualunque vincita o quota
+ */
+void inizializzaTabellePremi ();
+
+/* Calcola l'importo totale di una schedina su una estrazione (per le schedine a sistema, la somma
+ * degli importi di tutte le combinazioni)
+ * 
+ * @sched schedina valida (vedi schedinaValida(...))
+ * 
+ * @return importo totale
+ */
+double importoSchedina (const struct schedina* sched);
+
+/* Verifica che una schedina sia giocabile: ruote e numeri validi e distinti (al massimo QUANTITA_MASSIMA_NUMERI_SCHEDINA
+ * numeri, QUANTITA_MASSIMA_NUMERI_SISTEMA per le schedine a sistema), importi non negativi e puntati solo
+ * su eventi possibili con i numeri giocati, al massimo MASSIMO_ESTRAZIONI_SCHEDINA estrazioni
+ * 
+ * @sched schedina da verificare
+ * 
+ * @return 1 se la schedina e' valida, 0 altrimenti
+ */
+int schedinaValida (const struct schedina* sched);
+
+/* Calcola la quota di una schedina
+ * 
+ * @sched schedina valida (vedi schedinaValida(...))
+ * @quota struttura in cui scrivere la quota
+ */
+void calcolaQuota (const struct schedina* sched, struct quota* quota);
+
+#endif	// LOTTO_PREMI_H
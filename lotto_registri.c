@@ -0,0 +1,2858 @@
+#include "lotto_registri.h"
+#include "lotto_condivisa.h"
+#include "lotto_utenti.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+// Posizione di un record: numero del segmento nei 32 bit alti, offset nel segmento nei 32 bit bassi.
+// I segmenti sono numerati da 1, percio' la posizione 0 indica un record assente
+#define POSIZIONE(segmento, offset) (((uint64_t)(segmento) << 32) | (uint32_t)(offset))
+#define SEGMENTO(posizione) ((uint32_t)((posizione) >> 32))
+#define OFFSET_SEGMENTO(posizione) ((uint32_t)(posizione))
+
+// Posizione di un blocco di schedine archiviate: la posizione del record RECORD_ARCHIVIO che lo descrive,
+// con il bit piu' alto impostato (le posizioni dei record usano al piu' 63 bit)
+#define POSIZIONE_ARCHIVIATA ((uint64_t)1 << 63)
+#define ARCHIVIATA(posizione) (((posizione) & POSIZIONE_ARCHIVIATA) != 0)
+#define RECORD_BLOCCO(posizione) ((posizione) & ~POSIZIONE_ARCHIVIATA)
+
+// I file di archivio condividono la cache dei descrittori con i segmenti: il loro numero ha il bit piu' alto impostato
+#define BIT_FILE_ARCHIVIO (1u << 31)
+#define NUMERO_FILE_ARCHIVIO(numero) ((numero) | BIT_FILE_ARCHIVIO)
+
+// Blocchi di archivio scritti tra due sincronizzazioni del file di archivio
+#define BLOCCHI_PER_SINCRONIZZAZIONE 64
+
+#define RECORD_PER_PAGINA 7
+
+// Descrittori dei segmenti tenuti aperti da ogni processo (cache a corrispondenza diretta sul numero del segmento)
+#define DESCRITTORI_SEGMENTI 64
+
+// Una lettura viene ripetuta se i record sono stati spostati dalla compattazione mentre venivano letti
+#define TENTATIVI_LETTURA 3
+
+// Lunghezza massima di uno username in un record
+#define MASSIMA_LUNGHEZZA_UTENTE 511
+
+// I record con un solo valore valido (riepilogo e cursore) occupano una posizione ciascuno nell'indice
+#define QUANTI_VALORI 2
+#define VALORE(tipo) ((tipo) - RECORD_RIEPILOGO)
+
+// Valore iniziale dei codici di controllo (FNV-1a)
+#define CONTROLLO_INIZIALE 2166136261u
+
+// Checkpoint dell'indice
+#define MAGIC_CHECKPOINT 0x4B435452		// "RTCK"
+#define UTENTI_PER_BLOCCO_CHECKPOINT 256	// utenti copiati ad ogni acquisizione del mutex
+
+// Intervallo (in microsecondi) dopo cui un processo in attesa di una sincronizzazione controlla
+// che il processo che la sta eseguendo non sia terminato
+#define CONTROLLO_SINCRONIZZATORE 100000
+
+/* Posizione di un record nei segmenti
+ */
+struct posizione_record {
+	uint64_t posizione;
+	uint32_t offset;		// offset logico nel registro
+	uint32_t lunghezza;		// lunghezza dei dati
+};
+
+/* Dati di un record RECORD_ARCHIVIO: dove si trova il blocco compresso delle schedine che iniziano
+ * dall'offset del record (lo header del record contiene le estrazioni dell'ultima schedina del blocco)
+ */
+struct record_archivio {
+	uint32_t numero;				// numero del file di archivio
+	uint32_t offset_file;			// offset del blocco nel file di archivio
+	uint32_t lunghezza_compressa;
+	uint32_t lunghezza;				// lunghezza delle schedine del blocco (non compresse)
+	uint32_t quante_schedine;
+	uint32_t controllo;				// FNV-1a del blocco compresso
+};
+
+/* Pagina dell'indice: le posizioni dei record di un registro, in ordine di offset, sono divise in pagine collegate
+ */
+struct pagina_registro {
+	uint32_t successiva;	// indice della pagina successiva, 0 se e' l'ultima
+	uint32_t quante;
+	struct posizione_record record[RECORD_PER_PAGINA];
+};
+
+/* Registro di un utente nell'indice
+ */
+struct registro {
+	uint32_t prima_pagina;	// 0 se il registro e' vuoto
+	uint32_t ultima_pagina;
+	uint32_t fine;			// offset logico della fine del registro
+	uint32_t disordinato;	// solo durante la ricostruzione: i record non sono stati caricati in ordine di offset
+};
+
+/* Elemento dell'indice, nella stessa posizione dell'utente nella directory degli utenti
+ */
+struct indice_utente {
+	struct registro schedine;
+	struct registro vincite;
+	uint32_t estrazioni_ultima_schedina;	// estrazioni effettuate quando e' stata registrata l'ultima schedina
+	uint32_t inizio_non_estratte;			// offset della prima schedina registrata dopo estrazioni_ultima_schedina
+	uint32_t inizio_da_controllare;			// valore dell'ultimo record RECORD_CURSORE
+	uint32_t elencato;						// 1 se l'utente e' nell'elenco degli utenti con registri
+	struct posizione_record valori[QUANTI_VALORI];
+};
+
+/* Segmento presente nell'archivio
+ */
+struct segmento {
+	uint32_t numero;		// 0 se l'elemento e' libero
+	uint32_t byte_totali;
+	uint32_t byte_validi;	// byte dei record ancora raggiungibili dall'indice
+};
+
+/* Header di un checkpoint dell'indice, seguito dai segmenti (struct checkpoint_segmento)
+ * e dagli utenti (struct checkpoint_utente)
+ */
+struct header_checkpoint {
+	uint32_t magic;
+	uint32_t controllo;			// FNV-1a dei dati che seguono lo header e dei campi successivi dello header
+	uint64_t generazione;
+	uint64_t lunghezza;			// lunghezza dei dati che seguono lo header
+	uint64_t inizio_coda;		// fine dell'archivio all'inizio del checkpoint: i record successivi vanno riletti
+	uint64_t ultima_posizione;	// ultimo record scritto prima di inizio_coda (0 se l'archivio era vuoto)
+	uint32_t ultimo_controllo;	// codice di controllo di quel record, per riconoscere l'archivio a cui appartiene il checkpoint
+	uint32_t quanti_segmenti;
+	uint32_t quanti_utenti;
+	uint32_t riservato;
+};
+
+struct checkpoint_segmento {
+	uint32_t numero;
+	uint32_t byte_totali;
+};
+
+/* Registri di un utente nel checkpoint, seguiti dallo username (senza terminatore)
+ * e dalle posizioni dei record delle schedine e delle vincite
+ */
+struct checkpoint_utente {
+	uint16_t lunghezza_utente;
+	uint16_t riservato;
+	uint32_t quante_schedine;
+	uint32_t quante_vincite;
+	uint32_t estrazioni_ultima_schedina;
+	uint32_t inizio_non_estratte;
+	uint32_t inizio_da_controllare;
+	struct posizione_record valori[QUANTI_VALORI];
+};
+
+/* Struttura allocata in memoria condivisa
+ */
+struct archivio_registri {
+	pthread_mutex_t mutex;
+	pthread_cond_t gruppo_completo;		// segnalata quando il gruppo in formazione raggiunge la dimensione massima
+	pthread_cond_t gruppo_durevole;		// segnalata al termine di ogni sincronizzazione
+	uint32_t estrazioni;			// estrazioni effettuate
+	uint32_t segmento_attivo;		// segmento in cui vengono aggiunti i record
+	uint32_t dimensione_attivo;
+	uint32_t pagine_usate;			// la pagina 0 non viene usata
+	uint32_t pagine_libere;			// prima pagina liberata dall'archiviazione (collegate da successiva), 0 se nessuna
+	uint32_t quante_pagine_libere;
+	uint64_t ultima_posizione;		// ultimo record scritto
+	uint32_t ultimo_controllo;		// codice di controllo dell'ultimo record scritto
+	
+	// Checkpoint
+	uint64_t generazione_checkpoint;	// generazione dell'ultimo checkpoint scritto o caricato
+	uint64_t byte_da_checkpoint;		// byte scritti (o riletti all'avvio) dopo l'inizio dell'ultimo checkpoint
+	uint64_t byte_riletti;				// byte dei segmenti letti all'avvio
+	
+	// Commit di gruppo: le schedine sono numerate in ordine di scrittura
+	uint64_t schedine_scritte;		// numero dell'ultima schedina scritta
+	uint64_t schedine_durevoli;		// le schedine fino a questo numero sono su disco
+	uint64_t ultimo_gruppo;			// schedine portate su disco dall'ultima sincronizzazione
+	pid_t sincronizzatore;			// processo che sta sincronizzando il segmento attivo, 0 se nessuno
+	
+	// Metriche
+	uint64_t record_scritti;
+	uint64_t byte_scritti;
+	uint64_t segmenti_compattati;
+	uint64_t byte_copiati;
+	uint64_t sincronizzazioni;
+	uint64_t schedine_sincronizzate;
+	uint64_t schedine_archiviate;
+	uint64_t byte_archiviati;			// byte delle schedine archiviate
+	uint64_t byte_archivio;				// byte dei blocchi scritti nei file di archivio
+	uint64_t letture_archivio;			// letture del registro che comprendono blocchi archiviati
+	uint64_t letture_archivio_lente;	// letture che hanno superato OBIETTIVO_LATENZA_ARCHIVIO
+	uint64_t latenza_archivio_massima;	// in microsecondi
+	uint64_t vincite_riunite;			// record del registro delle vincite sostituiti da un record che li riunisce
+	
+	struct segmento segmenti[MASSIMO_SEGMENTI];		// il segmento n occupa l'elemento n % MASSIMO_SEGMENTI
+	struct indice_utente utenti[CAPACITA_DIRECTORY_UTENTI];
+	uint32_t quanti_utenti;								// utenti con almeno un record
+	uint32_t elenco_utenti[CAPACITA_DIRECTORY_UTENTI];	// posizioni nell'indice degli utenti con almeno un record
+	struct pagina_registro pagine[CAPACITA_PAGINE_REGISTRI];
+};
+
+static struct archivio_registri* archivio = NULL;
+static char prefisso_segmenti[512];
+
+// Durabilita' delle schedine (impostata prima delle fork(...), percio' uguale in tutti i processi)
+static int durabilita = DURABILITA_GRUPPO;
+static long attesa_gruppo = ATTESA_GRUPPO_PREDEFINITA;
+static uint64_t massimo_gruppo = MASSIMO_GRUPPO_PREDEFINITO;
+
+// Archiviazione (impostata prima delle fork(...)). Il file di archivio attivo e' usato solo dal processo in background
+static uint32_t orizzonte_archivio = ORIZZONTE_ARCHIVIO_PREDEFINITO;
+static uint64_t limite_archiviazione = (uint64_t)LIMITE_ARCHIVIAZIONE_PREDEFINITO << 10;	// byte al secondo
+static uint32_t file_archivio;
+static uint32_t dimensione_archivio;
+
+// Descrittori dei segmenti aperti dal processo
+static int descrittori[DESCRITTORI_SEGMENTI];
+static uint32_t numeri_descrittori[DESCRITTORI_SEGMENTI];	// 0 se il descrittore non e' aperto
+
+//
+// SEGMENTI
+//
+static void percorsoSegmento (char* percorso, size_t dimensione, uint32_t numero)
+{
+	if (numero & BIT_FILE_ARCHIVIO) {
+		snprintf(percorso, dimensione, FORMATO_PERCORSO_ARCHIVIO, prefisso_segmenti, numero & ~BIT_FILE_ARCHIVIO);
+	}
+	else {
+		snprintf(percorso, dimensione, FORMATO_PERCORSO_SEGMENTO, prefisso_segmenti, numero);
+	}
+}
+
+/* Restituisce il descrittore di un segmento, aprendolo se il processo non lo ha ancora aperto
+ * 
+ * @numero numero del segmento, oppure NUMERO_FILE_ARCHIVIO(...) di un file di archivio
+ * @crea 1 per creare il segmento se non esiste
+ * 
+ * @return descrittore del segmento (aperto in lettura e scrittura), -1 in caso di errore
+ */
+static int descrittoreSegmento (uint32_t numero, int crea)
+{
+	int i = numero % DESCRITTORI_SEGMENTI;
+	char percorso[600];
+	
+	if (numeri_descrittori[i] == numero) {
+		return descrittori[i];
+	}
+	if (numeri_descrittori[i] != 0) {
+		close(descrittori[i]);
+		numeri_descrittori[i] = 0;
+	}
+	
+	percorsoSegmento(percorso, sizeof(percorso), numero);
+	descrittori[i] = open(percorso, O_RDWR | (crea ? O_CREAT : 0), 0644);
+	if (descrittori[i] < 0) {
+		return -1;
+	}
+	numeri_descrittori[i] = numero;
+	return descrittori[i];
+}
+
+static void chiudiDescrittore (uint32_t numero)
+{
+	int i = numero % DESCRITTORI_SEGMENTI;
+	
+	if (numeri_descrittori[i] == numero) {
+		close(descrittori[i]);
+		numeri_descrittori[i] = 0;
+	}
+}
+
+/* Chiude i descrittori dei segmenti aperti dal processo chiamante
+ */
+void chiudiSegmentiAperti ()
+{
+	int i;
+	
+	for (i = 0; i < DESCRITTORI_SEGMENTI; ++i) {
+		if (numeri_descrittori[i] != 0) {
+			chiudiDescrittore(numeri_descrittori[i]);
+		}
+	}
+}
+
+/* Aggiorna un codice di controllo (FNV-1a) con una sequenza di byte
+ */
+static uint32_t aggiornaControllo (uint32_t hash, const void* dati, size_t lunghezza)
+{
+	const uint8_t* byte = dati;
+	size_t i;
+	
+	for (i = 0; i < lunghezza; ++i) {
+		hash ^= byte[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/* Calcola il codice di controllo di un record
+ */
+static uint32_t controlloRecord (const struct header_record* header, const char* utente, const void* dati)
+{
+	uint32_t hash;
+	
+	hash = aggiornaControllo(CONTROLLO_INIZIALE, (const uint8_t*)header + sizeof(header->controllo),
+			sizeof(*header) - sizeof(header->controllo));
+	hash = aggiornaControllo(hash, utente, header->lunghezza_utente);
+	return aggiornaControllo(hash, dati, header->lunghezza);
+}
+
+/* Compila lo header di un record, codice di controllo compreso
+ * 
+ * @return dimensione del record su file
+ */
+uint32_t preparaHeaderRecord (struct header_record* header, uint8_t tipo, const char* utente, uint32_t offset,
+		uint32_t estrazioni, const void* dati, uint32_t lunghezza)
+{
+	memset(header, 0, sizeof(*header));
+	header->lunghezza = lunghezza;
+	header->lunghezza_utente = (uint16_t)strlen(utente);
+	header->tipo = tipo;
+	header->offset = offset;
+	header->estrazioni = estrazioni;
+	header->controllo = controlloRecord(header, utente, dati);
+	
+	return sizeof(*header) + header->lunghezza_utente + lunghezza;
+}
+
+/* Scrive un record su un segmento
+ * 
+ * @controllo puntatore in cui scrivere il codice di controllo del record
+ * 
+ * @return numero dei byte scritti, -1 in caso di errore
+ */
+static ssize_t scriviRecordRegistro (int fd, off_t posizione, uint8_t tipo, const char* utente, uint32_t offset,
+		uint32_t estrazioni, const void* dati, uint32_t lunghezza, uint32_t* controllo)
+{
+	struct header_record header;
+	struct iovec parti[3];
+	size_t totale;
+	
+	totale = preparaHeaderRecord(&header, tipo, utente, offset, estrazioni, dati, lunghezza);
+	*controllo = header.controllo;
+	
+	parti[0].iov_base = &header;
+	parti[0].iov_len = sizeof(header);
+	parti[1].iov_base = (void*)utente;
+	parti[1].iov_len = header.lunghezza_utente;
+	parti[2].iov_base = (void*)dati;
+	parti[2].iov_len = lunghezza;
+	
+	return (pwritev(fd, parti, 3, posizione) == (ssize_t)totale) ? (ssize_t)totale : -1;
+}
+
+//
+// DURABILITA'
+//
+/* Calcola l'istante (sull'orologio monotono) che segue di un certo numero di microsecondi l'istante attuale
+ */
+static void istanteTra (struct timespec* istante, long microsecondi)
+{
+	clock_gettime(CLOCK_MONOTONIC, istante);
+	istante->tv_sec += microsecondi / 1000000;
+	istante->tv_nsec += (microsecondi % 1000000) * 1000;
+	if (istante->tv_nsec >= 1000000000) {
+		istante->tv_sec++;
+		istante->tv_nsec -= 1000000000;
+	}
+}
+
+/* Registra che le schedine fino a un certo numero sono su disco e risveglia i processi che le attendono
+ * (il chiamante possiede il mutex)
+ */
+static void registraSincronizzazione (uint64_t schedine)
+{
+	if (schedine > archivio->schedine_durevoli) {
+		archivio->ultimo_gruppo = schedine - archivio->schedine_durevoli;
+		archivio->schedine_sincronizzate += schedine - archivio->schedine_durevoli;
+		archivio->schedine_durevoli = schedine;
+	}
+	archivio->sincronizzazioni++;
+	pthread_cond_broadcast(&archivio->gruppo_durevole);
+}
+
+/* Porta su disco il segmento attivo (il chiamante possiede il mutex).
+ * Tutti i segmenti precedenti sono stati sincronizzati al momento della rotazione.
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int sincronizzaSegmentoAttivo ()
+{
+	int fd = descrittoreSegmento(archivio->segmento_attivo, 0);
+	
+	if (fd < 0 || fdatasync(fd) < 0) {
+		perror("Impossibile sincronizzare segmento dei registri");
+		return -1;
+	}
+	registraSincronizzazione(archivio->schedine_scritte);
+	return 0;
+}
+
+/* Porta su disco la cartella dei segmenti, cosi' che un segmento appena creato non vada perso
+ */
+static void sincronizzaCartella ()
+{
+	char cartella[512];
+	char* separatore;
+	int fd;
+	
+	snprintf(cartella, sizeof(cartella), "%s", prefisso_segmenti);
+	separatore = strrchr(cartella, '/');
+	if (separatore) {
+		*separatore = '\0';
+	}
+	
+	fd = open(separatore ? cartella : ".", O_RDONLY | O_DIRECTORY);
+	if (fd < 0 || fsync(fd) < 0) {
+		perror("Impossibile sincronizzare cartella dei registri");
+	}
+	if (fd >= 0) close(fd);
+}
+
+/* Attende che una schedina sia su disco (commit di gruppo).
+ * Il primo processo in attesa diventa il sincronizzatore: attende che si formi un gruppo di schedine
+ * e le porta su disco con una sola fdatasync(...). Gli altri processi attendono la fine della sincronizzazione;
+ * le schedine scritte mentre e' in corso formano il gruppo successivo.
+ * Il gruppo e' completo quando contiene tante schedine quante il gruppo precedente (al massimo massimo_gruppo),
+ * o dopo attesa_gruppo microsecondi: i client attendono la conferma prima di giocare di nuovo, percio'
+ * il gruppo precedente stima quanti client stanno giocando. Un client da solo non attende mai.
+ * 
+ * @numero numero della schedina
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int attendiSchedinaDurevole (uint64_t numero)
+{
+	struct timespec scadenza;
+	uint64_t obiettivo, completo;
+	uint32_t segmento;
+	int fd, errore = 0;
+	
+	bloccaMutexCondiviso(&archivio->mutex);
+	
+	while (archivio->schedine_durevoli < numero && errore == 0) {
+		// Un altro processo sta sincronizzando: la sua sincronizzazione (o la successiva) comprende la schedina
+		if (archivio->sincronizzatore != 0) {
+			istanteTra(&scadenza, CONTROLLO_SINCRONIZZATORE);
+			if (attendiCondizioneCondivisa(&archivio->gruppo_durevole, &archivio->mutex, &scadenza)
+					&& archivio->sincronizzatore != 0 && kill(archivio->sincronizzatore, 0) < 0 && errno == ESRCH) {
+				// Il sincronizzatore e' terminato prima di completare la sincronizzazione
+				archivio->sincronizzatore = 0;
+			}
+			continue;
+		}
+		
+		// Il processo diventa il sincronizzatore e attende che il gruppo si completi
+		archivio->sincronizzatore = getpid();
+		completo = (archivio->ultimo_gruppo < massimo_gruppo) ? archivio->ultimo_gruppo : massimo_gruppo;
+		if (attesa_gruppo > 0) {
+			istanteTra(&scadenza, attesa_gruppo);
+			while (archivio->schedine_scritte - archivio->schedine_durevoli < completo
+					&& attendiCondizioneCondivisa(&archivio->gruppo_completo, &archivio->mutex, &scadenza) == 0);
+		}
+		obiettivo = archivio->schedine_scritte;
+		segmento = archivio->segmento_attivo;
+		
+		// La sincronizzazione avviene senza il mutex: intanto gli altri processi possono scrivere
+		sbloccaMutexCondiviso(&archivio->mutex);
+		fd = descrittoreSegmento(segmento, 0);
+		errore = (fd < 0 || fdatasync(fd) < 0) ? errno : 0;
+		bloccaMutexCondiviso(&archivio->mutex);
+		
+		archivio->sincronizzatore = 0;
+		if (errore == 0) {
+			registraSincronizzazione(obiettivo);
+		}
+		else if (archivio->schedine_durevoli >= numero) {
+			// Il segmento e' stato sincronizzato dalla rotazione (e poi eventualmente compattato)
+			errore = 0;
+		}
+		else {
+			fprintf(stderr, "Impossibile sincronizzare segmento dei registri: %s\n", strerror(errore));
+			fflush(stderr);
+			pthread_cond_broadcast(&archivio->gruppo_durevole);
+		}
+	}
+	
+	sbloccaMutexCondiviso(&archivio->mutex);
+	return (errore == 0) ? 0 : -1;
+}
+
+/* Imposta la durabilita' delle schedine
+ * 
+ * @return 0 in caso di successo, -1 se l'opzione non e' valida
+ */
+int impostaDurabilitaRegistri (const char* opzione)
+{
+	long attesa, massimo;
+	char* fine;
+	
+	if (strcmp(opzione, "nessuna") == 0) {
+		durabilita = DURABILITA_NESSUNA;
+		return 0;
+	}
+	if (strcmp(opzione, "schedina") == 0) {
+		durabilita = DURABILITA_SCHEDINA;
+		return 0;
+	}
+	if (strncmp(opzione, "gruppo", 6) != 0) {
+		return -1;
+	}
+	
+	// "gruppo" oppure "gruppo=attesa/massimo"
+	attesa = ATTESA_GRUPPO_PREDEFINITA;
+	massimo = MASSIMO_GRUPPO_PREDEFINITO;
+	if (opzione[6] == '=') {
+		attesa = strtol(opzione + 7, &fine, 10);
+		if (fine == opzione + 7 || *fine != '/' || attesa < 0 || attesa >= 1000000) {
+			return -1;
+		}
+		massimo = strtol(fine + 1, &fine, 10);
+		if (*fine != '\0' || massimo <= 0) {
+			return -1;
+		}
+	}
+	else if (opzione[6] != '\0') {
+		return -1;
+	}
+	
+	durabilita = DURABILITA_GRUPPO;
+	attesa_gruppo = attesa;
+	massimo_gruppo = (uint64_t)massimo;
+	return 0;
+}
+
+/* Porta su disco tutti i record scritti finora
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int sincronizzaRegistri ()
+{
+	int ret;
+	
+	bloccaMutexCondiviso(&archivio->mutex);
+	ret = sincronizzaSegmentoAttivo();
+	sbloccaMutexCondiviso(&archivio->mutex);
+	return ret;
+}
+
+//
+// SCRITTURA
+//
+/* Crea un nuovo segmento e lo rende il segmento attivo (il chiamante possiede il mutex)
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int apriSegmento (uint32_t numero)
+{
+	struct segmento* segmento = &archivio->segmenti[numero % MASSIMO_SEGMENTI];
+	
+	if (segmento->numero != 0) {
+		fprintf(stderr, "Archivio dei registri pieno: troppi segmenti\n");
+		fflush(stderr);
+		return -1;
+	}
+	if (descrittoreSegmento(numero, 1) < 0) {
+		perror("Impossibile creare segmento dei registri");
+		return -1;
+	}
+	
+	sincronizzaCartella();
+	
+	segmento->numero = numero;
+	segmento->byte_totali = 0;
+	segmento->byte_validi = 0;
+	archivio->segmento_attivo = numero;
+	archivio->dimensione_attivo = 0;
+	return 0;
+}
+
+/* Restituisce il descrittore del segmento in cui scrivere un record, aprendo un nuovo segmento
+ * se il record non entra in quello attivo (il chiamante possiede il mutex)
+ * 
+ * @dimensione dimensione del record
+ * 
+ * @return descrittore del segmento attivo, -1 in caso di errore
+ */
+static int segmentoPerRecord (uint32_t dimensione)
+{
+	if (archivio->dimensione_attivo > 0 && (uint64_t)archivio->dimensione_attivo + dimensione > DIMENSIONE_SEGMENTO) {
+		// Il segmento chiuso viene portato su disco (anche senza durabilita' delle schedine, perche' i checkpoint
+		// si riferiscono ai suoi record): in seguito si sincronizza solo il segmento attivo
+		if (sincronizzaSegmentoAttivo() < 0) {
+			return -1;
+		}
+		if (apriSegmento(archivio->segmento_attivo + 1) < 0) {
+			return -1;
+		}
+	}
+	return descrittoreSegmento(archivio->segmento_attivo, 1);
+}
+
+/* Registra la scrittura di un record in coda al segmento attivo (il chiamante possiede il mutex)
+ */
+static void registraScrittura (uint32_t dimensione, uint32_t controllo)
+{
+	struct segmento* segmento = &archivio->segmenti[archivio->segmento_attivo % MASSIMO_SEGMENTI];
+	
+	archivio->ultima_posizione = POSIZIONE(archivio->segmento_attivo, archivio->dimensione_attivo);
+	archivio->ultimo_controllo = controllo;
+	archivio->byte_da_checkpoint += dimensione;
+	archivio->dimensione_attivo += dimensione;
+	segmento->byte_totali += dimensione;
+	segmento->byte_validi += dimensione;
+	archivio->record_scritti++;
+	archivio->byte_scritti += dimensione;
+}
+
+/* Sottrae un record non piu' raggiungibile dall'indice dai byte validi del suo segmento
+ */
+static void invalidaRecord (uint64_t posizione, uint32_t dimensione)
+{
+	struct segmento* segmento = &archivio->segmenti[SEGMENTO(posizione) % MASSIMO_SEGMENTI];
+	
+	if (segmento->numero == SEGMENTO(posizione) && segmento->byte_validi >= dimensione) {
+		segmento->byte_validi -= dimensione;
+	}
+}
+
+/* Aggiunge un record in coda all'archivio (il chiamante possiede il mutex)
+ * 
+ * @posizione puntatore in cui scrivere la posizione del record
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int appendiRecord (uint8_t tipo, const char* utente, uint32_t offset, uint32_t estrazioni,
+		const void* dati, uint32_t lunghezza, uint64_t* posizione)
+{
+	uint32_t dimensione = sizeof(struct header_record) + strlen(utente) + lunghezza, controllo;
+	ssize_t scritti;
+	int fd;
+	
+	fd = segmentoPerRecord(dimensione);
+	if (fd < 0) {
+		return -1;
+	}
+	
+	scritti = scriviRecordRegistro(fd, archivio->dimensione_attivo, tipo, utente, offset, estrazioni, dati, lunghezza, &controllo);
+	if (scritti < 0) {
+		perror("Impossibile scrivere segmento dei registri");
+		return -1;
+	}
+	
+	*posizione = POSIZIONE(archivio->segmento_attivo, archivio->dimensione_attivo);
+	registraScrittura((uint32_t)scritti, controllo);
+	return 0;
+}
+
+//
+// INDICE
+//
+static struct indice_utente* indiceUtente (const char* utente)
+{
+	int64_t posizione = posizioneUtente(utente);
+	
+	return (posizione < 0) ? NULL : &archivio->utenti[posizione];
+}
+
+/* Inserisce un utente nell'elenco degli utenti con registri, percorso dai checkpoint (il chiamante possiede il mutex)
+ */
+static void elencaUtente (struct indice_utente* indice)
+{
+	if (!indice->elencato) {
+		indice->elencato = 1;
+		archivio->elenco_utenti[archivio->quanti_utenti++] = (uint32_t)(indice - archivio->utenti);
+	}
+}
+
+static uint32_t fineRegistro (const struct registro* registro, uint32_t inizio)
+{
+	return (registro->prima_pagina != 0) ? registro->fine : inizio;
+}
+
+/* Aggiunge la posizione di un record in fondo ad un registro dell'indice
+ * 
+ * @return 0 in caso di successo, -1 se l'indice e' pieno
+ */
+static int aggiungiPosizione (struct registro* registro, uint64_t posizione, uint32_t offset, uint32_t lunghezza)
+{
+	struct pagina_registro* pagina = (registro->ultima_pagina != 0) ? &archivio->pagine[registro->ultima_pagina] : NULL;
+	
+	if (!pagina || pagina->quante == RECORD_PER_PAGINA) {
+		uint32_t nuova;
+		
+		// Prima le pagine liberate dall'archiviazione
+		if (archivio->pagine_libere != 0) {
+			nuova = archivio->pagine_libere;
+			archivio->pagine_libere = archivio->pagine[nuova].successiva;
+			archivio->quante_pagine_libere--;
+		}
+		else if (archivio->pagine_usate < CAPACITA_PAGINE_REGISTRI) {
+			nuova = archivio->pagine_usate++;
+		}
+		else {
+			fprintf(stderr, "Indice dei registri pieno\n");
+			fflush(stderr);
+			return -1;
+		}
+		archivio->pagine[nuova].successiva = 0;
+		archivio->pagine[nuova].quante = 0;
+		
+		if (pagina) {
+			pagina->successiva = nuova;
+		}
+		else {
+			registro->prima_pagina = nuova;
+		}
+		registro->ultima_pagina = nuova;
+		pagina = &archivio->pagine[nuova];
+	}
+	
+	pagina->record[pagina->quante].posizione = posizione;
+	pagina->record[pagina->quante].offset = offset;
+	pagina->record[pagina->quante].lunghezza = lunghezza;
+	pagina->quante++;
+	
+	if (offset + lunghezza > registro->fine) {
+		registro->fine = offset + lunghezza;
+	}
+	return 0;
+}
+
+/* Cerca in un registro dell'indice il record che contiene un offset logico
+ * 
+ * @return posizione del record, NULL se nessun record contiene l'offset
+ */
+static struct posizione_record* cercaPosizione (const struct registro* registro, uint32_t offset)
+{
+	uint32_t p, i;
+	
+	for (p = registro->prima_pagina; p != 0; p = archivio->pagine[p].successiva) {
+		struct pagina_registro* pagina = &archivio->pagine[p];
+		
+		for (i = 0; i < pagina->quante; ++i) {
+			if (offset >= pagina->record[i].offset && offset < pagina->record[i].offset + pagina->record[i].lunghezza) {
+				return &pagina->record[i];
+			}
+		}
+	}
+	return NULL;
+}
+
+/* Copia le posizioni dei record di un registro che iniziano tra due offset (il chiamante possiede il mutex)
+ * 
+ * @record puntatore in cui scrivere l'indirizzo delle posizioni copiate, allocate dinamicamente
+ * @totale puntatore in cui scrivere la somma delle lunghezze dei record
+ * 
+ * @return numero delle posizioni copiate, -1 in caso di errore
+ */
+static long copiaPosizioni (const struct registro* registro, uint32_t da, uint32_t a, struct posizione_record** record, uint32_t* totale)
+{
+	long quante = 0, capacita = 0;
+	uint32_t p, i;
+	
+	*record = NULL;
+	*totale = 0;
+	for (p = registro->prima_pagina; p != 0; p = archivio->pagine[p].successiva) {
+		struct pagina_registro* pagina = &archivio->pagine[p];
+		
+		for (i = 0; i < pagina->quante; ++i) {
+			if (pagina->record[i].offset < da || pagina->record[i].offset >= a) {
+				continue;
+			}
+			if (quante == capacita) {
+				struct posizione_record* temp;
+				
+				capacita = capacita ? capacita * 2 : 64;
+				temp = realloc(*record, capacita * sizeof(struct posizione_record));
+				if (!temp) {
+					free(*record);
+					return -1;
+				}
+				*record = temp;
+			}
+			(*record)[quante++] = pagina->record[i];
+			*totale += pagina->record[i].lunghezza;
+		}
+	}
+	return quante;
+}
+
+/* Restituisce la dimensione su file del record a cui si riferisce una posizione dell'indice
+ */
+static uint32_t dimensioneSuFile (const struct posizione_record* record, uint32_t lunghezza_utente)
+{
+	return sizeof(struct header_record) + lunghezza_utente
+			+ (ARCHIVIATA(record->posizione) ? sizeof(struct record_archivio) : record->lunghezza);
+}
+
+/* Riscrive le posizioni di un registro nelle sue pagine (il chiamante possiede il mutex):
+ * le pagine che restano vuote vengono liberate, quelle mancanti vengono aggiunte in fondo
+ * 
+ * @record posizioni del registro, in ordine di offset
+ * @quante numero delle posizioni
+ * 
+ * @return 0 in caso di successo, -1 se l'indice e' pieno
+ */
+static int riscriviPagine (struct registro* registro, const struct posizione_record* record, long quante)
+{
+	uint32_t p = registro->prima_pagina, precedente = 0, successiva;
+	long k = 0, n;
+	
+	while (p != 0 && k < quante) {
+		n = (quante - k < RECORD_PER_PAGINA) ? quante - k : RECORD_PER_PAGINA;
+		memcpy(archivio->pagine[p].record, record + k, n * sizeof(struct posizione_record));
+		archivio->pagine[p].quante = n;
+		k += n;
+		precedente = p;
+		p = archivio->pagine[p].successiva;
+	}
+	
+	if (precedente != 0) {
+		archivio->pagine[precedente].successiva = 0;
+		registro->ultima_pagina = precedente;
+	}
+	else {
+		registro->prima_pagina = 0;
+		registro->ultima_pagina = 0;
+	}
+	for (; p != 0; p = successiva) {
+		successiva = archivio->pagine[p].successiva;
+		archivio->pagine[p].successiva = archivio->pagine_libere;
+		archivio->pagine_libere = p;
+		archivio->quante_pagine_libere++;
+	}
+	
+	for (; k < quante; ++k) {
+		if (aggiungiPosizione(registro, record[k].posizione, record[k].offset, record[k].lunghezza) < 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* Sostituisce le posizioni delle schedine di un blocco archiviato con la posizione del blocco
+ * (il chiamante possiede il mutex). Le schedine non sono piu' raggiungibili dall'indice: vengono sottratte
+ * dai byte validi dei loro segmenti, che la compattazione potra' eliminare.
+ * Allo stesso modo sostituisce i record del registro delle vincite con il record che li riunisce
+ * 
+ * @offset offset della prima schedina del blocco
+ * @lunghezza lunghezza delle schedine del blocco
+ * @posizione posizione del record RECORD_ARCHIVIO, con POSIZIONE_ARCHIVIATA (o del record che riunisce le vincite)
+ * @lunghezza_utente lunghezza dello username dell'utente
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int archiviaPosizioni (struct registro* registro, uint32_t offset, uint32_t lunghezza, uint64_t posizione,
+		uint32_t lunghezza_utente)
+{
+	struct posizione_record* record, * temp;
+	uint32_t totale;
+	long quante, rimaste = 0, k;
+	int ret;
+	
+	quante = copiaPosizioni(registro, 0, UINT32_MAX, &record, &totale);
+	if (quante < 0) {
+		return -1;
+	}
+	temp = realloc(record, (quante + 1) * sizeof(struct posizione_record));
+	if (!temp) {
+		free(record);
+		return -1;
+	}
+	record = temp;
+	
+	// Il blocco prende il posto delle sue schedine, dopo le posizioni con offset minore
+	for (k = 0; k < quante; ++k) {
+		if (record[k].offset >= offset && record[k].offset < offset + lunghezza) {
+			invalidaRecord(RECORD_BLOCCO(record[k].posizione), dimensioneSuFile(&record[k], lunghezza_utente));
+		}
+		else {
+			record[rimaste++] = record[k];
+		}
+	}
+	for (k = rimaste; k > 0 && record[k - 1].offset > offset; --k);
+	memmove(record + k + 1, record + k, (rimaste - k) * sizeof(struct posizione_record));
+	record[k].posizione = posizione;
+	record[k].offset = offset;
+	record[k].lunghezza = lunghezza;
+	
+	ret = riscriviPagine(registro, record, rimaste + 1);
+	if (offset + lunghezza > registro->fine) {
+		registro->fine = offset + lunghezza;
+	}
+	free(record);
+	return ret;
+}
+
+/* Legge le schedine di un blocco archiviato: legge il record RECORD_ARCHIVIO dal suo segmento,
+ * poi il blocco compresso dal file di archivio
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int leggiBloccoArchiviato (const struct posizione_record* record, uint32_t lunghezza_utente, void* destinazione)
+{
+	uint64_t posizione = RECORD_BLOCCO(record->posizione);
+	struct record_archivio blocco;
+	uLongf lunghezza = record->lunghezza;
+	char* compresso;
+	int fd, ret = -1;
+	
+	fd = descrittoreSegmento(SEGMENTO(posizione), 0);
+	if (fd < 0 || pread(fd, &blocco, sizeof(blocco), (off_t)OFFSET_SEGMENTO(posizione) + sizeof(struct header_record)
+			+ lunghezza_utente) != sizeof(blocco) || blocco.lunghezza != record->lunghezza) {
+		return -1;
+	}
+	
+	compresso = malloc(blocco.lunghezza_compressa);
+	fd = descrittoreSegmento(NUMERO_FILE_ARCHIVIO(blocco.numero), 0);
+	if (compresso && fd >= 0
+			&& pread(fd, compresso, blocco.lunghezza_compressa, blocco.offset_file) == (ssize_t)blocco.lunghezza_compressa
+			&& aggiornaControllo(CONTROLLO_INIZIALE, compresso, blocco.lunghezza_compressa) == blocco.controllo
+			&& uncompress(destinazione, &lunghezza, (const Bytef*)compresso, blocco.lunghezza_compressa) == Z_OK
+			&& lunghezza == record->lunghezza) {
+		ret = 0;
+	}
+	free(compresso);
+	return ret;
+}
+
+/* Registra la durata di una lettura del registro che comprende blocchi archiviati
+ * 
+ * @inizio istante di inizio della lettura (orologio monotono)
+ */
+static void registraLetturaArchivio (const struct timespec* inizio)
+{
+	struct timespec fine;
+	uint64_t microsecondi;
+	
+	clock_gettime(CLOCK_MONOTONIC, &fine);
+	microsecondi = (fine.tv_sec - inizio->tv_sec) * 1000000 + (fine.tv_nsec - inizio->tv_nsec) / 1000;
+	
+	bloccaMutexCondiviso(&archivio->mutex);
+	archivio->letture_archivio++;
+	if (microsecondi > OBIETTIVO_LATENZA_ARCHIVIO) {
+		archivio->letture_archivio_lente++;
+	}
+	if (microsecondi > archivio->latenza_archivio_massima) {
+		archivio->latenza_archivio_massima = microsecondi;
+	}
+	sbloccaMutexCondiviso(&archivio->mutex);
+}
+
+/* Legge i dati di un record dal suo segmento
+ * 
+ * @lunghezza_utente lunghezza dello username dell'utente a cui appartiene il record
+ * @destinazione area in cui copiare i dati
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int leggiDatiRecord (const struct posizione_record* record, uint32_t lunghezza_utente, void* destinazione)
+{
+	int fd;
+	off_t inizio = (off_t)OFFSET_SEGMENTO(record->posizione) + sizeof(struct header_record) + lunghezza_utente;
+	
+	if (ARCHIVIATA(record->posizione)) {
+		return leggiBloccoArchiviato(record, lunghezza_utente, destinazione);
+	}
+	fd = descrittoreSegmento(SEGMENTO(record->posizione), 0);
+	if (fd < 0) {
+		return -1;
+	}
+	return (pread(fd, destinazione, record->lunghezza, inizio) == (ssize_t)record->lunghezza) ? 0 : -1;
+}
+
+/* Legge i record di un registro che iniziano tra due offset
+ * 
+ * @schedine 1 per il registro delle schedine, 0 per il registro delle vincite
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int leggiRegistro (const char* utente, int schedine, uint32_t da, uint32_t a, char** dati, uint32_t* lunghezza)
+{
+	uint32_t lunghezza_utente = strlen(utente), totale, copiati;
+	struct posizione_record* record;
+	struct indice_utente* indice;
+	struct timespec inizio;
+	long quante, i;
+	int tentativo, archiviati = 0;
+	
+	clock_gettime(CLOCK_MONOTONIC, &inizio);
+	for (tentativo = 0; tentativo < TENTATIVI_LETTURA; ++tentativo) {
+		bloccaMutexCondiviso(&archivio->mutex);
+		indice = indiceUtente(utente);
+		quante = indice ? copiaPosizioni(schedine ? &indice->schedine : &indice->vincite, da, a, &record, &totale) : -1;
+		sbloccaMutexCondiviso(&archivio->mutex);
+		if (quante < 0) {
+			return -1;
+		}
+		
+		*dati = malloc(totale + 1);
+		if (!*dati) {
+			free(record);
+			return -1;
+		}
+		
+		// I record vengono letti senza il mutex: se la compattazione ne sposta uno, la lettura viene ripetuta
+		for (i = 0, copiati = 0; i < quante; ++i) {
+			if (leggiDatiRecord(&record[i], lunghezza_utente, *dati + copiati) < 0) {
+				break;
+			}
+			copiati += record[i].lunghezza;
+			archiviati |= ARCHIVIATA(record[i].posizione);
+		}
+		free(record);
+		
+		if (i == quante) {
+			(*dati)[totale] = '\0';
+			*lunghezza = totale;
+			if (archiviati) {
+				registraLetturaArchivio(&inizio);
+			}
+			return 0;
+		}
+		free(*dati);
+	}
+	
+	*dati = NULL;
+	return -1;
+}
+
+/* Sostituisce il record di un valore (riepilogo o cursore) di un utente (il chiamante possiede il mutex)
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int sostituisciValore (struct indice_utente* indice, const char* utente, uint8_t tipo, const void* dati, uint32_t lunghezza)
+{
+	struct posizione_record* valore = &indice->valori[VALORE(tipo)];
+	uint64_t posizione;
+	
+	if (appendiRecord(tipo, utente, 0, 0, dati, lunghezza, &posizione) < 0) {
+		return -1;
+	}
+	
+	if (valore->posizione != 0) {
+		invalidaRecord(valore->posizione, sizeof(struct header_record) + strlen(utente) + valore->lunghezza);
+	}
+	valore->posizione = posizione;
+	valore->lunghezza = lunghezza;
+	elencaUtente(indice);
+	return 0;
+}
+
+//
+// RICOSTRUZIONE DELL'INDICE
+//
+/* Inserisce nell'indice un record letto da un segmento durante la ricostruzione
+ * 
+ * @return 0 in caso di successo, -1 se l'indice e' pieno
+ */
+static int caricaRecord (const struct header_record* header, const char* utente, const void* dati, uint64_t posizione,
+		uint32_t** disordinati, uint32_t* quanti_disordinati)
+{
+	struct indice_utente* indice = indiceUtente(utente);
+	struct registro* registro;
+	struct posizione_record* doppione;
+	struct record_archivio blocco;
+	
+	if (!indice) {		// utente non registrato: il record non e' raggiungibile
+		return 0;
+	}
+	elencaUtente(indice);
+	
+	switch (header->tipo) {
+		case RECORD_SCHEDINA:
+		case RECORD_VINCITE:
+			registro = (header->tipo == RECORD_SCHEDINA) ? &indice->schedine : &indice->vincite;
+			
+			if (header->tipo == RECORD_SCHEDINA) {
+				// La prima schedina registrata dopo l'ultima estrazione che ha preceduto le schedine dell'utente
+				if (registro->prima_pagina == 0 || header->estrazioni > indice->estrazioni_ultima_schedina) {
+					indice->estrazioni_ultima_schedina = header->estrazioni;
+					indice->inizio_non_estratte = header->offset;
+				}
+				else if (header->estrazioni == indice->estrazioni_ultima_schedina && header->offset < indice->inizio_non_estratte) {
+					indice->inizio_non_estratte = header->offset;
+				}
+			}
+			
+			// Un record fuori ordine e' stato spostato dalla compattazione: se l'originale e' ancora presente
+			// (interruzione prima dell'eliminazione del segmento), vale la copia, che e' stata letta dopo.
+			// Lo stesso accade per un record della coda gia' presente nel checkpoint.
+			// Una schedina gia' archiviata (il checkpoint contiene il suo blocco) viene ignorata
+			if (registro->prima_pagina != 0 && header->offset < registro->fine) {
+				doppione = cercaPosizione(registro, header->offset);
+				if (doppione && ARCHIVIATA(doppione->posizione)) {
+					return 0;
+				}
+				
+				// Vincite riunite (vedi riunisciVinciteRegistri()): il record che le riunisce sostituisce
+				// quelli letti finora, mentre un record gia' compreso in un record riunito viene ignorato
+				if (doppione && header->tipo == RECORD_VINCITE) {
+					if (doppione->offset == header->offset && header->lunghezza > doppione->lunghezza) {
+						return archiviaPosizioni(registro, header->offset, header->lunghezza, posizione, header->lunghezza_utente);
+					}
+					if (header->offset + header->lunghezza <= doppione->offset + doppione->lunghezza
+							&& (doppione->offset != header->offset || header->lunghezza < doppione->lunghezza)) {
+						return 0;
+					}
+				}
+				if (doppione && doppione->offset == header->offset) {
+					doppione->posizione = posizione;
+					doppione->lunghezza = header->lunghezza;
+					return 0;
+				}
+				
+				if (!registro->disordinato) {
+					uint32_t* temp = realloc(*disordinati, (*quanti_disordinati + 1) * sizeof(uint32_t));
+					if (!temp) {
+						return -1;
+					}
+					*disordinati = temp;
+					(*disordinati)[(*quanti_disordinati)++] = (uint32_t)(indice - archivio->utenti) * 2 + (header->tipo == RECORD_VINCITE);
+					registro->disordinato = 1;
+				}
+			}
+			return aggiungiPosizione(registro, posizione, header->offset, header->lunghezza);
+		
+		case RECORD_ARCHIVIO:
+			if (header->lunghezza != sizeof(blocco)) {
+				return 0;
+			}
+			memcpy(&blocco, dati, sizeof(blocco));
+			
+			// Le schedine archiviate sono tutte estratte
+			if (indice->schedine.prima_pagina == 0 || header->estrazioni > indice->estrazioni_ultima_schedina) {
+				indice->estrazioni_ultima_schedina = header->estrazioni;
+				indice->inizio_non_estratte = header->offset + blocco.lunghezza;
+			}
+			// Il blocco sostituisce le sue schedine lette finora (quelle ancora presenti nei segmenti)
+			return archiviaPosizioni(&indice->schedine, header->offset, blocco.lunghezza, posizione | POSIZIONE_ARCHIVIATA,
+					header->lunghezza_utente);
+		
+		case RECORD_CURSORE:
+			if (header->lunghezza == sizeof(uint32_t)) {
+				memcpy(&indice->inizio_da_controllare, dati, sizeof(uint32_t));
+			}
+			// fall through
+		case RECORD_RIEPILOGO:
+			indice->valori[VALORE(header->tipo)].posizione = posizione;
+			indice->valori[VALORE(header->tipo)].lunghezza = header->lunghezza;
+			return 0;
+		
+		default:		// tipo sconosciuto: il record viene ignorato
+			return 0;
+	}
+}
+
+static int ordine_crescente_offset (const void* a, const void* b)
+{
+	uint32_t x = ((const struct posizione_record*)a)->offset, y = ((const struct posizione_record*)b)->offset;
+	
+	return (x > y) - (x < y);
+}
+
+/* Riordina per offset le posizioni di un registro caricato fuori ordine
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int riordinaRegistro (struct registro* registro)
+{
+	struct posizione_record* record;
+	uint32_t totale, p, i;
+	long quante, k = 0;
+	
+	quante = copiaPosizioni(registro, 0, UINT32_MAX, &record, &totale);
+	if (quante < 0) {
+		return -1;
+	}
+	qsort(record, quante, sizeof(struct posizione_record), ordine_crescente_offset);
+	
+	for (p = registro->prima_pagina; p != 0; p = archivio->pagine[p].successiva) {
+		for (i = 0; i < archivio->pagine[p].quante; ++i) {
+			archivio->pagine[p].record[i] = record[k++];
+		}
+	}
+	registro->disordinato = 0;
+	free(record);
+	return 0;
+}
+
+/* Legge un segmento (da un offset in poi) e ne inserisce i record nell'indice.
+ * Si ferma al primo record incompleto o danneggiato: se il segmento e' l'ultimo, viene troncato in quel punto
+ * 
+ * @numero numero del segmento
+ * @inizio offset da cui leggere (diverso da 0 solo per il segmento in cui inizia la coda di un checkpoint)
+ * @ultimo 1 se e' l'ultimo segmento dell'archivio
+ * 
+ * @return numero dei record caricati, -1 in caso di errore
+ */
+static long caricaSegmento (uint32_t numero, uint32_t inizio, int ultimo, uint32_t** disordinati, uint32_t* quanti_disordinati)
+{
+	static char buffer_lettura[1 << 20];
+	struct segmento* segmento = &archivio->segmenti[numero % MASSIMO_SEGMENTI];
+	struct header_record header;
+	char percorso[600], utente[MASSIMA_LUNGHEZZA_UTENTE + 1];
+	char* dati = NULL;
+	uint32_t capacita = 0, posizione = inizio;
+	long caricati = 0;
+	struct stat info;
+	FILE* file;
+	
+	// Il segmento in cui inizia la coda e' gia' stato inserito dal checkpoint
+	if (segmento->numero != 0 && segmento->numero != numero) {
+		fprintf(stderr, "Archivio dei registri pieno: troppi segmenti\n");
+		return -1;
+	}
+	
+	percorsoSegmento(percorso, sizeof(percorso), numero);
+	file = fopen(percorso, "rb");
+	if (!file || fstat(fileno(file), &info) < 0 || fseek(file, inizio, SEEK_SET) < 0) {
+		perror("Impossibile aprire segmento dei registri");
+		if (file) fclose(file);
+		return -1;
+	}
+	setvbuf(file, buffer_lettura, _IOFBF, sizeof(buffer_lettura));
+	segmento->numero = numero;
+	segmento->byte_totali = inizio;
+	
+	while (fread(&header, sizeof(header), 1, file) == 1) {
+		uint32_t dimensione = sizeof(header) + header.lunghezza_utente + header.lunghezza;
+		
+		if (header.lunghezza_utente > MASSIMA_LUNGHEZZA_UTENTE || header.lunghezza > info.st_size - posizione) {
+			break;
+		}
+		if (header.lunghezza + 1 > capacita) {
+			char* temp = realloc(dati, header.lunghezza + 1);
+			if (!temp) {
+				break;
+			}
+			dati = temp;
+			capacita = header.lunghezza + 1;
+		}
+		if (fread(utente, 1, header.lunghezza_utente, file) != header.lunghezza_utente
+				|| fread(dati, 1, header.lunghezza, file) != header.lunghezza
+				|| controlloRecord(&header, utente, dati) != header.controllo) {
+			break;
+		}
+		utente[header.lunghezza_utente] = '\0';
+		
+		if (caricaRecord(&header, utente, dati, POSIZIONE(numero, posizione), disordinati, quanti_disordinati) < 0) {
+			free(dati);
+			fclose(file);
+			return -1;
+		}
+		archivio->ultima_posizione = POSIZIONE(numero, posizione);
+		archivio->ultimo_controllo = header.controllo;
+		archivio->byte_da_checkpoint += dimensione;
+		archivio->byte_riletti += dimensione;
+		segmento->byte_totali += dimensione;
+		posizione += dimensione;
+		caricati++;
+	}
+	free(dati);
+	fclose(file);
+	
+	if (posizione < info.st_size) {
+		if (ultimo && truncate(percorso, posizione) == 0) {
+			printf("Segmento %s: scartati %lu byte incompleti in coda\n", percorso, (unsigned long)(info.st_size - posizione));
+		}
+		else {
+			printf("Segmento %s danneggiato: ignorati %lu byte dall'offset %u\n", percorso,
+					(unsigned long)(info.st_size - posizione), posizione);
+		}
+		fflush(stdout);
+	}
+	if (ultimo) {
+		archivio->segmento_attivo = numero;
+		archivio->dimensione_attivo = posizione;
+	}
+	return caricati;
+}
+
+static int ordine_crescente_numero (const void* a, const void* b)
+{
+	uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+	
+	return (x > y) - (x < y);
+}
+
+/* Cerca i segmenti (o i file di archivio) presenti nella cartella dell'archivio
+ * 
+ * @infisso testo che segue il prefisso e precede il numero del file ("" per i segmenti)
+ * @estensione estensione del file (".seg" per i segmenti)
+ * @numeri puntatore in cui scrivere l'indirizzo dei numeri dei file (in ordine crescente), allocati dinamicamente
+ * 
+ * @return numero dei file trovati, -1 in caso di errore
+ */
+static long cercaSegmenti (const char* infisso, const char* estensione, uint32_t** numeri)
+{
+	char cartella[512], iniziale[600];
+	const char* nome;
+	struct dirent* elemento;
+	DIR* dir;
+	long quanti = 0;
+	
+	// Il prefisso e' "<cartella>/<nome>"
+	nome = strrchr(prefisso_segmenti, '/');
+	if (nome) {
+		snprintf(cartella, sizeof(cartella), "%.*s", (int)(nome - prefisso_segmenti), prefisso_segmenti);
+		nome++;
+	}
+	else {
+		strcpy(cartella, ".");
+		nome = prefisso_segmenti;
+	}
+	snprintf(iniziale, sizeof(iniziale), "%s%s", nome, infisso);
+	
+	*numeri = NULL;
+	dir = opendir(cartella);
+	if (!dir) {
+		perror("Impossibile aprire la cartella dei registri");
+		return -1;
+	}
+	
+	while ((elemento = readdir(dir)) != NULL) {
+		size_t lunghezza = strlen(elemento->d_name);
+		char* fine;
+		unsigned long numero;
+		
+		if (strncmp(elemento->d_name, iniziale, strlen(iniziale)) != 0 || lunghezza < strlen(estensione)
+				|| strcmp(elemento->d_name + lunghezza - strlen(estensione), estensione) != 0) {
+			continue;
+		}
+		numero = strtoul(elemento->d_name + strlen(iniziale), &fine, 10);
+		if (numero == 0 || numero >= BIT_FILE_ARCHIVIO || strcmp(fine, estensione) != 0) {
+			continue;
+		}
+		
+		if (quanti % 64 == 0) {
+			uint32_t* temp = realloc(*numeri, (quanti + 64) * sizeof(uint32_t));
+			if (!temp) {
+				closedir(dir);
+				return -1;
+			}
+			*numeri = temp;
+		}
+		(*numeri)[quanti++] = (uint32_t)numero;
+	}
+	closedir(dir);
+	
+	qsort(*numeri, quanti, sizeof(uint32_t), ordine_crescente_numero);
+	return quanti;
+}
+
+/* Sceglie il file di archivio in cui aggiungere i blocchi archiviati: l'ultimo presente, se non e' pieno
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int apriFileArchivio ()
+{
+	char percorso[600];
+	struct stat info;
+	uint32_t* numeri;
+	long quanti;
+	
+	quanti = cercaSegmenti("archivio_", ".arc", &numeri);
+	if (quanti < 0) {
+		return -1;
+	}
+	file_archivio = (quanti > 0) ? numeri[quanti - 1] : 1;
+	dimensione_archivio = 0;
+	free(numeri);
+	
+	percorsoSegmento(percorso, sizeof(percorso), NUMERO_FILE_ARCHIVIO(file_archivio));
+	if (stat(percorso, &info) == 0) {
+		if (info.st_size < DIMENSIONE_SEGMENTO) {
+			dimensione_archivio = (uint32_t)info.st_size;
+		}
+		else {
+			file_archivio++;
+		}
+	}
+	return 0;
+}
+
+/* Ricalcola i byte validi di ogni segmento percorrendo l'indice (al termine della ricostruzione)
+ */
+static void ricalcolaByteValidi ()
+{
+	const struct registro* registri[2];
+	uint32_t u, p, i, lunghezza_utente;
+	int r, v;
+	
+	for (i = 0; i < MASSIMO_SEGMENTI; ++i) {
+		archivio->segmenti[i].byte_validi = 0;
+	}
+	
+	for (u = 0; u < archivio->quanti_utenti; ++u) {
+		struct indice_utente* indice = &archivio->utenti[archivio->elenco_utenti[u]];
+		
+		lunghezza_utente = strlen(usernameInPosizione(archivio->elenco_utenti[u]));
+		registri[0] = &indice->schedine;
+		registri[1] = &indice->vincite;
+		
+		for (r = 0; r < 2; ++r) {
+			for (p = registri[r]->prima_pagina; p != 0; p = archivio->pagine[p].successiva) {
+				for (i = 0; i < archivio->pagine[p].quante; ++i) {
+					struct posizione_record* record = &archivio->pagine[p].record[i];
+					uint32_t numero = SEGMENTO(RECORD_BLOCCO(record->posizione));
+					struct segmento* segmento = &archivio->segmenti[numero % MASSIMO_SEGMENTI];
+					
+					if (segmento->numero == numero) {
+						segmento->byte_validi += dimensioneSuFile(record, lunghezza_utente);
+					}
+				}
+			}
+		}
+		for (v = 0; v < QUANTI_VALORI; ++v) {
+			struct segmento* segmento = &archivio->segmenti[SEGMENTO(indice->valori[v].posizione) % MASSIMO_SEGMENTI];
+			
+			if (indice->valori[v].posizione != 0 && segmento->numero == SEGMENTO(indice->valori[v].posizione)) {
+				segmento->byte_validi += dimensioneSuFile(&indice->valori[v], lunghezza_utente);
+			}
+		}
+	}
+}
+
+//
+// CHECKPOINT
+//
+static void percorsoCheckpoint (char* percorso, size_t dimensione, int copia)
+{
+	snprintf(percorso, dimensione, FORMATO_PERCORSO_CHECKPOINT, prefisso_segmenti, copia);
+}
+
+static uint32_t quantiRecordRegistro (const struct registro* registro)
+{
+	uint32_t p, quanti = 0;
+	
+	for (p = registro->prima_pagina; p != 0; p = archivio->pagine[p].successiva) {
+		quanti += archivio->pagine[p].quante;
+	}
+	return quanti;
+}
+
+/* Aggiunge i registri di un utente in fondo al buffer di un checkpoint (il chiamante possiede il mutex)
+ * 
+ * @elemento posizione dell'utente nell'indice
+ * @buffer puntatore al buffer, riallocato se necessario
+ * @capacita puntatore alla dimensione del buffer
+ * @usati puntatore al numero dei byte occupati nel buffer
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int copiaUtenteCheckpoint (uint32_t elemento, char** buffer, size_t* capacita, size_t* usati)
+{
+	const struct indice_utente* indice = &archivio->utenti[elemento];
+	const char* utente = usernameInPosizione(elemento);
+	const struct registro* registri[2] = {&indice->schedine, &indice->vincite};
+	struct checkpoint_utente copia;
+	size_t dimensione;
+	uint32_t p;
+	int r;
+	
+	memset(&copia, 0, sizeof(copia));
+	copia.lunghezza_utente = (uint16_t)strlen(utente);
+	copia.quante_schedine = quantiRecordRegistro(&indice->schedine);
+	copia.quante_vincite = quantiRecordRegistro(&indice->vincite);
+	copia.estrazioni_ultima_schedina = indice->estrazioni_ultima_schedina;
+	copia.inizio_non_estratte = indice->inizio_non_estratte;
+	copia.inizio_da_controllare = indice->inizio_da_controllare;
+	memcpy(copia.valori, indice->valori, sizeof(copia.valori));
+	
+	dimensione = sizeof(copia) + copia.lunghezza_utente
+			+ ((size_t)copia.quante_schedine + copia.quante_vincite) * sizeof(struct posizione_record);
+	if (*usati + dimensione > *capacita) {
+		size_t nuova = (*usati + dimensione) * 2;
+		char* temp = realloc(*buffer, nuova);
+		
+		if (!temp) {
+			return -1;
+		}
+		*buffer = temp;
+		*capacita = nuova;
+	}
+	
+	memcpy(*buffer + *usati, &copia, sizeof(copia));
+	memcpy(*buffer + *usati + sizeof(copia), utente, copia.lunghezza_utente);
+	*usati += sizeof(copia) + copia.lunghezza_utente;
+	for (r = 0; r < 2; ++r) {
+		for (p = registri[r]->prima_pagina; p != 0; p = archivio->pagine[p].successiva) {
+			memcpy(*buffer + *usati, archivio->pagine[p].record, archivio->pagine[p].quante * sizeof(struct posizione_record));
+			*usati += archivio->pagine[p].quante * sizeof(struct posizione_record);
+		}
+	}
+	return 0;
+}
+
+/* Scrive un checkpoint dell'indice nella copia piu' vecchia.
+ * L'indice viene copiato a blocchi di utenti, senza bloccare le scritture: un registro modificato durante
+ * la copia puo' comparire nel checkpoint prima o dopo la modifica, ma il record che l'ha modificato
+ * segue l'inizio della coda e viene comunque riletto all'avvio.
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int scriviCheckpoint ()
+{
+	struct header_checkpoint header;
+	struct checkpoint_segmento* segmenti;
+	char percorso[600];
+	char* buffer = NULL;
+	size_t capacita = 0, usati;
+	uint32_t quanti_utenti, controllo, i, j;
+	FILE* file;
+	int ret = 0;
+	
+	segmenti = malloc(MASSIMO_SEGMENTI * sizeof(struct checkpoint_segmento));
+	if (!segmenti) {
+		return -1;
+	}
+	memset(&header, 0, sizeof(header));
+	header.magic = MAGIC_CHECKPOINT;
+	
+	bloccaMutexCondiviso(&archivio->mutex);
+	header.generazione = ++archivio->generazione_checkpoint;
+	header.inizio_coda = POSIZIONE(archivio->segmento_attivo, archivio->dimensione_attivo);
+	header.ultima_posizione = archivio->ultima_posizione;
+	header.ultimo_controllo = archivio->ultimo_controllo;
+	for (i = 0; i < MASSIMO_SEGMENTI; ++i) {
+		if (archivio->segmenti[i].numero != 0) {
+			segmenti[header.quanti_segmenti].numero = archivio->segmenti[i].numero;
+			segmenti[header.quanti_segmenti].byte_totali = archivio->segmenti[i].byte_totali;
+			header.quanti_segmenti++;
+		}
+	}
+	quanti_utenti = archivio->quanti_utenti;
+	archivio->byte_da_checkpoint = 0;
+	sbloccaMutexCondiviso(&archivio->mutex);
+	
+	percorsoCheckpoint(percorso, sizeof(percorso), header.generazione % 2);
+	file = fopen(percorso, "wb");
+	if (!file) {
+		perror("Impossibile creare checkpoint dei registri");
+		free(segmenti);
+		return -1;
+	}
+	
+	// Lo header viene scritto per ultimo: fino ad allora la copia non e' valida
+	usati = header.quanti_segmenti * sizeof(struct checkpoint_segmento);
+	controllo = aggiornaControllo(CONTROLLO_INIZIALE, segmenti, usati);
+	if (fseek(file, sizeof(header), SEEK_SET) < 0 || fwrite(segmenti, 1, usati, file) != usati) {
+		ret = -1;
+	}
+	header.lunghezza = usati;
+	free(segmenti);
+	
+	for (i = 0; i < quanti_utenti && ret == 0; i += UTENTI_PER_BLOCCO_CHECKPOINT) {
+		usati = 0;
+		
+		bloccaMutexCondiviso(&archivio->mutex);
+		for (j = i; j < quanti_utenti && j < i + UTENTI_PER_BLOCCO_CHECKPOINT && ret == 0; ++j) {
+			ret = copiaUtenteCheckpoint(archivio->elenco_utenti[j], &buffer, &capacita, &usati);
+		}
+		sbloccaMutexCondiviso(&archivio->mutex);
+		
+		if (ret == 0 && fwrite(buffer, 1, usati, file) != usati) {
+			ret = -1;
+		}
+		controllo = aggiornaControllo(controllo, buffer, usati);
+		header.lunghezza += usati;
+		header.quanti_utenti = j;
+	}
+	free(buffer);
+	
+	// I record a cui si riferisce il checkpoint devono essere su disco prima che il checkpoint diventi valido
+	if (ret == 0 && sincronizzaRegistri() < 0) {
+		ret = -1;
+	}
+	header.controllo = aggiornaControllo(controllo, &header.generazione, sizeof(header) - offsetof(struct header_checkpoint, generazione));
+	if (ret == 0 && (fflush(file) != 0 || pwrite(fileno(file), &header, sizeof(header), 0) != sizeof(header)
+			|| fdatasync(fileno(file)) < 0)) {
+		ret = -1;
+	}
+	if (ret < 0) {
+		perror("Impossibile scrivere checkpoint dei registri");
+	}
+	fclose(file);
+	
+	if (ret == 0) {
+		sincronizzaCartella();
+	}
+	return ret;
+}
+
+/* Scrive un checkpoint dell'indice se dall'inizio del precedente sono stati scritti almeno BYTE_TRA_CHECKPOINT byte
+ * 
+ * @return 1 se il checkpoint e' stato scritto, 0 se non era necessario, -1 in caso di errore
+ */
+int aggiornaCheckpointRegistri ()
+{
+	uint64_t byte;
+	
+	bloccaMutexCondiviso(&archivio->mutex);
+	byte = archivio->byte_da_checkpoint;
+	sbloccaMutexCondiviso(&archivio->mutex);
+	
+	if (byte < BYTE_TRA_CHECKPOINT) {
+		return 0;
+	}
+	return (scriviCheckpoint() < 0) ? -1 : 1;
+}
+
+/* Legge una copia del checkpoint e ne verifica il codice di controllo
+ * 
+ * @copia numero della copia (0 o 1)
+ * @header header in cui scrivere lo header del checkpoint
+ * 
+ * @return dati del checkpoint, allocati dinamicamente (NULL se la copia manca o non e' valida)
+ */
+static char* leggiCheckpoint (int copia, struct header_checkpoint* header)
+{
+	char percorso[600];
+	struct stat info;
+	char* dati = NULL;
+	int fd;
+	
+	percorsoCheckpoint(percorso, sizeof(percorso), copia);
+	fd = open(percorso, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+	
+	if (fstat(fd, &info) == 0 && pread(fd, header, sizeof(*header), 0) == sizeof(*header)
+			&& header->magic == MAGIC_CHECKPOINT && header->lunghezza <= (uint64_t)info.st_size - sizeof(*header)) {
+		dati = malloc(header->lunghezza + 1);
+		if (dati && pread(fd, dati, header->lunghezza, sizeof(*header)) != (ssize_t)header->lunghezza) {
+			free(dati);
+			dati = NULL;
+		}
+	}
+	close(fd);
+	
+	if (dati && aggiornaControllo(aggiornaControllo(CONTROLLO_INIZIALE, dati, header->lunghezza), &header->generazione,
+			sizeof(*header) - offsetof(struct header_checkpoint, generazione)) != header->controllo) {
+		free(dati);
+		dati = NULL;
+	}
+	return dati;
+}
+
+static int cercaNumero (const uint32_t* numeri, long quanti, uint32_t numero)
+{
+	long i;
+	
+	for (i = 0; i < quanti; ++i) {
+		if (numeri[i] == numero) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Controlla che un checkpoint appartenga all'archivio presente nella cartella
+ * (e non, per esempio, ad un archivio sostituito dal simulatore)
+ * 
+ * @numeri numeri dei segmenti presenti, in ordine crescente
+ * 
+ * @return 1 se il checkpoint e' utilizzabile, 0 altrimenti
+ */
+static int checkpointUtilizzabile (const struct header_checkpoint* header, const char* dati, const uint32_t* numeri, long quanti)
+{
+	const struct checkpoint_segmento* segmenti = (const struct checkpoint_segmento*)dati;
+	struct header_record record;
+	char percorso[600];
+	struct stat info;
+	uint32_t i;
+	long s;
+	int fd, presente;
+	
+	if ((uint64_t)header->quanti_segmenti * sizeof(struct checkpoint_segmento) > header->lunghezza) {
+		return 0;
+	}
+	
+	// La coda inizia in un segmento presente, lungo almeno quanto registrato nel checkpoint
+	percorsoSegmento(percorso, sizeof(percorso), SEGMENTO(header->inizio_coda));
+	if (!cercaNumero(numeri, quanti, SEGMENTO(header->inizio_coda)) || stat(percorso, &info) < 0
+			|| info.st_size < OFFSET_SEGMENTO(header->inizio_coda)) {
+		return 0;
+	}
+	
+	// L'ultimo record scritto prima del checkpoint e' quello registrato
+	if (header->ultima_posizione != 0) {
+		fd = descrittoreSegmento(SEGMENTO(header->ultima_posizione), 0);
+		if (fd < 0 || pread(fd, &record, sizeof(record), OFFSET_SEGMENTO(header->ultima_posizione)) != sizeof(record)
+				|| record.controllo != header->ultimo_controllo) {
+			return 0;
+		}
+	}
+	
+	// I segmenti precedenti alla coda sono stati tutti creati prima del checkpoint
+	for (s = 0; s < quanti && numeri[s] < SEGMENTO(header->inizio_coda); ++s) {
+		for (i = 0, presente = 0; i < header->quanti_segmenti && !presente; ++i) {
+			presente = (segmenti[i].numero == numeri[s]);
+		}
+		if (!presente) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Inserisce nell'indice i segmenti e i registri di un checkpoint
+ * 
+ * @return numero dei record caricati, -1 in caso di errore
+ */
+static long applicaCheckpoint (const struct header_checkpoint* header, const char* dati, const uint32_t* numeri, long quanti)
+{
+	const struct checkpoint_segmento* segmenti = (const struct checkpoint_segmento*)dati;
+	size_t letti = header->quanti_segmenti * sizeof(struct checkpoint_segmento);
+	struct checkpoint_utente copia;
+	struct posizione_record record;
+	char utente[MASSIMA_LUNGHEZZA_UTENTE + 1];
+	long caricati = 0;
+	uint32_t i, j;
+	
+	// I segmenti eliminati dalla compattazione dopo il checkpoint non vengono inseriti
+	for (i = 0; i < header->quanti_segmenti; ++i) {
+		struct segmento* segmento = &archivio->segmenti[segmenti[i].numero % MASSIMO_SEGMENTI];
+		
+		if (segmenti[i].numero <= SEGMENTO(header->inizio_coda) && cercaNumero(numeri, quanti, segmenti[i].numero)) {
+			segmento->numero = segmenti[i].numero;
+			segmento->byte_totali = segmenti[i].byte_totali;
+		}
+	}
+	
+	for (i = 0; i < header->quanti_utenti; ++i) {
+		struct indice_utente* indice;
+		
+		if (letti + sizeof(copia) > header->lunghezza) {
+			return -1;
+		}
+		memcpy(&copia, dati + letti, sizeof(copia));
+		if (copia.lunghezza_utente > MASSIMA_LUNGHEZZA_UTENTE || letti + sizeof(copia) + copia.lunghezza_utente
+				+ ((uint64_t)copia.quante_schedine + copia.quante_vincite) * sizeof(record) > header->lunghezza) {
+			return -1;
+		}
+		memcpy(utente, dati + letti + sizeof(copia), copia.lunghezza_utente);
+		utente[copia.lunghezza_utente] = '\0';
+		letti += sizeof(copia) + copia.lunghezza_utente;
+		
+		// Un utente non piu' presente nel file degli utenti viene saltato
+		indice = indiceUtente(utente);
+		if (!indice) {
+			letti += ((size_t)copia.quante_schedine + copia.quante_vincite) * sizeof(record);
+			continue;
+		}
+		elencaUtente(indice);
+		indice->estrazioni_ultima_schedina = copia.estrazioni_ultima_schedina;
+		indice->inizio_non_estratte = copia.inizio_non_estratte;
+		indice->inizio_da_controllare = copia.inizio_da_controllare;
+		memcpy(indice->valori, copia.valori, sizeof(indice->valori));
+		caricati += (indice->valori[0].posizione != 0) + (indice->valori[1].posizione != 0);
+		
+		for (j = 0; j < copia.quante_schedine + copia.quante_vincite; ++j) {
+			memcpy(&record, dati + letti, sizeof(record));
+			letti += sizeof(record);
+			
+			if (aggiungiPosizione((j < copia.quante_schedine) ? &indice->schedine : &indice->vincite,
+					record.posizione, record.offset, record.lunghezza) < 0) {
+				return -1;
+			}
+			caricati++;
+		}
+	}
+	
+	return caricati;
+}
+
+/* Carica la copia piu' recente del checkpoint utilizzabile
+ * 
+ * @numeri numeri dei segmenti presenti, in ordine crescente
+ * @inizio_coda puntatore in cui scrivere la posizione da cui rileggere i segmenti (0 se non c'e' un checkpoint)
+ * 
+ * @return numero dei record caricati, -1 in caso di errore
+ */
+static long caricaCheckpoint (const uint32_t* numeri, long quanti, uint64_t* inizio_coda)
+{
+	struct header_checkpoint header[2];
+	char* dati[2];
+	long caricati = 0;
+	int copia, scelta;
+	
+	*inizio_coda = 0;
+	dati[0] = leggiCheckpoint(0, &header[0]);
+	dati[1] = leggiCheckpoint(1, &header[1]);
+	
+	// Prima la copia piu' recente; la piu' vecchia se la piu' recente non e' utilizzabile
+	scelta = (dati[1] && (!dati[0] || header[1].generazione > header[0].generazione)) ? 1 : 0;
+	for (copia = 0; copia < 2; ++copia, scelta = 1 - scelta) {
+		// I prossimi checkpoint devono superare anche le copie non utilizzabili
+		if (dati[scelta] && header[scelta].generazione > archivio->generazione_checkpoint) {
+			archivio->generazione_checkpoint = header[scelta].generazione;
+		}
+		if (dati[scelta] && *inizio_coda == 0
+				&& checkpointUtilizzabile(&header[scelta], dati[scelta], numeri, quanti)) {
+			caricati = applicaCheckpoint(&header[scelta], dati[scelta], numeri, quanti);
+			*inizio_coda = header[scelta].inizio_coda;
+			
+			printf("Checkpoint dei registri caricato (generazione %lu)\n", (unsigned long)header[scelta].generazione);
+			fflush(stdout);
+		}
+	}
+	
+	free(dati[0]);
+	free(dati[1]);
+	return caricati;
+}
+
+/* Crea l'indice dei registri in memoria condivisa e lo ricostruisce dal checkpoint piu' recente
+ * e dai segmenti scritti dopo il checkpoint (tutti i segmenti, se non c'e' un checkpoint utilizzabile)
+ * 
+ * @prefisso prefisso del percorso dei segmenti
+ * @quante_estrazioni numero delle estrazioni nel file delle estrazioni
+ * 
+ * @return numero dei record caricati, -1 in caso di errore
+ */
+long inizializzaRegistri (const char* prefisso, uint32_t quante_estrazioni)
+{
+	uint32_t* numeri, * disordinati = NULL, quanti_disordinati = 0, i;
+	long quanti, caricati, ret, s;
+	uint64_t inizio_coda;
+	
+	archivio = (struct archivio_registri*)allocaMemoriaCondivisa(sizeof(struct archivio_registri));
+	if (!archivio || inizializzaMutexCondiviso(&archivio->mutex) < 0
+			|| inizializzaCondizioneCondivisa(&archivio->gruppo_completo) < 0
+			|| inizializzaCondizioneCondivisa(&archivio->gruppo_durevole) < 0) {
+		return -1;
+	}
+	snprintf(prefisso_segmenti, sizeof(prefisso_segmenti), "%s", prefisso);
+	archivio->estrazioni = quante_estrazioni;
+	archivio->pagine_usate = 1;
+	
+	quanti = cercaSegmenti("", ".seg", &numeri);
+	if (quanti < 0) {
+		return -1;
+	}
+	if (apriFileArchivio() < 0) {
+		free(numeri);
+		return -1;
+	}
+	
+	// Il checkpoint evita di rileggere i segmenti che lo precedono
+	ret = caricati = caricaCheckpoint(numeri, quanti, &inizio_coda);
+	
+	// I segmenti vengono letti in ordine di creazione: per ogni valore vale l'ultimo record letto
+	for (s = 0; s < quanti && ret >= 0; ++s) {
+		if (numeri[s] < SEGMENTO(inizio_coda)) {
+			continue;
+		}
+		ret = caricaSegmento(numeri[s], (numeri[s] == SEGMENTO(inizio_coda)) ? OFFSET_SEGMENTO(inizio_coda) : 0,
+				s == quanti - 1, &disordinati, &quanti_disordinati);
+		caricati += ret;
+	}
+	free(numeri);
+	
+	// Registri con record spostati dalla compattazione
+	for (i = 0; i < quanti_disordinati && ret >= 0; ++i) {
+		struct indice_utente* indice = &archivio->utenti[disordinati[i] / 2];
+		
+		ret = riordinaRegistro((disordinati[i] % 2) ? &indice->vincite : &indice->schedine);
+	}
+	free(disordinati);
+	ricalcolaByteValidi();
+	
+	if (ret >= 0 && quanti == 0) {
+		ret = apriSegmento(1);
+	}
+	return (ret < 0) ? -1 : caricati;
+}
+
+/* Libera la memoria condivisa occupata dall'indice dei registri e chiude i segmenti aperti dal processo
+ */
+void chiudiRegistri ()
+{
+	chiudiSegmentiAperti();
+	liberaMemoriaCondivisa(archivio, sizeof(struct archivio_registri));
+	archivio = NULL;
+}
+
+//
+// REGISTRI
+//
+static int aggiungiSchedina (const char* utente, const char* record, uint32_t lunghezza, int estratta, int attendi)
+{
+	struct indice_utente* indice;
+	uint32_t fine, estrazioni, segmento = 0;
+	uint64_t posizione, numero = 0;
+	int fd, ret = -1;
+	
+	bloccaMutexCondiviso(&archivio->mutex);
+	
+	indice = indiceUtente(utente);
+	if (indice) {
+		fine = fineRegistro(&indice->schedine, INIZIO_REGISTRO_SCHEDINE);
+		estrazioni = (estratta && archivio->estrazioni > 0) ? archivio->estrazioni - 1 : archivio->estrazioni;
+		
+		ret = appendiRecord(RECORD_SCHEDINA, utente, fine, estrazioni, record, lunghezza, &posizione);
+		if (ret == 0) {
+			// Prima schedina dopo un'estrazione: le schedine precedenti risultano estratte
+			if (indice->schedine.prima_pagina == 0 || indice->estrazioni_ultima_schedina < estrazioni) {
+				indice->estrazioni_ultima_schedina = estrazioni;
+				indice->inizio_non_estratte = fine;
+			}
+			ret = aggiungiPosizione(&indice->schedine, posizione, fine, lunghezza);
+			elencaUtente(indice);
+		}
+		if (ret == 0) {
+			numero = ++archivio->schedine_scritte;
+			segmento = archivio->segmento_attivo;
+		}
+	}
+	
+	if (ret == 0 && attendi && durabilita == DURABILITA_GRUPPO && archivio->sincronizzatore != 0) {
+		pthread_cond_signal(&archivio->gruppo_completo);
+	}
+	
+	sbloccaMutexCondiviso(&archivio->mutex);
+	
+	if (ret == 0 && attendi && durabilita == DURABILITA_SCHEDINA) {
+		// La sincronizzazione avviene senza il mutex, come nel commit di gruppo:
+		// intanto gli altri processi possono scrivere e leggere i registri
+		fd = descrittoreSegmento(segmento, 0);
+		ret = (fd < 0 || fdatasync(fd) < 0) ? -1 : 0;
+		
+		bloccaMutexCondiviso(&archivio->mutex);
+		if (ret == 0) {
+			registraSincronizzazione(numero);
+		}
+		else if (archivio->schedine_durevoli >= numero) {
+			// Il segmento e' stato sincronizzato dalla rotazione (e poi eventualmente compattato)
+			ret = 0;
+		}
+		else {
+			perror("Impossibile sincronizzare segmento dei registri");
+		}
+		sbloccaMutexCondiviso(&archivio->mutex);
+	}
+	else if (ret == 0 && attendi && durabilita == DURABILITA_GRUPPO) {
+		ret = attendiSchedinaDurevole(numero);
+	}
+	return ret;
+}
+
+/* Aggiunge una schedina in coda al registro di un utente e attende che sia su disco (secondo la durabilita' impostata)
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int aggiungiSchedinaRegistro (const char* utente, const char* record, uint32_t lunghezza)
+{
+	return aggiungiSchedina(utente, record, lunghezza, 0, 1);
+}
+
+/* Aggiunge una schedina (eventualmente gia' estratta) in coda al registro di un utente
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int importaSchedinaRegistro (const char* utente, const char* record, uint32_t lunghezza, int estratta)
+{
+	return aggiungiSchedina(utente, record, lunghezza, estratta, 0);
+}
+
+/* Legge lo stato del registro delle schedine di un utente
+ * 
+ * @utente username
+ * @stato struttura in cui scrivere lo stato
+ */
+void statoRegistro (const char* utente, struct stato_registro* stato)
+{
+	struct indice_utente* indice;
+	
+	stato->fine = INIZIO_REGISTRO_SCHEDINE;
+	stato->inizio_non_estratte = INIZIO_REGISTRO_SCHEDINE;
+	stato->inizio_da_controllare = INIZIO_REGISTRO_SCHEDINE;
+	
+	bloccaMutexCondiviso(&archivio->mutex);
+	indice = indiceUtente(utente);
+	if (indice && indice->schedine.prima_pagina != 0) {
+		stato->fine = indice->schedine.fine;
+		
+		// Se dopo l'ultima schedina c'e' stata un'estrazione, tutte le schedine sono estratte
+		stato->inizio_non_estratte = (indice->estrazioni_ultima_schedina < archivio->estrazioni) ?
+				indice->schedine.fine : indice->inizio_non_estratte;
+		if (indice->valori[VALORE(RECORD_CURSORE)].posizione != 0) {
+			stato->inizio_da_controllare = indice->inizio_da_controllare;
+		}
+	}
+	sbloccaMutexCondiviso(&archivio->mutex);
+}
+
+/* Legge i record del registro delle schedine compresi tra due offset
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int leggiRegistroSchedine (const char* utente, uint32_t da, uint32_t a, char** dati, uint32_t* lunghezza)
+{
+	return leggiRegistro(utente, 1, da, a, dati, lunghezza);
+}
+
+/* Riscrive sul posto alcuni byte di un record del registro delle schedine, aggiornandone il codice di controllo
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int riscriviRegistroSchedine (const char* utente, uint32_t offset, const char* dati, uint32_t lunghezza)
+{
+	struct indice_utente* indice;
+	struct posizione_record* record;
+	struct header_record* header;
+	uint32_t lunghezza_utente = strlen(utente), dimensione;
+	char* buffer = NULL;
+	int fd, ret = -1;
+	
+	bloccaMutexCondiviso(&archivio->mutex);
+	
+	indice = indiceUtente(utente);
+	record = indice ? cercaPosizione(&indice->schedine, offset) : NULL;
+	if (record && !ARCHIVIATA(record->posizione) && offset + lunghezza <= record->offset + record->lunghezza) {
+		dimensione = sizeof(struct header_record) + lunghezza_utente + record->lunghezza;
+		buffer = malloc(dimensione);
+		fd = descrittoreSegmento(SEGMENTO(record->posizione), 0);
+		
+		if (buffer && fd >= 0 && pread(fd, buffer, dimensione, OFFSET_SEGMENTO(record->posizione)) == (ssize_t)dimensione) {
+			header = (struct header_record*)buffer;
+			memcpy(buffer + sizeof(*header) + lunghezza_utente + (offset - record->offset), dati, lunghezza);
+			header->controllo = controlloRecord(header, buffer + sizeof(*header), buffer + sizeof(*header) + lunghezza_utente);
+			
+			if (pwrite(fd, buffer, dimensione, OFFSET_SEGMENTO(record->posizione)) == (ssize_t)dimensione
+					&& (durabilita == DURABILITA_NESSUNA || fdatasync(fd) == 0)) {
+				ret = 0;
+			}
+			if (record->posizione == archivio->ultima_posizione) {
+				archivio->ultimo_controllo = header->controllo;
+			}
+		}
+	}
+	
+	sbloccaMutexCondiviso(&archivio->mutex);
+	free(buffer);
+	return ret;
+}
+
+/* Imposta l'offset della prima schedina di cui non e' stata verificata la vincita
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int impostaInizioDaControllare (const char* utente, uint32_t offset)
+{
+	struct indice_utente* indice;
+	int ret = -1;
+	
+	bloccaMutexCondiviso(&archivio->mutex);
+	indice = indiceUtente(utente);
+	if (indice && sostituisciValore(indice, utente, RECORD_CURSORE, &offset, sizeof(offset)) == 0) {
+		indice->inizio_da_controllare = offset;
+		ret = 0;
+	}
+	sbloccaMutexCondiviso(&archivio->mutex);
+	return ret;
+}
+
+/* Aggiunge del testo in coda al registro delle vincite di un utente
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int aggiungiVinciteRegistro (const char* utente, const char* testo, uint32_t lunghezza)
+{
+	struct indice_utente* indice;
+	uint64_t posizione;
+	uint32_t fine;
+	int ret = -1;
+	
+	bloccaMutexCondiviso(&archivio->mutex);
+	indice = indiceUtente(utente);
+	if (indice) {
+		fine = fineRegistro(&indice->vincite, 0);
+		ret = appendiRecord(RECORD_VINCITE, utente, fine, 0, testo, lunghezza, &posizione);
+		if (ret == 0) {
+			ret = aggiungiPosizione(&indice->vincite, posizione, fine, lunghezza);
+			elencaUtente(indice);
+		}
+	}
+	sbloccaMutexCondiviso(&archivio->mutex);
+	return ret;
+}
+
+/* Legge l'intero registro delle vincite di un utente
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int leggiRegistroVincite (const char* utente, char** dati, uint32_t* lunghezza)
+{
+	return leggiRegistro(utente, 0, 0, UINT32_MAX, dati, lunghezza);
+}
+
+/* Legge il riepilogo delle vincite di un utente
+ * 
+ * @return numero dei byte letti (0 se l'utente non ha un riepilogo), -1 in caso di errore
+ */
+int leggiRiepilogoRegistro (const char* utente, void* riepilogo, uint32_t dimensione)
+{
+	struct indice_utente* indice;
+	struct posizione_record valore;
+	char* dati;
+	int tentativo, ret = -1;
+	
+	for (tentativo = 0; tentativo < TENTATIVI_LETTURA && ret < 0; ++tentativo) {
+		bloccaMutexCondiviso(&archivio->mutex);
+		indice = indiceUtente(utente);
+		if (indice) {
+			valore = indice->valori[VALORE(RECORD_RIEPILOGO)];
+		}
+		sbloccaMutexCondiviso(&archivio->mutex);
+		
+		if (!indice) {
+			return -1;
+		}
+		if (valore.posizione == 0) {
+			return 0;
+		}
+		
+		dati = malloc(valore.lunghezza);
+		if (!dati) {
+			return -1;
+		}
+		if (leggiDatiRecord(&valore, strlen(utente), dati) == 0) {
+			ret = (valore.lunghezza < dimensione) ? valore.lunghezza : dimensione;
+			memcpy(riepilogo, dati, ret);
+		}
+		free(dati);
+	}
+	return ret;
+}
+
+/* Sostituisce il riepilogo delle vincite di un utente
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int scriviRiepilogoRegistro (const char* utente, const void* riepilogo, uint32_t dimensione)
+{
+	struct indice_utente* indice;
+	int ret = -1;
+	
+	bloccaMutexCondiviso(&archivio->mutex);
+	indice = indiceUtente(utente);
+	if (indice) {
+		ret = sostituisciValore(indice, utente, RECORD_RIEPILOGO, riepilogo, dimensione);
+	}
+	sbloccaMutexCondiviso(&archivio->mutex);
+	return ret;
+}
+
+/* Registra che e' stata effettuata un'estrazione
+ */
+void registraEstrazioneRegistri ()
+{
+	bloccaMutexCondiviso(&archivio->mutex);
+	archivio->estrazioni++;
+	sbloccaMutexCondiviso(&archivio->mutex);
+}
+
+//
+// COMPATTAZIONE
+//
+/* Copia in coda all'archivio un record di un segmento da compattare, se e' ancora raggiungibile dall'indice
+ * (il chiamante possiede il mutex)
+ * 
+ * @return 1 se il record e' stato copiato, 0 se non e' piu' valido, -1 in caso di errore
+ */
+static int copiaRecordValido (const struct header_record* header, const char* utente, uint64_t posizione)
+{
+	struct indice_utente* indice = indiceUtente(utente);
+	struct posizione_record* record = NULL;
+	uint32_t dimensione = sizeof(*header) + header->lunghezza_utente + header->lunghezza;
+	uint64_t riferimento = posizione;	// posizione del record nell'indice
+	char* buffer;
+	int fd_origine, fd;
+	
+	if (!indice) {
+		return 0;
+	}
+	
+	if (header->tipo == RECORD_SCHEDINA || header->tipo == RECORD_VINCITE || header->tipo == RECORD_ARCHIVIO) {
+		record = cercaPosizione((header->tipo == RECORD_VINCITE) ? &indice->vincite : &indice->schedine, header->offset);
+	}
+	else if (header->tipo == RECORD_RIEPILOGO || header->tipo == RECORD_CURSORE) {
+		record = &indice->valori[VALORE(header->tipo)];
+	}
+	if (header->tipo == RECORD_ARCHIVIO) {
+		riferimento |= POSIZIONE_ARCHIVIATA;
+	}
+	if (!record || record->posizione != riferimento) {
+		return 0;
+	}
+	
+	// Il record viene riletto sotto il mutex: potrebbe essere stato riscritto dopo la lettura del segmento
+	buffer = malloc(dimensione);
+	fd_origine = descrittoreSegmento(SEGMENTO(posizione), 0);
+	if (!buffer || fd_origine < 0 || pread(fd_origine, buffer, dimensione, OFFSET_SEGMENTO(posizione)) != (ssize_t)dimensione) {
+		free(buffer);
+		return -1;
+	}
+	
+	fd = segmentoPerRecord(dimensione);
+	if (fd < 0 || pwrite(fd, buffer, dimensione, archivio->dimensione_attivo) != (ssize_t)dimensione) {
+		perror("Impossibile scrivere segmento dei registri");
+		free(buffer);
+		return -1;
+	}
+	free(buffer);
+	
+	record->posizione = POSIZIONE(archivio->segmento_attivo, archivio->dimensione_attivo) | (riferimento & POSIZIONE_ARCHIVIATA);
+	registraScrittura(dimensione, header->controllo);
+	archivio->byte_copiati += dimensione;
+	return 1;
+}
+
+/* Copia i record validi di un segmento in coda all'archivio ed elimina il segmento
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int compattaSegmento (uint32_t numero)
+{
+	static char buffer_lettura[1 << 20];
+	struct header_record header;
+	char percorso[600], utente[MASSIMA_LUNGHEZZA_UTENTE + 1];
+	uint32_t posizione = 0;
+	FILE* file;
+	int ret = 0;
+	
+	percorsoSegmento(percorso, sizeof(percorso), numero);
+	file = fopen(percorso, "rb");
+	if (!file) {
+		perror("Impossibile aprire segmento da compattare");
+		return -1;
+	}
+	setvbuf(file, buffer_lettura, _IOFBF, sizeof(buffer_lettura));
+	
+	// I record vengono letti in sequenza senza il mutex, che viene acquisito solo per copiare ogni record valido
+	while (ret >= 0 && fread(&header, sizeof(header), 1, file) == 1) {
+		if (header.lunghezza_utente > MASSIMA_LUNGHEZZA_UTENTE
+				|| fread(utente, 1, header.lunghezza_utente, file) != header.lunghezza_utente
+				|| fseek(file, header.lunghezza, SEEK_CUR) < 0) {
+			break;
+		}
+		utente[header.lunghezza_utente] = '\0';
+		
+		bloccaMutexCondiviso(&archivio->mutex);
+		ret = copiaRecordValido(&header, utente, POSIZIONE(numero, posizione));
+		sbloccaMutexCondiviso(&archivio->mutex);
+		
+		posizione += sizeof(header) + header.lunghezza_utente + header.lunghezza;
+	}
+	fclose(file);
+	if (ret < 0) {
+		return -1;
+	}
+	
+	// I record validi sono stati copiati (e le copie portate su disco): il segmento non e' piu' raggiungibile dall'indice
+	bloccaMutexCondiviso(&archivio->mutex);
+	if (sincronizzaSegmentoAttivo() < 0) {
+		sbloccaMutexCondiviso(&archivio->mutex);
+		return -1;
+	}
+	archivio->segmenti[numero % MASSIMO_SEGMENTI].numero = 0;
+	archivio->segmenti_compattati++;
+	sbloccaMutexCondiviso(&archivio->mutex);
+	
+	chiudiDescrittore(numero);
+	if (unlink(percorso) < 0) {
+		perror("Impossibile eliminare segmento compattato");
+	}
+	return 0;
+}
+
+/* Compatta i segmenti chiusi con meno di SOGLIA_COMPATTAZIONE byte validi (in percentuale)
+ * 
+ * @return numero dei segmenti eliminati, -1 in caso di errore
+ */
+int compattaRegistri ()
+{
+	int i, eliminati = 0;
+	
+	for (i = 0; i < MASSIMO_SEGMENTI; ++i) {
+		struct segmento* segmento = &archivio->segmenti[i];
+		uint32_t numero;
+		int da_compattare;
+		
+		bloccaMutexCondiviso(&archivio->mutex);
+		numero = segmento->numero;
+		da_compattare = numero != 0 && numero != archivio->segmento_attivo
+				&& (uint64_t)segmento->byte_validi * 100 < (uint64_t)segmento->byte_totali * SOGLIA_COMPATTAZIONE;
+		sbloccaMutexCondiviso(&archivio->mutex);
+		
+		if (!da_compattare) {
+			continue;
+		}
+		if (compattaSegmento(numero) < 0) {
+			return -1;
+		}
+		eliminati++;
+	}
+	return eliminati;
+}
+
+//
+// ARCHIVIAZIONE
+//
+/* Blocco di schedine scritto nel file di archivio, in attesa di sostituire le schedine nell'indice
+ */
+struct blocco_archiviato {
+	uint32_t elemento;			// posizione dell'utente nell'indice
+	uint32_t offset;			// offset della prima schedina del blocco
+	uint32_t estrazioni;		// estrazioni effettuate quando e' stata registrata l'ultima schedina del blocco
+	uint64_t prima_posizione;	// posizione della prima schedina, per riconoscere un blocco non piu' valido
+	struct record_archivio dati;
+};
+
+/* Imposta l'archiviazione delle schedine concluse
+ * 
+ * @return 0 in caso di successo, -1 se l'opzione non e' valida
+ */
+int impostaArchiviazioneRegistri (const char* opzione)
+{
+	long orizzonte, limite = LIMITE_ARCHIVIAZIONE_PREDEFINITO;
+	char* fine;
+	
+	// "orizzonte" oppure "orizzonte/limite"
+	orizzonte = strtol(opzione, &fine, 10);
+	if (fine == opzione || orizzonte < 0 || orizzonte > UINT32_MAX) {
+		return -1;
+	}
+	if (*fine == '/') {
+		opzione = fine + 1;
+		limite = strtol(opzione, &fine, 10);
+		if (fine == opzione || limite <= 0) {
+			return -1;
+		}
+	}
+	if (*fine != '\0') {
+		return -1;
+	}
+	
+	orizzonte_archivio = (uint32_t)orizzonte;
+	limite_archiviazione = (uint64_t)limite << 10;
+	return 0;
+}
+
+/* Copia le posizioni delle prime schedine concluse di un utente che non sono ancora state archiviate,
+ * fino a MASSIMO_BYTE_BLOCCO_ARCHIVIO byte (il chiamante possiede il mutex)
+ * 
+ * @record puntatore in cui scrivere l'indirizzo delle posizioni copiate, allocate dinamicamente
+ * @totale puntatore in cui scrivere la somma delle lunghezze delle schedine
+ * 
+ * @return numero delle posizioni copiate, -1 in caso di errore
+ */
+static long copiaSchedineConcluse (const struct indice_utente* indice, struct posizione_record** record, uint32_t* totale)
+{
+	long quante = 0;
+	uint32_t p, i;
+	
+	*record = NULL;
+	*totale = 0;
+	
+	// Le schedine concluse precedono la prima schedina da controllare (che esiste solo dopo una verifica delle vincite)
+	if (indice->valori[VALORE(RECORD_CURSORE)].posizione == 0) {
+		return 0;
+	}
+	for (p = indice->schedine.prima_pagina; p != 0; p = archivio->pagine[p].successiva) {
+		struct pagina_registro* pagina = &archivio->pagine[p];
+		
+		for (i = 0; i < pagina->quante; ++i) {
+			struct posizione_record* schedina = &pagina->record[i];
+			
+			// Le schedine di un blocco sono consecutive: il blocco termina prima di un blocco gia' archiviato
+			if (ARCHIVIATA(schedina->posizione)) {
+				if (quante > 0) {
+					return quante;
+				}
+				continue;
+			}
+			if (schedina->offset + schedina->lunghezza > indice->inizio_da_controllare
+					|| *totale + schedina->lunghezza > MASSIMO_BYTE_BLOCCO_ARCHIVIO) {
+				return quante;
+			}
+			
+			if (quante % 64 == 0) {
+				struct posizione_record* temp = realloc(*record, (quante + 64) * sizeof(struct posizione_record));
+				if (!temp) {
+					free(*record);
+					*record = NULL;
+					return -1;
+				}
+				*record = temp;
+			}
+			(*record)[quante++] = *schedina;
+			*totale += schedina->lunghezza;
+		}
+	}
+	return quante;
+}
+
+/* Scrive un blocco compresso in coda al file di archivio, aprendone uno nuovo se il blocco non entra
+ * in quello attivo (il file chiuso viene portato su disco, cosi' che in seguito si sincronizzi solo il file attivo)
+ * 
+ * @compresso blocco compresso
+ * @lunghezza lunghezza del blocco compresso
+ * @dati dati del record RECORD_ARCHIVIO in cui scrivere la posizione del blocco
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int scriviBloccoArchivio (const char* compresso, uint32_t lunghezza, struct record_archivio* dati)
+{
+	int fd;
+	
+	if (dimensione_archivio > 0 && (uint64_t)dimensione_archivio + lunghezza > DIMENSIONE_SEGMENTO) {
+		fd = descrittoreSegmento(NUMERO_FILE_ARCHIVIO(file_archivio), 0);
+		if (fd < 0 || fdatasync(fd) < 0) {
+			perror("Impossibile sincronizzare file di archivio");
+			return -1;
+		}
+		file_archivio++;
+		dimensione_archivio = 0;
+	}
+	
+	fd = descrittoreSegmento(NUMERO_FILE_ARCHIVIO(file_archivio), 1);
+	if (fd < 0 || pwrite(fd, compresso, lunghezza, dimensione_archivio) != (ssize_t)lunghezza) {
+		perror("Impossibile scrivere file di archivio");
+		return -1;
+	}
+	if (dimensione_archivio == 0) {
+		sincronizzaCartella();
+	}
+	
+	dati->numero = file_archivio;
+	dati->offset_file = dimensione_archivio;
+	dati->lunghezza_compressa = lunghezza;
+	dati->controllo = aggiornaControllo(CONTROLLO_INIZIALE, compresso, lunghezza);
+	dimensione_archivio += lunghezza;
+	return 0;
+}
+
+/* Prepara il blocco delle prime schedine concluse (non ancora archiviate) di un utente e lo scrive compresso
+ * nel file di archivio. Le schedine vengono lette senza il mutex: nessun altro processo le modifica
+ * (precedono la prima schedina da controllare) e la compattazione e' eseguita dallo stesso processo
+ * 
+ * @elemento posizione dell'utente nell'indice
+ * @blocco blocco da compilare
+ * @byte puntatore al contatore dei byte letti e scritti
+ * 
+ * @return 1 se il blocco e' stato scritto, 0 se l'utente non ha abbastanza schedine da archiviare, -1 in caso di errore
+ */
+static int preparaBloccoArchivio (uint32_t elemento, struct blocco_archiviato* blocco, uint64_t* byte)
+{
+	const char* utente = usernameInPosizione(elemento);
+	uint32_t lunghezza_utente = strlen(utente), totale, lunghezza = 0, estrazioni;
+	struct posizione_record* record;
+	struct header_record header;
+	char* schedine, * compresso = NULL;
+	uLongf lunghezza_compressa;
+	long quante, i;
+	int fd, ret = -1;
+	
+	bloccaMutexCondiviso(&archivio->mutex);
+	quante = copiaSchedineConcluse(&archivio->utenti[elemento], &record, &totale);
+	estrazioni = archivio->estrazioni;
+	sbloccaMutexCondiviso(&archivio->mutex);
+	
+	if (quante <= 0 || totale < MINIMO_BYTE_BLOCCO_ARCHIVIO) {
+		free(record);
+		return (quante < 0) ? -1 : 0;
+	}
+	schedine = malloc(totale);
+	if (!schedine) {
+		free(record);
+		return -1;
+	}
+	
+	// Le schedine sono in ordine di registrazione: il blocco termina prima della prima schedina troppo recente
+	for (i = 0; i < quante; ++i) {
+		off_t inizio = OFFSET_SEGMENTO(record[i].posizione);
+		
+		fd = descrittoreSegmento(SEGMENTO(record[i].posizione), 0);
+		if (fd < 0 || pread(fd, &header, sizeof(header), inizio) != sizeof(header) || header.tipo != RECORD_SCHEDINA
+				|| header.offset != record[i].offset || header.lunghezza != record[i].lunghezza
+				|| (uint64_t)header.estrazioni + orizzonte_archivio > estrazioni
+				|| pread(fd, schedine + lunghezza, header.lunghezza, inizio + sizeof(header) + lunghezza_utente) != (ssize_t)header.lunghezza) {
+			break;
+		}
+		blocco->estrazioni = header.estrazioni;
+		lunghezza += header.lunghezza;
+		*byte += sizeof(header) + lunghezza_utente + header.lunghezza;
+	}
+	
+	if (lunghezza < MINIMO_BYTE_BLOCCO_ARCHIVIO) {
+		ret = 0;
+	}
+	else {
+		lunghezza_compressa = compressBound(lunghezza);
+		compresso = malloc(lunghezza_compressa);
+		if (compresso && compress2((Bytef*)compresso, &lunghezza_compressa, (const Bytef*)schedine, lunghezza,
+				Z_DEFAULT_COMPRESSION) == Z_OK && scriviBloccoArchivio(compresso, lunghezza_compressa, &blocco->dati) == 0) {
+			blocco->elemento = elemento;
+			blocco->offset = record[0].offset;
+			blocco->prima_posizione = record[0].posizione;
+			blocco->dati.lunghezza = lunghezza;
+			blocco->dati.quante_schedine = (uint32_t)i;
+			*byte += lunghezza_compressa;
+			ret = 1;
+		}
+	}
+	
+	free(compresso);
+	free(schedine);
+	free(record);
+	return ret;
+}
+
+/* Porta su disco il file di archivio e sostituisce nell'indice le schedine dei blocchi scritti con i record RECORD_ARCHIVIO:
+ * un record RECORD_ARCHIVIO non si riferisce mai ad un blocco che non e' su disco
+ * 
+ * @blocchi blocchi scritti nel file di archivio
+ * @quanti numero dei blocchi
+ * 
+ * @return numero delle schedine archiviate, -1 in caso di errore
+ */
+static long applicaBlocchiArchiviati (const struct blocco_archiviato* blocchi, int quanti)
+{
+	struct indice_utente* indice;
+	struct posizione_record* record;
+	const char* utente;
+	uint64_t posizione;
+	long archiviate = 0;
+	int fd, i, ret = 0;
+	
+	fd = descrittoreSegmento(NUMERO_FILE_ARCHIVIO(file_archivio), 0);
+	if (fd < 0 || fdatasync(fd) < 0) {
+		perror("Impossibile sincronizzare file di archivio");
+		return -1;
+	}
+	
+	for (i = 0; i < quanti && ret == 0; ++i) {
+		utente = usernameInPosizione(blocchi[i].elemento);
+		
+		bloccaMutexCondiviso(&archivio->mutex);
+		indice = &archivio->utenti[blocchi[i].elemento];
+		
+		// Il blocco non e' piu' valido se la sua prima schedina e' stata spostata dopo la lettura
+		record = cercaPosizione(&indice->schedine, blocchi[i].offset);
+		if (record && record->posizione == blocchi[i].prima_posizione) {
+			ret = appendiRecord(RECORD_ARCHIVIO, utente, blocchi[i].offset, blocchi[i].estrazioni, &blocchi[i].dati,
+					sizeof(blocchi[i].dati), &posizione);
+			if (ret == 0) {
+				ret = archiviaPosizioni(&indice->schedine, blocchi[i].offset, blocchi[i].dati.lunghezza,
+						posizione | POSIZIONE_ARCHIVIATA, strlen(utente));
+			}
+			if (ret == 0) {
+				archiviate += blocchi[i].dati.quante_schedine;
+				archivio->schedine_archiviate += blocchi[i].dati.quante_schedine;
+				archivio->byte_archiviati += blocchi[i].dati.lunghezza;
+				archivio->byte_archivio += blocchi[i].dati.lunghezza_compressa;
+			}
+		}
+		sbloccaMutexCondiviso(&archivio->mutex);
+	}
+	return (ret < 0) ? -1 : archiviate;
+}
+
+/* Sospende l'archiviazione quanto basta perche' i byte letti e scritti non superino limite_archiviazione byte al secondo
+ * 
+ * @inizio istante di inizio dell'archiviazione (orologio monotono)
+ * @byte byte letti e scritti dall'inizio dell'archiviazione
+ */
+static void rallentaArchiviazione (const struct timespec* inizio, uint64_t byte)
+{
+	struct timespec adesso, attesa;
+	double trascorsi, previsti;
+	
+	clock_gettime(CLOCK_MONOTONIC, &adesso);
+	trascorsi = (adesso.tv_sec - inizio->tv_sec) + (adesso.tv_nsec - inizio->tv_nsec) / 1e9;
+	previsti = (double)byte / limite_archiviazione;
+	
+	if (previsti > trascorsi) {
+		attesa.tv_sec = (time_t)(previsti - trascorsi);
+		attesa.tv_nsec = (long)((previsti - trascorsi - attesa.tv_sec) * 1e9);
+		nanosleep(&attesa, NULL);
+	}
+}
+
+/* Archivia le schedine concluse registrate da almeno orizzonte_archivio estrazioni.
+ * Per ogni utente viene scritto al piu' un blocco; ogni BLOCCHI_PER_SINCRONIZZAZIONE blocchi il file di archivio
+ * viene portato su disco con una sola fdatasync(...) e i blocchi sostituiscono le loro schedine nell'indice.
+ * Un'interruzione del server lascia al piu' dei blocchi non raggiungibili in fondo al file di archivio
+ * 
+ * @return numero delle schedine archiviate, -1 in caso di errore
+ */
+long archiviaRegistri ()
+{
+	struct blocco_archiviato* blocchi;
+	struct timespec inizio;
+	uint64_t byte = 0;
+	uint32_t quanti_utenti, u;
+	long archiviate = 0, ret = 0;
+	int quanti = 0;
+	
+	if (orizzonte_archivio == 0) {
+		return 0;
+	}
+	blocchi = malloc(BLOCCHI_PER_SINCRONIZZAZIONE * sizeof(struct blocco_archiviato));
+	if (!blocchi) {
+		return -1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &inizio);
+	
+	// L'elenco degli utenti cresce solo in coda: gli utenti aggiunti durante l'archiviazione vengono percorsi la prossima volta
+	bloccaMutexCondiviso(&archivio->mutex);
+	quanti_utenti = archivio->quanti_utenti;
+	sbloccaMutexCondiviso(&archivio->mutex);
+	
+	for (u = 0; u < quanti_utenti && ret >= 0; ++u) {
+		ret = preparaBloccoArchivio(archivio->elenco_utenti[u], &blocchi[quanti], &byte);
+		if (ret > 0 && ++quanti == BLOCCHI_PER_SINCRONIZZAZIONE) {
+			ret = applicaBlocchiArchiviati(blocchi, quanti);
+			archiviate += (ret > 0) ? ret : 0;
+			quanti = 0;
+		}
+		rallentaArchiviazione(&inizio, byte);
+	}
+	if (ret >= 0 && quanti > 0) {
+		ret = applicaBlocchiArchiviati(blocchi, quanti);
+		archiviate += (ret > 0) ? ret : 0;
+	}
+	
+	free(blocchi);
+	return (ret < 0) ? -1 : archiviate;
+}
+
+/* Copia le posizioni dei primi record consecutivi del registro delle vincite di un utente che possono
+ * essere riuniti in un solo record di al massimo MASSIMO_BYTE_VINCITE_RIUNITE byte (il chiamante possiede il mutex).
+ * I record vengono cercati solo se il registro occupa piu' di una pagina dell'indice
+ * 
+ * @record puntatore in cui scrivere l'indirizzo delle posizioni copiate, allocate dinamicamente
+ * @totale puntatore in cui scrivere la somma delle lunghezze dei record
+ * 
+ * @return numero delle posizioni copiate (almeno 2, oppure 0 se non ci sono record da riunire), -1 in caso di errore
+ */
+static long copiaVinciteDaRiunire (const struct indice_utente* indice, struct posizione_record** record, uint32_t* totale)
+{
+	long quante, inizio, fine;
+	uint32_t somma;
+	
+	*record = NULL;
+	*totale = 0;
+	if (indice->vincite.prima_pagina == indice->vincite.ultima_pagina) {
+		return 0;
+	}
+	
+	quante = copiaPosizioni(&indice->vincite, 0, UINT32_MAX, record, &somma);
+	if (quante < 0) {
+		return -1;
+	}
+	
+	// I record gia' riuniti sono lunghi: si parte dal primo che si puo' riunire con il successivo
+	for (inizio = 0; inizio + 1 < quante; ++inizio) {
+		if ((uint64_t)(*record)[inizio].lunghezza + (*record)[inizio + 1].lunghezza <= MASSIMO_BYTE_VINCITE_RIUNITE) {
+			break;
+		}
+	}
+	somma = 0;
+	for (fine = inizio; fine < quante && somma + (*record)[fine].lunghezza <= MASSIMO_BYTE_VINCITE_RIUNITE; ++fine) {
+		somma += (*record)[fine].lunghezza;
+	}
+	if (fine - inizio < 2) {
+		free(*record);
+		*record = NULL;
+		return 0;
+	}
+	
+	memmove(*record, *record + inizio, (fine - inizio) * sizeof(struct posizione_record));
+	*totale = somma;
+	return fine - inizio;
+}
+
+/* Riunisce i primi record consecutivi del registro delle vincite di un utente in un solo record.
+ * I record vengono letti senza il mutex: nessun altro processo li modifica (le vincite vengono solo aggiunte in coda)
+ * e la compattazione e' eseguita dallo stesso processo
+ * 
+ * @elemento posizione dell'utente nell'indice
+ * @byte puntatore al contatore dei byte letti e scritti
+ * 
+ * @return 1 se i record sono stati riuniti, 0 se non ce n'erano da riunire, -1 in caso di errore
+ */
+static int riunisciVinciteUtente (uint32_t elemento, uint64_t* byte)
+{
+	const char* utente = usernameInPosizione(elemento);
+	uint32_t lunghezza_utente = strlen(utente), totale, copiati = 0;
+	struct indice_utente* indice = &archivio->utenti[elemento];
+	struct posizione_record* record, * primo;
+	uint64_t posizione;
+	char* vincite;
+	long quante, i;
+	int ret = 0;
+	
+	bloccaMutexCondiviso(&archivio->mutex);
+	quante = copiaVinciteDaRiunire(indice, &record, &totale);
+	sbloccaMutexCondiviso(&archivio->mutex);
+	
+	if (quante <= 0) {
+		return (quante < 0) ? -1 : 0;
+	}
+	vincite = malloc(totale);
+	if (!vincite) {
+		free(record);
+		return -1;
+	}
+	for (i = 0; i < quante; ++i) {
+		if (leggiDatiRecord(&record[i], lunghezza_utente, vincite + copiati) < 0) {
+			free(vincite);
+			free(record);
+			return -1;
+		}
+		copiati += record[i].lunghezza;
+		*byte += sizeof(struct header_record) + lunghezza_utente + record[i].lunghezza;
+	}
+	
+	bloccaMutexCondiviso(&archivio->mutex);
+	
+	// I record riuniti vengono sostituiti solo se il primo si trova ancora dove e' stato letto
+	primo = cercaPosizione(&indice->vincite, record[0].offset);
+	if (primo && primo->posizione == record[0].posizione
+			&& appendiRecord(RECORD_VINCITE, utente, record[0].offset, 0, vincite, totale, &posizione) == 0) {
+		ret = archiviaPosizioni(&indice->vincite, record[0].offset, totale, posizione, lunghezza_utente);
+		if (ret == 0) {
+			archivio->vincite_riunite += quante;
+			ret = 1;
+		}
+	}
+	
+	sbloccaMutexCondiviso(&archivio->mutex);
+	*byte += sizeof(struct header_record) + lunghezza_utente + totale;
+	
+	free(vincite);
+	free(record);
+	return ret;
+}
+
+/* Riunisce in un solo record i record consecutivi del registro delle vincite degli utenti che occupano
+ * piu' di una pagina dell'indice, leggendo e scrivendo al piu' limite_archiviazione byte al secondo
+ * 
+ * @return numero dei registri delle vincite riuniti, -1 in caso di errore
+ */
+long riunisciVinciteRegistri ()
+{
+	struct timespec inizio;
+	uint64_t byte = 0;
+	uint32_t quanti_utenti, u;
+	long riuniti = 0;
+	int ret = 0;
+	
+	clock_gettime(CLOCK_MONOTONIC, &inizio);
+	
+	bloccaMutexCondiviso(&archivio->mutex);
+	quanti_utenti = archivio->quanti_utenti;
+	sbloccaMutexCondiviso(&archivio->mutex);
+	
+	for (u = 0; u < quanti_utenti && ret >= 0; ++u) {
+		ret = riunisciVinciteUtente(archivio->elenco_utenti[u], &byte);
+		riuniti += (ret > 0) ? 1 : 0;
+		rallentaArchiviazione(&inizio, byte);
+	}
+	return (ret < 0) ? -1 : riuniti;
+}
+
+/* Restituisce il numero delle pagine dell'indice ancora disponibili (mai usate o liberate)
+ */
+uint32_t pagineDisponibiliRegistri ()
+{
+	uint32_t disponibili;
+	
+	bloccaMutexCondiviso(&archivio->mutex);
+	disponibili = CAPACITA_PAGINE_REGISTRI - archivio->pagine_usate + archivio->quante_pagine_libere;
+	sbloccaMutexCondiviso(&archivio->mutex);
+	return disponibili;
+}
+
+/* Scrive le metriche dei registri (una per riga, nel formato "nome valore")
+ * 
+ * @buffer buffer in cui scrivere le metriche
+ * @dimensione dimensione del buffer
+ * 
+ * @return numero di caratteri scritti
+ */
+int scriviMetricheRegistri (char* buffer, size_t dimensione)
+{
+	uint64_t byte_totali = 0, byte_validi = 0;
+	uint32_t quanti_segmenti = 0;
+	int i, ret;
+	
+	bloccaMutexCondiviso(&archivio->mutex);
+	for (i = 0; i < MASSIMO_SEGMENTI; ++i) {
+		if (archivio->segmenti[i].numero != 0) {
+			quanti_segmenti++;
+			byte_totali += archivio->segmenti[i].byte_totali;
+			byte_validi += archivio->segmenti[i].byte_validi;
+		}
+	}
+	
+	ret = snprintf(buffer, dimensione,
+			"registri_segmenti %u\n"
+			"registri_segmento_attivo %u\n"
+			"registri_byte %lu\n"
+			"registri_byte_validi %lu\n"
+			"registri_record_scritti %lu\n"
+			"registri_byte_scritti %lu\n"
+			"registri_pagine_indice %u\n"
+			"registri_segmenti_compattati %lu\n"
+			"registri_byte_copiati %lu\n"
+			"registri_durabilita %i\n"
+			"registri_sincronizzazioni %lu\n"
+			"registri_schedine_sincronizzate %lu\n"
+			"registri_checkpoint %lu\n"
+			"registri_byte_da_checkpoint %lu\n"
+			"registri_byte_riletti_avvio %lu\n"
+			"registri_archiviazione_orizzonte %u\n"
+			"registri_schedine_archiviate %lu\n"
+			"registri_byte_archiviati %lu\n"
+			"registri_byte_archivio %lu\n"
+			"registri_pagine_libere %u\n"
+			"registri_pagine_disponibili %u\n"
+			"registri_vincite_riunite %lu\n"
+			"registri_letture_archivio %lu\n"
+			"registri_letture_archivio_lente %lu\n"
+			"registri_latenza_archivio_massima_us %lu\n",
+			quanti_segmenti, archivio->segmento_attivo, (unsigned long)byte_totali, (unsigned long)byte_validi,
+			(unsigned long)archivio->record_scritti, (unsigned long)archivio->byte_scritti, archivio->pagine_usate - 1,
+			(unsigned long)archivio->segmenti_compattati, (unsigned long)archivio->byte_copiati, durabilita,
+			(unsigned long)archivio->sincronizzazioni, (unsigned long)archivio->schedine_sincronizzate,
+			(unsigned long)archivio->generazione_checkpoint, (unsigned long)archivio->byte_da_checkpoint,
+			(unsigned long)archivio->byte_riletti, orizzonte_archivio, (unsigned long)archivio->schedine_archiviate,
+			(unsigned long)archivio->byte_archiviati, (unsigned long)archivio->byte_archivio, archivio->quante_pagine_libere,
+			CAPACITA_PAGINE_REGISTRI - archivio->pagine_usate + archivio->quante_pagine_libere,
+			(unsigned long)archivio->vincite_riunite,
+			(unsigned long)archivio->letture_archivio, (unsigned long)archivio->letture_archivio_lente,
+			(unsigned long)archivio->latenza_archivio_massima);
+	sbloccaMutexCondiviso(&archivio->mutex);
+	
+	return caratteriScritti(ret, dimensione);
+}
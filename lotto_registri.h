@@ -0,0 +1,350 @@
+#ifndef LOTTO_REGISTRI_H
+#define LOTTO_REGISTRI_H
+
+#include "lotto_utenti.h"
+#include <stddef.h>
+#include <stdint.h>
+
+//////////////////////////////////////////////////////
+//			REGISTRI DEGLI UTENTI (SEGMENTI)		//
+//////////////////////////////////////////////////////
+/* I registri di tutti gli utenti (schedine, vincite e riepilogo) sono memorizzati in un unico archivio
+ * a segmenti: una sequenza di file "<prefisso><numero>.seg" di al piu' DIMENSIONE_SEGMENTO byte,
+ * scritti solo in coda. Quando il segmento attivo e' pieno se ne apre uno nuovo (rotazione).
+ * Ogni record contiene lo username dell'utente a cui appartiene e un codice di controllo,
+ * percio' l'archivio si rilegge senza altri file; un record incompleto in fondo all'ultimo segmento
+ * (interruzione del server durante una scrittura) viene scartato all'avvio.
+ * 
+ * Il registro delle schedine di un utente e' una sequenza logica di byte con lo stesso formato
+ * dei vecchi file %utente%_schedine.bin: il primo record inizia all'offset INIZIO_REGISTRO_SCHEDINE
+ * e gli offset dei cursori (prima schedina non estratta, prima schedina da controllare) hanno lo stesso significato.
+ * Ogni record di una schedina memorizza il proprio offset logico e il numero delle estrazioni gia' effettuate
+ * quando e' stato registrato: una schedina e' estratta se dopo la sua registrazione c'e' stata un'estrazione,
+ * percio' un'estrazione non deve aggiornare i registri di tutti gli utenti.
+ * 
+ * L'indice (utente --> posizioni dei suoi record nei segmenti) e' in memoria condivisa. Dopo ogni BYTE_TRA_CHECKPOINT
+ * byte scritti, il processo in background ne salva un checkpoint, alternando due copie con codice di controllo
+ * e numero di generazione: una copia scritta a meta' (interruzione del server) non sostituisce mai l'altra.
+ * All'avvio l'indice viene ricostruito dalla copia valida piu' recente, rileggendo solo i segmenti scritti dopo
+ * l'inizio del checkpoint: i segmenti riletti all'avvio sono limitati a circa BYTE_TRA_CHECKPOINT byte, qualunque sia
+ * la dimensione dell'archivio, mentre il caricamento del checkpoint resta proporzionale alla dimensione dell'indice
+ * (numero degli utenti e dei loro record non archiviati). Senza un checkpoint utilizzabile si rileggono tutti i segmenti.
+ * Le scritture e gli aggiornamenti dell'indice sono serializzati
+ * da un mutex condiviso; le letture copiano le posizioni dall'indice e leggono i record con pread(...),
+ * su descrittori che ogni processo tiene aperti (nessuna open(...) per comando).
+ * 
+ * I record sostituiti (riepiloghi e cursori precedenti) restano nei segmenti: la compattazione, eseguita
+ * da un processo in background, copia in coda all'archivio i record ancora validi dei segmenti con
+ * meno di SOGLIA_COMPATTAZIONE byte validi (in percentuale) e poi li elimina.
+ * 
+ * Durabilita' delle schedine: la conferma di una giocata viene inviata solo quando la schedina e' su disco.
+ * Una fdatasync(...) per ogni schedina limiterebbe le giocate al numero di sincronizzazioni al secondo del disco,
+ * percio' le schedine vengono sincronizzate a gruppi (commit di gruppo): il primo processo che attende
+ * una schedina sincronizza tutte quelle scritte fino a quel momento, gli altri attendono la sua sincronizzazione.
+ * I segmenti vengono sincronizzati anche quando sono chiusi dalla rotazione e prima che la compattazione
+ * elimini un segmento (le copie dei record devono essere su disco).
+ * 
+ * Archiviazione: le schedine concluse (che precedono la prima schedina da controllare) e registrate da almeno
+ * un certo numero di estrazioni (orizzonte) vengono spostate dal processo in background nei file di archivio
+ * "<prefisso>archivio_<numero>.arc", compresse a blocchi di schedine consecutive dello stesso utente.
+ * Per ogni blocco viene aggiunto all'archivio un record RECORD_ARCHIVIO che indica dove si trova il blocco:
+ * nell'indice le schedine del blocco sono sostituite da un'unica posizione (quella del record), percio' l'indice
+ * contiene solo le schedine recenti e i segmenti che contenevano le schedine archiviate vengono compattati.
+ * Le letture del registro delle schedine decomprimono i blocchi che contengono l'area richiesta:
+ * un blocco non supera MASSIMO_BYTE_BLOCCO_ARCHIVIO byte, cosi' che la latenza di una lettura resti limitata
+ * (le letture piu' lente di OBIETTIVO_LATENZA_ARCHIVIO vengono contate nelle metriche).
+ * L'archiviazione legge e scrive al piu' un certo numero di byte al secondo, per non rallentare i processi
+ * che servono i client; come la compattazione, e' sospesa durante le estrazioni.
+ * 
+ * Il registro delle vincite cresce di un record ad ogni verifica: lo stesso processo riunisce periodicamente
+ * i record consecutivi di un registro in un unico record (al massimo MASSIMO_BYTE_VINCITE_RIUNITE byte),
+ * cosi' che le pagine dell'indice occupate dalle vincite vengano liberate e i vecchi record compattati.
+ */
+
+// Percorso di un segmento, a partire dal prefisso e dal numero del segmento
+#define FORMATO_PERCORSO_SEGMENTO "%s%06u.seg"
+
+// Percorso di una delle due copie del checkpoint dell'indice, a partire dal prefisso e dal numero della copia (0 o 1)
+#define FORMATO_PERCORSO_CHECKPOINT "%sindice_%i.ckp"
+
+// Percorso di un file di archivio, a partire dal prefisso e dal numero del file
+#define FORMATO_PERCORSO_ARCHIVIO "%sarchivio_%06u.arc"
+
+// Byte scritti nei segmenti dopo i quali si salva un nuovo checkpoint (limita i byte da rileggere all'avvio)
+#define BYTE_TRA_CHECKPOINT (16 << 20)
+
+// Dimensione massima di un segmento
+#define DIMENSIONE_SEGMENTO (64 << 20)
+
+// Numero massimo di segmenti presenti contemporaneamente (l'archivio puo' occupare fino a 256 GB)
+#define MASSIMO_SEGMENTI 4096
+
+// Un segmento chiuso viene compattato quando i suoi byte validi scendono sotto questa percentuale
+#define SOGLIA_COMPATTAZIONE 50
+
+// Pagine dell'indice previste per ogni utente: le schedine archiviate e le vincite riunite occupano
+// una sola posizione per blocco, percio' un utente occupa poche pagine anche con molti record
+#define PAGINE_PER_UTENTE 8
+
+// Numero di pagine dell'indice in memoria condivisa (ogni pagina contiene le posizioni di RECORD_PER_PAGINA record),
+// proporzionale agli utenti previsti dalla directory (meta' della sua capacita'). La memoria condivisa e' allocata
+// senza riserva, percio' occupa solo le pagine effettivamente usate
+#define CAPACITA_PAGINE_REGISTRI ((CAPACITA_DIRECTORY_UTENTI / 2) * PAGINE_PER_UTENTE)
+
+// Pagine che devono restare disponibili perche' vengano accettati nuovi utenti: le restanti sono riservate
+// ai record degli utenti gia' registrati (vedi pagineDisponibiliRegistri())
+#define RISERVA_PAGINE_REGISTRI (CAPACITA_PAGINE_REGISTRI / 64)
+
+// Lunghezza massima del record che riunisce record consecutivi del registro delle vincite
+#define MASSIMO_BYTE_VINCITE_RIUNITE (256 << 10)
+
+// Offset logico del primo record del registro delle schedine (nei vecchi file seguiva lo header di 8 byte)
+#define INIZIO_REGISTRO_SCHEDINE 8
+
+// Tipi di record
+#define RECORD_SCHEDINA 1		// record del registro delle schedine ("timestamp schedina|")
+#define RECORD_VINCITE 2		// vincite aggiunte al registro delle vincite da una verifica
+#define RECORD_RIEPILOGO 3		// riepilogo delle vincite (vale l'ultimo scritto)
+#define RECORD_CURSORE 4		// offset della prima schedina da controllare (vale l'ultimo scritto)
+#define RECORD_ARCHIVIO 5		// posizione di un blocco di schedine archiviate (sostituisce le schedine del blocco)
+
+// Livelli di durabilita' delle schedine
+#define DURABILITA_NESSUNA 0	// nessuna sincronizzazione: le schedine confermate si perdono se il sistema si arresta
+#define DURABILITA_GRUPPO 1		// una fdatasync(...) per gruppo di schedine (predefinito)
+#define DURABILITA_SCHEDINA 2	// una fdatasync(...) per ogni schedina
+
+// Il gruppo di schedine viene sincronizzato dopo questa attesa (in microsecondi), o prima se e' completo
+// (vedi impostaDurabilitaRegistri(...))
+#define ATTESA_GRUPPO_PREDEFINITA 1000
+#define MASSIMO_GRUPPO_PREDEFINITO 32
+
+// Archiviazione: le schedine concluse vengono archiviate dopo ORIZZONTE_ARCHIVIO_PREDEFINITO estrazioni,
+// leggendo e scrivendo al piu' LIMITE_ARCHIVIAZIONE_PREDEFINITO KB al secondo (vedi impostaArchiviazioneRegistri(...))
+#define ORIZZONTE_ARCHIVIO_PREDEFINITO 100
+#define LIMITE_ARCHIVIAZIONE_PREDEFINITO 4096
+
+// Dimensione (non compressa) dei blocchi di archivio: un utente viene archiviato solo se le sue schedine
+// da archiviare occupano almeno MINIMO_BYTE_BLOCCO_ARCHIVIO byte
+#define MINIMO_BYTE_BLOCCO_ARCHIVIO (4 << 10)
+#define MASSIMO_BYTE_BLOCCO_ARCHIVIO (256 << 10)
+
+// Latenza massima (in microsecondi) di una lettura del registro che comprende schedine archiviate
+#define OBIETTIVO_LATENZA_ARCHIVIO 50000
+
+/* Header di un record su file, seguito dallo username (senza terminatore) e dai dati
+ */
+struct header_record {
+	uint32_t controllo;			// FNV-1a dei campi successivi, dello username e dei dati
+	uint32_t lunghezza;			// lunghezza dei dati
+	uint16_t lunghezza_utente;
+	uint8_t tipo;
+	uint8_t riservato;
+	uint32_t offset;			// offset logico nel registro (schedine e vincite)
+	uint32_t estrazioni;		// estrazioni effettuate quando la schedina e' stata registrata
+};
+
+/* Stato del registro delle schedine di un utente (gli offset corrispondono ai vecchi campi dello header)
+ */
+struct stato_registro {
+	uint32_t fine;					// offset della fine del registro
+	uint32_t inizio_non_estratte;	// offset della prima schedina non ancora estratta
+	uint32_t inizio_da_controllare;	// offset della prima schedina di cui non e' stata verificata la vincita
+};
+
+/* Imposta la durabilita' delle schedine (DEVE essere chiamata prima di creare i processi figli)
+ * 
+ * @opzione "nessuna", "schedina", "gruppo" oppure "gruppo=attesa/massimo": il gruppo viene sincronizzato
+ *	dopo <attesa> microsecondi dalla prima schedina o quando contiene tante schedine quante il gruppo
+ *	precedente, al massimo <massimo> (con attesa 0 il gruppo e' formato dalle schedine scritte
+ *	durante la sincronizzazione precedente)
+ * 
+ * @return 0 in caso di successo, -1 se l'opzione non e' valida
+ */
+int impostaDurabilitaRegistri (const char* opzione);
+
+/* Imposta l'archiviazione delle schedine concluse (DEVE essere chiamata prima di creare i processi figli)
+ * 
+ * @opzione "orizzonte" oppure "orizzonte/limite": le schedine concluse vengono archiviate quando sono state registrate
+ *	da almeno <orizzonte> estrazioni (0 disattiva l'archiviazione), leggendo e scrivendo al piu' <limite> KB al secondo
+ * 
+ * @return 0 in caso di successo, -1 se l'opzione non e' valida
+ */
+int impostaArchiviazioneRegistri (const char* opzione);
+
+/* Crea l'indice dei registri in memoria condivisa e lo ricostruisce leggendo tutti i segmenti.
+ * Deve essere chiamata dal processo principale prima di creare i processi figli,
+ * dopo la directory degli utenti (i record di utenti non registrati vengono ignorati).
+ * 
+ * @prefisso prefisso del percorso dei segmenti: il segmento n e' "<prefisso><n>.seg" (n a 6 cifre)
+ * @quante_estrazioni numero delle estrazioni nel file delle estrazioni
+ * 
+ * @return numero dei record caricati, -1 in caso di errore
+ */
+long inizializzaRegistri (const char* prefisso, uint32_t quante_estrazioni);
+
+/* Libera la memoria condivisa occupata dall'indice dei registri
+ */
+void chiudiRegistri ();
+
+/* Aggiunge una schedina in coda al registro di un utente.
+ * Termina quando la schedina e' su disco, secondo la durabilita' impostata (vedi impostaDurabilitaRegistri(...))
+ * 
+ * @utente username
+ * @record record della schedina ("timestamp schedina|")
+ * @lunghezza lunghezza del record
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int aggiungiSchedinaRegistro (const char* utente, const char* record, uint32_t lunghezza);
+
+/* Come aggiungiSchedinaRegistro(...), ma permette di indicare se la schedina e' gia' stata estratta
+ * (usata per importare i registri da altri formati). Non attende che la schedina sia su disco:
+ * al termine dell'importazione va chiamata sincronizzaRegistri()
+ * 
+ * @estratta 1 se la schedina e' gia' stata estratta, 0 altrimenti
+ */
+int importaSchedinaRegistro (const char* utente, const char* record, uint32_t lunghezza, int estratta);
+
+/* Legge lo stato del registro delle schedine di un utente (un utente senza schedine ha un registro vuoto)
+ * 
+ * @utente username
+ * @stato struttura in cui scrivere lo stato
+ */
+void statoRegistro (const char* utente, struct stato_registro* stato);
+
+/* Legge i record del registro delle schedine compresi tra due offset
+ * 
+ * @utente username
+ * @da offset del primo record da leggere
+ * @a offset della fine dell'area da leggere (i record che iniziano da <a> in poi non vengono letti)
+ * @dati puntatore in cui scrivere l'indirizzo dei record letti, allocati dinamicamente
+ *	(da deallocare con free(...)) e seguiti da un terminatore
+ * @lunghezza puntatore in cui scrivere la lunghezza dei record letti
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int leggiRegistroSchedine (const char* utente, uint32_t da, uint32_t a, char** dati, uint32_t* lunghezza);
+
+/* Riscrive sul posto alcuni byte di un record del registro delle schedine
+ * (per esempio il timestamp di annullamento di un abbonamento, che ha larghezza fissa)
+ * 
+ * @utente username
+ * @offset offset logico del primo byte da riscrivere
+ * @dati nuovi byte, che devono appartenere tutti allo stesso record
+ * @lunghezza numero dei byte
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int riscriviRegistroSchedine (const char* utente, uint32_t offset, const char* dati, uint32_t lunghezza);
+
+/* Imposta l'offset della prima schedina di cui non e' stata verificata la vincita
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int impostaInizioDaControllare (const char* utente, uint32_t offset);
+
+/* Aggiunge del testo in coda al registro delle vincite di un utente
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int aggiungiVinciteRegistro (const char* utente, const char* testo, uint32_t lunghezza);
+
+/* Legge l'intero registro delle vincite di un utente
+ * 
+ * @utente username
+ * @dati puntatore in cui scrivere l'indirizzo del registro, allocato dinamicamente e seguito da un terminatore
+ * @lunghezza puntatore in cui scrivere la lunghezza del registro
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int leggiRegistroVincite (const char* utente, char** dati, uint32_t* lunghezza);
+
+/* Legge il riepilogo delle vincite di un utente
+ * 
+ * @utente username
+ * @riepilogo area in cui copiare il riepilogo
+ * @dimensione dimensione dell'area
+ * 
+ * @return numero dei byte letti (0 se l'utente non ha un riepilogo), -1 in caso di errore
+ */
+int leggiRiepilogoRegistro (const char* utente, void* riepilogo, uint32_t dimensione);
+
+/* Sostituisce il riepilogo delle vincite di un utente
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int scriviRiepilogoRegistro (const char* utente, const void* riepilogo, uint32_t dimensione);
+
+/* Porta su disco tutti i record scritti finora
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int sincronizzaRegistri ();
+
+/* Chiude i descrittori dei segmenti aperti dal processo chiamante.
+ * Il processo principale la chiama prima di creare i processi figli, cosi' che i segmenti eliminati
+ * dalla compattazione non restino aperti (e occupati su disco) per tutta la vita del server
+ */
+void chiudiSegmentiAperti ();
+
+/* Registra che e' stata effettuata un'estrazione: tutte le schedine registrate finora risultano estratte
+ * (DEVE essere chiamata solo dal processo principale)
+ */
+void registraEstrazioneRegistri ();
+
+/* Compatta i segmenti chiusi con meno di SOGLIA_COMPATTAZIONE byte validi (in percentuale)
+ * 
+ * @return numero dei segmenti eliminati, -1 in caso di errore
+ */
+int compattaRegistri ();
+
+/* Archivia le schedine concluse registrate da almeno un orizzonte di estrazioni (vedi impostaArchiviazioneRegistri(...))
+ * 
+ * @return numero delle schedine archiviate, -1 in caso di errore
+ */
+long archiviaRegistri ();
+
+/* Riunisce in un solo record i record consecutivi del registro delle vincite degli utenti che occupano
+ * piu' di una pagina dell'indice (DEVE essere chiamata dallo stesso processo della compattazione)
+ * 
+ * @return numero dei registri delle vincite riuniti, -1 in caso di errore
+ */
+long riunisciVinciteRegistri ();
+
+/* Restituisce il numero delle pagine dell'indice ancora disponibili (mai usate o liberate)
+ */
+uint32_t pagineDisponibiliRegistri ();
+
+/* Salva un checkpoint dell'indice se dall'inizio del precedente sono stati scritti almeno BYTE_TRA_CHECKPOINT byte
+ * (o, dopo l'avvio, se i segmenti riletti erano almeno BYTE_TRA_CHECKPOINT byte)
+ * 
+ * @return 1 se il checkpoint e' stato salvato, 0 se non era necessario, -1 in caso di errore
+ */
+int aggiornaCheckpointRegistri ();
+
+/* Compila lo header di un record, codice di controllo compreso (usata anche dal simulatore,
+ * che genera i segmenti senza indice: il record su file e' lo header seguito dallo username e dai dati)
+ * 
+ * @header header da compilare
+ * @tipo tipo del record
+ * @utente username
+ * @offset offset logico del record nel registro
+ * @estrazioni estrazioni effettuate (solo per le schedine)
+ * @dati dati del record
+ * @lunghezza lunghezza dei dati
+ * 
+ * @return dimensione del record su file
+ */
+uint32_t preparaHeaderRecord (struct header_record* header, uint8_t tipo, const char* utente, uint32_t offset,
+		uint32_t estrazioni, const void* dati, uint32_t lunghezza);
+
+/* Scrive le metriche dei registri (una per riga, nel formato "nome valore")
+ * 
+ * @buffer buffer in cui scrivere le metriche
+ * @dimensione dimensione del buffer
+ * 
+ * @return numero di caratteri scritti
+ */
+int scriviMetricheRegistri (char* buffer, size_t dimensione);
+
+#endif	// LOTTO_REGISTRI_H
@@ -1,16 +1,34 @@
 #include "lotto.h"
+#include "lotto_bloccati.h"
+#include "lotto_casuale.h"
+#include "lotto_colonne.h"
+#include "lotto_esposizione.h"
+#include "lotto_interni.h"
+#include "lotto_limitatore.h"
+#include "lotto_pianificatore.h"
+#include "lotto_premi.h"
+#include "lotto_registri.h"
+#include "lotto_sessioni.h"
+#include "lotto_statistiche.h"
+#include "lotto_utenti.h"
 #include <arpa/inet.h>
+#include <ctype.h>
 #include <dirent.h>
 #include <errno.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <signal.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
@@ -20,12 +38,23 @@
 // Costanti temporali lato server {
 	#define PERIODO_ESTRAZIONE 5
 	#define SECONDI_IN_UN_MINUTO 60
+	
+	// Secondi tra due manutenzioni dei registri (compattazione dei segmenti e checkpoint dell'indice)
+	#define INTERVALLO_MANUTENZIONE_REGISTRI 60
 // }
 
 // Connessione TCP {
 	#define LUNGHEZZA_BACKLOG 10
 // }
 
+// Limitatore delle richieste {
+	// Una richiesta vedi_estrazione costa un gettone ogni ESTRAZIONI_PER_GETTONE estrazioni richieste
+	#define ESTRAZIONI_PER_GETTONE 100
+	
+	// Numero delle estrazioni con la vincita piu' alta inviate da !replay
+	#define ESTRAZIONI_MIGLIORI_REPLAY 5
+// }
+
 // Sezione FILE {
 	#define CARTELLA_FILES "./files"
 
@@ -33,10 +62,18 @@
 	 * -----------------------------------------------------------------------
 	 * |  utente (stringa)  | " " (char) |  password (stringa)  | " " (char) |
 	 * -----------------------------------------------------------------------
+	 * 
+	 * Il file e' il log delle registrazioni: viene letto solo all'avvio per popolare
+	 * la directory degli utenti in memoria condivisa (vedi lotto_utenti.h)
 	 */
 	#define FILE_UTENTI CARTELLA_FILES"/utenti.txt"
 
-	/* Formato record di FILE_CLIENT_BLOCCATI
+	/* Il file FILE_FILTRO_UTENTI contiene il filtro di Bloom sugli username registrati
+	 * (vedi lotto_utenti.h). Se non e' coerente con FILE_UTENTI, viene ricostruito all'avvio
+	 */
+	#define FILE_FILTRO_UTENTI CARTELLA_FILES"/utenti.bloom"
+	
+	/* Formato record di FILE_CLIENT_BLOCCATI, log dei blocchi (vedi lotto_bloccati.h)
 	 * -----------------------------------------------
 	 * |  ip address (in_addr)  | timestamp (time_t) |
 	 * -----------------------------------------------
@@ -47,25 +84,59 @@
 	#define LUNGHEZZA_ESTRAZIONE_SINGOLA_RUOTA   (sizeof(uint8_t)+QUANTI_NUMERI_ESTRATTI*sizeof(uint32_t))
 	#define LUNGHEZZA_BLOCCO_ESTRAZIONE   (sizeof(time_t)+LUNGHEZZA_ESTRAZIONE_SINGOLA_RUOTA*QUANTE_RUOTE)
 
-	/* Formato record dei file schedina degli utenti
+	/* Il file FILE_STATISTICHE contiene frequenze e ritardi dei numeri di ogni ruota (vedi lotto_statistiche.h).
+	 * Viene riscritto dopo ogni estrazione e ricostruito da FILE_ESTRAZIONI all'avvio, se non e' coerente
+	 */
+	#define FILE_STATISTICHE CARTELLA_FILES"/statistiche.bin"
+	
+	/* I file colonnari contengono i numeri estratti su una sola ruota, in ordine di estrazione (vedi lotto_colonne.h).
+	 * Il file della ruota r e' PREFISSO_FILE_COLONNE"<r>.bin"; viene allineato a FILE_ESTRAZIONI all'avvio
+	 */
+	#define PREFISSO_FILE_COLONNE CARTELLA_FILES"/estrazioni_ruota_"
+	
+	/* Formato record del registro delle schedine degli utenti
 	 * -----------------------------------------------------------------------
 	 * |  timestamp (time_t)  | ' ' | schedina serializzata (stringa) | '|'  |
 	 * -----------------------------------------------------------------------
-	 */
-
-	/* Il file %utente%_schedine.bin ha uno header composto da due campi da 4 byte ciascuno.
 	 * 
-	 * Il primo campo e' l'offset  dell'insieme di schedine di tipo 1 (ovvero che non hanno subito un'estrazione.
-	 * Questo campo viene aggiornato dalla routine di estrazione dei numeri
+	 * I registri degli utenti (schedine, vincite e riepilogo) sono memorizzati nei segmenti
+	 * PREFISSO_FILE_REGISTRI"<n>.seg", comuni a tutti gli utenti (vedi lotto_registri.h).
+	 * Il registro delle schedine ha lo stesso formato dei vecchi file %utente%_schedine.bin, a partire dall'offset
+	 * INIZIO_REGISTRO_SCHEDINE. Al posto dello header del file, lo stato del registro (statoRegistro(...)) contiene:
+	 * 
+	 * - l'offset dell'insieme di schedine di tipo 1 (ovvero che non hanno subito un'estrazione),
+	 *   ricavato dalle estrazioni registrate con registraEstrazioneRegistri(...)
 	 * 
-	 * Il secondo campo e' l'offset dell'insieme di schedine (estratte o meno) su cui non e' stata verificata la vincite,
-	 * ovvero che sono state inserite nel sistema DOPO l'ultima chiamata del comando !vedi_vincite da parte dell'utente.
-	 * Questo campo viene aggiornato dalla ruotine eseguiVediVinci(...)
+	 * - l'offset dell'insieme di schedine (estratte o meno) su cui non e' stata verificata la vincite,
+	 *   ovvero che sono state inserite nel sistema DOPO l'ultima chiamata del comando !vedi_vincite da parte dell'utente,
+	 *   oppure che partecipano ancora ad estrazioni future (schedine valide per piu' estrazioni e abbonamenti).
+	 *   Questo campo viene aggiornato dalla ruotine eseguiVediVinci(...)
+	 */
+	#define PREFISSO_FILE_REGISTRI CARTELLA_FILES"/registro_"
+
+	/* Il riepilogo delle vincite di un utente e' un unico record a dimensione fissa (struct riepilogo_vincite)
+	 * con i totali delle vincite dell'utente. Il record viene aggiornato incrementalmente
+	 * ogni volta che una vincita viene scritta nel registro vincite.
+	 * I record scritti prima dell'aggiunta di estrazioni_controllate e fine_controllata sono piu' corti: i campi
+	 * mancanti valgono 0, che e' corretto perche' allora tutte le schedine controllate erano concluse
+	 */
+	#define LUNGHEZZA_RECORD_RIEPILOGO sizeof(struct riepilogo_vincite)
+	#define LUNGHEZZA_MINIMA_RECORD_RIEPILOGO offsetof(struct riepilogo_vincite, estrazioni_controllate)
+	
+	/* I vecchi file di registro per utente (%utente%_schedine.bin, %utente%_vincite.txt e %utente%_riepilogo.bin)
+	 * vengono importati nei segmenti ad ogni avvio, finche' l'importazione non e' stata completata e
+	 * FILE_IMPORTAZIONE_REGISTRI e' stato creato: un'importazione interrotta riprende dai dati gia' importati.
+	 * Vengono letti dove si trovano, senza spostarli: direttamente in CARTELLA_FILES (disposizione precedente)
+	 * oppure nelle sottocartelle indicate da percorsoFileUtente(...) (vedi lotto.h), dove li sposta lotto_migrazione
 	 */
 	#define LUNGHEZZA_HEADER_SCHEDINE_BIN 8
+	#define FILE_IMPORTAZIONE_REGISTRI CARTELLA_FILES"/registri_importati"
 // }
 
 int estrazione_completata = 0; // flag per viene settato alla notifica della conclusione di un'estrazione
+int estrazioni_ordinate = 1; // 0 se i timestamp di FILE_ESTRAZIONI non sono strettamente crescenti (vedi verificaOrdineEstrazioni())
+time_t ultima_estrazione = 0; // timestamp dell'ultima estrazione di FILE_ESTRAZIONI
+uint32_t estrazioni_nel_file = 0; // numero delle estrazioni di FILE_ESTRAZIONI (aggiornato dal processo principale)
 
 //////////////////////////////////////////////
 //			COMUNICAZIONE SU SOCKET			//
@@ -129,18 +200,18 @@ int invia (const int socket, void* msg, const uint16_t lenmsg)
 {
 	int ret;
 	uint16_t len;
+	struct iovec parti[2];
 	
 	len = htons(lenmsg);	// conversione in network format per ottenere architecture indipendence
 	
-	// Invio della lunghezza del messaggio
-	ret = send(socket, &len, sizeof(len), 0);
-	if (ret < 0) {
-		perror("Errore in fase d'invio della lunghezza");
-		return -1;
-	}
+	// Invio della lunghezza e del messaggio con una sola chiamata: inviati separatamente,
+	// il secondo segmento attende l'ACK del primo (algoritmo di Nagle), che il client ritarda fino a 40ms
+	parti[0].iov_base = &len;
+	parti[0].iov_len = sizeof(len);
+	parti[1].iov_base = msg;
+	parti[1].iov_len = lenmsg;
 	
-	// Invio del messaggio
-	ret = send(socket, msg, lenmsg, 0);
+	ret = writev(socket, parti, 2);
 	if (ret < 0) {
 		perror("Errore in fase d'invio del messaggio");
 		return -1;
@@ -214,50 +285,11 @@ int min (int a, int b)
 	return (a <= b) ? a : b;
 }
 
-/* Dato l'indice di una puntata (0: ESTRATTO, 1: AMBO...), restituisce il "moltiplicatore del premio",
- * ovvero il valore della vincita per ogni Euro giocato (supponendo che l'importo della giocata 
- * non venga suddiviso in sotto-importi). Rappresenta la funzione di conversione della Tabella 1
- * a pagina 2 delle specifiche di progetto.
- *
- * @p indice della vincita/puntata
- *
- * @return valore della vincita per ogni euro giocato
- */
-double moltiplicatorePremio (int p)
-{
-	switch (p) {
-		case 0: return PREMIO_SINGOLO;
-		case 1: return PREMIO_AMBO;
-		case 2: return PREMIO_TERNO;
-		case 3: return PREMIO_QUATERNA;
-		case 4: return PREMIO_CINQUINA;
-		default: return 1;
-	}
-}
-
-/* Calcola il coefficiente binomiale con parametri n e k
- * Formula originale --> ( n! ) / ( k! * (n-k)! )
- * che semplificanso diventa --> ( n * (n-1) * (n-2) * ... * (n-k+1) ) / ( k * (k-1) * ... * 2 * 1)
- */
-double coefficienteBinomiale (unsigned int n, unsigned int k)
-{
-	unsigned int i;
-	unsigned int sopra = 1, sotto = 1;
-	
-	if (k > n) return -1;
-	
-	for (i = 0; i < k; ++i) {
-		sopra *= (n-i);
-		sotto *= (i+1);
-	}
-	
-	return ((double)sopra)/((double)sotto);
-}
-
 //////////////////////////////////////////////
 //			SERVIZI PER L'UTENTE			//
 //////////////////////////////////////////////
-/* Genera una stringa di caratteri alfanumerici lunga LUNGHEZZA_SESSION_ID
+/* Genera una stringa di caratteri alfanumerici lunga LUNGHEZZA_SESSION_ID.
+ * I caratteri sono estratti dal generatore crittografico (il session id non deve essere prevedibile)
  * @buffer indirizzo ad un array di caratteri lungo LUNGHEZZA_SESSION_ID + 1 (NULL terminator)
  */
 void generaSessionId (char* buffer)
@@ -265,10 +297,10 @@ void generaSessionId (char* buffer)
 	int i;
 	
 	for (i = 0; i < LUNGHEZZA_SESSION_ID; ++i) {
-		// Genera un numero casuale nell'intervallo [0, QUANTI_CARATTERI_ALFANUMERICI].
+		// Genera un numero casuale nell'intervallo [0, QUANTI_CARATTERI_ALFANUMERICI).
 		// Ogni numero dell'intervallo e' in corrispondenza biunivoca con un elemento
 		// dell'unione ordinata degli intervalli [0, 9]+[a,z]+[A,Z]
-		int random = rand() % QUANTI_CARATTERI_ALFANUMERICI;
+		int random = (int)casualeSicuroLimitato(QUANTI_CARATTERI_ALFANUMERICI);
 		
 		if (random < QUANTE_CIFRE) {
 			// E' una cifra
@@ -294,47 +326,84 @@ void generaSessionId (char* buffer)
 	buffer[LUNGHEZZA_SESSION_ID] = '\0';
 }
 
-/* Cerca uno username dato nel file FILE_UTENTI
+/* Legge il riepilogo delle vincite di un utente dal suo registro.
+ * Se il riepilogo non esiste (per esempio per gli utenti che non hanno ancora controllato le vincite),
+ * il riepilogo restituito ha tutti i campi nulli.
  * 
- * @username stringa che contiene lo username da cercare
- * @password stringa in cui scrivere la password dell'utente, se esiste.
- *	Se e' NULL, la funzione non copia la password (utile per signup)
+ * @user nome dell'utente
+ * @riepilogo struttura in cui scrivere il riepilogo letto
  * 
- * @return 1 se lo username esiste, 0 se lo username non esiste, -1 in caso di errore
+ * @return 1 se il record e' stato letto, 0 se il record non esiste, -1 in caso di errore
  */
-int cercaUsername (char* username, char* password)
+int leggiRiepilogoVincite (const char* user, struct riepilogo_vincite* riepilogo)
 {
-	FILE* fileUtenti;
 	int ret;
 	
-	// Apertura in lettura del file FILE_UTENTI
-	fileUtenti = fopen(FILE_UTENTI, "r");
-	if (!fileUtenti) {
-		perror("Impossibile aprire file");
+	memset(riepilogo, 0, sizeof(*riepilogo));
+	
+	ret = leggiRiepilogoRegistro(user, riepilogo, LUNGHEZZA_RECORD_RIEPILOGO);
+	if (ret < 0) {
+		fprintf(stderr, "Impossibile leggere riepilogo di %s\n", user);
 		return -1;
 	}
 	
-	// Ricerca di username e password sul file FILE_UTENTI
-	while (1){
-		char temp_password[512], temp_username[512];
-		
-		ret = fscanf(fileUtenti, "%s %s ", temp_username, temp_password);
-		
-		// End Of File, non e' stato trovato lo username
-		if (ret <= 0 || ret == EOF) {
-			fclose(fileUtenti);
-			return 0;
-		}
-		
-		// Confronta lo username trovato con quello dato
-		if (strcmp(username, temp_username) == 0) {
-			fclose(fileUtenti);
-			if (password) {
-				strcpy(password, temp_password);
-			}
-			return 1;
-		}
+	if ((size_t)ret < LUNGHEZZA_MINIMA_RECORD_RIEPILOGO) {	// record incompleto: viene considerato nullo
+		memset(riepilogo, 0, sizeof(*riepilogo));
+		return 0;
+	}
+	return 1;
+}
+
+/* Sostituisce il riepilogo delle vincite di un utente nel suo registro
+ * 
+ * @user nome dell'utente
+ * @riepilogo riepilogo da memorizzare
+ * 
+ * @return 1 in caso di successo, -1 in caso di errore
+ */
+int scriviRiepilogoVincite (const char* user, const struct riepilogo_vincite* riepilogo)
+{
+	if (scriviRiepilogoRegistro(user, riepilogo, LUNGHEZZA_RECORD_RIEPILOGO) < 0) {
+		fprintf(stderr, "Impossibile scrivere riepilogo di %s\n", user);
+		return -1;
+	}
+	return 1;
+}
+
+/* Legge un record del registro delle schedine
+ * 
+ * @registro record letti dal registro
+ * @lunghezza lunghezza di registro
+ * @posizione posizione del record in registro
+ * @timestamp puntatore in cui scrivere il timestamp del record
+ * @inizio puntatore in cui scrivere la posizione della schedina serializzata in registro
+ * @fine puntatore in cui scrivere la posizione del primo byte dopo la schedina serializzata
+ * 
+ * @return posizione del record successivo, 0 se il record non e' completo
+ */
+uint32_t leggiRecordSchedina (const char* registro, const uint32_t lunghezza, const uint32_t posizione,
+								long int* timestamp, uint32_t* inizio, uint32_t* fine)
+{
+	const char* separatore;
+	char* schedina;
+	
+	// [Formato record] --> documentazione nella sezione FILE dell'area dei #define (inizio codice sorgente)
+	// (sscanf(...) misura ogni volta l'intera stringa: su un registro lungo la lettura diventerebbe quadratica)
+	separatore = memchr(registro + posizione, '|', lunghezza - posizione);
+	if (!separatore) {
+		return 0;
 	}
+	*timestamp = strtol(registro + posizione, &schedina, 10);
+	if (*schedina == ' ') {
+		schedina++;
+	}
+	if (schedina > separatore) {
+		return 0;
+	}
+	
+	*inizio = (uint32_t)(schedina - registro);
+	*fine = (uint32_t)(separatore - registro);
+	return *fine + 1;
 }
 
 /* Effettua il login di un utente sul server.
@@ -364,11 +433,7 @@ int effettuaLogin (const int socket, const struct sockaddr_in clientAddr, char*
 	// Variabili di appoggio per effettuare la decodifica del messaggio
 	char utente[512], password[512], temp_password[512];
 	char* temp = NULL;
-	const char delimiter = ' ';
-	
-	// Variabili per navigazione file
-	FILE* clientBloccati;
-	struct stat info;
+	const char delimiter[] = " ";	// strsep(...) richiede una stringa terminata
 	
 	// Tempo
 	time_t current_time;
@@ -377,69 +442,18 @@ int effettuaLogin (const int socket, const struct sockaddr_in clientAddr, char*
 	
 	//
 	// CONTROLLA SE IP E' BLOCCATO
-	//	
-	// Controlla dimensione file bloccato
-	ret = stat(FILE_CLIENT_BLOCCATI, &info);
-	
-	if (info.st_size > 0) {
-		// Apre in lettura il file, che verra' letto dall'ultima posizione verso la prima
-		// (ovvero dal record piu' recente, al meno recente) in modo da ottimizzare la ricerca
-		clientBloccati = fopen(FILE_CLIENT_BLOCCATI, "rb");
-		if (!clientBloccati) {
-			perror("Impossibile aprire file");
-			return -1;
-		}
-		
-		// Muovi il cursore fino all'ultimo "record" del file
-		// (per il formato, vedere documentazione nella sezione FILE dell'area dei #define, inizio file sorgente)
-		ret = fseek(clientBloccati, -(sizeof(struct in_addr) + sizeof(time_t)), SEEK_END);
-		if (ret < 0) {
-			perror("Impossibile raggiungere fine file");
-			return -1;
-		}
-	
-		// Legge il file al contrario
-		while (1) {
-			struct in_addr addr;
-			time_t timestamp;
-			int fine_file = 0;
-			
-			// Se abbiamo raggiunto la testa del file, allora questa e' l'ultima lettura
-			if (ftell(clientBloccati) == 0) {
-				fine_file = 1;
-			}
-
-			fread(&addr, sizeof(struct in_addr), 1, clientBloccati);
-			fread(&timestamp, sizeof(time_t), 1, clientBloccati);
-
-			// Se i record rimasti da leggere sono fuori dalla fascia temporale di blocco (MINUTI_DI_BLOCCO_IP minuti),
-			// e' inutile continuare
-			if (difftime(current_time, timestamp) > (MINUTI_DI_BLOCCO_IP * SECONDI_IN_UN_MINUTO)) {
-				break;
-			}
-
-			// Controlla se l'IP del client e' attualmente bloccato
-			if (addr.s_addr == clientAddr.sin_addr.s_addr) {
-				inviaErrore(socket, IP_BLOCCATO);
-				fclose(clientBloccati);
-				return 0;
-			}
-			
-			if (fine_file) {
-				break;
-			}
-			
-			// Sposta il cursore all'inizio del record precedente
-			fseek(clientBloccati, -2*(sizeof(struct in_addr) + sizeof(time_t)), SEEK_CUR);
-		}
-		fclose(clientBloccati);
+	//
+	// Ricerca nella tabella condivisa degli indirizzi bloccati (nessuna chiamata di sistema)
+	if (indirizzoBloccato(clientAddr.sin_addr.s_addr, current_time)) {
+		inviaErrore(socket, IP_BLOCCATO);
+		return 0;
 	}
 	
 	//
 	// ESTRAZIONE DATI DAL MESSAGGIO
 	//
 	// Estrazione username
-	temp = strsep(&msg, &delimiter);
+	temp = strsep(&msg, delimiter);
 	strcpy(utente, temp);
 	
 	// Estrazione password
@@ -448,10 +462,7 @@ int effettuaLogin (const int socket, const struct sockaddr_in clientAddr, char*
 	//
 	// CONTROLLO USERNAME E PASSWORD
 	//
-	ret = cercaUsername(utente, temp_password);
-	if (ret < 0) {
-		return -1;
-	}
+	ret = cercaUtente(utente, temp_password);
 	
 	// Username o password sbagliati
 	if (ret == 0 || strcmp(password, temp_password) != 0) {
@@ -460,15 +471,11 @@ int effettuaLogin (const int socket, const struct sockaddr_in clientAddr, char*
 		if (*accessiFalliti >= 3) {
 			inviaErrore(socket, TERZO_LOGIN_ERRATO);
 
-			// Blocca il client: scrive indirizzo IP e timestamp nel file FILE_CLIENT_BLOCCATI
-			clientBloccati = fopen(FILE_CLIENT_BLOCCATI, "ab");
-			if (!clientBloccati) {
-				perror("Impossibile aprire file per bloccare client");
+			// Blocca il client: scrive indirizzo IP e timestamp nel log FILE_CLIENT_BLOCCATI
+			// e lo inserisce nella tabella degli indirizzi bloccati
+			if (bloccaIndirizzo(clientAddr.sin_addr.s_addr, current_time) < 0) {
 				return -1;
 			}
-			fwrite(&clientAddr.sin_addr, sizeof(clientAddr.sin_addr), 1, clientBloccati);
-			fwrite(&current_time, sizeof(current_time), 1, clientBloccati);
-			fclose(clientBloccati);
 		}
 		else {
 			inviaErrore(socket, LOGIN_ERRATO);
@@ -487,19 +494,74 @@ int effettuaLogin (const int socket, const struct sockaddr_in clientAddr, char*
 	}
 	strcpy(*user, utente);
 	
-	generaSessionId(sessionId);
+	// Registra la sessione nell'archivio condiviso, generando un nuovo session id se quello generato e' gia' in uso
+	do {
+		generaSessionId(sessionId);
+		ret = creaSessione(sessionId, (uint32_t)identificativoUtente(utente), current_time);
+	} while (ret == 0);
+	
+	if (ret < 0) {
+		fprintf(stderr, "Archivio delle sessioni pieno\n");
+		fflush(stderr);
+		inviaErrore(socket, ERRORE_INTERNO_SERVER);
+		return -1;
+	}
 	
 	// Invia sessionId al client
 	inviaDati(socket, sessionId, LUNGHEZZA_SESSION_ID + 1);
 	return 1;
 }
 
+/* Riprende su questa connessione una sessione ottenuta con un login precedente (anche su un'altra connessione),
+ * senza ripetere il login. La sessione deve essere presente nell'archivio delle sessioni e non deve essere scaduta.
+ * Se la sessione e' valida, invia al client lo username dell'utente.
+ * 
+ * @socket descrittore del socket su cui avviene la comuncazione client-server
+ * @msg indirizzo al messaggio applicativo nel seguente formato:
+ *		----------------------------------
+ *		|  session_id (stringa + '\\0')  |
+ *		----------------------------------
+ * @msgLen lunghezza di msg
+ * @user puntatore in cui inserire l'indirizzo del nome utente allocato dinamicamente
+ * @sessionId stringa in cui memorizzare il session id ripreso
+ * 
+ * @return 1 se la sessione e' stata ripresa, 0 se il session id non e' valido, -1 in caso di errore
+ */
+int eseguiRiprendiSessione (const int socket, const char* msg, const size_t msgLen, char** user, char* sessionId)
+{
+	uint32_t utente;
+	const char* username;
+	
+	if (msgLen < LUNGHEZZA_SESSION_ID + 1 || !validaSessione(msg, time(NULL), &utente)) {
+		return (inviaErrore(socket, SESSION_ID_ERRATO) < 0) ? -1 : 0;
+	}
+	
+	username = usernameUtente(utente);
+	*user = (char*)malloc(strlen(username) + 1);
+	if (*user == NULL) {
+		perror("malloc fallita");
+		return -1;
+	}
+	strcpy(*user, username);
+	
+	memcpy(sessionId, msg, LUNGHEZZA_SESSION_ID);
+	sessionId[LUNGHEZZA_SESSION_ID] = '\0';
+	
+	if (inviaDati(socket, *user, strlen(*user) + 1) < 0) {
+		return -1;
+	}
+	return 1;
+}
+
 /* Effettua la registazione di un utente.
  * Controlla che il nome utente scelta non esista gia'.
  * NON effettua il login automatico.
  * 
+ * Ogni nuovo username proposto dopo il primo consuma un gettone del limitatore, come una nuova richiesta di signup.
+ * 
  * @socket descrittore del socket su cui avviene la comunicazione client-server
  * @presentationClientAddress indirizzo del socket client in formato presentazione
+ * @indirizzoClient indirizzo IPv4 del client in formato network
  * @msg indirizzo al messaggio applicativo nel seguente formato:
  *		---------------------------------------------------
  *		|  username  |  ' ' (spazio)  |  password  | '\0' |
@@ -509,50 +571,46 @@ int effettuaLogin (const int socket, const struct sockaddr_in clientAddr, char*
  * @return 1 se la registrazione ha successo, 0 se la registrazione fallisce per colpa del client,
  *    -1 in caso di errore interno o se il client chiude la connessione
  */
-int effettuaSignup (const int socket, const char* presentationClientAddress, char* msg, const size_t msgLen)
+int effettuaSignup (const int socket, const char* presentationClientAddress, const uint32_t indirizzoClient, char* msg, const size_t msgLen)
 {
 	int ret;
-	FILE* fileUtente;
 	char messaggioAlClient[3];
 
 	
-	/* Struttura dei file di registro nomeutente_schedine.bin
-	 * 
-	 * I primi 8 byte costituiscono lo header (due campi da 4 byte).
-	 * Il primo campo e' l'offset  dell'insieme di schedine di tipo 1 (ovvero che non hanno subito un'estrazione.
-	 * Il secondo campo e' l'offset dell'insieme di schedine (estratte o meno) su cui non e' stata verificata la vincite,
-	 * ovvero che sono state inserite nel sistema DOPO l'ultima chiamata del comando !vedi_vincite da parte dell'utente.
-	 * 
-	 * Ogni record contiene una schedina serializzata con un text protocol
-	 */
-	FILE* fileRegistro;
-	char indirizzo_file_registro[128];
-	uint32_t header_file_registro = LUNGHEZZA_HEADER_SCHEDINE_BIN; // alla creazione i due campi "puntano" alla fine del file
-	
 	// Variabili per parse del messaggio
 	char utente[512], password[512];
 	char* temp;
-	char delimiter = ' ';
+	const char delimiter[] = " ";
 	
 	//
 	// ESTRAZIONE DATI DAL MESSAGGIO
 	//
 	// Estrazione username
-	temp = strsep(&msg, &delimiter);
+	temp = strsep(&msg, delimiter);
 	strcpy(utente, temp);
 	
 	// Estrazione password
 	strcpy(password, msg);
 	
+	// Le ultime pagine dell'indice dei registri sono riservate agli utenti gia' registrati:
+	// un nuovo utente non deve far fallire le loro scritture
+	if (pagineDisponibiliRegistri() < RISERVA_PAGINE_REGISTRI) {
+		fprintf(stderr, "Indice dei registri quasi pieno: signup rifiutata\n");
+		fflush(stderr);
+		inviaErrore(socket, CAPACITA_ESAURITA);
+		return 0;
+	}
+	
 	while (1) { 
 		char* messaggio = NULL;
 		
-		// CONTROLLA SE ESISTE GIA' LO USERNAME
-		ret = cercaUsername(utente, NULL);
+		// REGISTRA UTENTE SUL SERVER, SE LO USERNAME NON ESISTE GIA'
+		// (il controllo dell'unicita' e la registrazione avvengono atomicamente)
+		ret = registraUtente(utente, password);
 		if (ret < 0) {
 			return -1;
 		}
-		if (ret == 0) {	// lo username e' unico
+		if (ret == 1) {	// lo username era unico ed e' stato registrato
 			break;
 		}
 		
@@ -562,41 +620,85 @@ int effettuaSignup (const int socket, const char* presentationClientAddress, cha
 		ret = attendiMessaggioDalClient(socket, (void**)&messaggio, presentationClientAddress);
 		if (ret <= 0) return -1;
 		
+		// Il nuovo tentativo viene limitato come una richiesta di signup
+		if (!richiestaConsentita(indirizzoClient, SIGNUP, 1)) {
+			free(messaggio);
+			inviaErrore(socket, RICHIESTE_ECCESSIVE);
+			return 0;
+		}
+		
 		temp = &messaggio[1];	// salta l'intestazione del messaggio
-		strcpy(utente, temp);
-	}
-	
-	//
-	// REGISTRA UTENTE SU CLIENT
-	//
-	fileUtente = fopen(FILE_UTENTI, "a");
-	if (!fileUtente) {
-		perror("Impossibile aprire file utenti");
-		return -1;
+		snprintf(utente, sizeof(utente), "%s", temp);
+		free(messaggio);
 	}
-	fprintf(fileUtente, "%s %s ", utente, password);
-	fclose(fileUtente);
 	
-	// Creazione files di registro
-	sprintf(indirizzo_file_registro, "%s/%s_schedine.bin", CARTELLA_FILES, utente);
-	fileRegistro = fopen(indirizzo_file_registro, "wb");
-	// Scrittura header:
-	// 1) Offset del blocco delle schedine giocate di tipo 1 (non ancora estratte)
-	fwrite(&header_file_registro, sizeof(header_file_registro), 1, fileRegistro);
-	// 2) Offset del blocco delle schedine (estratte o meno) di cui non e' stata controllata la vincita
-	fwrite(&header_file_registro, sizeof(header_file_registro), 1, fileRegistro);
-	fclose(fileRegistro);
-
-	sprintf(indirizzo_file_registro, "%s/%s_vincite.txt", CARTELLA_FILES, utente);
-	fileRegistro = fopen(indirizzo_file_registro, "w");	// Crea il file senza scrivere nulla
-	fclose(fileRegistro);
+	// I registri dell'utente non vanno creati: un utente senza record ha registri vuoti e riepilogo nullo
 	
 	strcpy(messaggioAlClient, "OK");
 	inviaDati(socket, messaggioAlClient, 3);
 	return 1;
 }
 
+/* Legge una schedina serializzata (vedi serializza_schedina_txt(...)) ricevuta da un client,
+ * controllando che ogni quantita' rientri nei vettori di destinazione prima di leggerne gli elementi
+ * 
+ * @msg schedina serializzata
+ * @msg_len lunghezza di msg (compreso il terminatore)
+ * @sched schedina in cui scrivere il risultato. I vettori ruote, numeriGiocati e importi devono
+ *	essere gia' allocati, rispettivamente di QUANTE_RUOTE, QUANTITA_MASSIMA_NUMERI_SISTEMA e QUANTI_TIPI_PREMIO elementi
+ * 
+ * @return 1 se la schedina e' stata letta ed e' valida, 0 altrimenti
+ */
+int leggiSchedinaRicevuta (const char* msg, const size_t msg_len, struct schedina* sched)
+{
+	int i, contatore, char_letti;
+	
+	if (msg_len == 0 || msg[msg_len - 1] != '\0') {
+		return 0;
+	}
+	
+	// Marcatori (sistema, estrazioni, abbonamento)
+	contatore = leggiMarcatoriSchedina(msg, sched);
+	if (contatore < 0) {
+		return 0;
+	}
+	
+	if (sscanf(msg + contatore, "%i %n", &sched->quanteRuote, &char_letti) != 1
+			|| sched->quanteRuote < 1 || sched->quanteRuote > QUANTE_RUOTE) {
+		return 0;
+	}
+	contatore += char_letti;
+	for (i = 0; i < sched->quanteRuote; ++i) {
+		if (sscanf(msg + contatore, "%i %n", &sched->ruote[i], &char_letti) != 1) return 0;
+		contatore += char_letti;
+	}
+	
+	if (sscanf(msg + contatore, "%i %n", &sched->quantiNumeri, &char_letti) != 1
+			|| sched->quantiNumeri < 1 || sched->quantiNumeri > QUANTITA_MASSIMA_NUMERI_SISTEMA) {
+		return 0;
+	}
+	contatore += char_letti;
+	for (i = 0; i < sched->quantiNumeri; ++i) {
+		if (sscanf(msg + contatore, "%i %n", &sched->numeriGiocati[i], &char_letti) != 1) return 0;
+		contatore += char_letti;
+	}
+	
+	if (sscanf(msg + contatore, "%i %n", &sched->quantiImporti, &char_letti) != 1
+			|| sched->quantiImporti < 1 || sched->quantiImporti > QUANTI_TIPI_PREMIO) {
+		return 0;
+	}
+	contatore += char_letti;
+	for (i = 0; i < sched->quantiImporti; ++i) {
+		if (sscanf(msg + contatore, "%lf %n", &sched->importi[i], &char_letti) != 1) return 0;
+		contatore += char_letti;
+	}
+	
+	return schedinaValida(sched);
+}
+
 /* Esegui il comando !invia_giocata <schedina>
+ * La schedina viene registrata una sola volta anche se e' valida per piu' estrazioni (o e' un abbonamento):
+ * e' la verifica delle vincite a giocarla su ognuna delle estrazioni che copre.
  * 
  * @socket descrittore del socket su cui avviene la comuncazione client-server
  * @clientAddr indirizzo del socket client
@@ -611,43 +713,235 @@ int effettuaSignup (const int socket, const char* presentationClientAddress, cha
  */
 int eseguiInviaGiocata (const int socket, const char* msg, const size_t msg_len, char* user)
 {
-	char indirizzo_file_registro[128];
 	const char messaggio_al_client[3] = "OK";
+	int ruote[QUANTE_RUOTE], numeri[QUANTITA_MASSIMA_NUMERI_SISTEMA];
+	double importi[QUANTI_TIPI_PREMIO];
+	struct schedina sched = {ruote, 0, numeri, 0, importi, 0};
 	
-	// File
-	FILE* file_registro;
+	char* schedina_serializzata;
+	uint16_t len_schedina_serializzata;
+	char* record;
+	int len_record;
 	
 	// Tempo
 	time_t timestamp;	// servira' per determinare l'estrazione corrispondente alla schedina
 	
-	time(&timestamp);
+	// Verifica la schedina prima di registrarla (i sistemi ammettono fino a QUANTITA_MASSIMA_NUMERI_SISTEMA numeri).
+	// Un abbonamento deve arrivare attivo
+	if (msg_len <= LUNGHEZZA_SESSION_ID + 1
+			|| !leggiSchedinaRicevuta(msg + LUNGHEZZA_SESSION_ID + 1, msg_len - LUNGHEZZA_SESSION_ID - 1, &sched)
+			|| sched.annullamento != 0) {
+		return (inviaErrore(socket, MESSAGGIO_NON_COMPRENSIBILE) < 0) ? -1 : 0;
+	}
+	
+	// La schedina viene registrata nel formato canonico: il timestamp di annullamento degli abbonamenti
+	// deve avere larghezza fissa per poter essere riscritto sul posto da eseguiAnnullaAbbonamento(...)
+	schedina_serializzata = serializza_schedina_txt(sched, &len_schedina_serializzata);
+	if (!schedina_serializzata) {
+		inviaErrore(socket, ERRORE_INTERNO_SERVER);
+		return -1;
+	}
 	
-	// Configurazione dell'indirizzo del file di registro
-	sprintf(indirizzo_file_registro, "%s/%s_schedine.bin", CARTELLA_FILES, user);
+	time(&timestamp);
 	
 	// Memorizzazione delle schedina serializzata con timestamp di ricezione
-	file_registro = fopen(indirizzo_file_registro, "a");
-	if (!file_registro) {
-		perror("Impossibile aprire file schedine utente");
+	len_record = snprintf(NULL, 0, "%ld %s|", (long int)timestamp, schedina_serializzata);
+	record = malloc(len_record + 1);
+	if (!record) {
+		free(schedina_serializzata);
+		inviaErrore(socket, ERRORE_INTERNO_SERVER);
+		return -1;
+	}
+	sprintf(record, "%ld %s|", (long int)timestamp, schedina_serializzata);
+	free(schedina_serializzata);
+	
+	// La conferma viene inviata solo dopo che la schedina e' su disco (secondo la durabilita' impostata con -d)
+	if (aggiungiSchedinaRegistro(user, record, (uint32_t)len_record) < 0) {
+		fprintf(stderr, "Impossibile registrare schedina di %s\n", user);
+		free(record);
 		inviaErrore(socket, ERRORE_INTERNO_SERVER);
 		return -1;
 	}
-	fprintf(file_registro, "%ld %s|", (long int)timestamp, msg + LUNGHEZZA_SESSION_ID + 1);
-	fclose(file_registro);
+	free(record);
+	
+	registraEsposizioneSchedina(&sched);
 	
 	return inviaDati(socket, messaggio_al_client, strlen(messaggio_al_client)+1);
 }
 
-/* Esegui il comando !vedi_giocate <tipo>
- * Invia al client tutte le schedine del tipo <tipo>, serializzate
+/* Cerca con una ricerca binaria la prima estrazione di FILE_ESTRAZIONI con timestamp non inferiore a <timestamp>.
+ * I record delle estrazioni hanno lunghezza fissa LUNGHEZZA_BLOCCO_ESTRAZIONE e vengono aggiunti
+ * in ordine di timestamp, percio' il timestamp dell'estrazione i-esima si trova all'offset i * LUNGHEZZA_BLOCCO_ESTRAZIONE.
+ * Se all'avvio i timestamp non risultano strettamente crescenti (vedi verificaOrdineEstrazioni()), la ricerca e' lineare.
+ * 
+ * @file_estrazione file delle estrazioni aperto in lettura
+ * @quante_estrazioni numero delle estrazioni nel file
+ * @timestamp timestamp da cercare
+ * 
+ * @return indice della prima estrazione con timestamp >= <timestamp> (quante_estrazioni se non esiste),
+ *     -1 in caso di errore
+ */
+long cercaEstrazione (FILE* file_estrazione, const long quante_estrazioni, const time_t timestamp)
+{
+	long inizio = 0, fine = quante_estrazioni;
+	
+	if (!estrazioni_ordinate) {
+		time_t timestamp_estrazione;
+		
+		if (fseek(file_estrazione, 0, SEEK_SET) < 0) {
+			return -1;
+		}
+		for (inizio = 0; inizio < quante_estrazioni; ++inizio) {
+			if (fread(&timestamp_estrazione, sizeof(timestamp_estrazione), 1, file_estrazione) != 1
+					|| fseek(file_estrazione, (long)(LUNGHEZZA_BLOCCO_ESTRAZIONE - sizeof(timestamp_estrazione)), SEEK_CUR) < 0) {
+				return -1;
+			}
+			if (timestamp_estrazione >= timestamp) {
+				break;
+			}
+		}
+		return inizio;
+	}
+	
+	while (inizio < fine) {
+		long mezzo = inizio + (fine - inizio) / 2;
+		time_t timestamp_mezzo;
+		
+		if (fseek(file_estrazione, mezzo * (long)LUNGHEZZA_BLOCCO_ESTRAZIONE, SEEK_SET) < 0
+				|| fread(&timestamp_mezzo, sizeof(timestamp_mezzo), 1, file_estrazione) != 1) {
+			return -1;
+		}
+		
+		if (timestamp_mezzo < timestamp) inizio = mezzo + 1;
+		else fine = mezzo;
+	}
+	return inizio;
+}
+
+/* Determina l'esito di una schedina gia' registrata, giocandola sulle estrazioni che copre
+ * (le estrazioni con timestamp non inferiore a quello di registrazione, cercate con cercaEstrazione(...))
+ * 
+ * @sched schedina
+ * @timestamp timestamp di registrazione della schedina
+ * @file_estrazione file delle estrazioni aperto in lettura
+ * @quante_estrazioni numero delle estrazioni nel file
+ * 
+ * @return ESITO_VINCENTE se la schedina ha vinto su almeno un'estrazione, ESITO_IN_GIOCO se non ha vinto
+ *     ma partecipa ancora ad estrazioni future, ESITO_PERDENTE altrimenti; -1 in caso di errore
+ */
+int esitoSchedina (const struct schedina* sched, const time_t timestamp, FILE* file_estrazione, const long quante_estrazioni)
+{
+	long estrazione;
+	int coperte = 0, i;
+	uint8_t blocco[LUNGHEZZA_BLOCCO_ESTRAZIONE];
+	struct insieme_numeri giocati = insiemeNumeri(sched->numeriGiocati, sched->quantiNumeri);
+	
+	estrazione = cercaEstrazione(file_estrazione, quante_estrazioni, timestamp);
+	if (estrazione < 0 || fseek(file_estrazione, estrazione * (long)LUNGHEZZA_BLOCCO_ESTRAZIONE, SEEK_SET) < 0) {
+		return -1;
+	}
+	
+	for (; estrazione < quante_estrazioni; ++estrazione) {
+		time_t timestamp_estrazione;
+		
+		if (fread(blocco, LUNGHEZZA_BLOCCO_ESTRAZIONE, 1, file_estrazione) != 1) {
+			return -1;
+		}
+		memcpy(&timestamp_estrazione, blocco, sizeof(timestamp_estrazione));
+		
+		// Stesse regole di schedinaCopreEstrazione(...)
+		if (sched->quanteEstrazioni == ABBONAMENTO) {
+			if (sched->annullamento != 0 && timestamp_estrazione >= sched->annullamento) break;
+		}
+		else if (coperte == sched->quanteEstrazioni) {
+			break;
+		}
+		coperte++;
+		
+		for (i = 0; i < sched->quanteRuote; ++i) {
+			uint32_t numeri_estratti[QUANTI_NUMERI_ESTRATTI];
+			int numeri[QUANTI_NUMERI_ESTRATTI], quante_vincite, j;
+			double vincite[QUANTI_TIPI_PREMIO];
+			
+			memcpy(numeri_estratti, blocco + sizeof(time_t) + sched->ruote[i] * LUNGHEZZA_ESTRAZIONE_SINGOLA_RUOTA + sizeof(uint8_t),
+					sizeof(numeri_estratti));
+			for (j = 0; j < QUANTI_NUMERI_ESTRATTI; ++j) {
+				numeri[j] = (int)numeri_estratti[j];
+			}
+			
+			quante_vincite = calcolaVinciteRuota(sched, quantiNumeriComuni(giocati, insiemeNumeri(numeri, QUANTI_NUMERI_ESTRATTI)), vincite);
+			for (j = 0; j < quante_vincite; ++j) {
+				if (vincite[j] > 0) return ESITO_VINCENTE;
+			}
+		}
+	}
+	
+	// Nessuna vincita: la schedina e' perdente solo se ha concluso le sue estrazioni
+	if (sched->quanteEstrazioni == ABBONAMENTO) {
+		return (sched->annullamento == 0) ? ESITO_IN_GIOCO : ESITO_PERDENTE;
+	}
+	return (coperte < sched->quanteEstrazioni) ? ESITO_IN_GIOCO : ESITO_PERDENTE;
+}
+
+/* Controlla se una schedina soddisfa i filtri del comando !vedi_giocate
+ * 
+ * @sched schedina
+ * @timestamp timestamp di registrazione della schedina
+ * @filtro filtri richiesti dal client
+ * @file_estrazione file delle estrazioni aperto in lettura (usato solo se e' richiesto un esito)
+ * @quante_estrazioni numero delle estrazioni nel file
+ * 
+ * @return 1 se la schedina soddisfa i filtri, 0 altrimenti, -1 in caso di errore
+ */
+int schedinaSoddisfaFiltro (const struct schedina* sched, const time_t timestamp, const struct filtro_giocate* filtro,
+		FILE* file_estrazione, const long quante_estrazioni)
+{
+	int i, trovato;
+	
+	// I filtri meno costosi vengono controllati per primi: l'esito richiede la lettura delle estrazioni
+	if (timestamp < (time_t)filtro->da || timestamp > (time_t)filtro->a) {
+		return 0;
+	}
+	
+	if (filtro->ruote != 0) {
+		for (i = 0, trovato = 0; i < sched->quanteRuote && !trovato; ++i) {
+			trovato = (filtro->ruote >> sched->ruote[i]) & 1;
+		}
+		if (!trovato) return 0;
+	}
+	
+	if (filtro->numero != 0) {
+		for (i = 0, trovato = 0; i < sched->quantiNumeri && !trovato; ++i) {
+			trovato = (sched->numeriGiocati[i] == filtro->numero);
+		}
+		if (!trovato) return 0;
+	}
+	
+	if (filtro->esito != ESITO_QUALSIASI) {
+		int esito = esitoSchedina(sched, timestamp, file_estrazione, quante_estrazioni);
+		
+		if (esito < 0) return -1;
+		return esito == filtro->esito;
+	}
+	return 1;
+}
+
+/* Esegui il comando !vedi_giocate <tipo> <filtri>
+ * Invia al client tutte le schedine del tipo <tipo> che soddisfano i filtri, serializzate
  * <tipo> 0: giocate relative a estrazioni gia' effettuate
  * <tipo> 1: giocate in attesa della prossima estrazione
+ * I filtri sono opzionali (vedi struct filtro_giocate in lotto.h) e vengono valutati sul server,
+ * percio' al client vengono inviate solo le schedine richieste.
  * 
  * @socket descrittore del socket su cui avviene la comuncazione client-server
  * @msg indirizzo al messaggio applicativo nel seguente formato:
- *		------------------------------------------------
- *		| session_id (stringa + '\\0') | tipo (uint8_t) |
- *		------------------------------------------------
+ *		------------------------------------------------------------------------
+ *		| session_id (stringa + '\\0') | tipo (uint8_t) | filtri (opzionali) |
+ *		------------------------------------------------------------------------
+ *     dove i filtri sono nel formato
+ *		-------------------------------------------------------------------------------------------------
+ *		| ruote (uint16_t) | numero (uint8_t) | da (uint32_t) | a (uint32_t) | esito (uint8_t) |
+ *		-------------------------------------------------------------------------------------------------
  * @msg_len lunghezza di msg
  * @user nome dell'utente
  * 
@@ -657,14 +951,18 @@ int eseguiVediGiocate (const int socket, const char* msg, const size_t msg_len,
 {
 	int ret;
 	uint8_t tipo;
+	struct filtro_giocate filtro = {0, 0, 0, UINT32_MAX, ESITO_QUALSIASI};
+	int filtrato = 0;	// 1 se il client ha inviato dei filtri
 	
 	char* messaggio_al_client;
 	
-	// File
-	FILE* file_registro;
+	// Registro
+	struct stato_registro stato;
+	char* registro;
+	FILE* file_estrazione = NULL;	// aperto solo se e' richiesto l'esito delle schedine
+	long quante_estrazioni = 0;
 	struct stat info;
-	uint32_t offset, quanti_byte = 0, byte_da_inviare, byte_letti;
-	char indirizzo_file[512];
+	uint32_t offset, fine, quanti_byte = 0, byte_da_inviare, byte_letti;
 	
 	if (msg_len < LUNGHEZZA_SESSION_ID + 1 + sizeof(uint8_t)) {
 		ret = inviaErrore(socket, MESSAGGIO_NON_COMPRENSIBILE);
@@ -674,77 +972,123 @@ int eseguiVediGiocate (const int socket, const char* msg, const size_t msg_len,
 	// Leggi tipo
 	tipo = *(uint8_t*)(msg + LUNGHEZZA_SESSION_ID + 1);
 	
-	// Apre il file schedine in modalita' binaria
-	sprintf(indirizzo_file, "%s/%s_schedine.bin", CARTELLA_FILES, user);
-	file_registro = fopen(indirizzo_file, "rb");
-	if (!file_registro) {
-		perror("Impossibile aprire file schedine");
-		inviaErrore(socket, ERRORE_INTERNO_SERVER);
-		return -1;
+	// Leggi i filtri, se presenti
+	if (msg_len >= LUNGHEZZA_SESSION_ID + 1 + sizeof(uint8_t) + LUNGHEZZA_FILTRO_GIOCATE) {
+		const char* campo = msg + LUNGHEZZA_SESSION_ID + 1 + sizeof(uint8_t);
+		
+		memcpy(&filtro.ruote, campo, sizeof(filtro.ruote));
+		campo += sizeof(filtro.ruote);
+		filtro.numero = *(uint8_t*)campo;
+		campo += sizeof(filtro.numero);
+		memcpy(&filtro.da, campo, sizeof(filtro.da));
+		campo += sizeof(filtro.da);
+		memcpy(&filtro.a, campo, sizeof(filtro.a));
+		campo += sizeof(filtro.a);
+		filtro.esito = *(uint8_t*)campo;
+		
+		filtro.ruote = ntohs(filtro.ruote);
+		filtro.da = ntohl(filtro.da);
+		filtro.a = ntohl(filtro.a);
+		filtrato = 1;
+		
+		if ((filtro.ruote >> QUANTE_RUOTE) != 0 || filtro.numero > NUMERI_ESTRAIBILI
+				|| filtro.da > filtro.a || filtro.esito > ESITO_IN_GIOCO) {
+			ret = inviaErrore(socket, MESSAGGIO_NON_COMPRENSIBILE);
+			return (ret == -1) ? -1 : 0;
+		}
 	}
 	
-	ret = stat(indirizzo_file, &info);
-	if (ret < 0) {
-		perror("Impossibile leggere dimensione file schedine");
-		inviaErrore(socket, ERRORE_INTERNO_SERVER);
-		return -1;
-	}
-	
-	// Inizializza offset e quanti_byte a seconda del tipo di schedine richiesto
-	// e utilizzando il primo campo dello header (che contiene l'offset in cui inizia
-	// la sezione delle schedine di tipo 1, ovver quelle non ancora estratte)
+	// Lo stato del registro contiene l'offset in cui inizia la sezione delle schedine di tipo 1,
+	// ovvero quelle non ancora estratte
+	statoRegistro(user, &stato);
 	if (tipo == 0) {
-		offset = LUNGHEZZA_HEADER_SCHEDINE_BIN;
-		// il primo campo dello header del file contiene l'offset da cui iniziano le schedine di tipo 1
-		fread(&quanti_byte, sizeof(quanti_byte), 1, file_registro);
-		quanti_byte -= LUNGHEZZA_HEADER_SCHEDINE_BIN;
+		offset = INIZIO_REGISTRO_SCHEDINE;
+		fine = stato.inizio_non_estratte;
 	}
 	else if (tipo == 1) {
-		// lo header del file contiene l'offset da cui iniziano le schedine di tipo 1
-		fread(&offset, sizeof(offset), 1, file_registro);
-		quanti_byte = info.st_size - offset;
+		offset = stato.inizio_non_estratte;
+		fine = stato.fine;
 	}
 	else {	// errore: il messaggio non e' comprensibile
-		fclose(file_registro);
 		ret = inviaErrore(socket, MESSAGGIO_NON_COMPRENSIBILE);
 		return (ret == -1) ? -1 : 0;
 	}
-
-	fclose(file_registro);
 	
 	// Se non ci sono schedine, invia un alert di tipo FILE_VUOTO
-	if (quanti_byte == 0) {
+	if (offset == fine) {
 		ret = inviaErrore(socket, FILE_VUOTO);
 		return (ret < 0) ? -1 : 1;
 	}
 	
-	// Apri in lettura il file schedine come file di testo
-	file_registro = fopen(indirizzo_file, "r");
-	if (!file_registro) {
-		perror("Impossibile aprire in lettura file schedine utente");
-		inviaErrore(socket, MESSAGGIO_NON_COMPRENSIBILE);
+	if (leggiRegistroSchedine(user, offset, fine, &registro, &quanti_byte) < 0) {
+		fprintf(stderr, "Impossibile leggere registro schedine di %s\n", user);
+		inviaErrore(socket, ERRORE_INTERNO_SERVER);
+		return -1;
+	}
+	messaggio_al_client = malloc(quanti_byte + 1);
+	if (!messaggio_al_client) {
+		free(registro);
+		inviaErrore(socket, ERRORE_INTERNO_SERVER);
 		return -1;
 	}
-	messaggio_al_client = malloc(quanti_byte);
-	memset(messaggio_al_client, 0, quanti_byte);
 	
-	// Posiziona il cursore all'inizio dell'area di lettura
-	fseek(file_registro, offset, SEEK_SET);
+	// L'esito delle schedine si ottiene giocandole sulle estrazioni
+	if (filtro.esito != ESITO_QUALSIASI) {
+		file_estrazione = fopen(FILE_ESTRAZIONI, "rb");
+		if (!file_estrazione || fstat(fileno(file_estrazione), &info) < 0) {
+			perror("Impossibile aprire file estrazioni");
+			if (file_estrazione) fclose(file_estrazione);
+			free(registro);
+			free(messaggio_al_client);
+			inviaErrore(socket, ERRORE_INTERNO_SERVER);
+			return -1;
+		}
+		quante_estrazioni = (long)(info.st_size / LUNGHEZZA_BLOCCO_ESTRAZIONE);
+	}
 	
 	byte_da_inviare = 0;	// byte effettivamente da inviare (senza timestamp)
 	byte_letti = 0;			// byte letti (contatore)
 	while (byte_letti < quanti_byte) {
-		int s_start, s_end; // Offset di inizio e fine della schedina relativamente al record
-		int next; // Quanti byte compongono il record
+		uint32_t s_start, s_end; // Offset di inizio e fine della schedina nel registro letto
 		long int temp;
 		
 		// [Formato record] --> documentazione nella sezione FILE dell'area dei #define (inizio codice sorgente)
-		fscanf(file_registro, "%ld %n%[^|]%n|%n", &temp, &s_start, messaggio_al_client + byte_da_inviare, &s_end, &next);
-
+		ret = leggiRecordSchedina(registro, quanti_byte, byte_letti, &temp, &s_start, &s_end);
+		if (ret == 0) {
+			break;
+		}
+		byte_letti = (uint32_t)ret;
+		memcpy(messaggio_al_client + byte_da_inviare, registro + s_start, s_end - s_start);
+		messaggio_al_client[byte_da_inviare + s_end - s_start] = '\0';
+		
+		// La schedina appena letta viene inviata solo se soddisfa i filtri (altrimenti viene sovrascritta dalla successiva)
+		if (filtrato) {
+			struct schedina sched;
+			int quanti_byte_schedina;
+			
+			sched = deserializza_schedina_txt(messaggio_al_client + byte_da_inviare, &quanti_byte_schedina);
+			ret = schedinaSoddisfaFiltro(&sched, (time_t)temp, &filtro, file_estrazione, quante_estrazioni);
+			free(sched.ruote);
+			free(sched.numeriGiocati);
+			free(sched.importi);
+			
+			if (ret <= 0) {
+				if (ret < 0) perror("Impossibile leggere file estrazioni");
+				continue;
+			}
+		}
+		
 		byte_da_inviare += (s_end - s_start);
-		byte_letti += next;
 	}
-	fclose(file_registro);
+	free(registro);
+	if (file_estrazione) fclose(file_estrazione);
+	
+	// Nessuna schedina soddisfa i filtri
+	if (byte_da_inviare == 0) {
+		free(messaggio_al_client);
+		ret = inviaErrore(socket, FILE_VUOTO);
+		return (ret < 0) ? -1 : 1;
+	}
 	
 	messaggio_al_client[byte_da_inviare++] = '\0';
 	
@@ -753,6 +1097,119 @@ int eseguiVediGiocate (const int socket, const char* msg, const size_t msg_len,
 	return ret;
 }
 
+/* Esegui il comando !annulla_abbonamento <n>
+ * Se <n> e' 0 invia al client gli abbonamenti attivi dell'utente (serializzati, nell'ordine del registro),
+ * altrimenti annulla l'<n>-esimo abbonamento attivo: il timestamp di annullamento viene riscritto sul posto
+ * nel registro delle schedine (ha larghezza fissa), e l'abbonamento non partecipa alle estrazioni successive.
+ * 
+ * Gli abbonamenti attivi non si concludono mai, percio' si trovano tutti dopo la prima schedina da controllare.
+ * 
+ * @socket descrittore del socket su cui avviene la comuncazione client-server
+ * @msg indirizzo al messaggio applicativo nel seguente formato:
+ *		--------------------------------------------------
+ *		| session_id (stringa + '\\0') | n (uint32_t) |
+ *		--------------------------------------------------
+ * @msg_len lunghezza di msg
+ * @user nome dell'utente
+ * 
+ * @return 1 se il comando ha successo, 0 se fallisce per colpa del client, -1 in caso di errore interno
+ */
+int eseguiAnnullaAbbonamento (const int socket, const char* msg, const size_t msg_len, char* user)
+{
+	int ret;
+	uint32_t n, quanti_attivi = 0;
+	const char messaggio_ok[3] = "OK";
+	char* messaggio_al_client;
+	uint32_t byte_da_inviare = 0;
+	
+	// Registro
+	struct stato_registro stato;
+	char* registro;
+	uint32_t quanti_byte, byte_letti = 0;
+	
+	if (msg_len < LUNGHEZZA_SESSION_ID + 1 + sizeof(uint32_t)) {
+		ret = inviaErrore(socket, MESSAGGIO_NON_COMPRENSIBILE);
+		return (ret == -1) ? -1 : 0;
+	}
+	memcpy(&n, msg + LUNGHEZZA_SESSION_ID + 1, sizeof(n));
+	n = ntohl(n);
+	
+	statoRegistro(user, &stato);
+	if (leggiRegistroSchedine(user, stato.inizio_da_controllare, stato.fine, &registro, &quanti_byte) < 0) {
+		fprintf(stderr, "Impossibile leggere registro schedine di %s\n", user);
+		inviaErrore(socket, ERRORE_INTERNO_SERVER);
+		return -1;
+	}
+	
+	messaggio_al_client = malloc(quanti_byte + 1);
+	if (!messaggio_al_client) {
+		free(registro);
+		inviaErrore(socket, ERRORE_INTERNO_SERVER);
+		return -1;
+	}
+
+	while (byte_letti < quanti_byte) {
+		char buffer[BUFFER_SIZE];
+		uint32_t s_start, s_end, offset = byte_letti;
+		long int temp;
+		struct schedina marcatori;
+		
+		// [Formato record] --> documentazione nella sezione FILE dell'area dei #define (inizio codice sorgente)
+		byte_letti = leggiRecordSchedina(registro, quanti_byte, offset, &temp, &s_start, &s_end);
+		if (byte_letti == 0 || s_end - s_start >= sizeof(buffer)) {
+			break;
+		}
+		memcpy(buffer, registro + s_start, s_end - s_start);
+		buffer[s_end - s_start] = '\0';
+		
+		if (leggiMarcatoriSchedina(buffer, &marcatori) < 0 || marcatori.quanteEstrazioni != ABBONAMENTO
+				|| marcatori.annullamento != 0) {
+			continue;
+		}
+		quanti_attivi++;
+		
+		if (n == 0) {	// elenco degli abbonamenti attivi
+			memcpy(messaggio_al_client + byte_da_inviare, buffer, s_end - s_start);
+			byte_da_inviare += s_end - s_start;
+		}
+		else if (quanti_attivi == n) {	// annullamento
+			uint32_t posizione = stato.inizio_da_controllare + s_start + (strchr(buffer, MARCATORE_ABBONAMENTO) - buffer) + 1;
+			char annullamento[CIFRE_ANNULLAMENTO + 1];
+			int ruote[QUANTE_RUOTE], numeri[QUANTITA_MASSIMA_NUMERI_SISTEMA];
+			double importi[QUANTI_TIPI_PREMIO];
+			struct schedina abbonamento = {ruote, 0, numeri, 0, importi, 0};
+			
+			free(registro);
+			free(messaggio_al_client);
+			
+			snprintf(annullamento, sizeof(annullamento), "%0*ld", CIFRE_ANNULLAMENTO, (long int)time(NULL));
+			if (riscriviRegistroSchedine(user, posizione, annullamento, CIFRE_ANNULLAMENTO) < 0) {
+				fprintf(stderr, "Impossibile annullare abbonamento di %s\n", user);
+				inviaErrore(socket, ERRORE_INTERNO_SERVER);
+				return -1;
+			}
+			
+			// L'abbonamento non partecipa piu' alle prossime estrazioni
+			if (leggiSchedinaRicevuta(buffer, s_end - s_start + 1, &abbonamento)) {
+				annullaEsposizioneAbbonamento(&abbonamento, (time_t)temp);
+			}
+			return inviaDati(socket, messaggio_ok, sizeof(messaggio_ok));
+		}
+	}
+	free(registro);
+	
+	if (n != 0 || quanti_attivi == 0) {	// abbonamento inesistente, o nessun abbonamento da elencare
+		free(messaggio_al_client);
+		ret = inviaErrore(socket, (n != 0) ? MESSAGGIO_NON_COMPRENSIBILE : FILE_VUOTO);
+		return (ret < 0) ? -1 : (n == 0);
+	}
+	
+	messaggio_al_client[byte_da_inviare++] = '\0';
+	ret = inviaDati(socket, messaggio_al_client, (uint16_t)byte_da_inviare);
+	free(messaggio_al_client);
+	return ret;
+}
+
 /* Esegui il comando !vedi_estrazione <n> <ruota>
  * Invia al client i numeri estratti nelle ultime <n> estrazioni, sulla ruota <ruota> ricevuta
  * Se la ruota non e' stata specificata, il server invia le informazioni di tutte le ruote.
@@ -813,34 +1270,54 @@ int eseguiVediEstrazione (const int socket, const char* msg, const size_t msg_le
 	
 	// Caso con ruota specificata
 	if (ruota != RUOTA_NON_SPECIFICATA && info.st_size > 0) {
-		// Raggiunge l'ultima estrazione.
-		//
-		/* Le estrazioni vengono memorizzate a blocchi di "ruote estratte" di dimensione LUNGHEZZA_RECORD_ESTRAZIONE.
-		 * Un record di estrazione puo' essere scomposto nel timestamp e nelle 
-		 * estrazioni vere e proprie (che formano un sottoblocco).
-		 * La variabile ruota indica l'indice della ruota all'interno del sottoblocco delle estrazioni a partire dall'alto.
-		 * 
-		 * Percio' la distanza dal basso nel blocco di un estrazione singola e'
-		 * (QUANTE_RUOTE - 1 - ruota) * LUNGHEZZA_ESTRAZIONE_SINGOLA_RUOTA.
-		 * 
-		 * Inoltre, bisogna necessariamente tornare indietro di un estrazione singola
-		 * poiche' all'apertura del file il cursore e' in cima al file e non in fondo.
-		 */
-		fseek(file_estrazione, -(LUNGHEZZA_ESTRAZIONE_SINGOLA_RUOTA * (QUANTE_RUOTE - ruota)), SEEK_END);
+		// Le ultime <n> estrazioni della ruota sono contigue nel suo file colonnare (vedi lotto_colonne.h):
+		// vengono lette con una sola lettura, invece di saltare un intero blocco di FILE_ESTRAZIONI per ogni estrazione
+		long letti, quante_estrazioni = (long)(info.st_size / LUNGHEZZA_BLOCCO_ESTRAZIONE);
+		uint32_t da_leggere = (n < quante_estrazioni) ? n : (uint32_t)quante_estrazioni;
+		uint8_t* numeri = malloc((size_t)da_leggere * QUANTI_NUMERI_ESTRATTI);
 		
-		for (i = 0; i < n; ++i) {
-			// Legge un record di estrazione della ruota
-			fread(messaggio_al_client + quanti_byte, LUNGHEZZA_ESTRAZIONE_SINGOLA_RUOTA, 1, file_estrazione);
-			quanti_byte += LUNGHEZZA_ESTRAZIONE_SINGOLA_RUOTA;
-
-			// Controlla se siamo arrivati all'estrazione di testa
-			if (ftell(file_estrazione) <= LUNGHEZZA_BLOCCO_ESTRAZIONE) {
-				break;
+		letti = (numeri) ? leggiUltimeEstrazioniRuota(ruota, da_leggere, (uint32_t)quante_estrazioni, numeri) : -1;
+		
+		// File colonnare non allineato (scrittura fallita dopo un'estrazione): le estrazioni della ruota
+		// vengono lette da FILE_ESTRAZIONI, come prima dei file colonnari, fino al riavvio
+		if (letti < 0 && numeri) {
+			for (letti = 0; letti < (long)da_leggere; ++letti) {
+				uint32_t estratti[QUANTI_NUMERI_ESTRATTI];
+				long offset = (quante_estrazioni - (long)da_leggere + letti) * (long)LUNGHEZZA_BLOCCO_ESTRAZIONE
+						+ (long)sizeof(time_t) + ruota * (long)LUNGHEZZA_ESTRAZIONE_SINGOLA_RUOTA + (long)sizeof(uint8_t);
+				int j;
+				
+				if (fseek(file_estrazione, offset, SEEK_SET) < 0
+						|| fread(estratti, sizeof(uint32_t), QUANTI_NUMERI_ESTRATTI, file_estrazione) != QUANTI_NUMERI_ESTRATTI) {
+					letti = -1;
+					break;
+				}
+				for (j = 0; j < QUANTI_NUMERI_ESTRATTI; ++j) {
+					numeri[letti * QUANTI_NUMERI_ESTRATTI + j] = (uint8_t)estratti[j];
+				}
 			}
+		}
+		if (letti < 0) {
+			fclose(file_estrazione);
+			free(numeri);
+			free(messaggio_al_client);
+			ret = inviaErrore(socket, ERRORE_INTERNO_SERVER);
+			return -1;
+		}
+		
+		// Dalla piu' recente alla meno recente, nel formato di FILE_ESTRAZIONI
+		for (i = letti - 1; i >= 0; --i) {
+			int j;
 			
-			// Porta il cursore indietro di un intero blocco
-			fseek(file_estrazione, -LUNGHEZZA_BLOCCO_ESTRAZIONE - LUNGHEZZA_ESTRAZIONE_SINGOLA_RUOTA, SEEK_CUR);
+			messaggio_al_client[quanti_byte] = ruota;
+			for (j = 0; j < QUANTI_NUMERI_ESTRATTI; ++j) {
+				uint32_t numero = numeri[i * QUANTI_NUMERI_ESTRATTI + j];
+				
+				memcpy(messaggio_al_client + quanti_byte + sizeof(uint8_t) + j * sizeof(uint32_t), &numero, sizeof(numero));
+			}
+			quanti_byte += LUNGHEZZA_ESTRAZIONE_SINGOLA_RUOTA;
 		}
+		free(numeri);
 	}
 	// Caso con ruota non specificata
 	else if (ruota == RUOTA_NON_SPECIFICATA && info.st_size > 0) {
@@ -898,76 +1375,199 @@ int eseguiVediEstrazione (const int socket, const char* msg, const size_t msg_le
 	return 1;
 }
 
+/* Esegui il comando !cerca_estrazioni <da> <a> <ruote>
+ * Invia al client le estrazioni effettuate tra i timestamp <da> e <a> (inclusi), limitate alle ruote
+ * della maschera <ruote> (il bit i-esimo indica la ruota di codice i).
+ * Gli estremi dell'intervallo vengono cercati con una ricerca binaria su FILE_ESTRAZIONI
+ * (vedi cercaEstrazione(...)) e le estrazioni dell'intervallo vengono lette con una sola lettura contigua.
+ * Se le estrazioni non entrano in un messaggio, vengono inviate solo le prime: il client puo' chiedere le altre
+ * ripetendo il comando a partire dal timestamp successivo all'ultima estrazione ricevuta.
+ * 
+ * @socket descrittore del socket su cui avviene la comuncazione client-server
+ * @msg indirizzo al messaggio applicativo nel seguente formato:
+ *		-------------------------------------------------------------------------------------------
+ *		| session_id (stringa + '\\0') | da (uint32_t) | a (uint32_t) | maschera ruote (uint16_t) |
+ *		-------------------------------------------------------------------------------------------
+ * @msg_len lunghezza di msg
+ * 
+ * Il messaggio inviato al client ha il seguente formato:
+ *		-----------------------------------------------------------------------------------------
+ *		| estrazioni nell'intervallo (uint32_t) | estrazioni inviate (uint32_t) | estrazioni... |
+ *		-----------------------------------------------------------------------------------------
+ * dove ogni estrazione e' composta dal timestamp (uint32_t) e, per ogni ruota della maschera,
+ * dal codice della ruota (uint8_t) e dai numeri estratti (QUANTI_NUMERI_ESTRATTI uint32_t)
+ * 
+ * @return 1 se il comando ha successo, 0 se fallisce per colpa del client, -1 in caso di errore interno
+ */
+int eseguiCercaEstrazioni (const int socket, const char* msg, const size_t msg_len)
+{
+	int ret, ruota, quante_ruote = 0;
+	uint32_t da, a, quante_nell_intervallo, quante_inviate, valore;
+	uint16_t maschera;
+	long quante_estrazioni, prima, ultima, i;
+	size_t lunghezza_estrazione, quanti_byte = 0;
+	
+	uint8_t* blocchi;				// estrazioni dell'intervallo, lette dal file
+	uint8_t* messaggio_al_client;
+	
+	// File
+	FILE* file_estrazione;
+	struct stat info;
+	
+	// Controllo lunghezza messaggio
+	if (msg_len < LUNGHEZZA_SESSION_ID + 1 + 2 * sizeof(uint32_t) + sizeof(uint16_t)) {
+		ret = inviaErrore(socket, MESSAGGIO_NON_COMPRENSIBILE);
+		return (ret == -1) ? -1 : 0;
+	}
+	
+	// Lettura degli argomenti del comando
+	memcpy(&da, msg + LUNGHEZZA_SESSION_ID + 1, sizeof(da));
+	memcpy(&a, msg + LUNGHEZZA_SESSION_ID + 1 + sizeof(da), sizeof(a));
+	memcpy(&maschera, msg + LUNGHEZZA_SESSION_ID + 1 + sizeof(da) + sizeof(a), sizeof(maschera));
+	da = ntohl(da);
+	a = ntohl(a);
+	maschera = ntohs(maschera);
+	
+	if (da > a || maschera == 0 || (maschera >> QUANTE_RUOTE) != 0) {
+		ret = inviaErrore(socket, MESSAGGIO_NON_COMPRENSIBILE);
+		return (ret == -1) ? -1 : 0;
+	}
+	for (ruota = 0; ruota < QUANTE_RUOTE; ++ruota) {
+		if (maschera & (1 << ruota)) quante_ruote++;
+	}
+	lunghezza_estrazione = sizeof(uint32_t) + quante_ruote * LUNGHEZZA_ESTRAZIONE_SINGOLA_RUOTA;
+	
+	// Apertura file in lettura
+	file_estrazione = fopen(FILE_ESTRAZIONI, "rb");
+	if (!file_estrazione || fstat(fileno(file_estrazione), &info) < 0) {
+		if (file_estrazione) fclose(file_estrazione);
+		ret = inviaErrore(socket, ERRORE_INTERNO_SERVER);
+		return -1;
+	}
+	quante_estrazioni = (long)(info.st_size / LUNGHEZZA_BLOCCO_ESTRAZIONE);
+	
+	// Estremi dell'intervallo: [prima, ultima)
+	prima = cercaEstrazione(file_estrazione, quante_estrazioni, (time_t)da);
+	ultima = (prima < 0) ? -1 : cercaEstrazione(file_estrazione, quante_estrazioni, (time_t)a + 1);
+	if (prima < 0 || ultima < 0) {
+		fclose(file_estrazione);
+		ret = inviaErrore(socket, ERRORE_INTERNO_SERVER);
+		return -1;
+	}
+	
+	if (prima == ultima) {
+		// Nessuna estrazione nell'intervallo
+		fclose(file_estrazione);
+		ret = inviaErrore(socket, FILE_VUOTO);
+		return (ret == -1) ? -1 : 1;
+	}
+	
+	// Le estrazioni inviate devono entrare in un messaggio (lunghezza uint16_t, compreso il byte DATI)
+	quante_nell_intervallo = (uint32_t)(ultima - prima);
+	quante_inviate = (uint32_t)((UINT16_MAX - 1 - 2 * sizeof(uint32_t)) / lunghezza_estrazione);
+	if (quante_inviate > quante_nell_intervallo) {
+		quante_inviate = quante_nell_intervallo;
+	}
+	
+	// Lettura contigua delle estrazioni da inviare
+	blocchi = malloc(quante_inviate * LUNGHEZZA_BLOCCO_ESTRAZIONE);
+	messaggio_al_client = malloc(2 * sizeof(uint32_t) + quante_inviate * lunghezza_estrazione);
+	if (!blocchi || !messaggio_al_client || fseek(file_estrazione, prima * (long)LUNGHEZZA_BLOCCO_ESTRAZIONE, SEEK_SET) < 0
+			|| fread(blocchi, LUNGHEZZA_BLOCCO_ESTRAZIONE, quante_inviate, file_estrazione) != quante_inviate) {
+		fclose(file_estrazione);
+		free(blocchi);
+		free(messaggio_al_client);
+		ret = inviaErrore(socket, ERRORE_INTERNO_SERVER);
+		return -1;
+	}
+	fclose(file_estrazione);
+	
+	// Costruzione del messaggio in formato network
+	valore = htonl(quante_nell_intervallo);
+	memcpy(messaggio_al_client + quanti_byte, &valore, sizeof(valore));
+	quanti_byte += sizeof(valore);
+	valore = htonl(quante_inviate);
+	memcpy(messaggio_al_client + quanti_byte, &valore, sizeof(valore));
+	quanti_byte += sizeof(valore);
+	
+	for (i = 0; i < quante_inviate; ++i) {
+		const uint8_t* blocco = blocchi + i * LUNGHEZZA_BLOCCO_ESTRAZIONE;
+		time_t timestamp;
+		
+		memcpy(&timestamp, blocco, sizeof(timestamp));
+		valore = htonl((uint32_t)timestamp);
+		memcpy(messaggio_al_client + quanti_byte, &valore, sizeof(valore));
+		quanti_byte += sizeof(valore);
+		
+		for (ruota = 0; ruota < QUANTE_RUOTE; ++ruota) {
+			const uint8_t* estrazione = blocco + sizeof(time_t) + ruota * LUNGHEZZA_ESTRAZIONE_SINGOLA_RUOTA;
+			int j;
+			
+			if (!(maschera & (1 << ruota))) continue;
+			
+			messaggio_al_client[quanti_byte++] = estrazione[0];		// codice della ruota
+			for (j = 0; j < QUANTI_NUMERI_ESTRATTI; ++j) {
+				memcpy(&valore, estrazione + sizeof(uint8_t) + j * sizeof(uint32_t), sizeof(valore));
+				valore = htonl(valore);
+				memcpy(messaggio_al_client + quanti_byte, &valore, sizeof(valore));
+				quanti_byte += sizeof(valore);
+			}
+		}
+	}
+	free(blocchi);
+	
+	// Invia dati al client
+	ret = inviaDati(socket, messaggio_al_client, (uint16_t)quanti_byte);
+	free(messaggio_al_client);
+	return (ret < 0) ? -1 : 1;
+}
+
 ////////////////////////////////////////////////////////////////////////////
 //						ESEGUI VEDI_VINCITE								////
 ////////////////////////////////////////////////////////////////////////////
 
 /* Data una lista di schedine e un'estrazione completa (tutte le ruote),
- * elabora le vincite e le memorizza nel file file_vincite
+ * elabora le vincite e le memorizza nel file file_vincite.
+ * Ogni vincita scritta viene anche sommata al riepilogo delle vincite dell'utente.
+ * L'esito della schedina viene calcolato una sola volta per tutte le giocate identiche (vedi lotto_interni.h)
  * 
  * @sched lista delle schedine da elaborare
- * @estrazioni_array estrazione da elaborare. Ogni estrazione deve avere i numeri ordinati in ordine crescente.
+ * @estratti numeri estratti su ogni ruota
+ * @estrazione indice dell'estrazione in FILE_ESTRAZIONI
  * @timestamp timestamp dell'estrazione
  * @file_vincite puntatore descrittore del registro delle vincite su cui scrivere
+ * @riepilogo riepilogo delle vincite dell'utente da aggiornare
  */
-void elaboraVincitaSchedinaConEstrazione (struct schedina_list* sched, struct estrazione estrazioni_array[],
-												time_t timestamp, FILE* file_vincite)
+void elaboraVincitaSchedinaConEstrazione (struct schedina_list* sched, const struct insieme_numeri estratti[], const uint32_t estrazione,
+												time_t timestamp, FILE* file_vincite, struct riepilogo_vincite* riepilogo)
 {
 	int i;
-	int quantiImporti = sched->s.quantiImporti,
-		quantiNumeri = sched->s.quantiNumeri,
-		quanteRuote = sched->s.quanteRuote;
+	double totale_schedina = 0;		// totale vinto dalla schedina su tutte le ruote
+	int quanteRuote = sched->s.quanteRuote;
 	
 	struct vincita vincita_temp;	// per memorizzare i dati temporanei durante l'elaborazione della vincita
 	int ruote_vincenti = 0;			// numero di ruote con almeno una vincita
 	
-	/* distribuzione_premio[i] e' pari un fattore moltiplicativo del premio dovuto alla quantita' di numeri giocati.
-	 * Per ogni tipo di evento vincinte (0 = ESTRATTO SINGOLO, 1 = AMBO ...), viene calcolato quante possibili combinazioni
-	 * dell'evento vincente AL MASSIMO possono manifestarsi all'interno del set dei numeri scommessi.
-	 * Il che significa, per la logica combinatoria, dover calcolare il coefficiente binomiale con
-	 *	n = quantita' di numeri giocati
-	 *	k = i + 1
-	 */
-	double distribuzione_premio[quantiImporti]; 
-	
-	for (i = 0; i < quantiImporti; ++i) {
-		distribuzione_premio[i] = coefficienteBinomiale(quantiNumeri, i+1);
-	}
+	struct esito_giocata esito;		// esito per ogni Euro puntato, condiviso dalle giocate identiche
+	double puntata;
+	double liquidato_esposizione = 0;	// vincite di ESTRATTO e di AMBO
 	
-	// Ordina la schedina
-	qsort(sched->s.numeriGiocati, quantiNumeri, sizeof(int), ordine_crescente);
+	puntata = esitoGiocata(&sched->s, estrazione, estratti, &esito);
 	
 	// Costruzione di vincita_temp
 	costruisci_vincita(&vincita_temp, timestamp, quanteRuote);
 	
-	// Cerca i numeri giocati per ogni ruota dell'estrazione
+	// Raccoglie i numeri comuni di ogni ruota dall'esito (in ordine crescente)
 	for (i = 0; i < quanteRuote; ++i) {
 		uint8_t ruota = sched->s.ruote[i];
-		int index_scommessa = 0, index_estrazione = 0, j = 0; // indici per navigare i vettori
-		
-		int numeri_comuni[max(quantiNumeri, QUANTI_NUMERI_ESTRATTI)];	// contiene gli elementi comuni 
-																		// tra i numeri estratti e quelli giocati
-		int quanti_numeri_comuni = 0;
+		int numeri_comuni[QUANTI_NUMERI_ESTRATTI];	// elementi comuni tra i numeri estratti e quelli giocati
+		int quanti_numeri_comuni = 0, numero, j;
 		
 		vincita_temp.ruote[i] = 0; // valore di default a segnalare che la ruota di questo indice non e' vincente
 		
-		// Cerca elementi comuni tra il vettore dei numeri scommessi e il vettore dei numeri estratti
-		// considerando che entrambi sono ordinati
-		while (index_scommessa < quantiNumeri && index_estrazione < QUANTI_NUMERI_ESTRATTI) { 
-			
-			if (sched->s.numeriGiocati[index_scommessa] < estrazioni_array[ruota].numeri[index_estrazione]) {
-				index_scommessa++; 
-			}
-			
-			else if (estrazioni_array[ruota].numeri[index_estrazione] < sched->s.numeriGiocati[index_scommessa]) {
-				index_estrazione++; 
-			}
-			
-			else {
-				numeri_comuni[quanti_numeri_comuni] = sched->s.numeriGiocati[index_scommessa];
-				quanti_numeri_comuni++;
-				index_estrazione++;
-				index_scommessa++; 
+		for (numero = 1; numero <= NUMERI_ESTRAIBILI; ++numero) {
+			if (esito.comuni[ruota].parte[numero >> 6] & ((uint64_t)1 << (numero & 63))) {
+				numeri_comuni[quanti_numeri_comuni++] = numero;
 			}
 		}
 		
@@ -984,32 +1584,22 @@ void elaboraVincitaSchedinaConEstrazione (struct schedina_list* sched, struct es
 		memcpy(vincita_temp.numeri_vincitori[i], numeri_comuni, sizeof(int) * quanti_numeri_comuni);
 		vincita_temp.quanti_numeri_vincitori[i] = quanti_numeri_comuni;
 		
-		// Si usa il minimo come dimensione perche' se l'utente scommette per un'evento che richiede alpha numeri (es: terno, 3) 
-		// e ci sono solo beta numeri comuni (con beta < alpha, es: ambo, 2),
-		// allora sicuramente gli eventi con indice SUPERIORE a beta non si sono verificati.
-		// Inoltre, se si verifica un evento di indice beta, tutti gli eventi di indice INFERIORE a beta
-		// si verificano con una frequenza pari al coefficiente binomiale (es: se vinco il terno, vinco anche 3 ambi e 3 estratti)
-		vincita_temp.quanti_importi_vinti[i] = min(quantiImporti, quanti_numeri_comuni);
-		
-		vincita_temp.importi_vinti[i] = malloc(vincita_temp.quanti_importi_vinti[i] * sizeof(double));
-		
+		// Le vincite dell'esito sono per ogni Euro puntato (vedi calcolaVinciteRuota(...) in lotto_premi.h)
+		vincita_temp.importi_vinti[i] = malloc(QUANTI_TIPI_PREMIO * sizeof(double));
+		vincita_temp.quanti_importi_vinti[i] = min(sched->s.quantiImporti, quanti_numeri_comuni);
 		for (j = 0; j < vincita_temp.quanti_importi_vinti[i]; ++j) {
-			/* Formula usata:
-			 * > coefficienteBinomiale(quanti_numeri_comuni, j+1)
-			 *		--> frequenza dell'evento j (estratto, ambo, terno...) nel set dei numeri_comuni
-			 * > moltiplicatorePremio(j)
-			 *		--> moltiplicatore statico dovuto al tipo di scommessa (estratto, ambo, terno...)
-			 * > distribuzione_premio[j] * quanteRuote
-			 *		--> il premio base per ogni euro viene equamente ripartito su ogni ruota e viene diviso 
-			 *			per la frequenza per cui quell'evento j si puo' verificare nel set di numeri giocati
-			 */
-			vincita_temp.importi_vinti[i][j] =
-				coefficienteBinomiale(quanti_numeri_comuni, j+1) // frequenza dell'evento j+1 (estratto, ambo, terno...)
-																 // nel set dei numeri_comuni
-				* (moltiplicatorePremio(j) / ((double)(distribuzione_premio[j] * quanteRuote))); 
+			vincita_temp.importi_vinti[i][j] = esito.vincite[ruota][j] * puntata;
+			if (j < 2) {	// ESTRATTO e AMBO
+				liquidato_esposizione += vincita_temp.importi_vinti[i][j];
+			}
 		}
 	}
 	
+	// Riconciliazione dell'esposizione dell'estrazione (vedi lotto_esposizione.h)
+	if (liquidato_esposizione > 0) {
+		registraLiquidazione(estrazione, liquidato_esposizione);
+	}
+	
 	if(ruote_vincenti == 0) {
 		distruggi_vincita(&vincita_temp);
 		return;
@@ -1022,8 +1612,9 @@ void elaboraVincitaSchedinaConEstrazione (struct schedina_list* sched, struct es
 	for (i = 0; i < quanteRuote; ++i) {
 		int scorri = 0;
 		
-		// Se la ruota e' zero (valore di default), allora significa che non e' vincente
-		if (vincita_temp.ruote[i] == 0) {
+		// Se non ci sono numeri vincitori (valore di default), allora la ruota non e' vincente.
+		// Non si puo' usare il codice della ruota perche' BARI ha codice zero
+		if (vincita_temp.quanti_numeri_vincitori[i] == 0) {
 			continue;
 		}
 		
@@ -1038,46 +1629,100 @@ void elaboraVincitaSchedinaConEstrazione (struct schedina_list* sched, struct es
 		
 		for (scorri = 0; scorri < vincita_temp.quanti_importi_vinti[i]; ++scorri) {
 			fprintf(file_vincite, "%.2lf ", vincita_temp.importi_vinti[i][scorri]);
+			
+			riepilogo->totale_vincite[scorri] += vincita_temp.importi_vinti[i][scorri];
+			totale_schedina += vincita_temp.importi_vinti[i][scorri];
 		}
 		
 		fprintf(file_vincite, "|");
 	}
 	
+	// Aggiorna il riepilogo con la schedina vincente
+	riepilogo->quante_schedine_vincenti++;
+	if (totale_schedina > riepilogo->vincita_migliore) {
+		riepilogo->vincita_migliore = totale_schedina;
+		riepilogo->timestamp_vincita_migliore = timestamp;
+	}
+	
 	distruggi_vincita(&vincita_temp);
 }
 
+/* Indica se una schedina partecipa ad un'estrazione successiva alla sua registrazione
+ * 
+ * @sched schedina, con il numero delle estrazioni su cui e' gia' stata giocata
+ * @timestamp timestamp dell'estrazione
+ * 
+ * @return 1 se la schedina partecipa all'estrazione, 0 altrimenti
+ */
+int schedinaCopreEstrazione (const struct schedina_list* sched, const time_t timestamp)
+{
+	if (sched->s.quanteEstrazioni == ABBONAMENTO) {
+		// Un abbonamento partecipa a tutte le estrazioni precedenti al suo annullamento
+		return sched->s.annullamento == 0 || timestamp < sched->s.annullamento;
+	}
+	return sched->estrazioni_coperte < sched->s.quanteEstrazioni;
+}
+
 /* Verifica se le schedine della lista <schedine>, giocate dall utente <user>, hanno vinto.
  * In caso positivo, scrive le vincite sul registro vincite dell'utente
  * 
- * @schedine lista delle schedine da convalidare (ovvero determinare se vittoriose o meno)
+ * Ogni schedina viene giocata sulle estrazioni successive alla sua registrazione, fino a quanteEstrazioni
+ * (o fino all'annullamento per gli abbonamenti): una schedina registrata una sola volta viene quindi
+ * controllata su ognuna delle estrazioni che copre. Le estrazioni gia' controllate da una verifica precedente
+ * (le prime estrazioni_controllate del riepilogo) vengono contate ma non giocate di nuovo. Le schedine successive
+ * a fine_controllata non erano ancora estratte durante quella verifica, percio' sono state registrate dopo tutte
+ * le estrazioni che ha controllato e non vi partecipano, anche se registrate nello stesso secondo di una di esse.
+ * 
+ * @schedine lista delle schedine da convalidare (ovvero determinare se vittoriose o meno), in ordine di registrazione
  * @user nome dell'utente
+ * @quante_estrazioni numero delle estrazioni da considerare (le estrazioni successive verranno controllate
+ *	dalla prossima verifica, insieme alle schedine registrate nel frattempo)
+ * @fine offset della fine della lista delle schedine nel registro
+ * 
+ * @return offset della prima schedina che partecipa ancora ad estrazioni future, <fine> se non ce ne sono
  */
-void convalidaSchedineEstratte (struct schedina_list* schedine, const char* user)
+uint32_t convalidaSchedineEstratte (struct schedina_list* schedine, const char* user, const uint32_t quante_estrazioni, const uint32_t fine)
 {
 	int i, ret;
+	uint32_t estrazione;
+	struct riepilogo_vincite riepilogo;	// riepilogo aggiornato con le nuove vincite
+	uint32_t estrazioni_controllate, fine_controllata;	// estensione della verifica precedente
+	
+	// Puntatori nella lista delle schedine (ordinate per timestamp di registrazione)
+	struct schedina_list* prima_in_gioco = schedine,	// prima schedina non conclusa
+		* prossima = schedine,		// prima schedina registrata dopo l'estrazione in esame
+		* scorri;
 	
 	// Variabili per file
 	FILE* file_estrazioni;	// aperto in modalita' lettura binaria
 	
-	FILE* file_vincite;		// aperto in modalita' lettura standard
-	char indirizzo_file_vincite[512];
+	// Le nuove vincite vengono scritte in memoria e aggiunte al registro vincite con un solo record
+	FILE* file_vincite;
+	char* nuove_vincite = NULL;
+	size_t len_nuove_vincite = 0;
 	
-	// Timestamp usate durante l'analisi delle estrazione per individuare le schedine che vi appartengono
-	time_t	time1 = 0,	// timestamp dell'estrazione analizzata appena in precedenza
-			time2 = 0;	// timestamp dell'estrazione in analisi
+	time_t time2 = 0;	// timestamp dell'estrazione in analisi
 
 	// Apertura file_estrazioni
 	file_estrazioni = fopen(FILE_ESTRAZIONI, "rb");
 	fseek(file_estrazioni, 0, SEEK_SET);
 	
 	// Apertura file_vincite pronti per la scrittura di nuove vincite
-	sprintf(indirizzo_file_vincite, "%s/%s_vincite.txt", CARTELLA_FILES, user);
-	file_vincite = fopen(indirizzo_file_vincite, "r+");
-	fseek(file_vincite, 0, SEEK_END);
+	file_vincite = open_memstream(&nuove_vincite, &len_nuove_vincite);
+	if (!file_vincite) {
+		perror("Impossibile creare buffer vincite");
+		fclose(file_estrazioni);
+		return schedine ? schedine->offset : fine;
+	}
 	
-	// Esplora tutte le estrazioni per cercare l'estrazione corrispondente ad ogni schedina
-	while (1) {
-		struct estrazione estrazioni_array[QUANTE_RUOTE];
+	// Carica il riepilogo delle vincite, che verra' aggiornato ad ogni vincita scritta
+	leggiRiepilogoVincite(user, &riepilogo);
+	estrazioni_controllate = riepilogo.estrazioni_controllate;
+	fine_controllata = riepilogo.fine_controllata;
+	
+	// Esplora le estrazioni in ordine cronologico, giocando su ognuna le schedine che la coprono
+	for (estrazione = 0; estrazione < quante_estrazioni; ++estrazione) {
+		struct insieme_numeri estratti[QUANTE_RUOTE];	// numeri estratti su ogni ruota
 		int estrazione_prelevata_da_file = 0;
 		
 		// Legge timestamp di estrazione
@@ -1088,15 +1733,39 @@ void convalidaSchedineEstratte (struct schedina_list* schedine, const char* user
 			break;
 		}
 		
-		// Analizza le schedine
-		while (schedine != NULL) {
-			// Controlla la condizione che la prima schedina della lista NON afferisce all'estrazione in esame.
-			// Siccome le schedine sono passate in ordine cronologico crescente,
-			// se la prima non e' afferente all'estrazione in esame (ovvero e' temporalmente successiva),
-			// non lo sono neanche le schedine successive.
-			if (!((time1 == 0 && schedine->timestamp <= time2) ||
-				(time1 != 0 && schedine->timestamp <= time2 && schedine->timestamp > time1))) {
-				break;
+		// Le schedine registrate prima dell'estrazione entrano in gioco
+		while (prossima != NULL && prossima->timestamp <= time2) {
+			prossima = prossima->next;
+		}
+		while (prima_in_gioco != prossima && prima_in_gioco->conclusa) {
+			prima_in_gioco = prima_in_gioco->next;
+		}
+		
+		// Non ci sono piu' schedine da analizzare
+		if (prima_in_gioco == NULL) {
+			break;
+		}
+		
+		// Analizza le schedine in gioco
+		for (scorri = prima_in_gioco; scorri != prossima; scorri = scorri->next) {
+			if (scorri->conclusa) {
+				continue;
+			}
+			if (estrazione < estrazioni_controllate && scorri->offset >= fine_controllata) {
+				continue;
+			}
+			if (!schedinaCopreEstrazione(scorri, time2)) {
+				scorri->conclusa = 1;
+				continue;
+			}
+			scorri->estrazioni_coperte++;
+			if (scorri->s.quanteEstrazioni != ABBONAMENTO && scorri->estrazioni_coperte == scorri->s.quanteEstrazioni) {
+				scorri->conclusa = 1;
+			}
+			
+			// Estrazione gia' controllata da una verifica precedente
+			if (estrazione < estrazioni_controllate) {
+				continue;
 			}
 			
 			// Per evitare letture inutili o doppie, l'estrazione viene prelevata dal file al massimo una volta,
@@ -1105,37 +1774,30 @@ void convalidaSchedineEstratte (struct schedina_list* schedine, const char* user
 				// Preleva i dati dell'estrazione in esame
 				for (i = 0; i < QUANTE_RUOTE; ++i) {
 					int j;
+					uint8_t ruota;
 					// I numeri estratti sono stati memorizzati come uin32_t per ottenere una maggior
 					// indipendenza dall'architettura del server e del client (dato che i dati sulle estrazioni
 					// vengono scambiati con un protocollo in binario.
-					// Tuttavia, per l'analisi delle schedine, ci servono interi con segno
+					// Per l'analisi delle schedine vengono convertiti nell'insieme dei numeri estratti sulla ruota
 					uint32_t numeri_estratti_temp[QUANTI_NUMERI_ESTRATTI];
+					int numeri_estratti[QUANTI_NUMERI_ESTRATTI];
 					
-					fread(&estrazioni_array[i].ruota, sizeof(uint8_t), 1, file_estrazioni);
+					fread(&ruota, sizeof(uint8_t), 1, file_estrazioni);
 					fread(numeri_estratti_temp, sizeof(int), QUANTI_NUMERI_ESTRATTI, file_estrazioni);
 
 					// Converti i numeri estratti in interi
 					for (j = 0; j < QUANTI_NUMERI_ESTRATTI; ++j) {
-						estrazioni_array[i].numeri[j] = (int)numeri_estratti_temp[j];
+						numeri_estratti[j] = (int)numeri_estratti_temp[j];
 					}
 					
-					// Ordina i numeri estratti
-					qsort(estrazioni_array[i].numeri, QUANTI_NUMERI_ESTRATTI, sizeof(int), ordine_crescente);
+					estratti[i] = insiemeNumeri(numeri_estratti, QUANTI_NUMERI_ESTRATTI);
 				}
 				
 				estrazione_prelevata_da_file = 1;
 			}
 			
 			// Elabora le vincite e le memorizza nel file
-			elaboraVincitaSchedinaConEstrazione(schedine, estrazioni_array, time2, file_vincite);
-			
-			// Aggiorna variabili di appoggio
-			schedine = schedine->next;
-		}
-		
-		// Non ci sono piu' schedine da analizzare
-		if (schedine == NULL) {
-			break;
+			elaboraVincitaSchedinaConEstrazione(scorri, estratti, estrazione, time2, file_vincite, &riepilogo);
 		}
 		
 		// Per mantenere consistente l'accesso al file, se non sono state trovate schedine afferente all'estrazione 
@@ -1144,12 +1806,29 @@ void convalidaSchedineEstratte (struct schedina_list* schedine, const char* user
 		if (estrazione_prelevata_da_file ==  0) {
 			fseek(file_estrazioni, LUNGHEZZA_ESTRAZIONE_SINGOLA_RUOTA * QUANTE_RUOTE, SEEK_CUR);
 		}
-		
-		time1 = time2;
 	}
 	
+	// Le estrazioni esplorate sono state controllate per tutte le schedine fino a <fine>
+	if (estrazione > riepilogo.estrazioni_controllate) {
+		riepilogo.estrazioni_controllate = estrazione;
+	}
+	riepilogo.fine_controllata = fine;
+	
 	fclose(file_vincite);
 	fclose(file_estrazioni);
+	
+	if (len_nuove_vincite > 0 && aggiungiVinciteRegistro(user, nuove_vincite, (uint32_t)len_nuove_vincite) < 0) {
+		fprintf(stderr, "Impossibile registrare vincite di %s\n", user);
+	}
+	free(nuove_vincite);
+	
+	scriviRiepilogoVincite(user, &riepilogo);
+	
+	// Prima schedina ancora in gioco (o non ancora giocata)
+	while (prima_in_gioco != NULL && prima_in_gioco->conclusa) {
+		prima_in_gioco = prima_in_gioco->next;
+	}
+	return (prima_in_gioco != NULL) ? prima_in_gioco->offset : fine;
 }
 
 /* Invia l'intero contenuto del registro vincite al client
@@ -1161,45 +1840,40 @@ void convalidaSchedineEstratte (struct schedina_list* schedine, const char* user
  */
 int inviaFileVincite (const int socket, const char* user)
 {
-	// Variabili per la gestione del file
-	FILE* file_vincite;
-	struct stat info;
-	char indirizzo_file_vincite[512];
-	
 	// Variabili per il messaggio al client
-	char* messaggio;
-	uint16_t lenmsg;
-	
-	// Apri file vincite
-	sprintf(indirizzo_file_vincite, "%s/%s_vincite.txt", CARTELLA_FILES, user);
+	char* registro;
+	const char* messaggio;
+	uint32_t lenmsg;
+	int ret;
 	
-	file_vincite = fopen(indirizzo_file_vincite, "rb");
-	if (!file_vincite) {
-		perror("inviaFileVincite(const int, const char*) fallita, impossibile aprire file vincite");
+	// Leggi il registro vincite
+	if (leggiRegistroVincite(user, &registro, &lenmsg) < 0) {
+		fprintf(stderr, "inviaFileVincite(const int, const char*) fallita, impossibile leggere registro vincite di %s\n", user);
 		inviaErrore(socket, ERRORE_INTERNO_SERVER);
 		return -1;
 	}
 	
-	stat(indirizzo_file_vincite, &info);
-	
 	// Caso in cui non vi sono state vincite nel passato dell'utente
-	if (info.st_size == 0) {
+	if (lenmsg == 0) {
+		free(registro);
 		return inviaErrore(socket, FILE_VUOTO);
 	}
 	
-	// Copia il contenuto del file nel messaggio da inviare
-	lenmsg = (uint16_t)(info.st_size) + 1; // carattere '/0' in fondo
-	messaggio = malloc(lenmsg);
-	memset(messaggio, 0, lenmsg);
-	
-	fread(messaggio, 1, lenmsg-1, file_vincite);
+	// Un messaggio contiene al massimo UINT16_MAX byte: di un registro piu' lungo vengono inviate le vincite piu' recenti
+	messaggio = registro;
+	if (lenmsg > UINT16_MAX - 1) {
+		messaggio = memchr(registro + lenmsg - (UINT16_MAX - 1), '|', UINT16_MAX - 1);
+		messaggio = messaggio ? messaggio + 1 : registro + lenmsg;
+	}
 	
-	return inviaDati(socket, messaggio, strlen(messaggio) + 1);
+	ret = inviaDati(socket, messaggio, (uint16_t)(strlen(messaggio) + 1));
+	free(registro);
+	return ret;
 }
 
 /* Esegui il comando !vedi_vincite
- * Controlla le ultime schedine giocate se hanno vinto, memorizza eventuali nuove vincite nel file utente relativo alle vincite
- * (che potrebbe contenere vincite passate) e ne invia il contenuto al client
+ * Controlla se le schedine in gioco hanno vinto nelle estrazioni non ancora controllate, memorizza eventuali
+ * nuove vincite nel file utente relativo alle vincite (che potrebbe contenere vincite passate) e ne invia il contenuto al client
  * 
  * @socket descrittore del socket su cui avviene la comuncazione client-server
  * @user nome dell'utente
@@ -1208,77 +1882,77 @@ int inviaFileVincite (const int socket, const char* user)
  */
 int eseguiVediVincite (const int socket, const char* user)
 {
-	// Variabili per accesso ai file
-	FILE* file_schedine;
-	char indirizzo_file_schedine[512];
+	// Variabili per accesso al registro
+	struct stato_registro stato;
+	char* registro;
+	uint32_t quanti_byte, byte_letti = 0;
+	struct stat info;
+	uint32_t quante_estrazioni;
 	
 	struct schedina_list* schedine = NULL,	// lista delle schedine da analizzare
 		* puntatore_schedina = NULL;		// puntatore di appoggio per la gestione della lista schedine
 	
-	// Variabili per memorizzare il valore dei campi dello header del file_schedine
+	// Variabili per memorizzare lo stato del registro delle schedine
 	// (vedi inizio file sorgente, area #define, sezione FILE)
 	uint32_t offset_schedine_non_estratte, offset_schedine_da_controllare;
 	
-	sprintf(indirizzo_file_schedine, "%s/%s_schedine.bin", CARTELLA_FILES, user);
-	
-	// Apertura in lettura e scrittura come file binario
-	file_schedine = fopen(indirizzo_file_schedine, "rb+");
-	if (!file_schedine) {
-		perror("Impossibile aprire file schedine");
+	// Le estrazioni da considerare vengono contate PRIMA di leggere lo stato: un'estrazione effettuata
+	// tra le due letture riguarda solo schedine che verranno controllate dalla prossima verifica
+	if (stat(FILE_ESTRAZIONI, &info) < 0) {
+		perror("Impossibile leggere dimensione file estrazioni");
 		inviaErrore(socket, ERRORE_INTERNO_SERVER);
 		return -1;
 	}
+	quante_estrazioni = (uint32_t)(info.st_size / LUNGHEZZA_BLOCCO_ESTRAZIONE);
 	
-	// Estrazione dello header
-	fread(&offset_schedine_non_estratte, sizeof(offset_schedine_non_estratte), 1, file_schedine);
-	fread(&offset_schedine_da_controllare, sizeof(offset_schedine_da_controllare), 1, file_schedine);
-	
-	// Aggiornamento del secondo campo dello header
-	// (alla fine dell'iterazione di questa funzione, tutte le schedine attualmente
-	// estratte ma non controllate, verranno controllate)
-	fseek(file_schedine, -sizeof(offset_schedine_da_controllare), SEEK_CUR);
-	fwrite(&offset_schedine_non_estratte, sizeof(offset_schedine_non_estratte), 1, file_schedine);
-	
-	fclose(file_schedine);
+	// Stato del registro
+	statoRegistro(user, &stato);
+	offset_schedine_non_estratte = stato.inizio_non_estratte;
+	offset_schedine_da_controllare = stato.inizio_da_controllare;
 	
 	if (offset_schedine_non_estratte == offset_schedine_da_controllare) {
-		// Non ci sono schedine da controllare, quinid invia al client il contenuto del proprio file vincite
+		// Non ci sono schedine da controllare, quinid invia al client il contenuto del proprio registro vincite
 		return inviaFileVincite(socket, user);
 	}
 	
-	// Apertura in lettura come file di testo
-	file_schedine = fopen(indirizzo_file_schedine, "r");
-	if (!file_schedine) {
-		perror("Impossibile aprire file schedine");
+	// Lettura di tutte le schedine ancora in gioco
+	if (leggiRegistroSchedine(user, offset_schedine_da_controllare, offset_schedine_non_estratte, &registro, &quanti_byte) < 0) {
+		fprintf(stderr, "Impossibile leggere registro schedine di %s\n", user);
 		inviaErrore(socket, ERRORE_INTERNO_SERVER);
 		return -1;
 	}
 	
-	fseek(file_schedine, offset_schedine_da_controllare, SEEK_SET);
-	
-	// Estrazione da file di tutte le schedine
-	while (ftell(file_schedine) < offset_schedine_non_estratte) {
+	while (byte_letti < quanti_byte) {
 		char buffer[BUFFER_SIZE];
-		int start_buffer, end_buffer, quanti_byte; // variabili per calcolare la dimensione del buffer
+		uint32_t start_buffer, end_buffer, offset = byte_letti;
+		int quanti_byte_schedina;
 		struct schedina_list* temp;
 		long int temp_time;
 		
 		// Estrai schedina
-		fscanf(file_schedine, "%ld %n%[^|]%n|", &temp_time, &start_buffer, buffer, &end_buffer);
+		byte_letti = leggiRecordSchedina(registro, quanti_byte, offset, &temp_time, &start_buffer, &end_buffer);
+		if (byte_letti == 0 || end_buffer - start_buffer >= sizeof(buffer)) {
+			break;
+		}
+		memcpy(buffer, registro + start_buffer, end_buffer - start_buffer);
+		buffer[end_buffer - start_buffer] = '\0';
 		
 		temp = malloc(sizeof(struct schedina_list));
 		if (!temp) {
 			perror("Memoria esaurita");
-			fclose(file_schedine);
+			free(registro);
 			inviaErrore(socket, ERRORE_INTERNO_SERVER);
 			return -1;
 		}
 		
-		quanti_byte = end_buffer - start_buffer;
+		quanti_byte_schedina = end_buffer - start_buffer;
 		
 		// Inizializza nuvo elemento schedina_list
-		temp->s = deserializza_schedina_txt(buffer, &quanti_byte);
+		temp->s = deserializza_schedina_txt(buffer, &quanti_byte_schedina);
 		temp->timestamp = (time_t)temp_time;
+		temp->offset = offset_schedine_da_controllare + offset;
+		temp->estrazioni_coperte = 0;
+		temp->conclusa = 0;
 		temp->next = NULL;
 		
 		// Inserisci in coda (puntatore_schedina punta all'ultimo elemento della lista schedine)
@@ -1290,29 +1964,480 @@ int eseguiVediVincite (const int socket, const char* user)
 		}
 		puntatore_schedina = temp;
 	}
+	free(registro);
 	
-	fclose(file_schedine);
+	// Controlla le schedine in gioco e memorizza le vincite nel registro.
+	// L'offset della prima schedina da controllare avanza fino alla prima schedina che partecipa ancora ad estrazioni future
+	// (le schedine valide per piu' estrazioni e gli abbonamenti restano nella sezione da controllare)
+	offset_schedine_da_controllare = convalidaSchedineEstratte(schedine, user, quante_estrazioni, offset_schedine_non_estratte);
 	
-	// Controlla le schedine estratte e memorizza le vincite su file
-	convalidaSchedineEstratte(schedine, user);
+	if (impostaInizioDaControllare(user, offset_schedine_da_controllare) < 0) {
+		fprintf(stderr, "Impossibile aggiornare registro schedine di %s\n", user);
+	}
 	
 	// Distruzione schedine dala memoria centrale
 	while (schedine != NULL) {
 		struct schedina_list* s = schedine;
 		schedine = schedine->next;
+		free(s->s.ruote);
+		free(s->s.numeriGiocati);
+		free(s->s.importi);
 		free(s);
 	}
 	
-	// Invia al client il contenuto del proprio file vincite
+	// Invia al client il contenuto del proprio registro vincite
 	return inviaFileVincite(socket, user);
 }
 
-
-
-/* Gestisce le richieste inviate da una client
+/* Esegui il comando !vedi_riepilogo
+ * Invia al client il riepilogo delle vincite gia' registrate, leggendo un unico record a dimensione fissa
+ * (le schedine non ancora controllate con !vedi_vincite non sono incluse nel riepilogo).
  * 
- *  FORMATO DEI MESSAGGI RICEVUTI, se il client ha gia' effettuto il login
- * ----------------------------------------------------------------
+ * Il messaggio inviato al client (in formato testuale) e' il seguente
+ *		--------------------------------------------------------------------------------------
+ *		| totali per tipo di puntata (QUANTI_TIPI_PREMIO double) | quante schedine vincenti |
+ *		| vincita migliore (double) | timestamp vincita migliore | '\\0' |
+ *		--------------------------------------------------------------------------------------
+ * 
+ * @socket descrittore del socket su cui avviene la comuncazione client-server
+ * @user nome dell'utente
+ * 
+ * @return 1 se il comando ha successo, -1 in caso di errore interno
+ */
+int eseguiVediRiepilogo (const int socket, const char* user)
+{
+	int ret, i, char_scritti;
+	struct riepilogo_vincite riepilogo;
+	char messaggio_al_client[BUFFER_SIZE];
+	size_t contatore = 0;
+
+	ret = leggiRiepilogoVincite(user, &riepilogo);
+	if (ret < 0) {
+		inviaErrore(socket, ERRORE_INTERNO_SERVER);
+		return -1;
+	}
+	
+	// Serializzazione del riepilogo
+	for (i = 0; i < QUANTI_TIPI_PREMIO; ++i) {
+		sprintf(messaggio_al_client + contatore, "%.2lf %n", riepilogo.totale_vincite[i], &char_scritti);
+		contatore += char_scritti;
+	}
+	sprintf(messaggio_al_client + contatore, "%u %.2lf %ld%n", riepilogo.quante_schedine_vincenti,
+			riepilogo.vincita_migliore, (long int)riepilogo.timestamp_vincita_migliore, &char_scritti);
+	contatore += char_scritti;
+	
+	return inviaDati(socket, messaggio_al_client, (uint16_t)(contatore + 1));
+}
+
+/* Esegui il comando !quota
+ * Invia al client la quota di una schedina senza registrarla: probabilita' degli esiti su una ruota
+ * e vincite attese, calcolate dalle tabelle della distribuzione ipergeometrica (vedi lotto_premi.h).
+ * Il comando non richiede il login.
+ * 
+ * @socket descrittore del socket su cui avviene la comuncazione client-server
+ * @msg schedina serializzata (stringa + '\0')
+ * @msg_len lunghezza di msg
+ * 
+ * Il messaggio inviato al client (in formato testuale) e' il seguente
+ *		------------------------------------------------------------------------------------------
+ *		| importo totale | per ogni k da 0 a QUANTI_NUMERI_ESTRATTI: probabilita' di k numeri     |
+ *		| comuni su una ruota e vincita su una ruota | quanti importi | per ogni tipo di puntata: |
+ *		| probabilita' di vincerla su una ruota | vincita attesa per ruota | vincita attesa | '\0' |
+ *		------------------------------------------------------------------------------------------
+ * 
+ * @return 1 se il comando ha successo, 0 se la schedina non e' valida, -1 in caso di errore
+ */
+int eseguiQuota (const int socket, const char* msg, const size_t msg_len)
+{
+	int ruote[QUANTE_RUOTE], numeri[QUANTITA_MASSIMA_NUMERI_SISTEMA];
+	double importi[QUANTI_TIPI_PREMIO];
+	struct schedina sched = {ruote, 0, numeri, 0, importi, 0};
+	struct quota quota;
+	char messaggio_al_client[BUFFER_SIZE];
+	int i, contatore;
+	
+	if (!leggiSchedinaRicevuta(msg, msg_len, &sched)) {
+		return (inviaErrore(socket, MESSAGGIO_NON_COMPRENSIBILE) < 0) ? -1 : 0;
+	}
+	
+	calcolaQuota(&sched, &quota);
+	
+	contatore = sprintf(messaggio_al_client, "%.2lf ", quota.importo);
+	for (i = 0; i <= QUANTI_NUMERI_ESTRATTI; ++i) {
+		contatore += sprintf(messaggio_al_client + contatore, "%.10e %.2lf ", quota.probabilita_comuni[i], quota.vincita_comuni[i]);
+	}
+	contatore += sprintf(messaggio_al_client + contatore, "%i ", sched.quantiImporti);
+	for (i = 0; i < sched.quantiImporti; ++i) {
+		contatore += sprintf(messaggio_al_client + contatore, "%.10e ", quota.probabilita_premio[i]);
+	}
+	contatore += sprintf(messaggio_al_client + contatore, "%.6lf %.6lf", quota.vincita_attesa_ruota, quota.vincita_attesa);
+	
+	return inviaDati(socket, messaggio_al_client, (uint16_t)(contatore + 1));
+}
+
+/* Esegui il comando !replay <da> <a> <schedina>
+ * Gioca la schedina su ogni estrazione effettuata tra i timestamp <da> e <a> (inclusi), come se fosse stata
+ * registrata prima di ognuna: il numero delle estrazioni e l'eventuale abbonamento della schedina vengono ignorati.
+ * Le vincite su una ruota dipendono solo da quanti numeri giocati sono stati estratti, percio' vengono calcolate
+ * una volta per ognuno dei casi possibili (da 0 a QUANTI_NUMERI_ESTRATTI numeri comuni); per ogni estrazione
+ * basta poi contare i numeri comuni con l'intersezione delle maschere dei numeri (vedi lotto_premi.h).
+ * Gli estremi dell'intervallo vengono cercati con cercaEstrazione(...) e le estrazioni dell'intervallo vengono
+ * scorse in sequenza sul file delle estrazioni mappato in memoria.
+ * 
+ * @socket descrittore del socket su cui avviene la comuncazione client-server
+ * @msg indirizzo al messaggio applicativo nel seguente formato:
+ *		----------------------------------------------------------------------------------------
+ *		| session_id (stringa + '\\0') | da (uint32_t) | a (uint32_t) | schedina (serializzata) |
+ *		----------------------------------------------------------------------------------------
+ * @msg_len lunghezza di msg
+ * 
+ * Il messaggio inviato al client e' in formato testuale:
+ *		-----------------------------------------------------------------------------------------------
+ *		| estrazioni giocate | importo giocato | vincita totale | estrazioni vincenti | quanti importi |
+ *		| per ogni tipo di puntata: estrazioni vincenti e vincita totale                              |
+ *		| quante estrazioni migliori | per ognuna: timestamp e vincita | '\0'                         |
+ *		-----------------------------------------------------------------------------------------------
+ * 
+ * @return 1 se il comando ha successo, 0 se fallisce per colpa del client, -1 in caso di errore interno
+ */
+int eseguiReplay (const int socket, const char* msg, const size_t msg_len)
+{
+	int ruote[QUANTE_RUOTE], numeri[QUANTITA_MASSIMA_NUMERI_SISTEMA];
+	double importi[QUANTI_TIPI_PREMIO];
+	struct schedina sched = {ruote, 0, numeri, 0, importi, 0};
+	struct insieme_numeri giocati;
+	const size_t inizio_schedina = LUNGHEZZA_SESSION_ID + 1 + 2 * sizeof(uint32_t);
+	uint32_t da, a;
+	int ret, i, j, k;
+	
+	// Vincite su una ruota per ogni quantita' di numeri comuni
+	double vincite_comuni[QUANTI_NUMERI_ESTRATTI + 1][QUANTI_TIPI_PREMIO];
+	int quante_vincite_comuni[QUANTI_NUMERI_ESTRATTI + 1];
+	
+	// Risultati
+	uint32_t estrazioni_vincenti = 0, vincenti_premio[QUANTI_TIPI_PREMIO];
+	double vincita_totale = 0, vincita_premio[QUANTI_TIPI_PREMIO];
+	int64_t timestamp_migliori[ESTRAZIONI_MIGLIORI_REPLAY];
+	double vincita_migliori[ESTRAZIONI_MIGLIORI_REPLAY];
+	int quante_migliori = 0;
+	
+	// File delle estrazioni, mappato in memoria
+	FILE* file_estrazione;
+	struct stat info;
+	long quante_estrazioni, prima, ultima, estrazione;
+	const uint8_t* storico = NULL;
+	
+	char messaggio_al_client[BUFFER_SIZE];
+	int contatore;
+	
+	if (msg_len <= inizio_schedina || !leggiSchedinaRicevuta(msg + inizio_schedina, msg_len - inizio_schedina, &sched)) {
+		ret = inviaErrore(socket, MESSAGGIO_NON_COMPRENSIBILE);
+		return (ret == -1) ? -1 : 0;
+	}
+	memcpy(&da, msg + LUNGHEZZA_SESSION_ID + 1, sizeof(da));
+	memcpy(&a, msg + LUNGHEZZA_SESSION_ID + 1 + sizeof(da), sizeof(a));
+	da = ntohl(da);
+	a = ntohl(a);
+	if (da > a) {
+		ret = inviaErrore(socket, MESSAGGIO_NON_COMPRENSIBILE);
+		return (ret == -1) ? -1 : 0;
+	}
+	
+	file_estrazione = fopen(FILE_ESTRAZIONI, "rb");
+	if (!file_estrazione || fstat(fileno(file_estrazione), &info) < 0) {
+		if (file_estrazione) fclose(file_estrazione);
+		ret = inviaErrore(socket, ERRORE_INTERNO_SERVER);
+		return -1;
+	}
+	quante_estrazioni = (long)(info.st_size / LUNGHEZZA_BLOCCO_ESTRAZIONE);
+	
+	// Estremi dell'intervallo: [prima, ultima)
+	prima = cercaEstrazione(file_estrazione, quante_estrazioni, (time_t)da);
+	ultima = (prima < 0) ? -1 : cercaEstrazione(file_estrazione, quante_estrazioni, (time_t)a + 1);
+	if (prima >= 0 && ultima > prima) {
+		storico = mmap(NULL, (size_t)ultima * LUNGHEZZA_BLOCCO_ESTRAZIONE, PROT_READ, MAP_PRIVATE, fileno(file_estrazione), 0);
+		if (storico == MAP_FAILED) {
+			storico = NULL;
+			ultima = -1;
+		}
+		else {
+			madvise((void*)storico, (size_t)ultima * LUNGHEZZA_BLOCCO_ESTRAZIONE, MADV_SEQUENTIAL);
+		}
+	}
+	fclose(file_estrazione);
+	if (prima < 0 || ultima < 0) {
+		ret = inviaErrore(socket, ERRORE_INTERNO_SERVER);
+		return -1;
+	}
+	if (prima == ultima) {
+		ret = inviaErrore(socket, FILE_VUOTO);
+		return (ret == -1) ? -1 : 1;
+	}
+	
+	// Tabella delle vincite per numeri comuni
+	for (k = 0; k <= QUANTI_NUMERI_ESTRATTI; ++k) {
+		quante_vincite_comuni[k] = calcolaVinciteRuota(&sched, k, vincite_comuni[k]);
+	}
+	giocati = insiemeNumeri(sched.numeriGiocati, sched.quantiNumeri);
+	memset(vincenti_premio, 0, sizeof(vincenti_premio));
+	memset(vincita_premio, 0, sizeof(vincita_premio));
+	
+	for (estrazione = prima; estrazione < ultima; ++estrazione) {
+		const uint8_t* blocco = storico + estrazione * LUNGHEZZA_BLOCCO_ESTRAZIONE;
+		double vincita_estrazione = 0;
+		int vinto[QUANTI_TIPI_PREMIO] = {0};
+		int64_t timestamp;
+		
+		for (i = 0; i < sched.quanteRuote; ++i) {
+			const uint8_t* estratti_ruota = blocco + sizeof(time_t) + sched.ruote[i] * LUNGHEZZA_ESTRAZIONE_SINGOLA_RUOTA + sizeof(uint8_t);
+			int numeri_estratti[QUANTI_NUMERI_ESTRATTI];
+			
+			for (j = 0; j < QUANTI_NUMERI_ESTRATTI; ++j) {
+				uint32_t numero;
+				
+				memcpy(&numero, estratti_ruota + j * sizeof(uint32_t), sizeof(numero));
+				numeri_estratti[j] = (int)numero;
+			}
+			
+			k = quantiNumeriComuni(giocati, insiemeNumeri(numeri_estratti, QUANTI_NUMERI_ESTRATTI));
+			for (j = 0; j < quante_vincite_comuni[k]; ++j) {
+				vincita_premio[j] += vincite_comuni[k][j];
+				vincita_estrazione += vincite_comuni[k][j];
+				vinto[j] |= (vincite_comuni[k][j] > 0);
+			}
+		}
+		
+		if (vincita_estrazione <= 0) {
+			continue;
+		}
+		estrazioni_vincenti++;
+		vincita_totale += vincita_estrazione;
+		for (j = 0; j < QUANTI_TIPI_PREMIO; ++j) {
+			vincenti_premio[j] += vinto[j];
+		}
+		
+		// Classifica delle estrazioni migliori, in ordine di vincita decrescente
+		if (quante_migliori == ESTRAZIONI_MIGLIORI_REPLAY && vincita_estrazione <= vincita_migliori[quante_migliori - 1]) {
+			continue;
+		}
+		if (quante_migliori < ESTRAZIONI_MIGLIORI_REPLAY) {
+			quante_migliori++;
+		}
+		memcpy(&timestamp, blocco, sizeof(time_t));
+		for (i = quante_migliori - 1; i > 0 && vincita_migliori[i - 1] < vincita_estrazione; --i) {
+			vincita_migliori[i] = vincita_migliori[i - 1];
+			timestamp_migliori[i] = timestamp_migliori[i - 1];
+		}
+		vincita_migliori[i] = vincita_estrazione;
+		timestamp_migliori[i] = timestamp;
+	}
+	munmap((void*)storico, (size_t)ultima * LUNGHEZZA_BLOCCO_ESTRAZIONE);
+	
+	contatore = sprintf(messaggio_al_client, "%lu %.2lf %.2lf %u %i ", (unsigned long)(ultima - prima),
+			importoSchedina(&sched) * (ultima - prima), vincita_totale, estrazioni_vincenti, sched.quantiImporti);
+	for (j = 0; j < sched.quantiImporti; ++j) {
+		contatore += sprintf(messaggio_al_client + contatore, "%u %.2lf ", vincenti_premio[j], vincita_premio[j]);
+	}
+	contatore += sprintf(messaggio_al_client + contatore, "%i", quante_migliori);
+	for (i = 0; i < quante_migliori; ++i) {
+		contatore += sprintf(messaggio_al_client + contatore, " %ld %.2lf", (long)timestamp_migliori[i], vincita_migliori[i]);
+	}
+	
+	return inviaDati(socket, messaggio_al_client, (uint16_t)(contatore + 1));
+}
+
+/* Esegui il comando !vedi_metriche
+ * Invia al client le metriche del server in formato testuale, una per riga nel formato "nome valore".
+ * Le metriche descrivono lo stato interno del server (limitatore, IP bloccati, sessioni, registri, esposizione),
+ * percio' il comando e' riservato all'utente UTENTE_AMMINISTRATORE, come !vedi_esposizione
+ * 
+ * @socket descrittore del socket su cui avviene la comuncazione client-server
+ * @user nome dell'utente
+ * 
+ * @return 1 se il comando ha successo, 0 se l'utente non e' l'amministratore, -1 in caso di errore
+ */
+int eseguiVediMetriche (const int socket, const char* user)
+{
+	char messaggio_al_client[BUFFER_SIZE * 4];
+	int contatore = 0, ret;
+	
+	if (strcmp(user, UTENTE_AMMINISTRATORE) != 0) {
+		ret = inviaErrore(socket, PERMESSO_NEGATO);
+		return (ret < 0) ? -1 : 0;
+	}
+	
+	contatore += scriviMetricheUtenti(messaggio_al_client + contatore, sizeof(messaggio_al_client) - contatore);
+	contatore += scriviMetricheBloccati(messaggio_al_client + contatore, sizeof(messaggio_al_client) - contatore);
+	contatore += scriviMetricheLimitatore(messaggio_al_client + contatore, sizeof(messaggio_al_client) - contatore);
+	contatore += scriviMetricheSessioni(messaggio_al_client + contatore, sizeof(messaggio_al_client) - contatore);
+	contatore += scriviMetrichePianificatore(messaggio_al_client + contatore, sizeof(messaggio_al_client) - contatore);
+	contatore += scriviMetricheGiocateInternate(messaggio_al_client + contatore, sizeof(messaggio_al_client) - contatore);
+	contatore += scriviMetricheEsposizione(messaggio_al_client + contatore, sizeof(messaggio_al_client) - contatore);
+	contatore += scriviMetricheRegistri(messaggio_al_client + contatore, sizeof(messaggio_al_client) - contatore);
+	
+	return inviaDati(socket, messaggio_al_client, (uint16_t)(contatore + 1));
+}
+
+/* Esegui il comando !statistiche <ruota>
+ * Invia al client frequenza e ritardo di ogni numero della ruota e gli ambi usciti piu' spesso,
+ * letti dalle statistiche aggiornate ad ogni estrazione (vedi lotto_statistiche.h): il costo del comando
+ * non dipende dalla lunghezza dello storico. Il comando non richiede il login.
+ * 
+ * @socket descrittore del socket su cui avviene la comuncazione client-server
+ * @msg ruota (uint8_t)
+ * @msg_len lunghezza di msg
+ * 
+ * Il messaggio inviato al client (in formato testuale) e' il seguente
+ *		------------------------------------------------------------------------------------------
+ *		| estrazioni | per ogni numero da 1 a NUMERI_ESTRAIBILI: frequenza e ritardo |           |
+ *		| quanti ambi | per ogni ambo: primo numero, secondo numero e frequenza | '\0'         |
+ *		------------------------------------------------------------------------------------------
+ * 
+ * @return 1 se il comando ha successo, 0 se la ruota non e' valida, -1 in caso di errore
+ */
+int eseguiStatistiche (const int socket, const char* msg, const size_t msg_len)
+{
+	int ret, contatore, i;
+	struct statistiche_ruota statistiche;
+	char messaggio_al_client[BUFFER_SIZE * 2];
+	
+	if (msg_len < sizeof(uint8_t) || leggiStatisticheRuota(*(uint8_t*)msg, &statistiche) < 0) {
+		ret = inviaErrore(socket, MESSAGGIO_NON_COMPRENSIBILE);
+		return (ret < 0) ? -1 : 0;
+	}
+	
+	contatore = sprintf(messaggio_al_client, "%u ", statistiche.estrazioni);
+	for (i = 0; i < NUMERI_ESTRAIBILI; ++i) {
+		contatore += sprintf(messaggio_al_client + contatore, "%u %u ", statistiche.frequenze[i], statistiche.ritardi[i]);
+	}
+	contatore += sprintf(messaggio_al_client + contatore, "%u", statistiche.quanti_ambi);
+	for (i = 0; i < (int)statistiche.quanti_ambi; ++i) {
+		contatore += sprintf(messaggio_al_client + contatore, " %u %u %u", statistiche.ambi[i].primo,
+				statistiche.ambi[i].secondo, statistiche.ambi[i].frequenza);
+	}
+	
+	return inviaDati(socket, messaggio_al_client, (uint16_t)(contatore + 1));
+}
+
+/* Esegui il comando !vedi_esposizione <ruota> <numero> [<secondo numero>]
+ * Invia al client quanto il banco pagherebbe alla prossima estrazione se sulla ruota venisse estratto il numero
+ * (o l'ambo) richiesto, per le puntate di ESTRATTO e di AMBO (vedi lotto_esposizione.h).
+ * Il comando e' riservato all'utente UTENTE_AMMINISTRATORE.
+ * 
+ * @socket descrittore del socket su cui avviene la comuncazione client-server
+ * @msg indirizzo al messaggio applicativo nel seguente formato:
+ *		-------------------------------------------------------------------------------------------
+ *		| session_id (stringa + '\0') | ruota (uint8_t) | numero (uint32_t) | secondo numero (uint32_t) |
+ *		-------------------------------------------------------------------------------------------
+ *		(secondo numero = 0 per l'esposizione sul solo numero)
+ * @msg_len lunghezza di msg
+ * @user nome dell'utente
+ * 
+ * @return 1 se il comando ha successo, 0 se fallisce per colpa del client, -1 in caso di errore
+ */
+int eseguiVediEsposizione (const int socket, const char* msg, const size_t msg_len, const char* user)
+{
+	int ret;
+	uint8_t ruota;
+	uint32_t primo, secondo;
+	double esposizione;
+	char messaggio_al_client[64];
+	
+	if (strcmp(user, UTENTE_AMMINISTRATORE) != 0) {
+		ret = inviaErrore(socket, PERMESSO_NEGATO);
+		return (ret < 0) ? -1 : 0;
+	}
+	
+	if (msg_len < LUNGHEZZA_SESSION_ID + 1 + sizeof(uint8_t) + 2 * sizeof(uint32_t)) {
+		ret = inviaErrore(socket, MESSAGGIO_NON_COMPRENSIBILE);
+		return (ret < 0) ? -1 : 0;
+	}
+	ruota = *(uint8_t*)(msg + LUNGHEZZA_SESSION_ID + 1);
+	memcpy(&primo, msg + LUNGHEZZA_SESSION_ID + 1 + sizeof(uint8_t), sizeof(primo));
+	memcpy(&secondo, msg + LUNGHEZZA_SESSION_ID + 1 + sizeof(uint8_t) + sizeof(uint32_t), sizeof(secondo));
+	
+	if (esposizioneEstrazione(ruota, (int)ntohl(primo), (int)ntohl(secondo), &esposizione) < 0) {
+		ret = inviaErrore(socket, MESSAGGIO_NON_COMPRENSIBILE);
+		return (ret < 0) ? -1 : 0;
+	}
+	
+	ret = sprintf(messaggio_al_client, "%.2lf", esposizione);
+	return inviaDati(socket, messaggio_al_client, (uint16_t)(ret + 1));
+}
+
+/* Esegui il comando !imposta_periodo <periodo>
+ * Cambia il periodo delle estrazioni senza riavviare il server: il nuovo periodo viene applicato
+ * dal processo principale, che riarma il timer del pianificatore (vedi lotto_pianificatore.h).
+ * Il comando e' riservato all'utente UTENTE_AMMINISTRATORE.
+ * 
+ * @socket descrittore del socket su cui avviene la comuncazione client-server
+ * @msg indirizzo al messaggio applicativo nel seguente formato:
+ *		---------------------------------------------------------
+ *		| session_id (stringa + '\0') | periodo in secondi (uint32_t) |
+ *		---------------------------------------------------------
+ * @msg_len lunghezza di msg
+ * @user nome dell'utente
+ * 
+ * @return 1 se il comando ha successo, 0 se fallisce per colpa del client, -1 in caso di errore
+ */
+int eseguiImpostaPeriodo (const int socket, const char* msg, const size_t msg_len, const char* user)
+{
+	int ret;
+	uint32_t periodo;
+	char messaggio_al_client[3];
+	
+	if (strcmp(user, UTENTE_AMMINISTRATORE) != 0) {
+		ret = inviaErrore(socket, PERMESSO_NEGATO);
+		return (ret < 0) ? -1 : 0;
+	}
+	
+	if (msg_len < LUNGHEZZA_SESSION_ID + 1 + sizeof(uint32_t)) {
+		ret = inviaErrore(socket, MESSAGGIO_NON_COMPRENSIBILE);
+		return (ret < 0) ? -1 : 0;
+	}
+	memcpy(&periodo, msg + LUNGHEZZA_SESSION_ID + 1, sizeof(periodo));
+	periodo = ntohl(periodo);
+	
+	if (periodo == 0) {
+		ret = inviaErrore(socket, MESSAGGIO_NON_COMPRENSIBILE);
+		return (ret < 0) ? -1 : 0;
+	}
+	if (richiediPeriodoPianificatore(periodo) < 0) {
+		ret = inviaErrore(socket, ERRORE_INTERNO_SERVER);
+		return (ret < 0) ? -1 : 0;
+	}
+	
+	strcpy(messaggio_al_client, "OK");
+	return (inviaDati(socket, messaggio_al_client, 3) < 0) ? -1 : 1;
+}
+
+/* Calcola il numero di gettoni del limitatore consumati da una richiesta.
+ * Tutti i comandi costano un gettone, tranne vedi_estrazione il cui costo cresce con il numero <n> di estrazioni richieste
+ * 
+ * @tipoRichiesta codice del comando
+ * @msg messaggio ricevuto, senza il byte del codice
+ * @msg_len lunghezza di msg
+ * 
+ * @return costo della richiesta
+ */
+double costoRichiesta (const uint8_t tipoRichiesta, const char* msg, const size_t msg_len)
+{
+	uint32_t n;
+	
+	if (tipoRichiesta != VEDI_ESTRAZIONE || msg_len < LUNGHEZZA_SESSION_ID + 1 + sizeof(uint32_t)) {
+		return 1;
+	}
+	
+	memcpy(&n, msg + LUNGHEZZA_SESSION_ID + 1, sizeof(n));
+	n = ntohl(n);
+	
+	return 1 + (double)(n / ESTRAZIONI_PER_GETTONE);
+}
+
+/* Gestisce le richieste inviate da una client
+ * 
+ *  FORMATO DEI MESSAGGI RICEVUTI, se il client ha gia' effettuto il login
+ * ----------------------------------------------------------------
  * |  CODICE (1 byte)  |  SESSION_ID (LUNGHEZZA_SESSION_ID byte)  |
  * ----------------------------------------------------------------
  * |      ATTRIBUTI MESSAGGIO (opzionali e variabili)             |
@@ -1335,6 +2460,7 @@ void gestisciRichiesteClient (const int socket, const struct sockaddr_in clientA
 	char sessionId[LUNGHEZZA_SESSION_ID + 1],
 		presentationClientAddress[INET_ADDRSTRLEN]; // IP del client in formato presentazione
 	char* user = NULL;	// username dell'utente
+	uint32_t utenteSessione;	// identificativo dell'utente nell'archivio delle sessioni
 	uint8_t accessiFalliti = 0;
 	
 	inet_ntop(AF_INET, &clientAddress.sin_addr.s_addr, presentationClientAddress, sizeof(presentationClientAddress));
@@ -1360,8 +2486,21 @@ void gestisciRichiesteClient (const int socket, const struct sockaddr_in clientA
 		// Estraggo byte d'intestazione
 		tipoRichiesta = (uint8_t)buffer[0];
 		
+		// Il client ha superato il limite di richieste per questo tipo di comando
+		if (!richiestaConsentita(clientAddress.sin_addr.s_addr, tipoRichiesta, costoRichiesta(tipoRichiesta, buffer + 1, len - 1))) {
+			printf("Client %s, socket %d: richiesta rifiutata dal limitatore\n", presentationClientAddress, socket);
+			fflush(stdout);
+			
+			ret = inviaErrore(socket, RICHIESTE_ECCESSIVE);
+			if (ret < 0) {
+				break;
+			}
+			continue;
+		}
+		
 		// L'utente non e' loggato e tenta di eseguire azioni subordinate al login.
-		if (!loggato && tipoRichiesta != SIGNUP && tipoRichiesta != LOGIN) {
+		if (!loggato && tipoRichiesta != SIGNUP && tipoRichiesta != LOGIN && tipoRichiesta != RIPRENDI_SESSIONE
+				&& tipoRichiesta != QUOTA && tipoRichiesta != STATISTICHE) {
 			ret = inviaErrore(socket, LOGIN_NON_EFFETTUATO);
 			if (ret < 0) {
 				break;
@@ -1369,9 +2508,10 @@ void gestisciRichiesteClient (const int socket, const struct sockaddr_in clientA
 			continue;
 		}
 		
-		if (loggato) {
-			// L'utente e' gia' loggato e cerca di eseguire azioni di login o signup
-			if (tipoRichiesta == SIGNUP || tipoRichiesta == LOGIN) {
+		// I comandi quota e statistiche non richiedono il login, percio' il messaggio non contiene il session id
+		if (loggato && tipoRichiesta != QUOTA && tipoRichiesta != STATISTICHE) {
+			// L'utente e' gia' loggato e cerca di eseguire azioni di login, signup o di riprendere una sessione
+			if (tipoRichiesta == SIGNUP || tipoRichiesta == LOGIN || tipoRichiesta == RIPRENDI_SESSIONE) {
 				ret = inviaErrore(socket, LOGIN_GIA_EFFETTUATO);
 				if (ret < 0) {
 					break;
@@ -1379,8 +2519,14 @@ void gestisciRichiesteClient (const int socket, const struct sockaddr_in clientA
 				continue;
 			}
 			
-			// Confronto session_id memorizzato e inviato
-			if(strncmp(sessionId, buffer+1, LUNGHEZZA_SESSION_ID) != 0) {
+			// Confronto session_id memorizzato e inviato, poi validazione nell'archivio delle sessioni.
+			// Se la sessione e' scaduta la connessione torna nello stato non loggato
+			if (strncmp(sessionId, buffer+1, LUNGHEZZA_SESSION_ID) != 0 ||
+					!validaSessione(buffer + 1, time(NULL), &utenteSessione)) {
+				loggato = 0;
+				free(user);
+				user = NULL;
+				
 				ret = inviaErrore(socket, SESSION_ID_ERRATO); 
 				if (ret < 0) {
 					break;
@@ -1408,16 +2554,30 @@ void gestisciRichiesteClient (const int socket, const struct sockaddr_in clientA
 				printf("Client %s, socket %d: login %s\n", presentationClientAddress, socket, (loggato) ? "completato" : "fallito");
 				break;
 			
+			case RIPRENDI_SESSIONE:
+				printf("Client %s, socket %d: riprendi_sessione iniziata\n", presentationClientAddress, socket);
+				fflush(stdout);
+				
+				ret = eseguiRiprendiSessione(socket, buffer + 1, len - 1, &user, sessionId);
+				if (ret < 0) {
+					goto chiusura;
+				}
+				
+				loggato = ret;
+				printf("Client %s, socket %d: riprendi_sessione %s\n", presentationClientAddress, socket, (loggato) ? "completata" : "fallita");
+				fflush(stdout);
+				break;
+			
 			case SIGNUP:
 				printf("Client %s, socket %d: signup iniziata\n", presentationClientAddress, socket);
 				fflush(stdout);
 				
-				ret = effettuaSignup(socket, presentationClientAddress, buffer + 1, len - 1);
+				ret = effettuaSignup(socket, presentationClientAddress, clientAddress.sin_addr.s_addr, buffer + 1, len - 1);
 				if (ret < 0) {
 					goto chiusura;
 				}
 				
-				printf("Client %s, socket %d: signup completata\n", presentationClientAddress, socket);
+				printf("Client %s, socket %d: signup %s\n", presentationClientAddress, socket, (ret == 1) ? "completata" : "fallita");
 				fflush(stdout);
 				break;
 			
@@ -1425,7 +2585,7 @@ void gestisciRichiesteClient (const int socket, const struct sockaddr_in clientA
 				printf("Client %s, socket %d: invia_giocata iniziata\n", presentationClientAddress, socket);
 				fflush(stdout);
 				
-				eseguiInviaGiocata(socket, buffer + 1, len - 1, user);
+				ret = eseguiInviaGiocata(socket, buffer + 1, len - 1, user);
 				if (ret < 0) goto chiusura;
 				
 				printf("Client %s, socket %d: invia_giocata ", presentationClientAddress, socket);
@@ -1434,7 +2594,7 @@ void gestisciRichiesteClient (const int socket, const struct sockaddr_in clientA
 				fflush(stdout);
 
 				break;
-				
+			
 			case VEDI_GIOCATE:
 				printf("Client %s, socket %d: vedi_giocate iniziata\n", presentationClientAddress, socket);
 				fflush(stdout);
@@ -1448,7 +2608,7 @@ void gestisciRichiesteClient (const int socket, const struct sockaddr_in clientA
 				fflush(stdout);
 				
 				break;
-				
+			
 			case VEDI_ESTRAZIONE:
 				printf("Client %s, socket %d: vedi_estrazione iniziata\n", presentationClientAddress, socket);
 				fflush(stdout);
@@ -1462,7 +2622,20 @@ void gestisciRichiesteClient (const int socket, const struct sockaddr_in clientA
 				else printf("fallita\n");
 				fflush(stdout);
 				break;
+			
+			case CERCA_ESTRAZIONI:
+				printf("Client %s, socket %d: cerca_estrazioni iniziata\n", presentationClientAddress, socket);
+				fflush(stdout);
+				
+				ret = eseguiCercaEstrazioni(socket, buffer + 1, len - 1);
+				if (ret < 0) goto chiusura;
 				
+				printf("Client %s, socket %d: cerca_estrazioni ", presentationClientAddress, socket);
+				if (ret > 0) printf("completata\n");
+				else printf("fallita\n");
+				fflush(stdout);
+				break;
+			
 			case VEDI_VINCITE:
 				printf("Client %s, socket %d: vedi_vincite iniziata\n", presentationClientAddress, socket);
 				fflush(stdout);
@@ -1477,6 +2650,67 @@ void gestisciRichiesteClient (const int socket, const struct sockaddr_in clientA
 				fflush(stdout);
 				break;
 			
+			case VEDI_RIEPILOGO:
+				printf("Client %s, socket %d: vedi_riepilogo iniziata\n", presentationClientAddress, socket);
+				fflush(stdout);
+				
+				ret = eseguiVediRiepilogo(socket, user);
+				
+				if (ret < 0) goto chiusura;
+				
+				printf("Client %s, socket %d: vedi_riepilogo completata\n", presentationClientAddress, socket);
+				fflush(stdout);
+				break;
+			
+			case VEDI_METRICHE:
+				ret = eseguiVediMetriche(socket, user);
+				if (ret < 0) goto chiusura;
+				break;
+			
+			case QUOTA:
+				ret = eseguiQuota(socket, buffer + 1, len - 1);
+				if (ret < 0) goto chiusura;
+				break;
+			
+			case ANNULLA_ABBONAMENTO:
+				printf("Client %s, socket %d: annulla_abbonamento iniziata\n", presentationClientAddress, socket);
+				fflush(stdout);
+				
+				ret = eseguiAnnullaAbbonamento(socket, buffer + 1, len - 1, user);
+				if (ret < 0) goto chiusura;
+				
+				printf("Client %s, socket %d: annulla_abbonamento ", presentationClientAddress, socket);
+				if (ret > 0) printf("completata\n");
+				else printf("fallita\n");
+				fflush(stdout);
+				break;
+			
+			case VEDI_ESPOSIZIONE:
+				ret = eseguiVediEsposizione(socket, buffer + 1, len - 1, user);
+				if (ret < 0) goto chiusura;
+				break;
+			
+			case STATISTICHE:
+				ret = eseguiStatistiche(socket, buffer + 1, len - 1);
+				if (ret < 0) goto chiusura;
+				break;
+			
+			case REPLAY:
+				ret = eseguiReplay(socket, buffer + 1, len - 1);
+				if (ret < 0) goto chiusura;
+				break;
+			
+			case IMPOSTA_PERIODO:
+				printf("Client %s, socket %d: imposta_periodo iniziata\n", presentationClientAddress, socket);
+				fflush(stdout);
+				
+				ret = eseguiImpostaPeriodo(socket, buffer + 1, len - 1, user);
+				if (ret < 0) goto chiusura;
+				
+				printf("Client %s, socket %d: imposta_periodo %s\n", presentationClientAddress, socket, (ret > 0) ? "completata" : "fallita");
+				fflush(stdout);
+				break;
+		
 		}
 	}
 	
@@ -1516,61 +2750,380 @@ void risvegliaProcesso (int segnale) {
 	return;
 }
 
-/* Aggiorna gli header di tutte le schedine, dando per assunto come ipotesi iniziale 
- * che e' stata appena effettuata l'estrazione
+/* Legge per intero un file di registro nel vecchio formato per utente
  * 
- * @return -1 in caso di fallimento, 1 altrimenti
+ * @indirizzo_file percorso del file
+ * @lunghezza puntatore in cui scrivere la lunghezza del file
+ * 
+ * @return contenuto del file (allocato dinamicamente e seguito da un terminatore), NULL se il file non esiste o in caso di errore
  */
-int aggiornaHeaderSchedine ()
+char* leggiVecchioRegistro (const char* indirizzo_file, uint32_t* lunghezza)
 {
-	struct dirent* de_files;	// puntatore alle directory entry (ovvero i file contenuti) della cartella files
-	DIR* dr_files;				// puntatore alla directory files
+	FILE* file;
+	struct stat info;
+	char* contenuto;
 	
-	// Apre la cartella che contiene i registri
-	dr_files = opendir(CARTELLA_FILES); 
-	if (!dr_files) { 
-		perror("Impossibile aprire la directory CARTELLA_FILES"); 
-		return -1; 
-	} 
-
-	while ((de_files = readdir(dr_files)) != NULL) {
+	file = fopen(indirizzo_file, "rb");
+	if (!file) {
+		return NULL;
+	}
+	if (fstat(fileno(file), &info) < 0 || (contenuto = malloc(info.st_size + 1)) == NULL) {
+		fclose(file);
+		return NULL;
+	}
+	
+	*lunghezza = (uint32_t)fread(contenuto, 1, info.st_size, file);
+	contenuto[*lunghezza] = '\0';
+	fclose(file);
+	return contenuto;
+}
+
+/* Legge per intero un file di registro nel vecchio formato di un utente, cercandolo prima direttamente
+ * in CARTELLA_FILES e poi nella sua sottocartella (una migrazione interrotta puo' aver spostato
+ * solo alcuni dei file dell'utente)
+ * 
+ * @utente username dell'utente
+ * @suffisso suffisso del file
+ * @lunghezza puntatore in cui scrivere la lunghezza del file
+ * 
+ * @return contenuto del file (allocato dinamicamente e seguito da un terminatore), NULL se il file non esiste o in caso di errore
+ */
+char* leggiVecchioRegistroUtente (const char* utente, const char* suffisso, uint32_t* lunghezza)
+{
+	char indirizzo_file[512];
+	char* contenuto = NULL;
+	
+	if (snprintf(indirizzo_file, sizeof(indirizzo_file), "%s/%s%s", CARTELLA_FILES, utente, suffisso) < (int)sizeof(indirizzo_file)) {
+		contenuto = leggiVecchioRegistro(indirizzo_file, lunghezza);
+	}
+	if (!contenuto && percorsoFileUtente(indirizzo_file, sizeof(indirizzo_file), CARTELLA_FILES, utente, suffisso) > 0) {
+		contenuto = leggiVecchioRegistro(indirizzo_file, lunghezza);
+	}
+	return contenuto;
+}
+
+/* Importa nei segmenti i vecchi file di registro per utente contenuti in una cartella: CARTELLA_FILES
+ * oppure una sua sottocartella (vedi percorsoFileUtente(...)). I record delle schedine mantengono lo stesso offset che avevano nel file,
+ * percio' i due campi dello header diventano lo stato del registro senza conversioni.
+ * I vecchi file non vengono modificati.
+ * L'importazione puo' essere ripetuta dopo un'interruzione: le schedine riprendono dalla fine del registro
+ * gia' importato, mentre vincite, cursore e riepilogo vengono importati solo se il registro non li contiene ancora
+ * 
+ * @cartella cartella da esplorare
+ * 
+ * @return numero dei registri importati, -1 in caso di fallimento
+ */
+int importaRegistriCartella (const char* cartella)
+{
+	struct dirent* de_files;	// puntatore alle directory entry (ovvero i file contenuti) della sottocartella
+	DIR* dr_files;				// puntatore alla sottocartella
+	size_t lunghezza_suffisso = strlen(SUFFISSO_SCHEDINE_UTENTE);
+	int importati = 0;
+	
+	dr_files = opendir(cartella);
+	if (!dr_files) {
+		return (errno == ENOENT || errno == ENOTDIR) ? 0 : -1;
+	}
+	
+	while ((de_files = readdir(dr_files)) != NULL) {
+		char utente[256], indirizzo_file[512];
+		size_t lunghezza_nome = strlen(de_files->d_name);
+		uint32_t header[2], quanti_byte, offset;
+		struct riepilogo_vincite riepilogo;
+		struct stato_registro stato;
+		char* registro;
 		
 		// Esplora tutta la cartella alla ricerca dei registri delle schedine
-		// (riconoscibili dal suffisso "_schedine.bin"
-		if(strcmp(de_files->d_name + strlen(de_files->d_name) - 13, "_schedine.bin") == 0) {
-			
-			// Abbiamo trovato il file delle schedine di un utente!
-			// Bisogna modificare lo header in modo che punti alla fine del file
-			// (non esiste alcuna schedina che NON abbia subito un'estrazione)
-			uint32_t new_header;
-			FILE* file_schedina;
-			char indirizzo_file[512];
+		// (riconoscibili dal suffisso SUFFISSO_SCHEDINE_UTENTE)
+		if (lunghezza_nome <= lunghezza_suffisso || lunghezza_nome - lunghezza_suffisso >= sizeof(utente)
+				|| strcmp(de_files->d_name + lunghezza_nome - lunghezza_suffisso, SUFFISSO_SCHEDINE_UTENTE) != 0) {
+			continue;
+		}
+		snprintf(utente, sizeof(utente), "%.*s", (int)(lunghezza_nome - lunghezza_suffisso), de_files->d_name);
+		
+		snprintf(indirizzo_file, sizeof(indirizzo_file), "%s/%s", cartella, de_files->d_name);
+		registro = leggiVecchioRegistro(indirizzo_file, &quanti_byte);
+		if (!registro || quanti_byte < LUNGHEZZA_HEADER_SCHEDINE_BIN || posizioneUtente(utente) < 0) {
+			free(registro);
+			continue;
+		}
+		memcpy(header, registro, sizeof(header));
+		statoRegistro(utente, &stato);
+		
+		// Schedine: quelle prima del primo campo dello header sono gia' state estratte.
+		// Quelle gia' importate (fino alla fine del registro) vengono saltate
+		offset = (stato.fine > LUNGHEZZA_HEADER_SCHEDINE_BIN) ? stato.fine : LUNGHEZZA_HEADER_SCHEDINE_BIN;
+		while (offset < quanti_byte) {
+			uint32_t prossimo, inizio, fine;
+			long int temp;
 			
-			sprintf(indirizzo_file, "%s/%s", CARTELLA_FILES, de_files->d_name);
-			file_schedina = fopen(indirizzo_file, "rb+");
-			if (!file_schedina) {
-				perror("Impossibile aprire file schedina");
+			prossimo = leggiRecordSchedina(registro, quanti_byte, offset, &temp, &inizio, &fine);
+			if (prossimo == 0) {
+				break;
+			}
+			if (importaSchedinaRegistro(utente, registro + offset, prossimo - offset, offset < header[0]) < 0) {
+				free(registro);
+				closedir(dr_files);
 				return -1;
 			}
-			
-			// Modifica lo header in modo che punti alla fine del file
-			fseek(file_schedina, 0, SEEK_END);
-			new_header = (uint32_t)ftell(file_schedina);
-			
-			fseek(file_schedina, 0, SEEK_SET);			
-			fwrite(&new_header, sizeof(new_header), 1, file_schedina);
-			fclose(file_schedina);
+			offset = prossimo;
+		}
+		free(registro);
+		
+		if (header[1] != LUNGHEZZA_HEADER_SCHEDINE_BIN && stato.inizio_da_controllare == INIZIO_REGISTRO_SCHEDINE) {
+			impostaInizioDaControllare(utente, header[1]);
+		}
+		
+		// Vincite (un solo record: sono gia' state importate se il registro non e' vuoto)
+		if (leggiRegistroVincite(utente, &registro, &quanti_byte) < 0) {
+			closedir(dr_files);
+			return -1;
+		}
+		free(registro);
+		if (quanti_byte == 0) {
+			registro = leggiVecchioRegistroUtente(utente, SUFFISSO_VINCITE_UTENTE, &quanti_byte);
+			if (registro && quanti_byte > 0) {
+				aggiungiVinciteRegistro(utente, registro, quanti_byte);
+			}
+			free(registro);
+		}
+		
+		// Riepilogo (i record incompleti sono nulli)
+		registro = (leggiRiepilogoRegistro(utente, &riepilogo, sizeof(riepilogo)) == 0) ?
+				leggiVecchioRegistroUtente(utente, SUFFISSO_RIEPILOGO_UTENTE, &quanti_byte) : NULL;
+		if (registro && quanti_byte >= LUNGHEZZA_MINIMA_RECORD_RIEPILOGO) {
+			memset(&riepilogo, 0, sizeof(riepilogo));
+			memcpy(&riepilogo, registro, min(quanti_byte, LUNGHEZZA_RECORD_RIEPILOGO));
+			scriviRiepilogoVincite(utente, &riepilogo);
+		}
+		free(registro);
+		
+		importati++;
+	}
+	
+	closedir(dr_files);
+	return importati;
+}
+
+/* Riconosce il nome di una sottocartella dei file per utente (due cifre esadecimali, vedi percorsoFileUtente(...))
+ * 
+ * @nome nome della voce della cartella
+ * 
+ * @return 1 se il nome e' quello di una sottocartella, 0 altrimenti
+ */
+int nomeSottocartellaUtenti (const char* nome)
+{
+	return isxdigit((unsigned char)nome[0]) && isxdigit((unsigned char)nome[1]) && nome[2] == '\0';
+}
+
+/* Importa nei segmenti i vecchi file di registro per utente (%utente%_schedine.bin, %utente%_vincite.txt
+ * e %utente%_riepilogo.bin) senza spostarli: prima quelli rimasti direttamente in CARTELLA_FILES
+ * (disposizione precedente), poi quelli delle sottocartelle. Le sottocartelle vengono elencate con readdir(...),
+ * percio' si esplorano solo quelle che esistono invece di tutte le CARTELLE_PER_LIVELLO * CARTELLE_PER_LIVELLO possibili
+ * 
+ * @return numero dei registri importati, -1 in caso di fallimento
+ */
+int importaVecchiRegistri ()
+{
+	struct dirent* de_primo;
+	struct dirent* de_secondo;
+	DIR* dr_primo;
+	DIR* dr_secondo;
+	char cartella[600];
+	int importati, ret;
+	
+	importati = importaRegistriCartella(CARTELLA_FILES);
+	if (importati < 0) {
+		perror("Impossibile importare i vecchi registri di CARTELLA_FILES");
+		return -1;
+	}
+
+	dr_primo = opendir(CARTELLA_FILES);
+	if (!dr_primo) {
+		perror("Impossibile esplorare CARTELLA_FILES");
+		return -1;
+	}
+	while ((de_primo = readdir(dr_primo)) != NULL) {
+		if (!nomeSottocartellaUtenti(de_primo->d_name)) {
+			continue;
+		}
+		snprintf(cartella, sizeof(cartella), "%s/%s", CARTELLA_FILES, de_primo->d_name);
+		dr_secondo = opendir(cartella);
+		if (!dr_secondo) {
+			continue;
+		}
+		
+		while ((de_secondo = readdir(dr_secondo)) != NULL) {
+			if (!nomeSottocartellaUtenti(de_secondo->d_name)) {
+				continue;
+			}
+			snprintf(cartella, sizeof(cartella), "%s/%s/%s", CARTELLA_FILES, de_primo->d_name, de_secondo->d_name);
+			ret = importaRegistriCartella(cartella);
+			if (ret < 0) {
+				perror("Impossibile importare i vecchi registri di una sottocartella di CARTELLA_FILES");
+				closedir(dr_secondo);
+				closedir(dr_primo);
+				return -1;
+			}
+			importati += ret;
+		}
+		closedir(dr_secondo);
+	}
+	closedir(dr_primo);
+	
+	return importati;
+}
+
+/* Legge i numeri estratti su ogni ruota dal record di FILE_ESTRAZIONI su cui si trova il cursore del file,
+ * portando il cursore al record successivo
+ * 
+ * @file_estrazioni file delle estrazioni aperto in lettura
+ * @estratti matrice in cui scrivere i numeri estratti su ogni ruota
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int leggiNumeriEstrazione (FILE* file_estrazioni, uint32_t estratti[QUANTE_RUOTE][QUANTI_NUMERI_ESTRATTI])
+{
+	int ruota;
+	
+	fseek(file_estrazioni, sizeof(time_t), SEEK_CUR);	// salta il timestamp
+	for (ruota = 0; ruota < QUANTE_RUOTE; ++ruota) {
+		fseek(file_estrazioni, sizeof(uint8_t), SEEK_CUR);	// salta il codice della ruota
+		if (fread(estratti[ruota], sizeof(uint32_t), QUANTI_NUMERI_ESTRATTI, file_estrazioni) != QUANTI_NUMERI_ESTRATTI) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* Controlla che i timestamp delle estrazioni di FILE_ESTRAZIONI siano strettamente crescenti, come richiesto
+ * dalla ricerca binaria di cercaEstrazione(...), e memorizza il timestamp dell'ultima estrazione
+ * e il numero delle estrazioni.
+ * Se non lo sono (file importato o scritto con l'orologio spostato all'indietro), le ricerche diventano lineari
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int verificaOrdineEstrazioni ()
+{
+	time_t timestamp;
+	FILE* file_estrazioni;
+	
+	file_estrazioni = fopen(FILE_ESTRAZIONI, "rb");
+	if (!file_estrazioni) {
+		perror("Impossibile aprire file estrazioni");
+		return -1;
+	}
+
+	while (fread(&timestamp, sizeof(timestamp), 1, file_estrazioni) == 1) {
+		if (timestamp <= ultima_estrazione) {
+			estrazioni_ordinate = 0;
+		}
+		ultima_estrazione = timestamp;
+		estrazioni_nel_file++;
+		if (fseek(file_estrazioni, (long)(LUNGHEZZA_BLOCCO_ESTRAZIONE - sizeof(timestamp)), SEEK_CUR) < 0) {
+			break;
 		}
 	}
+	fclose(file_estrazioni);
 
-	closedir(dr_files);   
+	if (!estrazioni_ordinate) {
+		printf("Timestamp delle estrazioni non strettamente crescenti: le ricerche sullo storico saranno lineari\n");
+		fflush(stdout);
+	}
 	return 0;
 }
 
+/* Allinea i file colonnari delle ruote (vedi lotto_colonne.h) a FILE_ESTRAZIONI,
+ * aggiungendo le estrazioni che mancano (tutte, se i file colonnari non esistono)
+ * 
+ * @return numero delle estrazioni nei file colonnari, -1 in caso di errore
+ */
+long inizializzaColonneEstrazioni ()
+{
+	long quante_estrazioni, presenti, i;
+	struct stat info;
+	FILE* file_estrazioni;
+	
+	file_estrazioni = fopen(FILE_ESTRAZIONI, "rb");
+	if (!file_estrazioni || fstat(fileno(file_estrazioni), &info) < 0) {
+		perror("Impossibile aprire file estrazioni");
+		if (file_estrazioni) fclose(file_estrazioni);
+		return -1;
+	}
+	quante_estrazioni = (long)(info.st_size / LUNGHEZZA_BLOCCO_ESTRAZIONE);
+	
+	presenti = inizializzaColonne(PREFISSO_FILE_COLONNE, (uint32_t)quante_estrazioni);
+	if (presenti < 0) {
+		fclose(file_estrazioni);
+		return -1;
+	}
+
+	fseek(file_estrazioni, presenti * (long)LUNGHEZZA_BLOCCO_ESTRAZIONE, SEEK_SET);
+	for (i = presenti; i < quante_estrazioni; ++i) {
+		uint32_t estratti[QUANTE_RUOTE][QUANTI_NUMERI_ESTRATTI];
+		
+		if (leggiNumeriEstrazione(file_estrazioni, estratti) < 0 || aggiungiEstrazioneColonne(estratti) < 0) {
+			fclose(file_estrazioni);
+			return -1;
+		}
+	}
+	fclose(file_estrazioni);
+
+	if (presenti < quante_estrazioni) {
+		printf("File colonnari delle ruote: aggiunte %ld estrazioni\n", quante_estrazioni - presenti);
+		fflush(stdout);
+	}
+	return quante_estrazioni;
+}
+
+/* Carica le statistiche delle estrazioni (vedi lotto_statistiche.h) da FILE_STATISTICHE.
+ * Se il file manca o non contiene tutte le estrazioni di FILE_ESTRAZIONI, le statistiche
+ * vengono ricostruite leggendo lo storico delle estrazioni e salvate di nuovo.
+ * 
+ * @return numero delle estrazioni considerate, -1 in caso di errore
+ */
+int inizializzaStatisticheEstrazioni ()
+{
+	int ret;
+	uint32_t quante_estrazioni, i;
+	struct stat info;
+	FILE* file_estrazioni;
+	
+	file_estrazioni = fopen(FILE_ESTRAZIONI, "rb");
+	if (!file_estrazioni || fstat(fileno(file_estrazioni), &info) < 0) {
+		perror("Impossibile aprire file estrazioni");
+		if (file_estrazioni) fclose(file_estrazioni);
+		return -1;
+	}
+	quante_estrazioni = (uint32_t)(info.st_size / LUNGHEZZA_BLOCCO_ESTRAZIONE);
+	
+	ret = inizializzaStatistiche(FILE_STATISTICHE, quante_estrazioni);
+	if (ret != 0) {
+		fclose(file_estrazioni);
+		return (ret < 0) ? -1 : (int)quante_estrazioni;
+	}
+	
+	for (i = 0; i < quante_estrazioni; ++i) {
+		uint32_t estratti[QUANTE_RUOTE][QUANTI_NUMERI_ESTRATTI];
+		
+		if (leggiNumeriEstrazione(file_estrazioni, estratti) < 0) {
+			fclose(file_estrazioni);
+			return -1;
+		}
+		registraEstrazioneStatistiche(estratti);
+	}
+	fclose(file_estrazioni);
+	
+	printf("Statistiche ricostruite da %u estrazioni\n", quante_estrazioni);
+	fflush(stdout);
+	
+	return (salvaStatistiche() < 0) ? -1 : (int)quante_estrazioni;
+}
+
 /* Estrae 5 numeri casuali e unici per ognuna delle 11 ruote.
  * Inserisce i numeri estratti in FILE_ESTRAZIONI.
- * Aggiorna gli header di tutti i file schedine degli utenti in modo che tutte le schedine
- * registrate prima delll'estrazione vengano marcate come estratte.
+ * Registra l'estrazione nei registri degli utenti, in modo che tutte le schedine
+ * registrate prima delll'estrazione vengano marcate come estratte (vedi lotto_registri.h).
  * 
  * In FILE_ESTRAZIONI ogni estrazione generale ha il seguente formato:
  *      ------------------------------------------------------------------
@@ -1581,17 +3134,28 @@ int aggiornaHeaderSchedine ()
  *      --------------------------------------------------------
  *      | codice ruota (uint8_t) | numeri estratti (5 uint32_t)|
  *      --------------------------------------------------------
+ * 
+ * @scadenza scadenza del calendario a cui corrisponde l'estrazione (vedi estrazioniDovute(...))
  */
-void effettuaEstrazione ()
+void effettuaEstrazione (const time_t scadenza)
 {
-	int ruota, i, ret;
+	int ruota;
 	time_t timestamp;
+	uint32_t estratti[QUANTE_RUOTE][QUANTI_NUMERI_ESTRATTI];
 	
 	// Variabili per I/O su file
 	FILE* file_estrazione;
 
-	// Inizializza timestamp
-	time(&timestamp);
+	// Il timestamp e' la scadenza del calendario, non l'orario attuale: le estrazioni recuperate
+	// una dopo l'altra (RECUPERO_COMPLETO) avvengono nello stesso secondo ma hanno scadenze distinte
+	timestamp = scadenza;
+	
+	// Se l'orologio e' stato spostato all'indietro, l'estrazione deve comunque seguire l'ultima:
+	// due estrazioni con lo stesso timestamp coprirebbero le stesse schedine e si confonderebbero
+	// nelle ricerche sullo storico (timestamp strettamente crescenti, vedi verificaOrdineEstrazioni())
+	if (timestamp <= ultima_estrazione) {
+		timestamp = ultima_estrazione + 1;
+	}
 	
 	// Apri file in append mode
 	file_estrazione = fopen(FILE_ESTRAZIONI, "ab");
@@ -1602,31 +3166,14 @@ void effettuaEstrazione ()
 	
 	// Memorizza timestamp
 	fwrite(&timestamp, sizeof(timestamp), 1, file_estrazione);
-		
+	
 	// Estrae i numeri delle ruote ruote
 	for (ruota = 0; ruota < QUANTE_RUOTE; ++ruota) {
 		uint8_t codice_ruota = (uint8_t)ruota;
-		uint32_t estrazione[QUANTI_NUMERI_ESTRATTI];
-		memset(estrazione, 0, QUANTI_NUMERI_ESTRATTI);
+		uint32_t* estrazione = estratti[ruota];
 		
-		// Estrae QUANTI_NUMERI_ESTRATTI interi diversi tra loro
-		for (i = 0; i < QUANTI_NUMERI_ESTRATTI; ++i) {
-			int scorri;
-			int booleanNumeroUnico; // indica se il numero attualmente estratto e' unico o meno
-			
-			do {
-				booleanNumeroUnico = 1;
-				estrazione[i] = (uint32_t)(rand() % NUMERI_ESTRAIBILI + 1);
-				
-				// Controlla l'unicita' del numero estratto
-				for (scorri = 0; scorri < i; ++scorri) {
-					if (estrazione[i] == estrazione[scorri]) {
-						booleanNumeroUnico = 0;
-						break;
-					}
-				}
-			} while (booleanNumeroUnico == 0);
-		}
+		// Estrae QUANTI_NUMERI_ESTRATTI interi diversi tra loro (Fisher-Yates parziale, senza ripetizioni)
+		estraiNumeri(generatoreDelProcesso(), estrazione, QUANTI_NUMERI_ESTRATTI, NUMERI_ESTRAIBILI);
 		
 		// Memorizza in un file l'estrazione
 		fwrite(&codice_ruota, sizeof(codice_ruota), 1 , file_estrazione);
@@ -1634,24 +3181,139 @@ void effettuaEstrazione ()
 	}
 
 	fclose(file_estrazione);
+	ultima_estrazione = timestamp;
+	estrazioni_nel_file++;
 	
-	ret = aggiornaHeaderSchedine();
-	if (ret < 0) {
-		printf("Routine di estrazione non completata\n");
-		fflush(stdout);
-		return;
+	// I file colonnari seguono FILE_ESTRAZIONI: se la scrittura fallisce vengono sospesi,
+	// le letture passano a FILE_ESTRAZIONI e i file vengono riallineati al prossimo avvio
+	if (aggiungiEstrazioneColonne(estratti) < 0) {
+		fprintf(stderr, "File colonnari delle ruote sospesi fino al riavvio\n");
+		fflush(stderr);
 	}
 	
+	// Importo dovuto sui numeri estratti; le schedine che hanno concluso le loro estrazioni escono dall'esposizione
+	riconciliaEsposizione(estrazioni_nel_file - 1, estratti);
+	
+	registraEstrazioneStatistiche(estratti);
+	salvaStatistiche();
+	
+	// Tutte le schedine registrate finora risultano estratte
+	registraEstrazioneRegistri();
+	
 	printf("Estrazione effettuata\n");
 	fflush(stdout);
 }
 
+/* Effettua le estrazioni dovute allo scadere del timer del pianificatore (vedi lotto_pianificatore.h).
+ * Durante ogni estrazione tutti gli altri processi del gruppo vengono sospesi:
+ * il segnale SIGUSR1 li blocca in attesa del segnale SIGUSR2, inviato al termine dell'estrazione.
+ * Il processo principale tiene bloccati entrambi i segnali, percio' non viene sospeso.
+ */
+void eseguiEstrazioniPianificate ()
+{
+	int quante, i;
+	time_t scadenze[MASSIMO_ESTRAZIONI_RECUPERATE];
+	struct timespec inizio, fine;
+	
+	quante = estrazioniDovute(scadenze);
+	
+	for (i = 0; i < quante; ++i) {
+		clock_gettime(CLOCK_MONOTONIC, &inizio);
+		
+		kill(0, SIGUSR1);	// blocca i processi
+		effettuaEstrazione(scadenze[i]);
+		kill(0, SIGUSR2);	// risveglia i processi
+		
+		clock_gettime(CLOCK_MONOTONIC, &fine);
+		registraDurataEstrazione((int64_t)(fine.tv_sec - inizio.tv_sec) * 1000000000LL + (fine.tv_nsec - inizio.tv_nsec));
+	}
+}
+
+/* Crea il processo che ogni INTERVALLO_MANUTENZIONE_REGISTRI secondi archivia le schedine concluse, compatta
+ * i segmenti dei registri e, se necessario, salva un checkpoint dell'indice (vedi lotto_registri.h).
+ * Il processo appartiene al gruppo del server, percio' viene sospeso durante le estrazioni
+ * come i processi che gestiscono i client, e termina insieme al processo principale.
+ * 
+ * @maschera maschera dei segnali dei processi figli
+ * @timer descrittore del timer delle estrazioni, che il processo chiude
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int avviaManutenzioneRegistri (const sigset_t* maschera, const int timer)
+{
+	pid_t pid, padre = getpid();
+	int ret;
+	
+	pid = fork();
+	if (pid < 0) {
+		perror("Impossibile creare il processo di manutenzione dei registri");
+		return -1;
+	}
+	if (pid > 0) {
+		return 0;
+	}
+	
+	// Il processo principale potrebbe essere terminato prima della prctl(...)
+	close(timer);
+	prctl(PR_SET_PDEATHSIG, SIGTERM);
+	if (getppid() != padre) {
+		exit(EXIT_SUCCESS);
+	}
+	sigprocmask(SIG_SETMASK, maschera, NULL);
+	
+	while (1) {
+		long archiviate;
+		
+		sleep(INTERVALLO_MANUTENZIONE_REGISTRI);
+		
+		// L'archiviazione precede la compattazione, che elimina i segmenti rimasti con le sole schedine archiviate
+		archiviate = archiviaRegistri();
+		if (archiviate < 0) {
+			fprintf(stderr, "Archiviazione delle schedine non completata\n");
+			fflush(stderr);
+		}
+		else if (archiviate > 0) {
+			printf("Archiviazione delle schedine: archiviate %li schedine\n", archiviate);
+			fflush(stdout);
+		}
+		
+		// Anche le vincite riunite lasciano nei segmenti record non piu' validi, eliminati dalla compattazione
+		archiviate = riunisciVinciteRegistri();
+		if (archiviate < 0) {
+			fprintf(stderr, "Riunione delle vincite non completata\n");
+			fflush(stderr);
+		}
+		else if (archiviate > 0) {
+			printf("Riunione delle vincite: riuniti i registri di %li utenti\n", archiviate);
+			fflush(stdout);
+		}
+		
+		ret = compattaRegistri();
+		if (ret < 0) {
+			fprintf(stderr, "Compattazione dei registri non completata\n");
+			fflush(stderr);
+		}
+		else if (ret > 0) {
+			printf("Compattazione dei registri: eliminati %i segmenti\n", ret);
+			fflush(stdout);
+		}
+		
+		// Il checkpoint segue la compattazione, cosi' che non si riferisca ai segmenti appena eliminati
+		if (aggiornaCheckpointRegistri() < 0) {
+			fprintf(stderr, "Checkpoint dei registri non salvato\n");
+			fflush(stderr);
+		}
+	}
+}
+
 //////////////////////////////////////////////
 //					MAIN					//
 //////////////////////////////////////////////
 int main(int argc, char** argv)
 {
-	int periodoEstrazione = PERIODO_ESTRAZIONE;
+	int periodoEstrazione = PERIODO_ESTRAZIONE * SECONDI_IN_UN_MINUTO;	// in secondi
+	int politicaRecupero = RECUPERO_UNICA;
+	char* fine_numero;
 	
 	// Variabili per TCP server
 	int listenerSocket, serverSocket;
@@ -1661,68 +3323,216 @@ int main(int argc, char** argv)
 	// Variabili per TCP client
 	struct sockaddr_in clientAddress;
 	
-	// Variabili per gestione processi
-	pid_t pid, processo_estrazione;
+	// Variabili per gestione processi ed estrazioni
+	pid_t pid;
+	int timerEstrazioni;
+	struct pollfd descrittori[3];
+	long nuovoPeriodo;
+	sigset_t segnaliEstrazione, mascheraFigli;
+	
+	// Variabili per i registri degli utenti
+	long quanteEstrazioni, quantiRecord;
+	FILE* file_importazione;
 	
 	// Variabili di appoggio
 	int ret;
 	socklen_t addrLen;
 
+	// Lettura delle opzioni inserite da console:
+	//    ./lotto_server <porta> [periodo] [-l nome=frequenza/raffica]... [-r una|tutte] [-d nessuna|gruppo[=attesa/massimo]|schedina] [-a orizzonte[/limite]]
+	// (-l imposta un limite del limitatore delle richieste, vedi lotto_limitatore.h;
+	//  -r sceglie la politica di recupero delle estrazioni perse, vedi lotto_pianificatore.h;
+	//  -d sceglie la durabilita' delle schedine giocate, vedi lotto_registri.h;
+	//  -a imposta l'archiviazione delle schedine concluse, vedi lotto_registri.h)
+	while ((ret = getopt(argc, argv, "l:r:d:a:")) != -1) {
+		if (ret == 'd' && impostaDurabilitaRegistri(optarg) == 0) {
+			continue;
+		}
+		else if (ret == 'a' && impostaArchiviazioneRegistri(optarg) == 0) {
+			continue;
+		}
+		else if (ret == 'r' && strcmp(optarg, "una") == 0) {
+			politicaRecupero = RECUPERO_UNICA;
+		}
+		else if (ret == 'r' && strcmp(optarg, "tutte") == 0) {
+			politicaRecupero = RECUPERO_COMPLETO;
+		}
+		else if (ret != 'l' || impostaLimite(optarg) < 0) {
+			fprintf(stderr, "Errore: opzione non valida. Uso: %s <porta> [periodo] [-l nome=frequenza/raffica]... [-r una|tutte] [-d nessuna|gruppo[=attesa/massimo]|schedina] [-a orizzonte[/limite]]\n", argv[0]);
+			fflush(stderr);
+			exit(EXIT_FAILURE);
+		}
+	}
+	
 	// Errore: manca il parametro <porta>
-	if (argc < 2) {
+	if (argc - optind < 1) {
 		fprintf(stderr, "Errore: il programma deve essere lanciato con almeno il parametro <porta>\n");
 		fflush(stderr);
 		exit(EXIT_FAILURE);
 	}
 
 	// Lettura dei parametri inseriti da console
-	porta = (uint16_t)atoi(argv[1]);
+	porta = (uint16_t)atoi(argv[optind]);
 	
-	if (argc >= 3) {
-		periodoEstrazione = atoi(argv[2]);
+	// Il periodo e' espresso in minuti, oppure in secondi con il suffisso 's' (per esempio "30s")
+	if (argc - optind >= 2) {
+		periodoEstrazione = (int)strtol(argv[optind + 1], &fine_numero, 10);
+		
+		if (strcmp(fine_numero, "s") != 0) {
+			periodoEstrazione = (*fine_numero == '\0') ? periodoEstrazione * SECONDI_IN_UN_MINUTO : 0;
+		}
 		
 		if (periodoEstrazione <= 0) {
-			printf("Errore: inserire un periodo di estrazione > 0");
+			printf("Errore: inserire un periodo di estrazione > 0 (in minuti, o in secondi con il suffisso 's')\n");
 			exit(EXIT_FAILURE);
 		}
 	}
 	
-	processo_estrazione = fork();
+	// Caricamento della directory degli utenti in memoria condivisa
+	// (deve precedere le fork, cosi' che tutti i processi la condividano)
+	ret = inizializzaDirectoryUtenti(FILE_UTENTI, FILE_FILTRO_UTENTI);
+	if (ret < 0) {
+		fprintf(stderr, "Errore: impossibile caricare la directory degli utenti\n");
+		fflush(stderr);
+		exit(EXIT_FAILURE);
+	}
+	printf("Directory degli utenti caricata: %i utenti registrati\n", ret);
+	fflush(stdout);
 	
-	srand(time(NULL)); // inizializza algoritmo pseudorandomico
+	// Caricamento degli indirizzi bloccati dal log (compattato all'avvio)
+	ret = inizializzaIndirizziBloccati(FILE_CLIENT_BLOCCATI);
+	if (ret < 0) {
+		fprintf(stderr, "Errore: impossibile caricare gli indirizzi bloccati\n");
+		fflush(stderr);
+		exit(EXIT_FAILURE);
+	}
+	printf("Indirizzi bloccati caricati: %i indirizzi attualmente bloccati\n", ret);
+	fflush(stdout);
 	
-	if (processo_estrazione < 0) {
-		perror("fork fallita");
+	// Secchielli del limitatore delle richieste in memoria condivisa
+	ret = inizializzaLimitatore();
+	if (ret < 0) {
+		fprintf(stderr, "Errore: impossibile inizializzare il limitatore delle richieste\n");
+		fflush(stderr);
 		exit(EXIT_FAILURE);
 	}
-	else if (processo_estrazione == 0) { 
-		time_t start_timer = 0, end_timer = 0;	// usati per calcolare il tempo di esecuzione della estrazione, 
-												//da sottrarre al periodo di sleep
-		
-		// Ignora i segnali usati per la sospensione e riattivazione dei processi server
-		signal(SIGUSR1, SIG_IGN);
-		signal(SIGUSR2, SIG_IGN);
-		
-		while (1) {
-			sleep(periodoEstrazione * SECONDI_IN_UN_MINUTO - (int)(end_timer - start_timer));
-			
-			time(&start_timer);	// calcola istante d'inizio dell'estrazione
-			kill(0, SIGUSR1);	// blocca i processi
-			effettuaEstrazione();
-			kill(0, SIGUSR2);	// risveglia i processi	
-			time(&end_timer);	// calcola istante di fine dell'estrazione
+
+	// Tabelle per il calcolo delle vincite e delle quote (ereditate dai processi figli)
+	inizializzaTabellePremi();
+	
+	// Esposizione del banco in memoria condivisa
+	ret = inizializzaEsposizione();
+	if (ret < 0) {
+		fprintf(stderr, "Errore: impossibile inizializzare le tabelle dell'esposizione\n");
+		fflush(stderr);
+		exit(EXIT_FAILURE);
+	}
+	
+	// Giocate internate in memoria condivisa (vedi lotto_interni.h)
+	ret = inizializzaGiocateInternate();
+	if (ret < 0) {
+		fprintf(stderr, "Errore: impossibile inizializzare le tabelle delle giocate internate\n");
+		fflush(stderr);
+		exit(EXIT_FAILURE);
+	}
+	
+	// Archivio delle sessioni in memoria condivisa
+	ret = inizializzaSessioni();
+	if (ret < 0) {
+		fprintf(stderr, "Errore: impossibile inizializzare l'archivio delle sessioni\n");
+		fflush(stderr);
+		exit(EXIT_FAILURE);
+	}
+	
+	// Ordine dei timestamp dello storico delle estrazioni (vedi cercaEstrazione(...))
+	ret = verificaOrdineEstrazioni();
+	if (ret < 0) {
+		fprintf(stderr, "Errore: impossibile leggere lo storico delle estrazioni\n");
+		fflush(stderr);
+		exit(EXIT_FAILURE);
+	}
+	
+	// File colonnari delle ruote, allineati allo storico delle estrazioni
+	quanteEstrazioni = inizializzaColonneEstrazioni();
+	if (quanteEstrazioni < 0) {
+		fprintf(stderr, "Errore: impossibile allineare i file colonnari delle ruote\n");
+		fflush(stderr);
+		exit(EXIT_FAILURE);
+	}
+	
+	// Indice dei registri degli utenti in memoria condivisa, ricostruito dai segmenti
+	// (deve seguire la directory degli utenti)
+	quantiRecord = inizializzaRegistri(PREFISSO_FILE_REGISTRI, (uint32_t)quanteEstrazioni);
+	if (quantiRecord < 0) {
+		fprintf(stderr, "Errore: impossibile caricare i registri degli utenti\n");
+		fflush(stderr);
+		exit(EXIT_FAILURE);
+	}
+	printf("Registri degli utenti caricati: %ld record\n", quantiRecord);
+	fflush(stdout);
+	
+	// I vecchi file di registro per utente vengono importati nei segmenti finche' l'importazione non e' completata
+	if (access(FILE_IMPORTAZIONE_REGISTRI, F_OK) < 0) {
+		ret = importaVecchiRegistri();
+		if (ret < 0 || sincronizzaRegistri() < 0) {
+			fprintf(stderr, "Errore: impossibile importare i vecchi registri degli utenti\n");
+			fflush(stderr);
+			exit(EXIT_FAILURE);
+		}
+		if (ret > 0) {
+			printf("Importati i registri di %i utenti\n", ret);
+			fflush(stdout);
 		}
 		
-		exit(0);
+		// Il file viene creato solo quando tutti i registri importati sono su disco
+		file_importazione = fopen(FILE_IMPORTAZIONE_REGISTRI, "wb");
+		if (!file_importazione) {
+			perror("Impossibile registrare il completamento dell'importazione dei registri");
+			exit(EXIT_FAILURE);
+		}
+		fclose(file_importazione);
 	}
-
+	chiudiSegmentiAperti();
+	
+	// Statistiche delle estrazioni in memoria condivisa, ricostruite dallo storico se il file non e' coerente
+	ret = inizializzaStatisticheEstrazioni();
+	if (ret < 0) {
+		fprintf(stderr, "Errore: impossibile caricare le statistiche delle estrazioni\n");
+		fflush(stderr);
+		exit(EXIT_FAILURE);
+	}
+	
+	// Timer delle estrazioni, controllato dal ciclo principale insieme al socket in ascolto
+	timerEstrazioni = inizializzaPianificatore((uint32_t)periodoEstrazione, politicaRecupero);
+	if (timerEstrazioni < 0) {
+		fprintf(stderr, "Errore: impossibile inizializzare il pianificatore delle estrazioni\n");
+		fflush(stderr);
+		exit(EXIT_FAILURE);
+	}
+	printf("Estrazioni pianificate ogni %i secondi\n", periodoEstrazione);
+	fflush(stdout);
+	
 	// Configurazione meccanismo di estrazione automatico.
-	// L'estrazione viene effettuata da un processo ad hoc che periodicamente si risveglia
-	// e invia un segnale di tipo SIGUSR1 a tutti gli altri processi del proprio gruppo.
-	// Il segnale SIGUSR1 blocca il processo in attesa del segnale SIGUSR2, lanciato da processo_estrazione
+	// L'estrazione viene effettuata dal processo principale, che allo scadere del timer
+	// invia un segnale di tipo SIGUSR1 a tutti gli altri processi del proprio gruppo.
+	// Il segnale SIGUSR1 blocca il processo in attesa del segnale SIGUSR2, inviato al termine dell'estrazione.
+	// Il processo principale blocca entrambi i segnali; i processi figli li sbloccano dopo la fork(...),
+	// cosi' che un segnale inviato prima che un figlio lo sblocchi resti pendente e non vada perso
 	signal(SIGUSR1, bloccaProcesso);
 	signal(SIGUSR2, risvegliaProcesso);
 	
+	sigemptyset(&segnaliEstrazione);
+	sigaddset(&segnaliEstrazione, SIGUSR1);
+	sigaddset(&segnaliEstrazione, SIGUSR2);
+	sigprocmask(SIG_BLOCK, &segnaliEstrazione, &mascheraFigli);
+	
+	// Processo che compatta periodicamente i segmenti dei registri e ne salva i checkpoint
+	if (avviaManutenzioneRegistri(&mascheraFigli, timerEstrazioni) < 0) {
+		exit(EXIT_FAILURE);
+	}
+	
+	// Ogni processo inizializza il proprio generatore casuale al primo utilizzo (vedi lotto_casuale.h)
+	
 	// Configurazione socket di ascolto
 	listenerSocket = socket(AF_INET, SOCK_STREAM, 0);
 	memset(&serverAddress, 0, sizeof(serverAddress));
@@ -1750,10 +3560,46 @@ int main(int argc, char** argv)
 	printf("Socket in ascolto configurata correttamente\n");
 	fflush(stdout);
 	
+	descrittori[0].fd = listenerSocket;
+	descrittori[0].events = POLLIN;
+	descrittori[1].fd = timerEstrazioni;
+	descrittori[1].events = POLLIN;
+	descrittori[2].fd = descrittoreRichiestePianificatore();
+	descrittori[2].events = POLLIN;
+	
 	while (1) {
 		char presentationAddress[INET_ADDRSTRLEN];
 		addrLen = sizeof(clientAddress);
 		
+		// Attende una nuova connessione, la scadenza del timer delle estrazioni o la richiesta di un nuovo periodo
+		ret = poll(descrittori, 3, -1);
+		if (ret < 0) {
+			if (errno != EINTR) {
+				perror("poll fallita");
+			}
+			continue;
+		}
+		
+		// Ad ogni scadenza del timer vengono anche rimossi i blocchi scaduti, che altrimenti
+		// resterebbero nella tabella fino al prossimo blocco
+		if (descrittori[1].revents & POLLIN) {
+			eseguiEstrazioniPianificate();
+			purgaIndirizziScaduti(time(NULL));
+		}
+		
+		// Un processo figlio ha chiesto un nuovo periodo (!imposta_periodo): il timer viene riarmato
+		if (descrittori[2].revents & POLLIN) {
+			nuovoPeriodo = applicaPeriodoRichiesto();
+			if (nuovoPeriodo > 0) {
+				printf("Estrazioni pianificate ogni %li secondi\n", nuovoPeriodo);
+				fflush(stdout);
+			}
+		}
+		
+		if (!(descrittori[0].revents & POLLIN)) {
+			continue;
+		}
+		
 		// Accetta nuova connessione dal client
 		serverSocket = accept(listenerSocket, (struct sockaddr*)&clientAddress, &addrLen);
 		printf("CONNESSIONE ACCETTATA: client %s, socket %i\n",
@@ -1761,6 +3607,15 @@ int main(int argc, char** argv)
 				serverSocket);
 		fflush(stdout);
 		
+		// Il client ha aperto troppe connessioni: viene rifiutato senza creare un processo
+		if (!richiestaConsentita(clientAddress.sin_addr.s_addr, CATEGORIA_CONNESSIONE, 1)) {
+			printf("Client %s, socket %i: connessione rifiutata dal limitatore\n", presentationAddress, serverSocket);
+			fflush(stdout);
+			inviaErrore(serverSocket, RICHIESTE_ECCESSIVE);
+			close(serverSocket);
+			continue;
+		}
+		
 		pid = fork();
 		
 		// Errore nella fork()
@@ -1773,6 +3628,8 @@ int main(int argc, char** argv)
 		// Processo figlio che gestisce la richiesta del client
 		if (pid == 0) {
 			close(listenerSocket);
+			close(timerEstrazioni);
+			sigprocmask(SIG_SETMASK, &mascheraFigli, NULL);
 			gestisciRichiesteClient(serverSocket, clientAddress);
 			close(serverSocket);
 			exit(EXIT_SUCCESS);
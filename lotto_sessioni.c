@@ -0,0 +1,314 @@
+#include "lotto_sessioni.h"
+#include "lotto_condivisa.h"
+#include "costanti.h"
+#include <stdio.h>
+#include <string.h>
+
+#define MASCHERA_SESSIONI (CAPACITA_SESSIONI - 1)
+
+// Oltre questo numero di sessioni vengono rimosse quelle scadute
+#define MASSIMO_SESSIONI (CAPACITA_SESSIONI / 4 * 3)
+
+#define SECONDI_INATTIVITA_SESSIONE (MINUTI_INATTIVITA_SESSIONE * 60)
+#define SECONDI_DURATA_SESSIONE (ORE_DURATA_SESSIONE * 3600)
+
+// L'ultima attivita' di una sessione viene registrata con questa granularita' (in secondi)
+#define GRANULARITA_ATTIVITA 60
+
+/* Chiave della tabella: il session id copiato in due interi (i byte non usati sono a zero),
+ * cosi' che possa essere letto con operazioni atomiche
+ */
+struct chiave_sessione {
+	uint64_t parte[2];
+};
+
+_Static_assert(LUNGHEZZA_SESSION_ID <= sizeof(struct chiave_sessione), "session id troppo lungo");
+
+/* Elemento della tabella.
+ * Un elemento con chiave nulla e' libero (un session id non contiene mai byte nulli)
+ */
+struct elemento_sessione {
+	struct chiave_sessione chiave;
+	uint32_t utente;
+	int64_t creazione;
+	int64_t ultima_attivita;
+};
+
+/* Struttura allocata in memoria condivisa
+ */
+struct archivio_sessioni {
+	pthread_mutex_t mutex;			// serializza le modifiche
+	uint32_t sequenza;				// contatore del seqlock: dispari durante una modifica della tabella
+	uint32_t quante_sessioni;		// elementi presenti nella tabella (anche se scaduti ma non ancora rimossi)
+	
+	// Metriche
+	uint64_t create;
+	uint64_t validazioni;
+	uint64_t rifiutate;
+	uint64_t scadute;				// sessioni scadute rimosse dalla tabella
+	
+	struct elemento_sessione elementi[CAPACITA_SESSIONI];
+};
+
+static struct archivio_sessioni* archivio = NULL;
+
+/* Costruisce la chiave di un session id
+ */
+static struct chiave_sessione chiaveSessione (const char* session_id)
+{
+	struct chiave_sessione chiave;
+	
+	memset(&chiave, 0, sizeof(chiave));
+	memcpy(&chiave, session_id, LUNGHEZZA_SESSION_ID);
+	return chiave;
+}
+
+/* Calcola la posizione iniziale di una chiave nella tabella
+ */
+static uint32_t posizioneSessione (struct chiave_sessione chiave)
+{
+	uint64_t hash = (chiave.parte[0] ^ (chiave.parte[1] * 0xFF51AFD7ED558CCDULL)) * 0x9E3779B97F4A7C15ULL;
+	
+	return (uint32_t)(hash >> 32) & MASCHERA_SESSIONI;
+}
+
+static int chiaviUguali (struct chiave_sessione a, struct chiave_sessione b)
+{
+	return a.parte[0] == b.parte[0] && a.parte[1] == b.parte[1];
+}
+
+/* Controlla se una sessione e' scaduta
+ */
+static int sessioneScaduta (int64_t creazione, int64_t ultima_attivita, time_t adesso)
+{
+	// L'ultima attivita' e' registrata con granularita' di GRANULARITA_ATTIVITA secondi
+	return adesso - creazione >= SECONDI_DURATA_SESSIONE ||
+			adesso - ultima_attivita >= SECONDI_INATTIVITA_SESSIONE + GRANULARITA_ATTIVITA;
+}
+
+/* Inizia una modifica della tabella: da questo momento i lettori ripeteranno la ricerca
+ * (se il processo precedente e' terminato durante una modifica, il contatore viene riallineato)
+ */
+static void iniziaModifica ()
+{
+	__atomic_store_n(&archivio->sequenza, archivio->sequenza | 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/* Termina una modifica della tabella, rendendola visibile ai lettori
+ */
+static void terminaModifica ()
+{
+	__atomic_store_n(&archivio->sequenza, archivio->sequenza + 1, __ATOMIC_RELEASE);
+}
+
+/* Scrive un elemento con scritture atomiche (DEVE essere chiamata durante una modifica)
+ */
+static void scriviElemento (uint32_t i, struct chiave_sessione chiave, uint32_t utente, int64_t creazione, int64_t ultima_attivita)
+{
+	__atomic_store_n(&archivio->elementi[i].utente, utente, __ATOMIC_RELAXED);
+	__atomic_store_n(&archivio->elementi[i].creazione, creazione, __ATOMIC_RELAXED);
+	__atomic_store_n(&archivio->elementi[i].ultima_attivita, ultima_attivita, __ATOMIC_RELAXED);
+	__atomic_store_n(&archivio->elementi[i].chiave.parte[1], chiave.parte[1], __ATOMIC_RELAXED);
+	__atomic_store_n(&archivio->elementi[i].chiave.parte[0], chiave.parte[0], __ATOMIC_RELAXED);
+}
+
+/* Rimuove un elemento spostando all'indietro gli elementi successivi della catena.
+ * DEVE essere chiamata durante una modifica
+ */
+static void rimuoviElemento (uint32_t i)
+{
+	struct chiave_sessione vuota = {{0, 0}};
+	uint32_t j = i, k;
+	
+	while (1) {
+		j = (j + 1) & MASCHERA_SESSIONI;
+		if (archivio->elementi[j].chiave.parte[0] == 0) {
+			break;
+		}
+		
+		// L'elemento in j puo' essere spostato in i solo se la sua posizione iniziale k non cade in (i, j]
+		k = posizioneSessione(archivio->elementi[j].chiave);
+		if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j)) {
+			continue;
+		}
+		
+		scriviElemento(i, archivio->elementi[j].chiave, archivio->elementi[j].utente,
+				archivio->elementi[j].creazione, archivio->elementi[j].ultima_attivita);
+		i = j;
+	}
+	
+	scriviElemento(i, vuota, 0, 0, 0);
+}
+
+/* Rimuove tutte le sessioni scadute (DEVE essere chiamata possedendo il mutex)
+ */
+static void rimuoviSessioniScadute (time_t adesso)
+{
+	uint32_t i = 0;
+	
+	iniziaModifica();
+	while (i < CAPACITA_SESSIONI) {
+		struct elemento_sessione* elemento = &archivio->elementi[i];
+		
+		// Dopo una rimozione la posizione i contiene l'elemento successivo della catena: va ricontrollata
+		if (elemento->chiave.parte[0] != 0 && sessioneScaduta(elemento->creazione, elemento->ultima_attivita, adesso)) {
+			rimuoviElemento(i);
+			archivio->quante_sessioni--;
+			archivio->scadute++;
+			continue;
+		}
+		i++;
+	}
+	terminaModifica();
+}
+
+/* Crea l'archivio delle sessioni in memoria condivisa
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int inizializzaSessioni ()
+{
+	archivio = (struct archivio_sessioni*)allocaMemoriaCondivisa(sizeof(struct archivio_sessioni));
+	if (!archivio) {
+		return -1;
+	}
+	
+	return inizializzaMutexCondiviso(&archivio->mutex);
+}
+
+/* Registra una nuova sessione
+ * 
+ * @session_id session id
+ * @utente identificativo dell'utente
+ * @adesso istante del login
+ * 
+ * @return 1 se la sessione e' stata registrata, 0 se il session id e' gia' in uso, -1 se l'archivio e' pieno
+ */
+int creaSessione (const char* session_id, uint32_t utente, time_t adesso)
+{
+	struct chiave_sessione chiave = chiaveSessione(session_id);
+	uint32_t i;
+	
+	bloccaMutexCondiviso(&archivio->mutex);
+	
+	if (archivio->quante_sessioni >= MASSIMO_SESSIONI) {
+		rimuoviSessioniScadute(adesso);
+		if (archivio->quante_sessioni >= MASSIMO_SESSIONI) {
+			sbloccaMutexCondiviso(&archivio->mutex);
+			return -1;
+		}
+	}
+	
+	for (i = posizioneSessione(chiave); archivio->elementi[i].chiave.parte[0] != 0; i = (i + 1) & MASCHERA_SESSIONI) {
+		if (chiaviUguali(archivio->elementi[i].chiave, chiave)) {
+			// Un session id scaduto puo' essere riassegnato
+			if (!sessioneScaduta(archivio->elementi[i].creazione, archivio->elementi[i].ultima_attivita, adesso)) {
+				sbloccaMutexCondiviso(&archivio->mutex);
+				return 0;
+			}
+			archivio->quante_sessioni--;
+			archivio->scadute++;
+			break;
+		}
+	}
+	
+	iniziaModifica();
+	scriviElemento(i, chiave, utente, adesso, adesso);
+	terminaModifica();
+	
+	archivio->quante_sessioni++;
+	archivio->create++;
+	
+	sbloccaMutexCondiviso(&archivio->mutex);
+	return 1;
+}
+
+/* Valida un session id, senza acquisire il mutex se l'ultima attivita' registrata e' abbastanza recente
+ * 
+ * @session_id session id da validare
+ * @adesso istante attuale
+ * @utente puntatore in cui scrivere l'identificativo dell'utente della sessione
+ * 
+ * @return 1 se la sessione esiste e non e' scaduta, 0 altrimenti
+ */
+int validaSessione (const char* session_id, time_t adesso, uint32_t* utente)
+{
+	struct chiave_sessione chiave = chiaveSessione(session_id);
+	uint32_t sequenza, i, utente_trovato;
+	int64_t creazione, ultima_attivita;
+	int trovata;
+	
+	__atomic_fetch_add(&archivio->validazioni, 1, __ATOMIC_RELAXED);
+	
+	do {
+		sequenza = __atomic_load_n(&archivio->sequenza, __ATOMIC_ACQUIRE);
+		trovata = 0;
+		utente_trovato = 0;
+		creazione = ultima_attivita = 0;
+		
+		for (i = posizioneSessione(chiave); ; i = (i + 1) & MASCHERA_SESSIONI) {
+			uint64_t parte0 = __atomic_load_n(&archivio->elementi[i].chiave.parte[0], __ATOMIC_RELAXED);
+			
+			if (parte0 == 0) {
+				break;
+			}
+			if (parte0 == chiave.parte[0] &&
+					__atomic_load_n(&archivio->elementi[i].chiave.parte[1], __ATOMIC_RELAXED) == chiave.parte[1]) {
+				utente_trovato = __atomic_load_n(&archivio->elementi[i].utente, __ATOMIC_RELAXED);
+				creazione = __atomic_load_n(&archivio->elementi[i].creazione, __ATOMIC_RELAXED);
+				ultima_attivita = __atomic_load_n(&archivio->elementi[i].ultima_attivita, __ATOMIC_RELAXED);
+				trovata = 1;
+				break;
+			}
+		}
+		
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((sequenza & 1) || sequenza != __atomic_load_n(&archivio->sequenza, __ATOMIC_RELAXED));
+	
+	if (!trovata || sessioneScaduta(creazione, ultima_attivita, adesso)) {
+		__atomic_fetch_add(&archivio->rifiutate, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+	
+	// Aggiorna l'ultima attivita' (l'elemento potrebbe essere stato spostato nel frattempo: va cercato di nuovo)
+	if (adesso - ultima_attivita >= GRANULARITA_ATTIVITA) {
+		bloccaMutexCondiviso(&archivio->mutex);
+		for (i = posizioneSessione(chiave); archivio->elementi[i].chiave.parte[0] != 0; i = (i + 1) & MASCHERA_SESSIONI) {
+			if (chiaviUguali(archivio->elementi[i].chiave, chiave)) {
+				__atomic_store_n(&archivio->elementi[i].ultima_attivita, (int64_t)adesso, __ATOMIC_RELAXED);
+				break;
+			}
+		}
+		sbloccaMutexCondiviso(&archivio->mutex);
+	}
+	
+	*utente = utente_trovato;
+	return 1;
+}
+
+/* Scrive le metriche dell'archivio delle sessioni (una per riga, nel formato "nome valore")
+ * 
+ * @buffer buffer in cui scrivere le metriche
+ * @dimensione dimensione del buffer
+ * 
+ * @return numero di caratteri scritti
+ */
+int scriviMetricheSessioni (char* buffer, size_t dimensione)
+{
+	int ret;
+	
+	ret = snprintf(buffer, dimensione,
+			"sessioni_in_archivio %u\n"
+			"sessioni_create %lu\n"
+			"sessioni_validazioni %lu\n"
+			"sessioni_rifiutate %lu\n"
+			"sessioni_scadute %lu\n",
+			__atomic_load_n(&archivio->quante_sessioni, __ATOMIC_RELAXED),
+			(unsigned long)__atomic_load_n(&archivio->create, __ATOMIC_RELAXED),
+			(unsigned long)__atomic_load_n(&archivio->validazioni, __ATOMIC_RELAXED),
+			(unsigned long)__atomic_load_n(&archivio->rifiutate, __ATOMIC_RELAXED),
+			(unsigned long)__atomic_load_n(&archivio->scadute, __ATOMIC_RELAXED));
+	
+	return caratteriScritti(ret, dimensione);
+}
@@ -0,0 +1,67 @@
+#ifndef LOTTO_SESSIONI_H
+#define LOTTO_SESSIONI_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+//////////////////////////////////////////////
+//				SESSIONI UTENTE				//
+//////////////////////////////////////////////
+/* L'archivio delle sessioni associa ogni session id all'utente che l'ha ottenuto con il login,
+ * insieme all'istante di creazione e a quello dell'ultima attivita'.
+ * E' una tabella hash ad indirizzamento aperto in memoria condivisa: qualunque processo del server
+ * puo' validare un session id, percio' una sessione puo' essere ripresa su una nuova connessione
+ * (comando RIPRENDI_SESSIONE) senza ripetere il login.
+ * 
+ * Come per gli indirizzi bloccati (vedi lotto_bloccati.h), la validazione non acquisisce mutex:
+ * le modifiche della tabella sono protette da un seqlock. L'istante dell'ultima attivita' viene aggiornato
+ * (acquisendo il mutex) al piu' una volta al minuto per sessione.
+ * 
+ * Una sessione scade dopo MINUTI_INATTIVITA_SESSIONE minuti senza richieste,
+ * o comunque ORE_DURATA_SESSIONE ore dopo il login.
+ */
+
+// Numero di elementi della tabella (potenza di 2)
+#define CAPACITA_SESSIONI (1 << 16)
+
+#define MINUTI_INATTIVITA_SESSIONE 30
+#define ORE_DURATA_SESSIONE 24
+
+/* Crea l'archivio delle sessioni in memoria condivisa.
+ * Deve essere chiamata dal processo principale prima di creare i processi figli.
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int inizializzaSessioni ();
+
+/* Registra una nuova sessione
+ * 
+ * @session_id session id (LUNGHEZZA_SESSION_ID caratteri alfanumerici)
+ * @utente identificativo dell'utente (vedi identificativoUtente(...))
+ * @adesso istante del login
+ * 
+ * @return 1 se la sessione e' stata registrata, 0 se il session id e' gia' in uso, -1 se l'archivio e' pieno
+ */
+int creaSessione (const char* session_id, uint32_t utente, time_t adesso);
+
+/* Valida un session id e, se la sessione e' valida, ne aggiorna l'istante dell'ultima attivita'
+ * 
+ * @session_id session id da validare
+ * @adesso istante attuale
+ * @utente puntatore in cui scrivere l'identificativo dell'utente della sessione
+ * 
+ * @return 1 se la sessione esiste e non e' scaduta, 0 altrimenti
+ */
+int validaSessione (const char* session_id, time_t adesso, uint32_t* utente);
+
+/* Scrive le metriche dell'archivio delle sessioni (una per riga, nel formato "nome valore")
+ * 
+ * @buffer buffer in cui scrivere le metriche
+ * @dimensione dimensione del buffer
+ * 
+ * @return numero di caratteri scritti
+ */
+int scriviMetricheSessioni (char* buffer, size_t dimensione);
+
+#endif	// LOTTO_SESSIONI_H
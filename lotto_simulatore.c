@@ -0,0 +1,447 @@
+#include "lotto.h"
+#include "lotto_casuale.h"
+#include "lotto_registri.h"
+#include <dirent.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Simulatore deterministico delle estrazioni.
+ * Genera, senza attendere il periodo di estrazione, una cartella files/ completa nel formato del server
+ * (utenti, estrazioni, segmenti dei registri delle schedine) a partire da un seme: a parita' di parametri
+ * i file generati sono identici byte per byte. Il tempo e' un orologio virtuale che avanza
+ * di un periodo ad ogni estrazione, percio' si possono generare anni di estrazioni in pochi secondi.
+ * 
+ * Le schedine di ogni intervallo tra due estrazioni vengono assegnate all'estrazione successiva,
+ * e nessuna vincita risulta ancora verificata: al primo !vedi_vincite di ogni utente il server
+ * deve elaborare l'intero arretrato.
+ * 
+ * Il server va poi avviato dalla cartella della simulazione:
+ *    cd <cartella> && ../lotto_server <porta>
+ */
+
+// Valori predefiniti dei parametri
+#define CARTELLA_SIMULAZIONE "simulazione"
+#define SEME_PREDEFINITO 1
+#define ESTRAZIONI_PREDEFINITE 1000
+#define UTENTI_PREDEFINITI 100
+#define GIOCATE_PREDEFINITE 10000
+#define PERIODO_PREDEFINITO 300			// secondi virtuali tra due estrazioni
+#define INIZIO_PREDEFINITO 1577836800	// 01-01-2020 00:00 UTC
+
+// Prefisso dei segmenti dei registri nella cartella files/ (come PREFISSO_FILE_REGISTRI del server)
+#define PREFISSO_SEGMENTI "registro_"
+
+/* Segmento dei registri in scrittura
+ */
+struct segmento_simulazione {
+	FILE* file;
+	uint32_t numero;
+	uint32_t dimensione;
+};
+
+struct parametri_simulazione {
+	const char* cartella;
+	uint64_t seme;
+	uint32_t estrazioni;
+	uint32_t utenti;
+	uint64_t giocate;
+	uint32_t periodo;
+	int64_t inizio;
+};
+
+static char cartella_files[512];
+static uint64_t byte_scritti = 0;
+
+/* Impronta (FNV-1a) dei dati generati: permette di verificare che due simulazioni siano identiche
+ */
+static uint64_t impronta = 14695981039346656037ULL;
+
+static void aggiornaImpronta (const void* dati, size_t lunghezza)
+{
+	size_t i;
+	
+	for (i = 0; i < lunghezza; ++i) {
+		impronta ^= ((const uint8_t*)dati)[i];
+		impronta *= 1099511628211ULL;
+	}
+}
+
+/* Restituisce l'istante attuale in secondi (orologio monotono, usato solo per misurare il throughput)
+ */
+static double adessoSecondi ()
+{
+	struct timespec t;
+	
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static int ordine_crescente_timestamp (const void* a, const void* b)
+{
+	int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+	
+	return (x > y) - (x < y);
+}
+
+/* Apre il segmento successivo a quello in scrittura
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int apriSegmentoSimulazione (struct segmento_simulazione* segmento)
+{
+	static char buffer_segmento[1 << 20];
+	char prefisso[600], indirizzo_file[700];
+	
+	if (segmento->file) {
+		fclose(segmento->file);
+	}
+	segmento->numero++;
+	segmento->dimensione = 0;
+	
+	sprintf(prefisso, "%s/%s", cartella_files, PREFISSO_SEGMENTI);
+	snprintf(indirizzo_file, sizeof(indirizzo_file), FORMATO_PERCORSO_SEGMENTO, prefisso, segmento->numero);
+	segmento->file = fopen(indirizzo_file, "wb");
+	if (!segmento->file) {
+		perror("Impossibile creare segmento dei registri");
+		return -1;
+	}
+	setvbuf(segmento->file, buffer_segmento, _IOFBF, sizeof(buffer_segmento));
+	return 0;
+}
+
+/* Aggiunge una schedina in coda al registro di un utente, scrivendone il record sul segmento in scrittura
+ * 
+ * @utente numero dell'utente
+ * @fine offset della fine del registro dell'utente, aggiornato
+ * @estrazioni estrazioni effettuate prima della registrazione della schedina
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int aggiungiSchedina (struct segmento_simulazione* segmento, uint32_t utente, uint32_t* fine,
+		uint32_t estrazioni, int64_t timestamp, const char* schedina)
+{
+	struct header_record header;
+	char record[2200], nome_utente[32];
+	uint32_t dimensione;
+	int lunghezza;
+	
+	lunghezza = sprintf(record, "%ld %s|", (long int)timestamp, schedina);
+	sprintf(nome_utente, "utente%u", utente);
+	
+	dimensione = preparaHeaderRecord(&header, RECORD_SCHEDINA, nome_utente, *fine, estrazioni, record, lunghezza);
+	if (segmento->dimensione > 0 && (uint64_t)segmento->dimensione + dimensione > DIMENSIONE_SEGMENTO) {
+		if (apriSegmentoSimulazione(segmento) < 0) {
+			return -1;
+		}
+	}
+	
+	if (fwrite(&header, sizeof(header), 1, segmento->file) != 1
+			|| fwrite(nome_utente, 1, header.lunghezza_utente, segmento->file) != header.lunghezza_utente
+			|| fwrite(record, 1, lunghezza, segmento->file) != (size_t)lunghezza) {
+		perror("Impossibile scrivere segmento dei registri");
+		return -1;
+	}
+	
+	segmento->dimensione += dimensione;
+	*fine += lunghezza;
+	byte_scritti += dimensione;
+	aggiornaImpronta(record, lunghezza);
+	return 0;
+}
+
+/* Genera una schedina casuale e ne restituisce la serializzazione (allocata dinamicamente)
+ */
+static char* generaSchedina (struct generatore_casuale* generatore)
+{
+	int ruote[QUANTE_RUOTE], numeri[QUANTITA_MASSIMA_NUMERI_SISTEMA];
+	uint32_t estratti[NUMERI_ESTRAIBILI];
+	double importi[QUANTI_TIPI_PREMIO];
+	struct schedina sched;
+	uint16_t lunghezza;
+	uint32_t estrazioni;
+	int i;
+	
+	// Ruote: una giocata su dieci e' su tutte le ruote, le altre su 1-3 ruote distinte
+	sched.quanteRuote = (casualeLimitato(generatore, 10) == 0) ? QUANTE_RUOTE : 1 + (int)casualeLimitato(generatore, 3);
+	estraiNumeri(generatore, estratti, sched.quanteRuote, QUANTE_RUOTE);
+	for (i = 0; i < sched.quanteRuote; ++i) {
+		ruote[i] = (int)estratti[i] - 1;
+	}
+	sched.ruote = ruote;
+	
+	// Numeri: da 1 a QUANTITA_MASSIMA_NUMERI_SCHEDINA numeri distinti,
+	// oppure (una giocata su venti) un sistema da 6 a QUANTITA_MASSIMA_NUMERI_SISTEMA numeri
+	sched.sistema = (casualeLimitato(generatore, 20) == 0);
+	sched.quantiNumeri = sched.sistema ? 6 + (int)casualeLimitato(generatore, QUANTITA_MASSIMA_NUMERI_SISTEMA - 5)
+			: 1 + (int)casualeLimitato(generatore, QUANTITA_MASSIMA_NUMERI_SCHEDINA);
+	estraiNumeri(generatore, estratti, sched.quantiNumeri, NUMERI_ESTRAIBILI);
+	for (i = 0; i < sched.quantiNumeri; ++i) {
+		numeri[i] = (int)estratti[i];
+	}
+	sched.numeriGiocati = numeri;
+	
+	// Importi: una puntata per ogni tipo giocabile con i numeri scelti, nulla con probabilita' 1/4
+	// (nei sistemi l'importo e' per combinazione, percio' e' dieci volte piu' basso)
+	sched.quantiImporti = (sched.quantiNumeri < QUANTI_TIPI_PREMIO) ? sched.quantiNumeri : QUANTI_TIPI_PREMIO;
+	for (i = 0; i < sched.quantiImporti; ++i) {
+		importi[i] = (casualeLimitato(generatore, 4) == 0) ? 0 : 0.5 * (1 + casualeLimitato(generatore, 20));
+		if (sched.sistema) {
+			importi[i] /= 10;
+		}
+	}
+	sched.importi = importi;
+	
+	// Estrazioni: una giocata su dieci vale per 2-10 estrazioni, una su duecento e' un abbonamento (mai annullato)
+	sched.annullamento = 0;
+	estrazioni = casualeLimitato(generatore, 200);
+	if (estrazioni == 0) {
+		sched.quanteEstrazioni = ABBONAMENTO;
+	}
+	else if (estrazioni <= 20) {
+		sched.quanteEstrazioni = 2 + (int)casualeLimitato(generatore, 9);
+	}
+	else {
+		sched.quanteEstrazioni = 1;
+	}
+	
+	return serializza_schedina_txt(sched, &lunghezza);
+}
+
+/* Crea la cartella files/ della simulazione e il file degli utenti (e rimuove i file derivati
+ * da una simulazione precedente, come il filtro di Bloom degli utenti e i segmenti dei registri)
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int preparaCartella (const struct parametri_simulazione* parametri)
+{
+	char indirizzo_file[600];
+	struct dirent* elemento;
+	DIR* dir;
+	FILE* file;
+	uint32_t i;
+	
+	if ((mkdir(parametri->cartella, 0755) < 0 && errno != EEXIST) || (mkdir(cartella_files, 0755) < 0 && errno != EEXIST)) {
+		perror("Impossibile creare la cartella della simulazione");
+		return -1;
+	}
+	
+	sprintf(indirizzo_file, "%s/utenti.bloom", cartella_files);
+	remove(indirizzo_file);
+	sprintf(indirizzo_file, "%s/client_bloccati.bin", cartella_files);
+	file = fopen(indirizzo_file, "wb");
+	if (file) {
+		fclose(file);
+	}
+	
+	sprintf(indirizzo_file, "%s/utenti.txt", cartella_files);
+	file = fopen(indirizzo_file, "w");
+	if (!file) {
+		perror("Impossibile creare file utenti");
+		return -1;
+	}
+	for (i = 0; i < parametri->utenti; ++i) {
+		fprintf(file, "utente%u password%u ", i, i);
+	}
+	fclose(file);
+	
+	// Segmenti, checkpoint e file di archivio dei registri di una simulazione precedente
+	// (i numeri dei segmenti possono non essere consecutivi)
+	dir = opendir(cartella_files);
+	if (!dir) {
+		perror("Impossibile aprire la cartella della simulazione");
+		return -1;
+	}
+	while ((elemento = readdir(dir)) != NULL) {
+		size_t lunghezza = strlen(elemento->d_name);
+		
+		if (strncmp(elemento->d_name, PREFISSO_SEGMENTI, strlen(PREFISSO_SEGMENTI)) == 0
+				&& lunghezza > 4 && (strcmp(elemento->d_name + lunghezza - 4, ".seg") == 0
+				|| strcmp(elemento->d_name + lunghezza - 4, ".ckp") == 0
+				|| strcmp(elemento->d_name + lunghezza - 4, ".arc") == 0)) {
+			snprintf(indirizzo_file, sizeof(indirizzo_file), "%s/%s", cartella_files, elemento->d_name);
+			remove(indirizzo_file);
+		}
+	}
+	closedir(dir);
+	
+	// Registri per utente del vecchio formato, che il server importerebbe in assenza di segmenti
+	// (sia quelli nella disposizione precedente che quelli nelle sottocartelle)
+	for (i = 0; i < parametri->utenti; ++i) {
+		const char* suffissi[] = {SUFFISSO_SCHEDINE_UTENTE, SUFFISSO_VINCITE_UTENTE, SUFFISSO_RIEPILOGO_UTENTE};
+		char utente[32];
+		int j;
+		
+		sprintf(utente, "utente%u", i);
+		for (j = 0; j < 3; ++j) {
+			snprintf(indirizzo_file, sizeof(indirizzo_file), "%s/%s%s", cartella_files, utente, suffissi[j]);
+			remove(indirizzo_file);
+			if (percorsoFileUtente(indirizzo_file, sizeof(indirizzo_file), cartella_files, utente, suffissi[j]) > 0) {
+				remove(indirizzo_file);
+			}
+		}
+	}
+	
+	return 0;
+}
+
+/* Esegue la simulazione
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int simula (const struct parametri_simulazione* parametri)
+{
+	struct generatore_casuale generatore;
+	struct segmento_simulazione segmento = {NULL, 0, 0};
+	uint32_t* fine_registri;	// offset della fine del registro delle schedine di ogni utente
+	int64_t* timestamp_giocate = NULL;
+	char indirizzo_file[600];
+	FILE* file_estrazioni;
+	static char buffer_estrazioni[1 << 20];
+	uint32_t k, i;
+	uint64_t giocate_generate = 0;
+	double inizio_reale, durata;
+	
+	inizializzaGeneratore(&generatore, parametri->seme);
+	snprintf(cartella_files, sizeof(cartella_files), "%s/files", parametri->cartella);
+	
+	fine_registri = malloc(parametri->utenti * sizeof(uint32_t) + 1);
+	if (!fine_registri) {
+		fprintf(stderr, "Impossibile allocare i registri degli utenti\n");
+		return -1;
+	}
+	for (i = 0; i < parametri->utenti; ++i) {
+		fine_registri[i] = INIZIO_REGISTRO_SCHEDINE;
+	}
+	
+	inizio_reale = adessoSecondi();
+	
+	if (preparaCartella(parametri) < 0 || apriSegmentoSimulazione(&segmento) < 0) {
+		return -1;
+	}
+	
+	sprintf(indirizzo_file, "%s/estrazioni.bin", cartella_files);
+	file_estrazioni = fopen(indirizzo_file, "wb");
+	if (!file_estrazioni) {
+		perror("Impossibile creare file estrazioni");
+		return -1;
+	}
+	setvbuf(file_estrazioni, buffer_estrazioni, _IOFBF, sizeof(buffer_estrazioni));
+	
+	for (k = 0; k < parametri->estrazioni; ++k) {
+		// L'estrazione k avviene alla fine dell'intervallo (inizio + k*periodo, inizio + (k+1)*periodo]
+		int64_t inizio_intervallo = parametri->inizio + (int64_t)k * parametri->periodo;
+		time_t timestamp_estrazione = (time_t)(inizio_intervallo + parametri->periodo);
+		uint64_t quante_giocate = parametri->giocate / parametri->estrazioni + (k < parametri->giocate % parametri->estrazioni);
+		uint8_t ruota;
+		
+		// Giocate dell'intervallo, in ordine cronologico, assegnate ad utenti casuali
+		if (quante_giocate > 0 && parametri->utenti > 0) {
+			int64_t* temp = realloc(timestamp_giocate, quante_giocate * sizeof(int64_t));
+			if (!temp) {
+				fprintf(stderr, "Impossibile allocare le giocate dell'intervallo\n");
+				return -1;
+			}
+			timestamp_giocate = temp;
+			
+			for (i = 0; i < quante_giocate; ++i) {
+				timestamp_giocate[i] = inizio_intervallo + 1 + casualeLimitato(&generatore, parametri->periodo);
+			}
+			qsort(timestamp_giocate, quante_giocate, sizeof(int64_t), ordine_crescente_timestamp);
+			
+			for (i = 0; i < quante_giocate; ++i) {
+				uint32_t utente = casualeLimitato(&generatore, parametri->utenti);
+				char* schedina = generaSchedina(&generatore);
+				
+				// Le schedine dell'intervallo sono registrate dopo k estrazioni: la prossima le rende estratte
+				if (!schedina || aggiungiSchedina(&segmento, utente, &fine_registri[utente], k, timestamp_giocate[i], schedina) < 0) {
+					return -1;
+				}
+				free(schedina);
+			}
+			giocate_generate += quante_giocate;
+		}
+		
+		// Estrazione
+		fwrite(&timestamp_estrazione, sizeof(timestamp_estrazione), 1, file_estrazioni);
+		aggiornaImpronta(&timestamp_estrazione, sizeof(timestamp_estrazione));
+		for (ruota = 0; ruota < QUANTE_RUOTE; ++ruota) {
+			uint32_t estrazione[QUANTI_NUMERI_ESTRATTI];
+			
+			estraiNumeri(&generatore, estrazione, QUANTI_NUMERI_ESTRATTI, NUMERI_ESTRAIBILI);
+			fwrite(&ruota, sizeof(ruota), 1, file_estrazioni);
+			fwrite(estrazione, sizeof(uint32_t), QUANTI_NUMERI_ESTRATTI, file_estrazioni);
+			aggiornaImpronta(estrazione, sizeof(estrazione));
+		}
+		byte_scritti += sizeof(time_t) + QUANTE_RUOTE * (sizeof(uint8_t) + QUANTI_NUMERI_ESTRATTI * sizeof(uint32_t));
+	}
+	
+	fclose(file_estrazioni);
+	
+	// Tutte le schedine sono estratte, nessuna vincita e' ancora stata verificata:
+	// il server ricostruisce lo stato dei registri dai segmenti
+	if (fclose(segmento.file) != 0) {
+		perror("Impossibile scrivere segmento dei registri");
+		return -1;
+	}
+	free(fine_registri);
+	free(timestamp_giocate);
+	
+	durata = adessoSecondi() - inizio_reale;
+	
+	printf("Simulazione completata in %.2f s (cartella %s)\n", durata, cartella_files);
+	printf("%12u estrazioni  %12.0f estrazioni/s\n", parametri->estrazioni, parametri->estrazioni / durata);
+	printf("%12lu giocate     %12.0f giocate/s\n", (unsigned long)giocate_generate, giocate_generate / durata);
+	printf("%12u utenti\n", parametri->utenti);
+	printf("%12.1f MB scritti  %12.1f MB/s\n", byte_scritti / 1e6, byte_scritti / 1e6 / durata);
+	printf("Orologio virtuale: dal %ld al %ld\n", (long int)parametri->inizio,
+			(long int)(parametri->inizio + (int64_t)parametri->estrazioni * parametri->periodo));
+	printf("Impronta dei dati generati: %016lx\n", (unsigned long)impronta);
+	fflush(stdout);
+	
+	return 0;
+}
+
+/* Avvia il simulatore
+ * 
+ *    ./lotto_simulatore [-c cartella] [-s seme] [-e estrazioni] [-u utenti] [-g giocate] [-p periodo (s)] [-t inizio (timestamp)]
+ */
+int main (int argc, char** argv)
+{
+	struct parametri_simulazione parametri = {
+		CARTELLA_SIMULAZIONE, SEME_PREDEFINITO, ESTRAZIONI_PREDEFINITE, UTENTI_PREDEFINITI,
+		GIOCATE_PREDEFINITE, PERIODO_PREDEFINITO, INIZIO_PREDEFINITO
+	};
+	int opzione;
+	
+	while ((opzione = getopt(argc, argv, "c:s:e:u:g:p:t:")) != -1) {
+		switch (opzione) {
+			case 'c': parametri.cartella = optarg; break;
+			case 's': parametri.seme = strtoull(optarg, NULL, 10); break;
+			case 'e': parametri.estrazioni = (uint32_t)strtoul(optarg, NULL, 10); break;
+			case 'u': parametri.utenti = (uint32_t)strtoul(optarg, NULL, 10); break;
+			case 'g': parametri.giocate = strtoull(optarg, NULL, 10); break;
+			case 'p': parametri.periodo = (uint32_t)strtoul(optarg, NULL, 10); break;
+			case 't': parametri.inizio = strtoll(optarg, NULL, 10); break;
+			default:
+				fprintf(stderr, "Uso: %s [-c cartella] [-s seme] [-e estrazioni] [-u utenti] [-g giocate]"
+						" [-p periodo (s)] [-t inizio (timestamp)]\n", argv[0]);
+				exit(EXIT_FAILURE);
+		}
+	}
+	
+	if (parametri.estrazioni == 0 || parametri.periodo == 0) {
+		fprintf(stderr, "Errore: il numero di estrazioni e il periodo devono essere > 0\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	if (simula(&parametri) < 0) {
+		exit(EXIT_FAILURE);
+	}
+	return 0;
+}
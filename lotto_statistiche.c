@@ -0,0 +1,205 @@
+#include "lotto_statistiche.h"
+#include "lotto_condivisa.h"
+#include "lotto_premi.h"
+#include <stdio.h>
+#include <string.h>
+
+#define MAGIC_STATISTICHE 0x54415453	// "STAT"
+
+/* Statistiche di tutte le ruote, salvate sul file delle statistiche dopo l'header
+ */
+struct dati_statistiche {
+	uint32_t estrazioni;
+	uint32_t frequenze[QUANTE_RUOTE][NUMERI_ESTRAIBILI];
+	uint32_t ultima_uscita[QUANTE_RUOTE][NUMERI_ESTRAIBILI];	// numero dell'estrazione (da 1) dell'ultima uscita, 0 se mai uscito
+	uint32_t frequenze_ambi[QUANTE_RUOTE][QUANTI_AMBI];
+	uint32_t quanti_ambi[QUANTE_RUOTE];
+	struct ambo_frequente ambi[QUANTE_RUOTE][QUANTI_AMBI_FREQUENTI];	// in ordine di frequenza decrescente
+};
+
+/* Header del file delle statistiche
+ */
+struct header_statistiche {
+	uint32_t magic;
+	uint32_t dimensione;		// sizeof(struct dati_statistiche): cambia se cambiano i parametri delle statistiche
+};
+
+/* Struttura allocata in memoria condivisa
+ */
+struct archivio_statistiche {
+	uint32_t sequenza;			// contatore del seqlock: dispari durante un aggiornamento
+	struct dati_statistiche dati;
+};
+
+static struct archivio_statistiche* archivio = NULL;
+static char percorso_file_statistiche[512];
+
+/* Aggiorna la classifica degli ambi piu' frequenti di una ruota dopo che la frequenza di un ambo e' aumentata di 1.
+ * Le frequenze crescono di un'unita' alla volta, percio' un ambo entra in classifica appena supera l'ultimo
+ */
+static void aggiornaAmbiFrequenti (int ruota, uint8_t primo, uint8_t secondo, uint32_t frequenza)
+{
+	struct ambo_frequente* ambi = archivio->dati.ambi[ruota];
+	uint32_t* quanti = &archivio->dati.quanti_ambi[ruota];
+	uint32_t i;
+	
+	for (i = 0; i < *quanti; ++i) {
+		if (ambi[i].primo == primo && ambi[i].secondo == secondo) {
+			break;
+		}
+	}
+	
+	if (i == *quanti) {		// l'ambo non e' in classifica
+		if (*quanti < QUANTI_AMBI_FREQUENTI) {
+			(*quanti)++;
+		}
+		else if (frequenza <= ambi[i - 1].frequenza) {
+			return;
+		}
+		else {
+			i--;			// prende il posto dell'ultimo
+		}
+		ambi[i].primo = primo;
+		ambi[i].secondo = secondo;
+	}
+	ambi[i].frequenza = frequenza;
+	
+	// Riporta l'ambo nella sua posizione
+	while (i > 0 && ambi[i - 1].frequenza < ambi[i].frequenza) {
+		struct ambo_frequente temp = ambi[i - 1];
+		
+		ambi[i - 1] = ambi[i];
+		ambi[i] = temp;
+		i--;
+	}
+}
+
+/* Crea le statistiche in memoria condivisa e le carica dal file delle statistiche
+ * 
+ * @file_statistiche percorso del file delle statistiche
+ * @quante_estrazioni numero delle estrazioni nel file delle estrazioni
+ * 
+ * @return 1 se le statistiche sono state caricate, 0 se vanno ricostruite, -1 in caso di errore
+ */
+int inizializzaStatistiche (const char* file_statistiche, uint32_t quante_estrazioni)
+{
+	struct header_statistiche header;
+	FILE* file;
+	int caricate = 0;
+	
+	archivio = (struct archivio_statistiche*)allocaMemoriaCondivisa(sizeof(struct archivio_statistiche));
+	if (!archivio) {
+		return -1;
+	}
+	snprintf(percorso_file_statistiche, sizeof(percorso_file_statistiche), "%s", file_statistiche);
+	
+	// Il file e' valido se ha gli stessi parametri delle statistiche e contiene tutte le estrazioni
+	file = fopen(file_statistiche, "rb");
+	if (file) {
+		caricate = fread(&header, sizeof(header), 1, file) == 1
+				&& header.magic == MAGIC_STATISTICHE && header.dimensione == sizeof(struct dati_statistiche)
+				&& fread(&archivio->dati, sizeof(archivio->dati), 1, file) == 1
+				&& archivio->dati.estrazioni == quante_estrazioni;
+		fclose(file);
+	}
+	
+	if (!caricate) {
+		memset(&archivio->dati, 0, sizeof(archivio->dati));
+	}
+	return caricate;
+}
+
+/* Aggiorna le statistiche con una nuova estrazione
+ * 
+ * @estratti numeri estratti su ogni ruota
+ */
+void registraEstrazioneStatistiche (uint32_t estratti[QUANTE_RUOTE][QUANTI_NUMERI_ESTRATTI])
+{
+	struct dati_statistiche* dati = &archivio->dati;
+	int ruota, i, j;
+	
+	// Inizio dell'aggiornamento: da questo momento i lettori ripeteranno la lettura
+	__atomic_store_n(&archivio->sequenza, archivio->sequenza + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	
+	dati->estrazioni++;
+	for (ruota = 0; ruota < QUANTE_RUOTE; ++ruota) {
+		for (i = 0; i < QUANTI_NUMERI_ESTRATTI; ++i) {
+			int a = (int)estratti[ruota][i];
+			
+			dati->frequenze[ruota][a - 1]++;
+			dati->ultima_uscita[ruota][a - 1] = dati->estrazioni;
+			
+			for (j = i + 1; j < QUANTI_NUMERI_ESTRATTI; ++j) {
+				int b = (int)estratti[ruota][j];
+				uint32_t frequenza = ++dati->frequenze_ambi[ruota][indiceAmbo(a, b)];
+				
+				aggiornaAmbiFrequenti(ruota, (uint8_t)((a < b) ? a : b), (uint8_t)((a < b) ? b : a), frequenza);
+			}
+		}
+	}
+	
+	__atomic_store_n(&archivio->sequenza, archivio->sequenza + 1, __ATOMIC_RELEASE);
+}
+
+/* Salva le statistiche sul file delle statistiche
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int salvaStatistiche ()
+{
+	struct header_statistiche header = {MAGIC_STATISTICHE, sizeof(struct dati_statistiche)};
+	char percorso_temporaneo[sizeof(percorso_file_statistiche) + 4];
+	FILE* file;
+	int ret;
+	
+	// Un'interruzione durante il salvataggio non deve lasciare un file parziale
+	snprintf(percorso_temporaneo, sizeof(percorso_temporaneo), "%s.tmp", percorso_file_statistiche);
+	file = fopen(percorso_temporaneo, "wb");
+	if (!file) {
+		perror("Impossibile aprire file statistiche");
+		return -1;
+	}
+	
+	ret = (fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(&archivio->dati, sizeof(archivio->dati), 1, file) == 1);
+	if (fclose(file) != 0 || !ret || rename(percorso_temporaneo, percorso_file_statistiche) < 0) {
+		perror("Impossibile salvare file statistiche");
+		return -1;
+	}
+	return 0;
+}
+
+/* Legge le statistiche di una ruota
+ * 
+ * @ruota codice della ruota
+ * @statistiche struttura in cui copiare le statistiche
+ * 
+ * @return 0 in caso di successo, -1 se la ruota non e' valida
+ */
+int leggiStatisticheRuota (int ruota, struct statistiche_ruota* statistiche)
+{
+	uint32_t sequenza;
+	int i;
+	
+	if (ruota < 0 || ruota >= QUANTE_RUOTE) {
+		return -1;
+	}
+	
+	do {
+		sequenza = __atomic_load_n(&archivio->sequenza, __ATOMIC_ACQUIRE);
+		
+		statistiche->estrazioni = archivio->dati.estrazioni;
+		for (i = 0; i < NUMERI_ESTRAIBILI; ++i) {
+			uint32_t ultima_uscita = archivio->dati.ultima_uscita[ruota][i];
+			
+			statistiche->frequenze[i] = archivio->dati.frequenze[ruota][i];
+			statistiche->ritardi[i] = statistiche->estrazioni - ultima_uscita;
+		}
+		statistiche->quanti_ambi = archivio->dati.quanti_ambi[ruota];
+		memcpy(statistiche->ambi, archivio->dati.ambi[ruota], sizeof(statistiche->ambi));
+		
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((sequenza & 1) || sequenza != __atomic_load_n(&archivio->sequenza, __ATOMIC_RELAXED));
+	
+	return 0;
+}
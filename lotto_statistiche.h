@@ -0,0 +1,75 @@
+#ifndef LOTTO_STATISTICHE_H
+#define LOTTO_STATISTICHE_H
+
+#include "costanti.h"
+#include <stdint.h>
+
+//////////////////////////////////////////////////////
+//			STATISTICHE DELLE ESTRAZIONI			//
+//////////////////////////////////////////////////////
+/* Per ogni ruota vengono mantenute la frequenza di ogni numero (quante volte e' stato estratto),
+ * il suo ritardo (quante estrazioni sono passate dall'ultima uscita) e gli ambi usciti piu' spesso.
+ * Le statistiche vengono aggiornate incrementalmente dal processo principale ad ogni estrazione,
+ * percio' la loro consultazione non dipende dalla lunghezza dello storico delle estrazioni.
+ * 
+ * Le statistiche sono in memoria condivisa: i processi figli le leggono senza mutex,
+ * ripetendo la lettura se e' stata interrotta da un aggiornamento (seqlock).
+ * Dopo ogni estrazione vengono salvate sul file delle statistiche, accanto al file delle estrazioni;
+ * se all'avvio il file non e' coerente con il file delle estrazioni, vanno ricostruite dallo storico.
+ */
+
+// Numero degli ambi piu' frequenti mantenuti per ogni ruota
+#define QUANTI_AMBI_FREQUENTI 10
+
+/* Ambo con la sua frequenza
+ */
+struct ambo_frequente {
+	uint8_t primo;
+	uint8_t secondo;
+	uint32_t frequenza;
+};
+
+/* Statistiche di una ruota
+ */
+struct statistiche_ruota {
+	uint32_t estrazioni;								// estrazioni considerate
+	uint32_t frequenze[NUMERI_ESTRAIBILI];				// frequenze[n - 1]: quante volte e' uscito il numero n
+	uint32_t ritardi[NUMERI_ESTRAIBILI];				// ritardi[n - 1]: estrazioni dall'ultima uscita del numero n
+	uint32_t quanti_ambi;
+	struct ambo_frequente ambi[QUANTI_AMBI_FREQUENTI];	// in ordine di frequenza decrescente
+};
+
+/* Crea le statistiche in memoria condivisa e le carica dal file delle statistiche.
+ * Deve essere chiamata dal processo principale prima di creare i processi figli.
+ * 
+ * @file_statistiche percorso del file delle statistiche
+ * @quante_estrazioni numero delle estrazioni nel file delle estrazioni
+ * 
+ * @return 1 se le statistiche sono state caricate, 0 se il file manca o non e' coerente con il numero
+ *	delle estrazioni (le statistiche sono vuote e vanno ricostruite con registraEstrazioneStatistiche(...)),
+ *	-1 in caso di errore
+ */
+int inizializzaStatistiche (const char* file_statistiche, uint32_t quante_estrazioni);
+
+/* Aggiorna le statistiche con una nuova estrazione (DEVE essere chiamata solo dal processo principale)
+ * 
+ * @estratti numeri estratti su ogni ruota
+ */
+void registraEstrazioneStatistiche (uint32_t estratti[QUANTE_RUOTE][QUANTI_NUMERI_ESTRATTI]);
+
+/* Salva le statistiche sul file delle statistiche (scrivendo un file temporaneo e rinominandolo)
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+int salvaStatistiche ();
+
+/* Legge le statistiche di una ruota
+ * 
+ * @ruota codice della ruota
+ * @statistiche struttura in cui copiare le statistiche
+ * 
+ * @return 0 in caso di successo, -1 se la ruota non e' valida
+ */
+int leggiStatisticheRuota (int ruota, struct statistiche_ruota* statistiche);
+
+#endif	// LOTTO_STATISTICHE_H
@@ -0,0 +1,607 @@
+#include "lotto_utenti.h"
+#include "costanti.h"
+#include "lotto_condivisa.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MASCHERA_DIRECTORY_UTENTI (CAPACITA_DIRECTORY_UTENTI - 1)
+
+// Oltre questo numero di utenti le catene di scansione diventano troppo lunghe
+#define MASSIMO_UTENTI_DIRECTORY (CAPACITA_DIRECTORY_UTENTI / 4 * 3)
+
+/* Elemento della tabella hash.
+ * Un elemento con hash pari a 0 e' libero (la funzione hash non restituisce mai 0)
+ */
+struct elemento_directory {
+	uint64_t hash;
+	uint32_t offset;				// offset di "username\0password\0" nell'arena
+	uint32_t lunghezza_username;
+};
+
+#define MAGIC_FILTRO_BLOOM 0x324D4C42	// "BLM2"
+
+/* Header del file del filtro di Bloom, seguito dal vettore dei bit.
+ * L'impronta identifica l'insieme degli username inseriti: un filtro con lo stesso numero di elementi
+ * ma costruito su un altro file degli utenti (o non aggiornato) non viene accettato
+ */
+struct header_filtro_bloom {
+	uint32_t magic;
+	uint32_t quante_hash;
+	uint64_t quanti_bit;
+	uint64_t quanti_elementi;		// numero di username inseriti nel filtro
+	uint64_t impronta;				// somma degli hash degli username inseriti nel filtro
+};
+
+/* Filtro di Bloom sugli username registrati, con i contatori usati per stimarne il tasso di falsi positivi
+ */
+struct filtro_bloom {
+	uint64_t bit[BIT_FILTRO_BLOOM / 64];
+	uint64_t quanti_elementi;
+	uint64_t impronta;				// somma degli hash degli username inseriti
+	uint64_t controlli;				// ricerche effettuate
+	uint64_t negativi;				// ricerche a cui il filtro ha risposto "sicuramente assente"
+	uint64_t falsi_positivi;		// ricerche a cui il filtro ha risposto "forse presente" per uno username assente
+};
+
+/* Struttura allocata in memoria condivisa
+ */
+struct directory_utenti {
+	pthread_mutex_t mutex;			// serializza gli inserimenti
+	uint32_t quanti_utenti;
+	uint64_t occupazione_arena;		// byte occupati nell'arena
+	struct filtro_bloom filtro;
+	struct elemento_directory elementi[CAPACITA_DIRECTORY_UTENTI];
+	char arena[DIMENSIONE_ARENA_UTENTI];
+};
+
+static struct directory_utenti* directory = NULL;
+static char percorso_file_utenti[512];
+static int descrittore_filtro = -1;	// file del filtro di Bloom, -1 se il filtro non viene salvato
+
+/* Calcola l'hash (FNV-1a a 64 bit) di uno username
+ * 
+ * @username stringa di cui calcolare l'hash
+ * @lunghezza puntatore alla variabile in cui scrivere la lunghezza dello username
+ * 
+ * @return hash dello username, sempre diverso da 0
+ */
+static uint64_t hashUsername (const char* username, uint32_t* lunghezza)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	uint32_t i;
+	
+	for (i = 0; username[i] != '\0'; ++i) {
+		hash ^= (uint8_t)username[i];
+		hash *= 1099511628211ULL;
+	}
+	*lunghezza = i;
+	
+	return (hash == 0) ? 1 : hash;
+}
+
+//
+// FILTRO DI BLOOM
+//
+/* Calcola la posizione del bit i-esimo associato ad un hash, con la tecnica del doppio hashing.
+ * I due hash di base sono ricavati rimescolando l'hash dello username, in modo da renderli
+ * indipendenti dalla posizione dello username nella tabella
+ * 
+ * @hash hash dello username
+ * @i indice della funzione hash (da 0 a HASH_FILTRO_BLOOM - 1)
+ * 
+ * @return posizione del bit nel filtro
+ */
+static uint32_t posizioneBitFiltro (uint64_t hash, int i)
+{
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDULL;
+	hash ^= hash >> 33;
+	
+	return (uint32_t)(((hash & 0xFFFFFFFF) + (uint64_t)i * ((hash >> 32) | 1)) % BIT_FILTRO_BLOOM);
+}
+
+/* Controlla se un hash potrebbe appartenere al filtro di Bloom
+ * 
+ * @return 0 se lo username e' sicuramente assente, 1 se potrebbe essere presente
+ */
+static int contenutoNelFiltro (uint64_t hash)
+{
+	int i;
+	
+	for (i = 0; i < HASH_FILTRO_BLOOM; ++i) {
+		uint32_t posizione = posizioneBitFiltro(hash, i);
+		
+		if (!(__atomic_load_n(&directory->filtro.bit[posizione / 64], __ATOMIC_ACQUIRE) & (1ULL << (posizione % 64)))) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Inserisce un hash nel filtro di Bloom e, se il filtro e' associato ad un file, salva le parole modificate
+ * 
+ * @hash hash dello username da inserire
+ */
+static void inserisciNelFiltro (uint64_t hash)
+{
+	int i;
+	
+	for (i = 0; i < HASH_FILTRO_BLOOM; ++i) {
+		uint32_t posizione = posizioneBitFiltro(hash, i);
+		uint64_t* parola = &directory->filtro.bit[posizione / 64];
+		
+		__atomic_fetch_or(parola, 1ULL << (posizione % 64), __ATOMIC_RELEASE);
+		
+		if (descrittore_filtro >= 0) {
+			pwrite(descrittore_filtro, parola, sizeof(*parola),
+					sizeof(struct header_filtro_bloom) + (posizione / 64) * sizeof(*parola));
+		}
+	}
+	
+	// Un'interruzione tra queste scritture rende l'header incoerente, e il filtro viene ricostruito al prossimo avvio
+	directory->filtro.quanti_elementi++;
+	directory->filtro.impronta += hash;
+	if (descrittore_filtro >= 0) {
+		pwrite(descrittore_filtro, &directory->filtro.quanti_elementi, sizeof(uint64_t),
+				offsetof(struct header_filtro_bloom, quanti_elementi));
+		pwrite(descrittore_filtro, &directory->filtro.impronta, sizeof(uint64_t),
+				offsetof(struct header_filtro_bloom, impronta));
+	}
+}
+
+/* Calcola l'impronta degli username della directory (la somma dei loro hash, che non dipende dall'ordine)
+ * 
+ * @return impronta della directory
+ */
+static uint64_t improntaDirectory ()
+{
+	uint64_t impronta = 0;
+	uint32_t i;
+	
+	for (i = 0; i < CAPACITA_DIRECTORY_UTENTI; ++i) {
+		impronta += directory->elementi[i].hash;
+	}
+	return impronta;
+}
+
+/* Ricostruisce il filtro di Bloom a partire dagli hash memorizzati nella tabella
+ */
+static void ricostruisciFiltroBloom ()
+{
+	uint32_t i;
+	int j;
+	
+	memset(directory->filtro.bit, 0, sizeof(directory->filtro.bit));
+	
+	for (i = 0; i < CAPACITA_DIRECTORY_UTENTI; ++i) {
+		if (directory->elementi[i].hash == 0) {
+			continue;
+		}
+		
+		for (j = 0; j < HASH_FILTRO_BLOOM; ++j) {
+			uint32_t posizione = posizioneBitFiltro(directory->elementi[i].hash, j);
+			directory->filtro.bit[posizione / 64] |= 1ULL << (posizione % 64);
+		}
+	}
+	
+	directory->filtro.quanti_elementi = directory->quanti_utenti;
+	directory->filtro.impronta = improntaDirectory();
+}
+
+/* Carica il filtro di Bloom dal file, se e' coerente con la directory appena caricata,
+ * altrimenti lo ricostruisce a partire dagli hash memorizzati nella tabella e lo salva su file
+ * 
+ * @file_filtro percorso del file del filtro
+ * 
+ * @return 1 se il filtro e' stato caricato, 0 se e' stato ricostruito, -1 in caso di errore
+ */
+static int caricaFiltroBloom (const char* file_filtro)
+{
+	struct header_filtro_bloom header;
+	
+	descrittore_filtro = open(file_filtro, O_RDWR | O_CREAT, 0644);
+	if (descrittore_filtro < 0) {
+		perror("Impossibile aprire file filtro di Bloom");
+		return -1;
+	}
+	
+	// Il file e' valido se ha gli stessi parametri del filtro e contiene esattamente gli utenti caricati
+	if (pread(descrittore_filtro, &header, sizeof(header), 0) == sizeof(header) &&
+			header.magic == MAGIC_FILTRO_BLOOM && header.quante_hash == HASH_FILTRO_BLOOM &&
+			header.quanti_bit == BIT_FILTRO_BLOOM && header.quanti_elementi == directory->quanti_utenti &&
+			header.impronta == improntaDirectory() &&
+			pread(descrittore_filtro, directory->filtro.bit, sizeof(directory->filtro.bit), sizeof(header))
+				== sizeof(directory->filtro.bit)) {
+		directory->filtro.quanti_elementi = header.quanti_elementi;
+		directory->filtro.impronta = header.impronta;
+		return 1;
+	}
+	
+	ricostruisciFiltroBloom();
+	
+	header.magic = MAGIC_FILTRO_BLOOM;
+	header.quante_hash = HASH_FILTRO_BLOOM;
+	header.quanti_bit = BIT_FILTRO_BLOOM;
+	header.quanti_elementi = directory->filtro.quanti_elementi;
+	header.impronta = directory->filtro.impronta;
+	
+	if (ftruncate(descrittore_filtro, 0) < 0 ||
+			pwrite(descrittore_filtro, &header, sizeof(header), 0) != sizeof(header) ||
+			pwrite(descrittore_filtro, directory->filtro.bit, sizeof(directory->filtro.bit), sizeof(header))
+				!= sizeof(directory->filtro.bit)) {
+		perror("Impossibile salvare il filtro di Bloom");
+		return -1;
+	}
+	return 0;
+}
+
+//
+// TABELLA HASH
+//
+/* Cerca l'elemento della directory associato ad uno username, senza acquisire il mutex
+ * 
+ * @username username da cercare
+ * @hash hash dello username
+ * @lunghezza lunghezza dello username
+ * 
+ * @return puntatore all'elemento se lo username esiste, NULL altrimenti
+ */
+static struct elemento_directory* trovaElemento (const char* username, uint64_t hash, uint32_t lunghezza)
+{
+	uint32_t i;
+	uint64_t hash_elemento;
+	
+	i = (uint32_t)(hash & MASCHERA_DIRECTORY_UTENTI);
+	
+	// Il caricamento con semantica acquire garantisce che i dati dell'elemento siano gia' visibili
+	while ((hash_elemento = __atomic_load_n(&directory->elementi[i].hash, __ATOMIC_ACQUIRE)) != 0) {
+		struct elemento_directory* elemento = &directory->elementi[i];
+		
+		if (hash_elemento == hash && elemento->lunghezza_username == lunghezza &&
+				memcmp(directory->arena + elemento->offset, username, lunghezza) == 0) {
+			return elemento;
+		}
+		
+		i = (i + 1) & MASCHERA_DIRECTORY_UTENTI;
+	}
+	
+	return NULL;
+}
+
+/* Inserisce un utente nella directory (senza scriverlo su file).
+ * Il chiamante deve possedere il mutex della directory oppure essere l'unico processo in esecuzione.
+ * 
+ * @username username dell'utente, che NON deve essere gia' presente
+ * @password password dell'utente
+ * @hash hash dello username
+ * @lunghezza_username lunghezza dello username
+ * 
+ * @return 1 in caso di successo, -1 se la directory e' piena
+ */
+static int inserisciNellaDirectory (const char* username, const char* password, uint64_t hash, uint32_t lunghezza_username)
+{
+	uint32_t lunghezza_password, i;
+	char* destinazione;
+	
+	lunghezza_password = strlen(password);
+	
+	if (directory->quanti_utenti >= MASSIMO_UTENTI_DIRECTORY ||
+			directory->occupazione_arena + lunghezza_username + lunghezza_password + 2 > DIMENSIONE_ARENA_UTENTI) {
+		fprintf(stderr, "Directory degli utenti piena\n");
+		fflush(stderr);
+		return -1;
+	}
+	
+	// Copia username e password nell'arena
+	destinazione = directory->arena + directory->occupazione_arena;
+	memcpy(destinazione, username, lunghezza_username + 1);
+	memcpy(destinazione + lunghezza_username + 1, password, lunghezza_password + 1);
+	
+	// Cerca il primo elemento libero
+	i = (uint32_t)(hash & MASCHERA_DIRECTORY_UTENTI);
+	while (directory->elementi[i].hash != 0) {
+		i = (i + 1) & MASCHERA_DIRECTORY_UTENTI;
+	}
+	
+	directory->elementi[i].offset = (uint32_t)directory->occupazione_arena;
+	directory->elementi[i].lunghezza_username = lunghezza_username;
+	
+	// L'elemento diventa visibile ai lettori solo ora, dopo che tutti i suoi dati sono stati scritti
+	__atomic_store_n(&directory->elementi[i].hash, hash, __ATOMIC_RELEASE);
+	
+	directory->occupazione_arena += lunghezza_username + lunghezza_password + 2;
+	directory->quanti_utenti++;
+	
+	return 1;
+}
+
+/* Crea la directory degli utenti in memoria condivisa e la popola con il contenuto del file degli utenti.
+ * 
+ * @file_utenti percorso del file degli utenti (formato: "username password " per ogni utente)
+ * 
+ * @return numero degli utenti caricati, -1 in caso di errore
+ */
+int inizializzaDirectoryUtenti (const char* file_utenti, const char* file_filtro)
+{
+	FILE* fileUtenti;
+	char username[512], password[512];
+	int ret;
+	uint32_t lunghezza;
+	uint64_t hash;
+	
+	directory = allocaMemoriaCondivisa(sizeof(struct directory_utenti));
+	if (!directory) {
+		return -1;
+	}
+	
+	ret = inizializzaMutexCondiviso(&directory->mutex);
+	if (ret < 0) {
+		chiudiDirectoryUtenti();
+		return -1;
+	}
+	
+	strncpy(percorso_file_utenti, file_utenti, sizeof(percorso_file_utenti) - 1);
+	
+	// Caricamento del file degli utenti
+	fileUtenti = fopen(file_utenti, "r");
+	if (!fileUtenti) {
+		perror("Impossibile aprire file utenti");
+		chiudiDirectoryUtenti();
+		return -1;
+	}
+	
+	while (fscanf(fileUtenti, "%511s %511s ", username, password) == 2) {
+		hash = hashUsername(username, &lunghezza);
+		
+		if (trovaElemento(username, hash, lunghezza) != NULL) {	// record duplicato: vale la prima registrazione
+			continue;
+		}
+		
+		ret = inserisciNellaDirectory(username, password, hash, lunghezza);
+		if (ret < 0) {
+			fclose(fileUtenti);
+			chiudiDirectoryUtenti();
+			return -1;
+		}
+	}
+	fclose(fileUtenti);
+	
+	// Caricamento (o ricostruzione) del filtro di Bloom
+	if (file_filtro) {
+		ret = caricaFiltroBloom(file_filtro);
+	}
+	else {
+		ricostruisciFiltroBloom();
+		ret = 0;
+	}
+	if (ret < 0) {
+		chiudiDirectoryUtenti();
+		return -1;
+	}
+	
+	return (int)directory->quanti_utenti;
+}
+
+/* Libera la memoria condivisa occupata dalla directory degli utenti
+ */
+void chiudiDirectoryUtenti ()
+{
+	if (descrittore_filtro >= 0) {
+		close(descrittore_filtro);
+		descrittore_filtro = -1;
+	}
+	liberaMemoriaCondivisa(directory, sizeof(struct directory_utenti));
+	directory = NULL;
+}
+
+/* Cerca uno username nella directory, consultando prima il filtro di Bloom.
+ * Aggiorna i contatori usati per misurare il tasso di falsi positivi del filtro
+ * 
+ * @username username da cercare
+ * 
+ * @return puntatore all'elemento se lo username esiste, NULL altrimenti
+ */
+static struct elemento_directory* cercaElemento (const char* username)
+{
+	struct elemento_directory* elemento;
+	uint32_t lunghezza;
+	uint64_t hash;
+	
+	hash = hashUsername(username, &lunghezza);
+	__atomic_fetch_add(&directory->filtro.controlli, 1, __ATOMIC_RELAXED);
+	
+	// Lo username e' sicuramente libero: non serve consultare la tabella
+	if (!contenutoNelFiltro(hash)) {
+		__atomic_fetch_add(&directory->filtro.negativi, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+	
+	elemento = trovaElemento(username, hash, lunghezza);
+	if (!elemento) {
+		__atomic_fetch_add(&directory->filtro.falsi_positivi, 1, __ATOMIC_RELAXED);
+	}
+	return elemento;
+}
+
+/* Cerca uno username nella directory degli utenti
+ * 
+ * @username stringa che contiene lo username da cercare
+ * @password stringa in cui scrivere la password dell'utente, se esiste (se e' NULL non viene copiata)
+ * 
+ * @return 1 se lo username esiste, 0 se lo username non esiste
+ */
+int cercaUtente (const char* username, char* password)
+{
+	struct elemento_directory* elemento;
+	
+	elemento = cercaElemento(username);
+	if (!elemento) {
+		return 0;
+	}
+	
+	if (password) {
+		strcpy(password, directory->arena + elemento->offset + elemento->lunghezza_username + 1);
+	}
+	return 1;
+}
+
+/* Restituisce l'identificativo di un utente, ovvero l'offset del suo username nell'arena
+ * (l'arena non viene mai compattata, percio' l'offset resta valido)
+ * 
+ * @username username dell'utente
+ * 
+ * @return identificativo dell'utente, -1 se lo username non esiste
+ */
+int64_t identificativoUtente (const char* username)
+{
+	struct elemento_directory* elemento;
+	
+	elemento = cercaElemento(username);
+	if (!elemento) {
+		return -1;
+	}
+	return elemento->offset;
+}
+
+/* Restituisce la posizione di un utente nella tabella della directory
+ * 
+ * @username username dell'utente
+ * 
+ * @return posizione dell'utente, -1 se lo username non esiste
+ */
+int64_t posizioneUtente (const char* username)
+{
+	struct elemento_directory* elemento;
+	uint32_t lunghezza;
+	uint64_t hash;
+	
+	hash = hashUsername(username, &lunghezza);
+	elemento = trovaElemento(username, hash, lunghezza);
+	if (!elemento) {
+		return -1;
+	}
+	return elemento - directory->elementi;
+}
+
+/* Restituisce lo username dell'utente che occupa una posizione della tabella della directory
+ * 
+ * @return stringa che contiene lo username, NULL se la posizione non e' occupata
+ */
+const char* usernameInPosizione (int64_t posizione)
+{
+	if (posizione < 0 || posizione >= CAPACITA_DIRECTORY_UTENTI
+			|| __atomic_load_n(&directory->elementi[posizione].hash, __ATOMIC_ACQUIRE) == 0) {
+		return NULL;
+	}
+	return directory->arena + directory->elementi[posizione].offset;
+}
+
+/* Restituisce lo username di un utente a partire dal suo identificativo
+ * 
+ * @identificativo identificativo restituito da identificativoUtente(...)
+ * 
+ * @return stringa che contiene lo username
+ */
+const char* usernameUtente (uint32_t identificativo)
+{
+	return directory->arena + identificativo;
+}
+
+/* Registra un nuovo utente: lo scrive in coda al file degli utenti e lo inserisce nella directory.
+ * 
+ * @username username del nuovo utente
+ * @password password del nuovo utente
+ * 
+ * @return 1 se l'utente e' stato registrato, 0 se lo username e' occupato, -1 in caso di errore
+ */
+int registraUtente (const char* username, const char* password)
+{
+	FILE* fileUtenti;
+	int ret;
+	uint32_t lunghezza;
+	uint64_t hash;
+	
+	// Lo username dell'amministratore non si puo' registrare, anche se l'account non esiste
+	if (strcmp(username, UTENTE_AMMINISTRATORE) == 0) {
+		return 0;
+	}
+	
+	bloccaMutexCondiviso(&directory->mutex);
+	
+	// Controlla se esiste gia' lo username
+	if (cercaElemento(username) != NULL) {
+		sbloccaMutexCondiviso(&directory->mutex);
+		return 0;
+	}
+	
+	// Scrittura nel log persistente
+	fileUtenti = fopen(percorso_file_utenti, "a");
+	if (!fileUtenti) {
+		perror("Impossibile aprire file utenti");
+		sbloccaMutexCondiviso(&directory->mutex);
+		return -1;
+	}
+	fprintf(fileUtenti, "%s %s ", username, password);
+	fclose(fileUtenti);
+	
+	// Il filtro viene aggiornato prima della tabella: un utente visibile nella tabella
+	// non deve mai risultare assente dal filtro
+	hash = hashUsername(username, &lunghezza);
+	inserisciNelFiltro(hash);
+	ret = inserisciNellaDirectory(username, password, hash, lunghezza);
+	
+	sbloccaMutexCondiviso(&directory->mutex);
+	return ret;
+}
+
+/* Restituisce il numero degli utenti registrati
+ */
+uint32_t quantiUtentiRegistrati ()
+{
+	return __atomic_load_n(&directory->quanti_utenti, __ATOMIC_RELAXED);
+}
+
+/* Scrive le metriche della directory degli utenti (una per riga, nel formato "nome valore")
+ * 
+ * @buffer buffer in cui scrivere le metriche
+ * @dimensione dimensione del buffer
+ * 
+ * @return numero di caratteri scritti
+ */
+int scriviMetricheUtenti (char* buffer, size_t dimensione)
+{
+	uint64_t controlli, negativi, falsi_positivi, bit_impostati = 0;
+	double tasso_falsi_positivi, riempimento;
+	int i, ret;
+	
+	controlli = __atomic_load_n(&directory->filtro.controlli, __ATOMIC_RELAXED);
+	negativi = __atomic_load_n(&directory->filtro.negativi, __ATOMIC_RELAXED);
+	falsi_positivi = __atomic_load_n(&directory->filtro.falsi_positivi, __ATOMIC_RELAXED);
+	
+	// Tasso di falsi positivi misurato: tra le ricerche di username assenti,
+	// la frazione a cui il filtro ha risposto "forse presente"
+	tasso_falsi_positivi = (negativi + falsi_positivi > 0) ?
+			(double)falsi_positivi / (double)(negativi + falsi_positivi) : 0;
+	
+	for (i = 0; i < BIT_FILTRO_BLOOM / 64; ++i) {
+		bit_impostati += __builtin_popcountll(__atomic_load_n(&directory->filtro.bit[i], __ATOMIC_RELAXED));
+	}
+	riempimento = (double)bit_impostati / BIT_FILTRO_BLOOM;
+	
+	ret = snprintf(buffer, dimensione,
+			"utenti_registrati %u\n"
+			"filtro_bloom_controlli %lu\n"
+			"filtro_bloom_negativi %lu\n"
+			"filtro_bloom_falsi_positivi %lu\n"
+			"filtro_bloom_tasso_falsi_positivi %.6f\n"
+			"filtro_bloom_tasso_falsi_positivi_atteso %.6f\n"
+			"filtro_bloom_riempimento %.6f\n",
+			quantiUtentiRegistrati(), (unsigned long)controlli, (unsigned long)negativi,
+			(unsigned long)falsi_positivi, tasso_falsi_positivi,
+			__builtin_powi(riempimento, HASH_FILTRO_BLOOM), riempimento);
+	
+	return caratteriScritti(ret, dimensione);
+}
@@ -0,0 +1,120 @@
+#ifndef LOTTO_UTENTI_H
+#define LOTTO_UTENTI_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//////////////////////////////////////////////////////
+//				DIRECTORY DEGLI UTENTI				//
+//////////////////////////////////////////////////////
+/* La directory degli utenti e' una tabella hash ad indirizzamento aperto (scansione lineare),
+ * indicizzata per username e allocata in memoria condivisa tra tutti i processi del server.
+ * Viene caricata all'avvio dal file degli utenti, che resta il log persistente delle registrazioni:
+ * ogni nuova registrazione viene scritta in coda al file e poi inserita nella tabella.
+ * 
+ * Le ricerche non acquisiscono alcun mutex (la directory e' letta molto piu' spesso di quanto venga scritta):
+ * un elemento diventa visibile solo dopo che i suoi dati sono stati completamente scritti.
+ * Gli inserimenti sono serializzati da un mutex condiviso.
+ * 
+ * Davanti alla tabella c'e' un filtro di Bloom sugli username registrati: la maggior parte degli username
+ * proposti in fase di signup non esiste, e il filtro risponde "sicuramente libero" senza consultare la tabella.
+ * Il filtro viene salvato su file ad ogni registrazione e ricaricato all'avvio (ricostruito se non e' valido).
+ */
+
+// Numero di elementi della tabella (potenza di 2): il fattore di carico resta sotto 0.5 con 1M di utenti
+#define CAPACITA_DIRECTORY_UTENTI (1 << 21)
+
+// Dimensione dell'area che contiene username e password ("username\0password\0")
+#define DIMENSIONE_ARENA_UTENTI (64 << 20)
+
+// Parametri del filtro di Bloom: con 1M di utenti il tasso di falsi positivi atteso e' circa 0.05%
+#define BIT_FILTRO_BLOOM (1 << 24)
+#define HASH_FILTRO_BLOOM 7
+
+/* Crea la directory degli utenti in memoria condivisa e la popola con il contenuto del file degli utenti.
+ * Carica il filtro di Bloom dal file del filtro, oppure lo ricostruisce se il file non e' coerente con gli utenti.
+ * Deve essere chiamata dal processo principale prima di creare i processi figli.
+ * 
+ * @file_utenti percorso del file degli utenti (formato: "username password " per ogni utente)
+ * @file_filtro percorso del file del filtro di Bloom. Se e' NULL il filtro non viene salvato su file
+ * 
+ * @return numero degli utenti caricati, -1 in caso di errore
+ */
+int inizializzaDirectoryUtenti (const char* file_utenti, const char* file_filtro);
+
+/* Libera la memoria condivisa occupata dalla directory degli utenti
+ */
+void chiudiDirectoryUtenti ();
+
+/* Cerca uno username nella directory degli utenti
+ * 
+ * @username stringa che contiene lo username da cercare
+ * @password stringa in cui scrivere la password dell'utente, se esiste.
+ *	Se e' NULL, la funzione non copia la password (utile per signup)
+ * 
+ * @return 1 se lo username esiste, 0 se lo username non esiste
+ */
+int cercaUtente (const char* username, char* password);
+
+/* Restituisce l'identificativo di un utente: un intero che resta valido finche' il server e' attivo
+ * e da cui si risale allo username senza ricerche nella directory (vedi usernameUtente(...))
+ * 
+ * @username username dell'utente
+ * 
+ * @return identificativo dell'utente, -1 se lo username non esiste
+ */
+int64_t identificativoUtente (const char* username);
+
+/* Restituisce la posizione di un utente nella tabella della directory: un intero minore di CAPACITA_DIRECTORY_UTENTI
+ * che resta valido finche' il server e' attivo (gli elementi della tabella non vengono mai spostati), utilizzabile
+ * come indice di tabelle parallele alla directory. Non consulta il filtro di Bloom ne' aggiorna le sue metriche
+ * 
+ * @username username dell'utente
+ * 
+ * @return posizione dell'utente, -1 se lo username non esiste
+ */
+int64_t posizioneUtente (const char* username);
+
+/* Restituisce lo username dell'utente che occupa una posizione della tabella della directory
+ * 
+ * @posizione posizione restituita da posizioneUtente(...)
+ * 
+ * @return stringa che contiene lo username (in memoria condivisa, NON va modificata ne' deallocata),
+ *	NULL se la posizione non e' occupata
+ */
+const char* usernameInPosizione (int64_t posizione);
+
+/* Restituisce lo username di un utente a partire dal suo identificativo
+ * 
+ * @identificativo identificativo restituito da identificativoUtente(...)
+ * 
+ * @return stringa che contiene lo username (in memoria condivisa, NON va modificata ne' deallocata)
+ */
+const char* usernameUtente (uint32_t identificativo);
+
+/* Registra un nuovo utente: lo scrive in coda al file degli utenti e lo inserisce nella directory.
+ * Il controllo dell'unicita' dello username e l'inserimento avvengono atomicamente.
+ * Lo username UTENTE_AMMINISTRATORE e' riservato e risulta sempre occupato.
+ * 
+ * @username username del nuovo utente
+ * @password password del nuovo utente
+ * 
+ * @return 1 se l'utente e' stato registrato, 0 se lo username e' occupato, -1 in caso di errore
+ */
+int registraUtente (const char* username, const char* password);
+
+/* Restituisce il numero degli utenti registrati
+ */
+uint32_t quantiUtentiRegistrati ();
+
+/* Scrive le metriche della directory degli utenti (una per riga, nel formato "nome valore"),
+ * tra cui il tasso di falsi positivi del filtro di Bloom misurato sulle ricerche di username non registrati
+ * 
+ * @buffer buffer in cui scrivere le metriche
+ * @dimensione dimensione del buffer
+ * 
+ * @return numero di caratteri scritti
+ */
+int scriviMetricheUtenti (char* buffer, size_t dimensione);
+
+#endif	// LOTTO_UTENTI_H
@@ -1,4 +1,8 @@
 #include "lotto.h"
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 /* Alloca in memoria dinamica e inizializza i vari campi di struttura di tipo vincita
  * 
@@ -61,7 +65,20 @@ char* serializza_schedina_txt (struct schedina sched, uint16_t* len)
 	char* schedina_serializzata = NULL;
 	char buffer[2048];
 	
-	sprintf(buffer, "%i %n", sched.quanteRuote, &char_scritti);
+	if (sched.sistema) {
+		sprintf(buffer, "%c %n", MARCATORE_SISTEMA, &char_scritti);
+		contatore += char_scritti;
+	}
+	if (sched.quanteEstrazioni == ABBONAMENTO) {
+		sprintf(buffer + contatore, "%c%0*ld %n", MARCATORE_ABBONAMENTO, CIFRE_ANNULLAMENTO, (long int)sched.annullamento, &char_scritti);
+		contatore += char_scritti;
+	}
+	else if (sched.quanteEstrazioni > 1) {
+		sprintf(buffer + contatore, "%c%i %n", MARCATORE_ESTRAZIONI, sched.quanteEstrazioni, &char_scritti);
+		contatore += char_scritti;
+	}
+	
+	sprintf(buffer + contatore, "%i %n", sched.quanteRuote, &char_scritti);
 	contatore += char_scritti;
 	
 	for (i = 0; i < sched.quanteRuote; ++i) {
@@ -109,9 +126,15 @@ char* serializza_schedina_txt (struct schedina sched, uint16_t* len)
  */
 struct schedina deserializza_schedina_txt (char* str, int* quanti_byte_letti)
 {
-	int i, contatore = 0, char_letti;
+	int i, contatore, char_letti;
 	struct schedina sched;
 	
+	// Marcatori (assenti nelle schedine ordinarie)
+	contatore = leggiMarcatoriSchedina(str, &sched);
+	if (contatore < 0) {
+		contatore = 0;
+	}
+	
 	sscanf(str + contatore, "%i %n", &sched.quanteRuote, &char_letti);
 	contatore += char_letti;
 	
@@ -147,6 +170,51 @@ struct schedina deserializza_schedina_txt (char* str, int* quanti_byte_letti)
 	return sched;
 }
 
+/* Legge i marcatori che precedono una schedina serializzata
+ * 
+ * @str schedina serializzata
+ * @sched schedina in cui scrivere i campi sistema, quanteEstrazioni e annullamento
+ * 
+ * @return numero di caratteri letti, -1 se un marcatore non e' valido
+ */
+int leggiMarcatoriSchedina (const char* str, struct schedina* sched)
+{
+	int contatore = 0, char_letti;
+	long int annullamento;
+	
+	sched->sistema = 0;
+	sched->quanteEstrazioni = 1;
+	sched->annullamento = 0;
+	
+	// I marcatori sono lettere, la schedina vera e propria inizia con una cifra
+	while (str[contatore] == MARCATORE_SISTEMA || str[contatore] == MARCATORE_ESTRAZIONI || str[contatore] == MARCATORE_ABBONAMENTO) {
+		char_letti = 0;
+		
+		switch (str[contatore]) {
+			case MARCATORE_SISTEMA:
+				sscanf(str + contatore, "%*c %n", &char_letti);
+				sched->sistema = 1;
+				break;
+			
+			case MARCATORE_ESTRAZIONI:
+				if (sscanf(str + contatore + 1, "%i %n", &sched->quanteEstrazioni, &char_letti) != 1) return -1;
+				char_letti++;
+				break;
+			
+			case MARCATORE_ABBONAMENTO:
+				if (sscanf(str + contatore + 1, "%ld %n", &annullamento, &char_letti) != 1) return -1;
+				char_letti++;
+				sched->quanteEstrazioni = ABBONAMENTO;
+				sched->annullamento = (time_t)annullamento;
+				break;
+		}
+		if (char_letti == 0) return -1;
+		contatore += char_letti;
+	}
+	
+	return contatore;
+}
+
 //
 // FUNZIONI DI CONVERSIONE
 //
@@ -198,3 +266,150 @@ void inserisci_lista_schedina (struct schedina_list** lista, struct schedina_lis
 		p2->next = elem;
 	}
 }
+
+/* Calcola l'hash (FNV-1a a 32 bit) di uno username, da cui dipendono le sottocartelle dei suoi file
+ * 
+ * @utente username dell'utente
+ * 
+ * @return hash dello username
+ */
+static uint32_t hashFileUtente (const char* utente)
+{
+	uint32_t hash = 2166136261u;
+	
+	while (*utente) {
+		hash ^= (uint8_t)*utente++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/* Scrive il percorso di un file per utente: <cartella>/ab/cd/%utente%<suffisso> (vedi lotto.h)
+ * 
+ * @percorso buffer in cui scrivere il percorso
+ * @dimensione dimensione del buffer
+ * @cartella cartella dei file (senza '/' finale)
+ * @utente username dell'utente
+ * @suffisso suffisso del file
+ * 
+ * @return lunghezza del percorso, -1 se il buffer non e' sufficiente
+ */
+int percorsoFileUtente (char* percorso, size_t dimensione, const char* cartella, const char* utente, const char* suffisso)
+{
+	uint32_t hash = hashFileUtente(utente);
+	int lunghezza;
+	
+	lunghezza = snprintf(percorso, dimensione, "%s/%02x/%02x/%s%s", cartella,
+			(unsigned int)(hash >> 24), (unsigned int)((hash >> 16) & 0xff), utente, suffisso);
+	if (lunghezza < 0 || (size_t)lunghezza >= dimensione) {
+		return -1;
+	}
+	return lunghezza;
+}
+
+/* Crea, se non esistono, le due sottocartelle che contengono i file di un utente
+ * 
+ * @cartella cartella dei file
+ * @utente username dell'utente
+ * 
+ * @return 0 in caso di successo, -1 in caso di errore
+ */
+static int creaCartelleFileUtente (const char* cartella, const char* utente)
+{
+	uint32_t hash = hashFileUtente(utente);
+	char percorso[512];
+	
+	snprintf(percorso, sizeof(percorso), "%s/%02x", cartella, (unsigned int)(hash >> 24));
+	if (mkdir(percorso, 0755) < 0 && errno != EEXIST) {
+		return -1;
+	}
+	snprintf(percorso, sizeof(percorso), "%s/%02x/%02x", cartella, (unsigned int)(hash >> 24), (unsigned int)((hash >> 16) & 0xff));
+	if (mkdir(percorso, 0755) < 0 && errno != EEXIST) {
+		return -1;
+	}
+	return 0;
+}
+
+/* Riconosce il nome di un file per utente dal suffisso
+ * 
+ * @nome nome del file
+ * 
+ * @return lunghezza dello username contenuto nel nome, 0 se non e' il nome di un file per utente
+ */
+static size_t lunghezzaUtenteFile (const char* nome)
+{
+	const char* suffissi[] = {SUFFISSO_SCHEDINE_UTENTE, SUFFISSO_VINCITE_UTENTE, SUFFISSO_RIEPILOGO_UTENTE};
+	size_t lunghezza_nome = strlen(nome), i;
+	
+	for (i = 0; i < sizeof(suffissi) / sizeof(suffissi[0]); ++i) {
+		size_t lunghezza_suffisso = strlen(suffissi[i]);
+		
+		if (lunghezza_nome > lunghezza_suffisso && strcmp(nome + lunghezza_nome - lunghezza_suffisso, suffissi[i]) == 0) {
+			return lunghezza_nome - lunghezza_suffisso;
+		}
+	}
+	return 0;
+}
+
+/* Sposta nelle rispettive sottocartelle i file per utente che si trovano direttamente nella cartella dei file,
+ * senza mai sostituire un file gia' presente nella sottocartella
+ * 
+ * @cartella cartella dei file (senza '/' finale)
+ * 
+ * @return numero dei file spostati, -1 in caso di errore (errno vale EEXIST se una destinazione e' un altro file)
+ */
+int migraFileUtenti (const char* cartella)
+{
+	struct dirent* elemento;
+	DIR* dir;
+	int spostati = 0;
+	
+	dir = opendir(cartella);
+	if (!dir) {
+		return -1;
+	}
+	
+	// I file spostati finiscono nelle sottocartelle, percio' la scansione non li incontra una seconda volta
+	while ((elemento = readdir(dir)) != NULL) {
+		char utente[256], vecchio_percorso[512], nuovo_percorso[512];
+		size_t lunghezza_utente = lunghezzaUtenteFile(elemento->d_name);
+		
+		if (lunghezza_utente == 0 || lunghezza_utente >= sizeof(utente)) {
+			continue;
+		}
+		snprintf(utente, sizeof(utente), "%.*s", (int)lunghezza_utente, elemento->d_name);
+		
+		if (snprintf(vecchio_percorso, sizeof(vecchio_percorso), "%s/%s", cartella, elemento->d_name) >= (int)sizeof(vecchio_percorso)
+				|| percorsoFileUtente(nuovo_percorso, sizeof(nuovo_percorso), cartella, utente, elemento->d_name + lunghezza_utente) < 0) {
+			continue;
+		}
+		if (creaCartelleFileUtente(cartella, utente) < 0) {
+			closedir(dir);
+			return -1;
+		}
+		
+		// link(...) non sostituisce mai un file esistente (a differenza di rename(...)): se la destinazione
+		// esiste ed e' lo stesso file, una migrazione precedente e' stata interrotta prima di unlink(...)
+		if (link(vecchio_percorso, nuovo_percorso) < 0) {
+			struct stat vecchio, nuovo;
+			
+			if (errno != EEXIST || stat(vecchio_percorso, &vecchio) < 0 || stat(nuovo_percorso, &nuovo) < 0) {
+				closedir(dir);
+				return -1;
+			}
+			if (vecchio.st_dev != nuovo.st_dev || vecchio.st_ino != nuovo.st_ino) {
+				closedir(dir);
+				errno = EEXIST;
+				return -1;
+			}
+		}
+		if (unlink(vecchio_percorso) < 0) {
+			closedir(dir);
+			return -1;
+		}
+		spostati++;
+	}
+	
+	closedir(dir);
+	return spostati;
+}